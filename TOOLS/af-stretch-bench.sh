@@ -0,0 +1,50 @@
+#!/bin/sh
+
+: "${MPV:=mpv}"
+: "${AFBENCH_SECONDS:=60}"
+: "${AFBENCH_SPEEDS:=1.25 1.5 2}"
+: "${AFBENCH_MPVFLAGS:=}"
+
+# Compare the CPU cost of the two --audio-pitch-correction filters,
+# af_scaletempo and af_stretch. Audio is decoded, filtered and thrown away by
+# ao_null as fast as possible. A run at speed 1 without filters is measured
+# first, and subtracted to get the cost of the filter alone. Pick a file with
+# a cheap audio codec (PCM, FLAC), so that decoding doesn't dominate.
+#
+# usage: af-stretch-bench.sh <file>
+
+if [ -z "$1" ]; then
+    echo "usage: $0 <file>" >&2
+    exit 1
+fi
+
+now()
+{
+    date +%s.%N
+}
+
+# Prints the elapsed time in seconds.
+run()
+{
+    file=$1
+    shift
+    start=$(now)
+    $MPV "$file" --no-video --ao=null:untimed --no-config --really-quiet \
+        --length="$AFBENCH_SECONDS" $AFBENCH_MPVFLAGS "$@" || exit $?
+    end=$(now)
+    echo "$start $end" | awk '{ print $2 - $1 }'
+}
+
+base=$(run "$1" --speed=1)
+echo "$AFBENCH_SECONDS s of audio, decoding and output: $base s"
+for speed in $AFBENCH_SPEEDS; do
+    for filter in scaletempo stretch; do
+        t=$(run "$1" --speed="$speed" --audio-pitch-correction=yes \
+                --audio-pitch-correction-filter="$filter")
+        echo "$t $base" | awk -v name="$filter" -v speed="$speed" \
+            -v len="$AFBENCH_SECONDS" \
+            '{ f = $1 - $2; if (f <= 0) f = 0.001;
+               printf "speed %-5s %-11s %8.3f s %8.0fx realtime\n",
+                      speed, name, $1, len / f }'
+    done
+done
@@ -0,0 +1,85 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Microbenchmark of the telecine block metrics: the pullup metrics on a
+// 720x480 luma field, and the divtc block difference and checksum on a full
+// frame, for each implementation the CPU supports.
+//
+// usage: TOOLS/bench/block_metrics [runs]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "talloc.h"
+#include "common/common.h"
+#include "osdep/timer.h"
+#include "video/filter/block_metrics.h"
+
+int main(int argc, char **argv)
+{
+    int runs = argc > 1 ? atoi(argv[1]) : 200;
+    if (runs < 1) {
+        fprintf(stderr, "usage: %s [runs]\n", argv[0]);
+        return 1;
+    }
+
+    void *tmp = talloc_new(NULL);
+    int w = 720, h = 480, n = w / 8;
+    // 2 rows of padding above and below, for the comb metric
+    unsigned char *a = talloc_size(tmp, w * (h + 4));
+    unsigned char *b = talloc_size(tmp, w * (h + 4));
+    for (int i = 0; i < w * (h + 4); i++) {
+        a[i] = rand();
+        b[i] = rand();
+    }
+    int *dest = talloc_array(tmp, int, n);
+    volatile uint64_t sink = 0;
+
+    mp_time_init();
+    printf("%d runs, times per field (pullup) or frame (divtc)\n", runs);
+    for (int level = 0; level < MP_BLOCK_METRICS_COUNT; level++) {
+        const struct mp_block_metrics *m = mp_block_metrics_get(level);
+        if (level && m == mp_block_metrics_get(level - 1))
+            continue; // not supported
+        int64_t t0 = mp_time_us();
+        for (int r = 0; r < runs; r++) {
+            for (int y = 0; y < h / 8; y++) {
+                unsigned char *pa = a + w * (y * 8 + 2);
+                unsigned char *pb = b + w * (y * 8 + 3);
+                m->diff(pa, pb, w * 2, n, dest);
+                m->comb(pa, pb, w * 2, n, dest);
+                m->var(pa, pb, w * 2, n, dest);
+            }
+        }
+        int64_t t1 = mp_time_us();
+        for (int r = 0; r < runs; r++) {
+            for (int y = 0; y + 8 <= h; y += 8)
+                m->sad8x8(a + w * y + 1, b + w * y + 1, w, w, n - 1, dest);
+        }
+        int64_t t2 = mp_time_us();
+        for (int r = 0; r < runs; r++) {
+            for (int y = 0; y < h; y++)
+                sink ^= m->xor64(a + w * y + 1, w / 8 - 1);
+        }
+        int64_t t3 = mp_time_us();
+        printf("%-5s pullup metrics %7.1f us, divtc diff %7.1f us, "
+               "checksum %7.1f us\n", m->name, (t1 - t0) / (double)runs,
+               (t2 - t1) / (double)runs, (t3 - t2) / (double)runs);
+    }
+    talloc_free(tmp);
+    return 0;
+}
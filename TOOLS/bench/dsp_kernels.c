@@ -0,0 +1,189 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Realtime factors at 48 kHz of the audio DSP kernels, with the libavcodec
+// this is linked against.
+//
+// usage: TOOLS/bench/dsp_kernels
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "talloc.h"
+#include "common/common.h"
+#include "osdep/timer.h"
+#include "audio/filter/dsp_kernels.h"
+
+static void fill(float *p, int n)
+{
+    for (int i = 0; i < n; i++)
+        p[i] = rand() / (float)RAND_MAX * 2 - 1;
+}
+
+// The af_scaletempo overlap search (which dominates its CPU usage) with the
+// default settings, per channel layout, for the direct search with each
+// implementation and for the FFT. Also shows whether the automatic choice
+// picks the faster one.
+static void bench_scaletempo(void *tmp)
+{
+    int channels[] = {1, 2, 6, 8};
+    int frames_stride = 48 * 60, frames_overlap = frames_stride * 0.2;
+    int frames_search = 48 * 14;
+    printf("scaletempo overlap search:\n");
+    for (int n = 0; n < MP_ARRAY_SIZE(channels); n++) {
+        int nch = channels[n];
+        int len = (frames_overlap - 1) * nch;
+        int search_len = len + (frames_search - 1) * nch;
+        float *pre_corr = talloc_array(tmp, float, len);
+        float *queue = talloc_array(tmp, float, search_len);
+        fill(pre_corr, len);
+        fill(queue, search_len);
+        struct mp_dsp_xcorr *c = mp_dsp_xcorr_create(tmp, len, search_len);
+
+        int runs = 30;
+        // One search per output stride.
+        double audio_us = runs * frames_stride / 48000.0 * 1e6;
+        volatile float sink = 0;
+        printf("%d ch:", nch);
+        for (int level = 0; level < MP_DSP_COUNT; level++) {
+            const struct mp_dsp_funcs *f = mp_dsp_get(level);
+            if (level && f == mp_dsp_get(level - 1))
+                continue; // not supported
+            int64_t t0 = mp_time_us();
+            for (int r = 0; r < runs; r++) {
+                for (int off = 0; off < frames_search; off++)
+                    sink += f->dot(pre_corr, queue + off * nch, len);
+            }
+            int64_t t1 = mp_time_us();
+            printf(" %s %.0fx,", f->name, audio_us / MPMAX(t1 - t0, 1));
+        }
+        int64_t t0 = mp_time_us();
+        for (int r = 0; r < runs; r++) {
+            memcpy(c->a, pre_corr, len * sizeof(float));
+            memcpy(c->b, queue, search_len * sizeof(float));
+            sink += mp_dsp_xcorr_run(c)[0];
+        }
+        int64_t t1 = mp_time_us();
+        bool fft = (int64_t)frames_search * len >
+                   mp_dsp_xcorr_cost(len, search_len);
+        printf(" FFT %.0fx realtime, auto: %s\n",
+               audio_us / MPMAX(t1 - t0, 1), fft ? "FFT" : "direct");
+        talloc_free_children(tmp);
+    }
+}
+
+// The DSP done by af_equalizer (10 bands), af_surround (two 32 tap FIRs)
+// and af_hrtf (five channel mode with rear matrix: ten 64 tap FIRs delayed
+// by up to 64 samples, two 193 tap bass filters), for each implementation.
+static void bench_filters(void *tmp)
+{
+    enum { LEN = 48000, BLOCK = 1000 };
+    float *in = talloc_array(tmp, float, LEN * 6);
+    float *out = talloc_array(tmp, float, LEN * 6);
+    float taps[193];
+    fill(in, LEN * 6);
+    fill(taps, 193);
+    printf("\nfilters, realtime factors:\n");
+    for (int level = 0; level < MP_DSP_COUNT; level++) {
+        const struct mp_dsp_funcs *f = mp_dsp_get(level);
+        if (level && f == mp_dsp_get(level - 1))
+            continue;
+        void *ctx = talloc_new(tmp);
+        int64_t t[5];
+        t[0] = mp_time_us();
+        for (int nch = 2; nch <= 6; nch += 4) {
+            struct mp_dsp_iir *iir = mp_dsp_iir_create(ctx, f, nch, 10);
+            memcpy(out, in, LEN * nch * sizeof(float));
+            mp_dsp_iir_process(iir, out, LEN);
+            t[nch / 2] = mp_time_us();
+        }
+        struct mp_dsp_fir *firs[12];
+        for (int n = 0; n < 2; n++)
+            firs[n] = mp_dsp_fir_create(ctx, f, taps, 32, 1, 0);
+        for (int pos = 0; pos < LEN; pos += BLOCK) {
+            for (int n = 0; n < 2; n++)
+                mp_dsp_fir_process(firs[n], out, in + n * LEN + pos, BLOCK);
+        }
+        t[4] = mp_time_us();
+        for (int n = 0; n < 12; n++) {
+            firs[n] = n < 10 ? mp_dsp_fir_create(ctx, f, taps, 64, 64, 0)
+                             : mp_dsp_fir_create(ctx, f, taps, 193, 0, 0);
+        }
+        for (int pos = 0; pos < LEN; pos += BLOCK) {
+            for (int n = 0; n < 12; n++)
+                mp_dsp_fir_process(firs[n], out, in + n % 6 * LEN + pos, BLOCK);
+        }
+        int64_t t_end = mp_time_us();
+        printf("%-5s equalizer 2ch %.0fx, 6ch %.0fx, surround %.0fx, "
+               "hrtf %.0fx (partitions %d, %d)\n", f->name,
+               1e6 / MPMAX(t[1] - t[0], 1), 1e6 / MPMAX(t[3] - t[1], 1),
+               1e6 / MPMAX(t[4] - t[3], 1), 1e6 / MPMAX(t_end - t[4], 1),
+               mp_dsp_fir_partition(firs[0]), mp_dsp_fir_partition(firs[11]));
+        talloc_free(ctx);
+    }
+    talloc_free_children(tmp);
+}
+
+// A single FIR filter, computed directly and with each FFT partition size,
+// with the best implementation. The automatic choice is marked with "*".
+static void bench_fir(void *tmp)
+{
+    enum { LEN = 48000, BLOCK = 1000 };
+    int sizes[] = {32, 64, 193, 512, 1000, 4000};
+    const struct mp_dsp_funcs *f = mp_dsp_get(-1);
+    float *in = talloc_array(tmp, float, LEN);
+    float *out = talloc_array(tmp, float, LEN);
+    fill(in, LEN);
+    printf("\nFIR (%s), realtime factor per partition size:\n", f->name);
+    for (int n = 0; n < MP_ARRAY_SIZE(sizes); n++) {
+        int num_taps = sizes[n];
+        float *taps = talloc_array(tmp, float, num_taps);
+        fill(taps, num_taps);
+        struct mp_dsp_fir *fir =
+            mp_dsp_fir_create(tmp, f, taps, num_taps, 0, 0);
+        int chosen = mp_dsp_fir_partition(fir);
+        talloc_free(fir);
+        printf("%4d taps:", num_taps);
+        for (int part = -1; part < num_taps && part <= 8192;
+             part = part < 16 ? 16 : part * 2)
+        {
+            fir = mp_dsp_fir_create(tmp, f, taps, num_taps, 0, part);
+            int64_t t0 = mp_time_us();
+            for (int pos = 0; pos < LEN; pos += BLOCK)
+                mp_dsp_fir_process(fir, out, in + pos, BLOCK);
+            int64_t t1 = mp_time_us();
+            int p = mp_dsp_fir_partition(fir);
+            printf(" %s%d %.0fx", p == chosen ? "*" : "", p,
+                   1e6 / MPMAX(t1 - t0, 1));
+            talloc_free(fir);
+        }
+        printf("\n");
+    }
+    talloc_free_children(tmp);
+}
+
+int main(int argc, char **argv)
+{
+    void *tmp = talloc_new(NULL);
+    mp_time_init();
+    bench_scaletempo(tmp);
+    bench_filters(tmp);
+    bench_fir(tmp);
+    talloc_free(tmp);
+    return 0;
+}
@@ -0,0 +1,173 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Compare memcpy_pic()/memset_pic() with what they did before large planes
+// were special-cased (a memcpy/memset per row), first for whole frames of
+// typical formats, then for single planes of increasing size, with the large
+// (non-temporal, and above 2 * MP_PIC_LARGE threaded) path forced. The second
+// part shows where MP_PIC_LARGE should be. Strides are padded to 64 bytes, as
+// with mp_image_alloc().
+//
+// usage: TOOLS/bench/memcpy_pic [runs]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "talloc.h"
+#include "common/common.h"
+#include "osdep/timer.h"
+#include "video/filter/slice_threads.h"
+#include "video/memcpy_pic.h"
+
+struct bench_format {
+    const char *name;
+    int w, h;
+    int num_planes;
+    int bytes[3];       // bytes per pixel (luma)
+    int sub[3];         // horizontal and vertical chroma subsampling shift
+};
+
+static const struct bench_format bench_formats[] = {
+    {"1080p yuv420p", 1920, 1080, 3, {1, 1, 1}, {0, 1, 1}},
+    {"1080p nv12",    1920, 1080, 2, {1, 2},    {0, 1}},
+    {"1080p p010",    1920, 1080, 2, {2, 4},    {0, 1}},
+    {"1080p rgb32",   1920, 1080, 1, {4},       {0}},
+    {"2160p yuv420p", 3840, 2160, 3, {1, 1, 1}, {0, 1, 1}},
+    {"2160p nv12",    3840, 2160, 2, {1, 2},    {0, 1}},
+    {"2160p p010",    3840, 2160, 2, {2, 4},    {0, 1}},
+    {"2160p rgb32",   3840, 2160, 1, {4},       {0}},
+};
+
+static void ref_memcpy_pic(uint8_t *dst, const uint8_t *src, int bytes, int h,
+                           int stride)
+{
+    for (int y = 0; y < h; y++)
+        memcpy(dst + (ptrdiff_t)y * stride, src + (ptrdiff_t)y * stride, bytes);
+}
+
+static void ref_memset_pic(uint8_t *dst, int bytes, int h, int stride)
+{
+    for (int y = 0; y < h; y++)
+        memset(dst + (ptrdiff_t)y * stride, 16, bytes);
+}
+
+static void bench_formats_run(void *tmp, int runs)
+{
+    printf("frame           copy: per row -> memcpy_pic, "
+           "clear: per row -> memset_pic\n");
+    for (int f = 0; f < MP_ARRAY_SIZE(bench_formats); f++) {
+        const struct bench_format *fmt = &bench_formats[f];
+        uint8_t *src[3], *dst[3];
+        int bytes[3], h[3], stride[3];
+        for (int p = 0; p < fmt->num_planes; p++) {
+            bytes[p] = (fmt->w >> fmt->sub[p]) * fmt->bytes[p];
+            h[p] = fmt->h >> fmt->sub[p];
+            stride[p] = MP_ALIGN_UP(bytes[p], 64);
+            src[p] = talloc_size(tmp, (size_t)stride[p] * h[p]);
+            dst[p] = talloc_size(tmp, (size_t)stride[p] * h[p]);
+            memset(src[p], p, (size_t)stride[p] * h[p]);
+            memset(dst[p], 0, (size_t)stride[p] * h[p]);
+        }
+
+        int64_t t[5];
+        t[0] = mp_time_us();
+        for (int r = 0; r < runs; r++) {
+            for (int p = 0; p < fmt->num_planes; p++)
+                ref_memcpy_pic(dst[p], src[p], bytes[p], h[p], stride[p]);
+        }
+        t[1] = mp_time_us();
+        for (int r = 0; r < runs; r++) {
+            for (int p = 0; p < fmt->num_planes; p++) {
+                memcpy_pic(dst[p], src[p], bytes[p], h[p], stride[p],
+                           stride[p]);
+            }
+        }
+        t[2] = mp_time_us();
+        for (int r = 0; r < runs; r++) {
+            for (int p = 0; p < fmt->num_planes; p++)
+                ref_memset_pic(dst[p], bytes[p], h[p], stride[p]);
+        }
+        t[3] = mp_time_us();
+        for (int r = 0; r < runs; r++) {
+            for (int p = 0; p < fmt->num_planes; p++)
+                memset_pic(dst[p], 16, bytes[p], h[p], stride[p]);
+        }
+        t[4] = mp_time_us();
+        printf("%-14s  copy: %7.1f -> %7.1f us, clear: %7.1f -> %7.1f us\n",
+               fmt->name, (t[1] - t[0]) / (double)runs,
+               (t[2] - t[1]) / (double)runs, (t[3] - t[2]) / (double)runs,
+               (t[4] - t[3]) / (double)runs);
+        talloc_free_children(tmp);
+    }
+}
+
+static void bench_sizes_run(void *tmp, int runs)
+{
+    printf("\nplane (KiB)     copy: per row -> large path, "
+           "clear: per row -> large path\n");
+    int bytes = 3840, stride = MP_ALIGN_UP(bytes + 1, 64);
+    for (int kib = 256; kib <= 64 * 1024; kib *= 2) {
+        int h = (int64_t)kib * 1024 / bytes;
+        uint8_t *src = talloc_size(tmp, (size_t)stride * h);
+        uint8_t *dst = talloc_size(tmp, (size_t)stride * h);
+        memset(src, 1, (size_t)stride * h);
+        memset(dst, 0, (size_t)stride * h);
+        // Keep the total amount of copied data roughly constant.
+        int n = MPMAX(runs * 32 * 1024 / kib, 1);
+
+        int64_t t[5];
+        t[0] = mp_time_us();
+        for (int r = 0; r < n; r++)
+            ref_memcpy_pic(dst, src, bytes, h, stride);
+        t[1] = mp_time_us();
+        for (int r = 0; r < n; r++)
+            memcpy_pic_large(dst, src, bytes, h, stride, stride);
+        t[2] = mp_time_us();
+        for (int r = 0; r < n; r++)
+            ref_memset_pic(dst, bytes, h, stride);
+        t[3] = mp_time_us();
+        for (int r = 0; r < n; r++)
+            memset_pic_large(dst, 16, 1, bytes, h, stride);
+        t[4] = mp_time_us();
+        bool large = (int64_t)bytes * h >= MP_PIC_LARGE;
+        printf("%8d%s        copy: %7.1f -> %7.1f us, "
+               "clear: %7.1f -> %7.1f us\n", kib, large ? "*" : " ",
+               (t[1] - t[0]) / (double)n, (t[2] - t[1]) / (double)n,
+               (t[3] - t[2]) / (double)n, (t[4] - t[3]) / (double)n);
+        talloc_free_children(tmp);
+    }
+    printf("* memcpy_pic()/memset_pic() take the large path\n");
+}
+
+int main(int argc, char **argv)
+{
+    int runs = argc > 1 ? atoi(argv[1]) : 20;
+    if (runs < 1) {
+        fprintf(stderr, "usage: %s [runs]\n", argv[0]);
+        return 1;
+    }
+
+    // Like a player, keep the shared threads alive.
+    struct mp_slice_threads *threads = mp_slice_threads_create(NULL, 0);
+    void *tmp = talloc_new(NULL);
+    mp_time_init();
+    bench_formats_run(tmp, runs);
+    bench_sizes_run(tmp, runs);
+    talloc_free(tmp);
+    talloc_free(threads);
+    return 0;
+}
@@ -0,0 +1,37 @@
+#!/bin/sh
+
+: "${MPV:=mpv}"
+: "${VFBENCH_FRAMES:=500}"
+: "${VFBENCH_FILTERS:=eq=contrast=1.2,gradfun,unsharp,noise=strength=10}"
+: "${VFBENCH_MPVFLAGS:=}"
+
+# Measure video filter throughput with and without --vf-pipeline. Frames are
+# decoded, filtered and thrown away by vo_null as fast as possible, so the
+# result is dominated by the filter chain for CPU heavy filters.
+#
+# usage: vf-pipeline-bench.sh <file>
+
+if [ -z "$1" ]; then
+    echo "usage: $0 <file>" >&2
+    exit 1
+fi
+
+now()
+{
+    date +%s.%N
+}
+
+run()
+{
+    start=$(now)
+    $MPV "$1" --vo=null --no-audio --untimed --no-config --really-quiet \
+        --frames="$VFBENCH_FRAMES" --vf="$VFBENCH_FILTERS" \
+        $VFBENCH_MPVFLAGS "$2" || exit $?
+    end=$(now)
+    echo "$start $end" | awk -v name="$2" -v frames="$VFBENCH_FRAMES" \
+        '{ t = $2 - $1; printf "%-18s %8.3f s %8.2f fps\n", name, t, frames / t }'
+}
+
+echo "filters: $VFBENCH_FILTERS, $VFBENCH_FRAMES frames"
+run "$1" --vf-pipeline=no
+run "$1" --vf-pipeline=yes
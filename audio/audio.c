@@ -26,9 +26,26 @@
 
 #include "talloc.h"
 #include "common/common.h"
+#include "osdep/atomics.h"
 #include "fmt-conversion.h"
 #include "audio.h"
 
+// See mp_audio_get_stats().
+static atomic_ullong stat_allocs = ATOMIC_VAR_INIT(0);
+static atomic_ullong stat_copies = ATOMIC_VAR_INIT(0);
+static atomic_ullong stat_copied_bytes = ATOMIC_VAR_INIT(0);
+
+// Return process-wide counters of audio data allocations and copies. Meant for
+// tests and debugging (to check that the audio path doesn't copy needlessly).
+void mp_audio_get_stats(struct mp_audio_stats *st)
+{
+    *st = (struct mp_audio_stats){
+        .allocs = atomic_load(&stat_allocs),
+        .copies = atomic_load(&stat_copies),
+        .copied_bytes = atomic_load(&stat_copied_bytes),
+    };
+}
+
 static void update_redundant_info(struct mp_audio *mpa)
 {
     assert(mp_chmap_is_empty(&mpa->channels) ||
@@ -159,6 +176,7 @@ void mp_audio_realloc(struct mp_audio *mpa, int samples)
         if (!mpa->allocated[n] || size != mpa->allocated[n]->size) {
             if (av_buffer_realloc(&mpa->allocated[n], size) < 0)
                 abort(); // OOM
+            atomic_fetch_add(&stat_allocs, 1);
             mpa->planes[n] = mpa->allocated[n]->data;
         }
     }
@@ -225,6 +243,9 @@ void mp_audio_copy(struct mp_audio *dst, int dst_offset,
                 (char *)src->planes[n] + src_offset * src->sstride,
                 length * dst->sstride);
     }
+    atomic_fetch_add(&stat_copies, 1);
+    atomic_fetch_add(&stat_copied_bytes,
+                     (unsigned long long)length * dst->sstride * dst->num_planes);
 }
 
 // Copy fields that describe characteristics of the audio frame, but which are
@@ -284,6 +305,35 @@ int mp_audio_make_writeable(struct mp_audio *data)
     return 0;
 }
 
+// Return a new frame referencing the same data (the data becomes shared, so
+// mp_audio_is_writeable() returns false for both frames). Non-refcounted data
+// is copied. Returns NULL on error.
+struct mp_audio *mp_audio_new_ref(struct mp_audio *frame)
+{
+    struct mp_audio *new = talloc_ptrtype(NULL, new);
+    talloc_set_destructor(new, mp_audio_destructor);
+    *new = *frame;
+    if (!frame->allocated[0]) {
+        mp_audio_set_null_data(new);
+        mp_audio_realloc(new, frame->samples);
+        new->samples = frame->samples;
+        mp_audio_copy(new, 0, frame, 0, frame->samples);
+        return new;
+    }
+    for (int n = 0; n < MP_NUM_CHANNELS; n++)
+        new->allocated[n] = NULL;
+    for (int n = 0; n < MP_NUM_CHANNELS; n++) {
+        if (frame->allocated[n]) {
+            new->allocated[n] = av_buffer_ref(frame->allocated[n]);
+            if (!new->allocated[n]) {
+                talloc_free(new);
+                return NULL;
+            }
+        }
+    }
+    return new;
+}
+
 struct mp_audio *mp_audio_from_avframe(struct AVFrame *avframe)
 {
     AVFrame *tmp = NULL;
@@ -386,6 +436,7 @@ struct mp_audio *mp_audio_pool_get(struct mp_audio_pool *pool,
             talloc_free(new);
             return NULL;
         }
+        atomic_fetch_add(&stat_allocs, 1);
         new->planes[n] = new->allocated[n]->data;
     }
     return new;
@@ -18,6 +18,8 @@
 #ifndef MP_AUDIO_H
 #define MP_AUDIO_H
 
+#include <stdint.h>
+
 #include "format.h"
 #include "chmap.h"
 
@@ -71,6 +73,7 @@ void mp_audio_skip_samples(struct mp_audio *data, int samples);
 
 bool mp_audio_is_writeable(struct mp_audio *data);
 int mp_audio_make_writeable(struct mp_audio *data);
+struct mp_audio *mp_audio_new_ref(struct mp_audio *frame);
 
 struct AVFrame;
 struct mp_audio *mp_audio_from_avframe(struct AVFrame *avframe);
@@ -84,4 +87,12 @@ struct mp_audio *mp_audio_pool_new_copy(struct mp_audio_pool *pool,
 int mp_audio_pool_make_writeable(struct mp_audio_pool *pool,
                                  struct mp_audio *frame);
 
+struct mp_audio_stats {
+    uint64_t allocs;        // data buffers allocated (also from pools)
+    uint64_t copies;        // mp_audio_copy() calls
+    uint64_t copied_bytes;
+};
+
+void mp_audio_get_stats(struct mp_audio_stats *st);
+
 #endif
@@ -25,26 +25,28 @@
 #include "audio.h"
 #include "format.h"
 
+// The buffer is a queue of refcounted frames. Appending frames and consuming
+// data is done by passing references, so normally no audio data is copied.
 struct mp_audio_buffer {
-    struct mp_audio *buffer;
+    struct mp_audio format;     // no data
+    struct mp_audio **frames;   // oldest first; all have the same format
+    int num_frames;
+    int samples;                // sum of frames[n]->samples
+    int capacity;               // see mp_audio_buffer_preallocate_min()
 };
 
 struct mp_audio_buffer *mp_audio_buffer_create(void *talloc_ctx)
 {
-    struct mp_audio_buffer *ab = talloc(talloc_ctx, struct mp_audio_buffer);
-    *ab = (struct mp_audio_buffer) {
-        .buffer = talloc_zero(ab, struct mp_audio),
-    };
-    return ab;
+    return talloc_zero(talloc_ctx, struct mp_audio_buffer);
 }
 
 // Reinitialize the buffer, set a new format, drop old data.
 // The audio data in fmt is not used, only the format.
 void mp_audio_buffer_reinit(struct mp_audio_buffer *ab, struct mp_audio *fmt)
 {
-    mp_audio_copy_config(ab->buffer, fmt);
-    mp_audio_realloc(ab->buffer, 1);
-    ab->buffer->samples = 0;
+    mp_audio_buffer_clear(ab);
+    ab->format = (struct mp_audio){0};
+    mp_audio_copy_config(&ab->format, fmt);
 }
 
 void mp_audio_buffer_reinit_fmt(struct mp_audio_buffer *ab, int format,
@@ -61,92 +63,166 @@ void mp_audio_buffer_get_format(struct mp_audio_buffer *ab,
                                 struct mp_audio *out_fmt)
 {
     *out_fmt = (struct mp_audio){0};
-    mp_audio_copy_config(out_fmt, ab->buffer);
+    mp_audio_copy_config(out_fmt, &ab->format);
 }
 
-// Make the total size of the internal buffer at least this number of samples.
+// Set the number of samples mp_audio_buffer_get_write_available() allows to
+// be buffered. (The data is not preallocated; it's held by the frames.)
 void mp_audio_buffer_preallocate_min(struct mp_audio_buffer *ab, int samples)
 {
-    mp_audio_realloc_min(ab->buffer, samples);
+    ab->capacity = MPMAX(ab->capacity, samples);
 }
 
-// Get number of samples that can be written without forcing a resize of the
-// internal buffer.
+// Get number of samples that can be written without going over the size set
+// with mp_audio_buffer_preallocate_min().
 int mp_audio_buffer_get_write_available(struct mp_audio_buffer *ab)
 {
-    return mp_audio_get_allocated_size(ab->buffer) - ab->buffer->samples;
+    return MPMAX(ab->capacity - ab->samples, 0);
 }
 
-// Get a pointer to the end of the buffer (where writing would append). If the
-// internal buffer is too small for the given number of samples, it's resized.
-// After writing to the buffer, mp_audio_buffer_finish_write() has to be used
-// to make the written data part of the readable buffer.
-void mp_audio_buffer_get_write_buffer(struct mp_audio_buffer *ab, int samples,
-                                      struct mp_audio *out_buffer)
+static void insert_frame(struct mp_audio_buffer *ab, int pos,
+                         struct mp_audio *frame)
 {
-    assert(samples >= 0);
-    mp_audio_realloc_min(ab->buffer, ab->buffer->samples + samples);
-    *out_buffer = *ab->buffer;
-    out_buffer->samples = ab->buffer->samples + samples;
-    mp_audio_skip_samples(out_buffer, ab->buffer->samples);
+    assert(mp_audio_config_equals(&ab->format, frame));
+    if (!frame->samples) {
+        talloc_free(frame);
+        return;
+    }
+    talloc_steal(ab, frame);
+    MP_TARRAY_INSERT_AT(ab, ab->frames, ab->num_frames, pos, frame);
+    ab->samples += frame->samples;
 }
 
-void mp_audio_buffer_finish_write(struct mp_audio_buffer *ab, int samples)
+// Append the frame to the end of the buffer. Takes ownership of the frame, so
+// the data is not copied.
+void mp_audio_buffer_append_frame(struct mp_audio_buffer *ab,
+                                  struct mp_audio *frame)
 {
-    assert(samples >= 0 && samples <= mp_audio_buffer_get_write_available(ab));
-    ab->buffer->samples += samples;
+    insert_frame(ab, ab->num_frames, frame);
 }
 
-// Append data to the end of the buffer.
-// If the buffer is not large enough, it is transparently resized.
-// For now always copies the data.
+// Append data to the end of the buffer. The data is referenced if mpa is
+// refcounted, and copied otherwise.
 void mp_audio_buffer_append(struct mp_audio_buffer *ab, struct mp_audio *mpa)
 {
-    int offset = ab->buffer->samples;
-    ab->buffer->samples += mpa->samples;
-    mp_audio_realloc_min(ab->buffer, ab->buffer->samples);
-    mp_audio_copy(ab->buffer, offset, mpa, 0, mpa->samples);
+    if (!mpa->samples)
+        return;
+    struct mp_audio *frame = mp_audio_new_ref(mpa);
+    if (!frame)
+        abort(); // OOM
+    mp_audio_buffer_append_frame(ab, frame);
 }
 
 // Prepend silence to the start of the buffer.
 void mp_audio_buffer_prepend_silence(struct mp_audio_buffer *ab, int samples)
 {
     assert(samples >= 0);
-    int oldlen = ab->buffer->samples;
-    ab->buffer->samples += samples;
-    mp_audio_realloc_min(ab->buffer, ab->buffer->samples);
-    mp_audio_copy(ab->buffer, samples, ab->buffer, 0, oldlen);
-    mp_audio_fill_silence(ab->buffer, 0, samples);
+    struct mp_audio *frame = talloc_zero(NULL, struct mp_audio);
+    mp_audio_copy_config(frame, &ab->format);
+    mp_audio_realloc(frame, samples);
+    frame->samples = samples;
+    mp_audio_fill_silence(frame, 0, samples);
+    insert_frame(ab, 0, frame);
 }
 
-// Get the start of the current readable buffer.
+// Get the first queued frame (without removing it). Use mp_audio_buffer_skip()
+// to consume it. The result is not a new reference; don't free it, and don't
+// use it after the buffer is modified. If the buffer is empty, it's set to the
+// format with 0 samples.
 void mp_audio_buffer_peek(struct mp_audio_buffer *ab, struct mp_audio *out_mpa)
 {
-    *out_mpa = *ab->buffer;
+    if (ab->num_frames) {
+        *out_mpa = *ab->frames[0];
+    } else {
+        *out_mpa = ab->format;
+        mp_audio_set_null_data(out_mpa);
+    }
+}
+
+// Like mp_audio_buffer_peek(), but make sure the returned frame contains at
+// least min(samples, mp_audio_buffer_samples(ab)) samples. If the first frame
+// is shorter, frames are merged, which copies their data.
+void mp_audio_buffer_peek_contiguous(struct mp_audio_buffer *ab, int samples,
+                                     struct mp_audio *out_mpa)
+{
+    samples = MPMIN(samples, ab->samples);
+    if (ab->num_frames > 1 && ab->frames[0]->samples < samples) {
+        struct mp_audio *frame = talloc_zero(NULL, struct mp_audio);
+        mp_audio_copy_config(frame, &ab->format);
+        mp_audio_realloc(frame, samples);
+        frame->samples = 0;
+        while (frame->samples < samples) {
+            struct mp_audio *src = ab->frames[0];
+            int pos = frame->samples;
+            frame->samples += src->samples;
+            mp_audio_realloc_min(frame, frame->samples);
+            mp_audio_copy(frame, pos, src, 0, src->samples);
+            talloc_free(src);
+            MP_TARRAY_REMOVE_AT(ab->frames, ab->num_frames, 0);
+        }
+        talloc_steal(ab, frame);
+        MP_TARRAY_INSERT_AT(ab, ab->frames, ab->num_frames, 0, frame);
+    }
+    mp_audio_buffer_peek(ab, out_mpa);
 }
 
 // Skip leading samples. (Used with mp_audio_buffer_peek() to read data.)
 void mp_audio_buffer_skip(struct mp_audio_buffer *ab, int samples)
 {
-    assert(samples >= 0 && samples <= ab->buffer->samples);
-    mp_audio_copy(ab->buffer, 0, ab->buffer, samples,
-                  ab->buffer->samples - samples);
-    ab->buffer->samples -= samples;
+    assert(samples >= 0 && samples <= ab->samples);
+    ab->samples -= samples;
+    while (samples > 0) {
+        struct mp_audio *frame = ab->frames[0];
+        if (samples < frame->samples) {
+            mp_audio_skip_samples(frame, samples);
+            break;
+        }
+        samples -= frame->samples;
+        talloc_free(frame);
+        MP_TARRAY_REMOVE_AT(ab->frames, ab->num_frames, 0);
+    }
+}
+
+// Move up to the given number of samples from the start of src to the end of
+// dst. Frames are moved or referenced; no data is copied.
+void mp_audio_buffer_move(struct mp_audio_buffer *dst,
+                          struct mp_audio_buffer *src, int samples)
+{
+    samples = MPMIN(samples, src->samples);
+    while (samples > 0) {
+        struct mp_audio *frame = src->frames[0];
+        if (samples < frame->samples) {
+            struct mp_audio *part = mp_audio_new_ref(frame);
+            if (!part)
+                abort(); // OOM
+            part->samples = samples;
+            mp_audio_buffer_append_frame(dst, part);
+            mp_audio_buffer_skip(src, samples);
+            break;
+        }
+        MP_TARRAY_REMOVE_AT(src->frames, src->num_frames, 0);
+        src->samples -= frame->samples;
+        samples -= frame->samples;
+        mp_audio_buffer_append_frame(dst, frame);
+    }
 }
 
 void mp_audio_buffer_clear(struct mp_audio_buffer *ab)
 {
-    ab->buffer->samples = 0;
+    for (int n = 0; n < ab->num_frames; n++)
+        talloc_free(ab->frames[n]);
+    ab->num_frames = 0;
+    ab->samples = 0;
 }
 
 // Return number of buffered audio samples
 int mp_audio_buffer_samples(struct mp_audio_buffer *ab)
 {
-    return ab->buffer->samples;
+    return ab->samples;
 }
 
 // Return amount of buffered audio in seconds.
 double mp_audio_buffer_seconds(struct mp_audio_buffer *ab)
 {
-    return ab->buffer->samples / (double)ab->buffer->rate;
+    return ab->samples / (double)ab->format.rate;
 }
@@ -30,13 +30,16 @@ void mp_audio_buffer_get_format(struct mp_audio_buffer *ab,
                                 struct mp_audio *out_fmt);
 void mp_audio_buffer_preallocate_min(struct mp_audio_buffer *ab, int samples);
 int mp_audio_buffer_get_write_available(struct mp_audio_buffer *ab);
-void mp_audio_buffer_get_write_buffer(struct mp_audio_buffer *ab, int minsamples,
-                                      struct mp_audio *out_buffer);
-void mp_audio_buffer_finish_write(struct mp_audio_buffer *ab, int samples);
+void mp_audio_buffer_append_frame(struct mp_audio_buffer *ab,
+                                  struct mp_audio *frame);
 void mp_audio_buffer_append(struct mp_audio_buffer *ab, struct mp_audio *mpa);
 void mp_audio_buffer_prepend_silence(struct mp_audio_buffer *ab, int samples);
 void mp_audio_buffer_peek(struct mp_audio_buffer *ab, struct mp_audio *out_mpa);
+void mp_audio_buffer_peek_contiguous(struct mp_audio_buffer *ab, int samples,
+                                     struct mp_audio *out_mpa);
 void mp_audio_buffer_skip(struct mp_audio_buffer *ab, int samples);
+void mp_audio_buffer_move(struct mp_audio_buffer *dst,
+                          struct mp_audio_buffer *src, int samples);
 void mp_audio_buffer_clear(struct mp_audio_buffer *ab);
 int mp_audio_buffer_samples(struct mp_audio_buffer *ab);
 double mp_audio_buffer_seconds(struct mp_audio_buffer *ab);
@@ -0,0 +1,150 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <assert.h>
+
+#include "talloc.h"
+#include "common/common.h"
+#include "osdep/atomics.h"
+#include "chmap.h"
+#include "audio_ring.h"
+
+#define CACHE_LINE 64
+
+// State of the reader or the writer. The padding makes sure the reader and
+// writer don't modify the same cache line.
+struct ring_side {
+    // Total samples read or written. Only the owning side stores it.
+    atomic_ulong pos;
+    // Position of the other side as last seen by this side. Private to the
+    // owning side; avoids touching the other side's cache line as long as the
+    // cached value says there is enough data or space.
+    unsigned long other;
+    char pad[CACHE_LINE];
+};
+
+struct mp_audio_ring {
+    char pad[CACHE_LINE];
+    struct ring_side w, r;
+    // Constant after creation.
+    uint8_t *planes[MP_NUM_CHANNELS];
+    int num_planes;
+    int sstride;
+    unsigned long size;     // capacity in samples
+    unsigned long mask;     // allocated samples - 1 (power of 2)
+};
+
+struct mp_audio_ring *mp_audio_ring_create(void *ta_parent, int num_planes,
+                                           int sstride, int samples)
+{
+    assert(num_planes > 0 && num_planes <= MP_NUM_CHANNELS);
+    assert(samples > 0);
+    struct mp_audio_ring *r = talloc_zero(ta_parent, struct mp_audio_ring);
+    unsigned long alloc = 1;
+    while (alloc < samples)
+        alloc *= 2;
+    r->num_planes = num_planes;
+    r->sstride = sstride;
+    r->size = samples;
+    r->mask = alloc - 1;
+    for (int n = 0; n < num_planes; n++)
+        r->planes[n] = talloc_size(r, alloc * sstride);
+    mp_audio_ring_reset(r);
+    return r;
+}
+
+// Copy samples between the ring at pos and buf (direction given by to_ring).
+static void copy_plane(struct mp_audio_ring *r, uint8_t *ring, uint8_t *buf,
+                       unsigned long pos, int samples, bool to_ring)
+{
+    size_t offset = pos & r->mask;
+    size_t len1 = MPMIN(samples, r->mask + 1 - offset) * r->sstride;
+    size_t len2 = samples * r->sstride - len1;
+    uint8_t *p = ring + offset * r->sstride;
+    if (to_ring) {
+        memcpy(p, buf, len1);
+        memcpy(ring, buf + len1, len2);
+    } else {
+        memcpy(buf, p, len1);
+        memcpy(buf + len1, ring, len2);
+    }
+}
+
+int mp_audio_ring_write(struct mp_audio_ring *r, void **data, int samples)
+{
+    unsigned long wpos = atomic_load_explicit(&r->w.pos, memory_order_relaxed);
+    unsigned long space = r->size - (wpos - r->w.other);
+    if (space < samples) {
+        // Acquire: the reader must be done with the data before it is
+        // overwritten.
+        r->w.other = atomic_load_explicit(&r->r.pos, memory_order_acquire);
+        space = r->size - (wpos - r->w.other);
+    }
+    samples = MPMIN(samples, space);
+    if (samples <= 0)
+        return 0;
+    for (int n = 0; n < r->num_planes; n++)
+        copy_plane(r, r->planes[n], data[n], wpos, samples, true);
+    // Release: publish the data to the reader.
+    atomic_store_explicit(&r->w.pos, wpos + samples, memory_order_release);
+    return samples;
+}
+
+int mp_audio_ring_read(struct mp_audio_ring *r, void **data, int samples)
+{
+    unsigned long rpos = atomic_load_explicit(&r->r.pos, memory_order_relaxed);
+    unsigned long avail = r->r.other - rpos;
+    if (avail < samples) {
+        r->r.other = atomic_load_explicit(&r->w.pos, memory_order_acquire);
+        avail = r->r.other - rpos;
+    }
+    samples = MPMIN(samples, avail);
+    if (samples <= 0)
+        return 0;
+    if (data) {
+        for (int n = 0; n < r->num_planes; n++)
+            copy_plane(r, r->planes[n], data[n], rpos, samples, false);
+    }
+    atomic_store_explicit(&r->r.pos, rpos + samples, memory_order_release);
+    return samples;
+}
+
+int mp_audio_ring_buffered(struct mp_audio_ring *r)
+{
+    // Load the read position first: the write position can only be ahead.
+    unsigned long rpos = atomic_load_explicit(&r->r.pos, memory_order_acquire);
+    unsigned long wpos = atomic_load_explicit(&r->w.pos, memory_order_acquire);
+    return MPMIN(wpos - rpos, r->size);
+}
+
+int mp_audio_ring_available(struct mp_audio_ring *r)
+{
+    return r->size - mp_audio_ring_buffered(r);
+}
+
+int mp_audio_ring_size(struct mp_audio_ring *r)
+{
+    return r->size;
+}
+
+void mp_audio_ring_reset(struct mp_audio_ring *r)
+{
+    atomic_store(&r->w.pos, 0);
+    atomic_store(&r->r.pos, 0);
+    r->w.other = r->r.other = 0;
+}
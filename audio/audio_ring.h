@@ -0,0 +1,56 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_AUDIO_RING_H
+#define MP_AUDIO_RING_H
+
+// Wait-free SPSC (single producer, single consumer) ringbuffer for audio with
+// any number of planes. All planes share one pair of read/write positions, so
+// the reader always sees the same amount of data on every plane.
+//
+// Reading and writing never block, allocate, or make system calls, so the
+// reading side is safe to use from realtime audio callbacks. All functions
+// except mp_audio_ring_reset() can be called concurrently, as long as only one
+// thread writes and only one thread reads.
+struct mp_audio_ring;
+
+// sstride: bytes per sample and plane
+// samples: capacity
+struct mp_audio_ring *mp_audio_ring_create(void *ta_parent, int num_planes,
+                                           int sstride, int samples);
+
+// Write up to samples from data[0..num_planes-1]. Returns the number of
+// samples written. Writer only.
+int mp_audio_ring_write(struct mp_audio_ring *r, void **data, int samples);
+
+// Read up to samples to data[0..num_planes-1]. If data is NULL, the data is
+// discarded. Returns the number of samples read. Reader only.
+int mp_audio_ring_read(struct mp_audio_ring *r, void **data, int samples);
+
+// Samples that can be read. If called by the writer, this is an upper bound.
+int mp_audio_ring_buffered(struct mp_audio_ring *r);
+
+// Samples that can be written. If called by the reader, this is an upper bound.
+int mp_audio_ring_available(struct mp_audio_ring *r);
+
+int mp_audio_ring_size(struct mp_audio_ring *r);
+
+// Discard all data. Neither the reader nor the writer must access the ring
+// at the same time.
+void mp_audio_ring_reset(struct mp_audio_ring *r);
+
+#endif
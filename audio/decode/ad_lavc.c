@@ -265,8 +265,8 @@ static int decode_packet(struct dec_audio *da, struct mp_audio **out)
             da->pts_offset += skip;
             priv->skip_samples -= skip;
         }
-        if (pad <= mpframe->samples)
-            mpframe->samples -= pad;
+        // Padding can cover more than this frame (end of stream).
+        mpframe->samples -= MPMIN(pad, mpframe->samples);
     }
 #endif
 
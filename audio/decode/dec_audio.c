@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/mem.h>
 
@@ -29,6 +30,7 @@
 #include "common/codecs.h"
 #include "common/msg.h"
 #include "misc/bstr.h"
+#include "osdep/threads.h"
 
 #include "stream/stream.h"
 #include "demux/demux.h"
@@ -56,6 +58,66 @@ static const struct ad_functions * const ad_drivers[] = {
     NULL
 };
 
+// A run of queued samples filtered at the same playback speed.
+struct ad_chunk {
+    int samples;
+    double speed;
+};
+
+struct ad_thread {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- all fields below are protected by lock
+    bool terminate;
+    bool paused;            // the player is accessing the audio chain
+    bool decoding;          // decoder thread is accessing the audio chain
+    bool reader_waiting;    // audio_thread_read() ran out of data
+    double seconds;         // how much audio to decode ahead
+    struct mp_audio_buffer *buffer; // decoded+filtered audio for the player
+    struct ad_chunk *chunks; // speed of the samples in buffer, oldest first
+    int num_chunks;
+    double end_pts;         // audio_get_output_pts() after the last append
+    int status;             // last AD_* code returned by audio_decode()
+    // --- only accessed by the decoder thread
+    struct mp_audio_buffer *tmp;
+};
+
+static void stop_thread(struct dec_audio *d_audio);
+
+// Must be called with t->lock held.
+static void clear_queue(struct ad_thread *t)
+{
+    mp_audio_buffer_clear(t->buffer);
+    t->num_chunks = 0;
+}
+
+// Must be called with t->lock held. samples have been appended to t->buffer.
+static void queue_add(struct ad_thread *t, int samples, double speed)
+{
+    if (samples <= 0)
+        return;
+    if (t->num_chunks && t->chunks[t->num_chunks - 1].speed == speed) {
+        t->chunks[t->num_chunks - 1].samples += samples;
+    } else {
+        MP_TARRAY_APPEND(t, t->chunks, t->num_chunks,
+                         (struct ad_chunk){samples, speed});
+    }
+}
+
+// Must be called with t->lock held. samples have been removed from t->buffer.
+static void queue_remove(struct ad_thread *t, int samples)
+{
+    while (samples > 0 && t->num_chunks) {
+        struct ad_chunk *c = &t->chunks[0];
+        int n = MPMIN(samples, c->samples);
+        c->samples -= n;
+        samples -= n;
+        if (!c->samples)
+            MP_TARRAY_REMOVE_AT(t->chunks, t->num_chunks, 0);
+    }
+}
+
 static void uninit_decoder(struct dec_audio *d_audio)
 {
     if (d_audio->ad_driver) {
@@ -150,6 +212,7 @@ void audio_uninit(struct dec_audio *d_audio)
 {
     if (!d_audio)
         return;
+    stop_thread(d_audio);
     MP_VERBOSE(d_audio, "Uninit audio filters...\n");
     af_destroy(d_audio->afilter);
     uninit_decoder(d_audio);
@@ -191,8 +254,7 @@ static bool copy_output(struct af_stream *afs, struct mp_audio_buffer *outbuf,
         struct mp_audio *mpa = af_read_output_frame(afs);
         if (!mpa)
             return false; // out of data
-        mp_audio_buffer_append(outbuf, mpa);
-        talloc_free(mpa);
+        mp_audio_buffer_append_frame(outbuf, mpa);
     }
     return true;
 }
@@ -245,6 +307,16 @@ int audio_decode(struct dec_audio *da, struct mp_audio_buffer *outbuf,
 
 void audio_reset_decoding(struct dec_audio *d_audio)
 {
+    struct ad_thread *t = d_audio->thread;
+    if (t) {
+        pthread_mutex_lock(&t->lock);
+        assert(t->paused && !t->decoding);
+        clear_queue(t);
+        t->end_pts = MP_NOPTS_VALUE;
+        t->status = AD_OK;
+        t->reader_waiting = false;
+        pthread_mutex_unlock(&t->lock);
+    }
     if (d_audio->ad_driver)
         d_audio->ad_driver->control(d_audio, ADCTRL_RESET, NULL);
     af_seek_reset(d_audio->afilter);
@@ -255,3 +327,233 @@ void audio_reset_decoding(struct dec_audio *d_audio)
         d_audio->waiting = NULL;
     }
 }
+
+// Return the pts at the end of the audio that has been output by the filter
+// chain so far.
+double audio_get_output_pts(struct dec_audio *d_audio)
+{
+    struct mp_audio in_format = d_audio->decode_format;
+
+    if (!mp_audio_config_valid(&in_format) || d_audio->afilter->initialized < 1)
+        return MP_NOPTS_VALUE;
+
+    // first calculate the end pts of audio that has been output by decoder
+    double a_pts = d_audio->pts;
+    if (a_pts == MP_NOPTS_VALUE)
+        return MP_NOPTS_VALUE;
+
+    // d_audio->pts is the timestamp of the latest input packet with
+    // known pts that the decoder has decoded. d_audio->pts_bytes is
+    // the amount of bytes the decoder has written after that timestamp.
+    a_pts += d_audio->pts_offset / (double)in_format.rate;
+
+    // Now a_pts hopefully holds the pts for end of audio from decoder.
+    // Subtract data in buffers between decoder and filter output.
+
+    // Decoded but not filtered
+    if (d_audio->waiting)
+        a_pts -= d_audio->waiting->samples / (double)in_format.rate;
+
+    // Data buffered in audio filters, measured in seconds of "missing" output.
+    // Filters divide audio length by playback_speed, so multiply by it
+    // to get the length in original units without speedup or slowdown.
+    a_pts -= af_calc_delay(d_audio->afilter) * d_audio->opts->playback_speed;
+
+    return a_pts;
+}
+
+static void *decode_thread(void *ptr)
+{
+    struct dec_audio *d_audio = ptr;
+    struct ad_thread *t = d_audio->thread;
+
+    mpthread_set_name("audio decoder");
+
+    pthread_mutex_lock(&t->lock);
+    while (!t->terminate) {
+        if (t->paused || t->status != AD_OK ||
+            mp_audio_buffer_seconds(t->buffer) >= t->seconds)
+        {
+            pthread_cond_wait(&t->wakeup, &t->lock);
+            continue;
+        }
+        t->decoding = true;
+        pthread_mutex_unlock(&t->lock);
+
+        // The player reinits the filter chain only while we're paused, so
+        // the output format can't change during audio_decode().
+        struct mp_audio fmt, cur;
+        fmt = d_audio->afilter->output;
+        mp_audio_buffer_get_format(t->tmp, &cur);
+        if (!mp_audio_config_equals(&cur, &fmt))
+            mp_audio_buffer_reinit(t->tmp, &fmt);
+
+        int status = audio_decode(d_audio, t->tmp, 1);
+        double pts = audio_get_output_pts(d_audio);
+        double speed = d_audio->playback_speed;
+
+        pthread_mutex_lock(&t->lock);
+        t->decoding = false;
+        mp_audio_buffer_get_format(t->buffer, &cur);
+        if (!mp_audio_config_equals(&cur, &fmt)) {
+            // Audio in the old format can't be played anymore anyway.
+            clear_queue(t);
+            mp_audio_buffer_reinit(t->buffer, &fmt);
+        }
+        int samples = mp_audio_buffer_samples(t->tmp);
+        mp_audio_buffer_move(t->buffer, t->tmp, samples);
+        queue_add(t, samples, speed);
+        t->end_pts = pts;
+        t->status = status;
+        // On AD_WAIT, the demuxer wakes up the player once there are new
+        // packets. Don't wake up the player on every retry at EOF either; it
+        // will notice the status the next time it reads anyway.
+        bool wakeup = t->reader_waiting && status != AD_WAIT;
+        if (wakeup)
+            t->reader_waiting = false;
+        pthread_cond_broadcast(&t->wakeup);
+        if (wakeup && d_audio->wakeup_cb) {
+            pthread_mutex_unlock(&t->lock);
+            d_audio->wakeup_cb(d_audio->wakeup_cb_ctx);
+            pthread_mutex_lock(&t->lock);
+        }
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+static void stop_thread(struct dec_audio *d_audio)
+{
+    struct ad_thread *t = d_audio->thread;
+    if (!t)
+        return;
+    pthread_mutex_lock(&t->lock);
+    t->terminate = true;
+    pthread_cond_broadcast(&t->wakeup);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->thread, NULL);
+    pthread_cond_destroy(&t->wakeup);
+    pthread_mutex_destroy(&t->lock);
+    talloc_free(t);
+    d_audio->thread = NULL;
+}
+
+// Run decoding and filtering on a separate thread, which keeps about the
+// given number of seconds of audio ready. The audio chain must be fully
+// initialized, and the demuxer must be threaded (the decoder thread reads
+// packets with demux_read_packet_async()).
+// The thread starts out paused. The player has to pause it again with
+// audio_thread_pause() before it can access the decoder, the filter chain,
+// or any d_audio fields, and resume it with audio_thread_resume() when done.
+bool audio_start_thread(struct dec_audio *d_audio, double seconds)
+{
+    assert(!d_audio->thread);
+    struct ad_thread *t = talloc_zero(NULL, struct ad_thread);
+    t->seconds = seconds;
+    t->paused = true;
+    t->end_pts = MP_NOPTS_VALUE;
+    t->buffer = mp_audio_buffer_create(t);
+    t->tmp = mp_audio_buffer_create(t);
+    mp_audio_buffer_reinit(t->buffer, &d_audio->afilter->output);
+    mp_audio_buffer_reinit(t->tmp, &d_audio->afilter->output);
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->wakeup, NULL);
+    d_audio->thread = t;
+    if (pthread_create(&t->thread, NULL, decode_thread, d_audio)) {
+        pthread_cond_destroy(&t->wakeup);
+        pthread_mutex_destroy(&t->lock);
+        talloc_free(t);
+        d_audio->thread = NULL;
+        return false;
+    }
+    MP_VERBOSE(d_audio, "Decoding on a separate thread (%.2f seconds).\n",
+               seconds);
+    return true;
+}
+
+// Let the decoder thread continue. Does nothing if there's no thread.
+void audio_thread_resume(struct dec_audio *d_audio)
+{
+    struct ad_thread *t = d_audio->thread;
+    if (!t)
+        return;
+    pthread_mutex_lock(&t->lock);
+    t->paused = false;
+    // The decoder might have new packets now.
+    if (t->status == AD_WAIT)
+        t->status = AD_OK;
+    pthread_cond_broadcast(&t->wakeup);
+    pthread_mutex_unlock(&t->lock);
+}
+
+// Wait until the decoder thread is done with the current chunk of audio, and
+// stop it from decoding more. Does nothing if there's no thread.
+void audio_thread_pause(struct dec_audio *d_audio)
+{
+    struct ad_thread *t = d_audio->thread;
+    if (!t)
+        return;
+    pthread_mutex_lock(&t->lock);
+    t->paused = true;
+    while (t->decoding)
+        pthread_cond_wait(&t->wakeup, &t->lock);
+    pthread_mutex_unlock(&t->lock);
+}
+
+// Like audio_decode(), but move audio from the decoder thread to outbuf.
+// Returns AD_WAIT if not enough audio is available yet (d_audio->wakeup_cb will
+// be called when more is). Errors and EOF are returned once the audio decoded
+// before them has been read.
+int audio_thread_read(struct dec_audio *d_audio, struct mp_audio_buffer *outbuf,
+                      int minsamples)
+{
+    struct ad_thread *t = d_audio->thread;
+    int res = AD_OK;
+    pthread_mutex_lock(&t->lock);
+    struct mp_audio fmt, cur;
+    mp_audio_buffer_get_format(outbuf, &fmt);
+    mp_audio_buffer_get_format(t->buffer, &cur);
+    if (!mp_audio_config_equals(&fmt, &cur)) {
+        // Decoded before the player reconfigured the output.
+        clear_queue(t);
+    }
+    int missing = minsamples - mp_audio_buffer_samples(outbuf);
+    if (missing > 0) {
+        missing = MPMIN(missing, mp_audio_buffer_samples(t->buffer));
+        mp_audio_buffer_move(outbuf, t->buffer, missing);
+        queue_remove(t, missing);
+    }
+    if (mp_audio_buffer_samples(outbuf) < minsamples) {
+        if (!mp_audio_buffer_samples(t->buffer) && t->status != AD_OK &&
+            t->status != AD_WAIT)
+        {
+            res = t->status;
+            t->status = AD_OK;
+        } else {
+            res = AD_WAIT;
+            t->reader_waiting = true;
+        }
+    }
+    pthread_cond_broadcast(&t->wakeup);
+    pthread_mutex_unlock(&t->lock);
+    return res;
+}
+
+// Return the pts at the end of the audio returned by the decoder thread, and
+// set *buffered to the duration of the audio not read by the player yet. The
+// duration is in source time: each queued sample is scaled by the playback
+// speed it was filtered with, so that it stays right across speed changes.
+double audio_thread_get_pts(struct dec_audio *d_audio, double *buffered)
+{
+    struct ad_thread *t = d_audio->thread;
+    pthread_mutex_lock(&t->lock);
+    double pts = t->end_pts;
+    struct mp_audio fmt;
+    mp_audio_buffer_get_format(t->buffer, &fmt);
+    double duration = 0;
+    for (int n = 0; n < t->num_chunks; n++)
+        duration += t->chunks[n].samples * t->chunks[n].speed;
+    *buffered = fmt.rate > 0 ? duration / fmt.rate : 0;
+    pthread_mutex_unlock(&t->lock);
+    return pts;
+}
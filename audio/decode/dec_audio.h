@@ -47,6 +47,17 @@ struct dec_audio {
     int pts_offset;
     // For free use by the ad_driver
     void *priv;
+    // Playback speed the filter chain is set up for (set by the player)
+    double playback_speed;
+
+    // Called by the decoder thread if more audio can be read, or if it
+    // reached EOF or an error (see audio_start_thread()).
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_cb_ctx;
+    struct ad_thread *thread; // if non-NULL, decoding runs on a separate thread
+    // Times the player ran out of audio from the decoder thread
+    int underruns;
+    bool in_underrun;
 };
 
 enum {
@@ -64,5 +75,13 @@ int audio_decode(struct dec_audio *d_audio, struct mp_audio_buffer *outbuf,
 int initial_audio_decode(struct dec_audio *d_audio);
 void audio_reset_decoding(struct dec_audio *d_audio);
 void audio_uninit(struct dec_audio *d_audio);
+double audio_get_output_pts(struct dec_audio *d_audio);
+
+bool audio_start_thread(struct dec_audio *d_audio, double seconds);
+void audio_thread_resume(struct dec_audio *d_audio);
+void audio_thread_pause(struct dec_audio *d_audio);
+int audio_thread_read(struct dec_audio *d_audio, struct mp_audio_buffer *outbuf,
+                      int minsamples);
+double audio_thread_get_pts(struct dec_audio *d_audio, double *buffered);
 
 #endif /* MPLAYER_DEC_AUDIO_H */
@@ -27,6 +27,7 @@
 
 #include "options/m_option.h"
 #include "options/m_config.h"
+#include "osdep/timer.h"
 
 #include "audio/audio_buffer.h"
 #include "af.h"
@@ -54,6 +55,7 @@ extern const struct af_info af_info_center;
 extern const struct af_info af_info_sinesuppress;
 extern const struct af_info af_info_karaoke;
 extern const struct af_info af_info_scaletempo;
+extern const struct af_info af_info_stretch;
 extern const struct af_info af_info_forcespeed;
 extern const struct af_info af_info_bs2b;
 extern const struct af_info af_info_lavfi;
@@ -85,6 +87,7 @@ static const struct af_info *const filter_list[] = {
     &af_info_karaoke,
     &af_info_forcespeed,
     &af_info_scaletempo,
+    &af_info_stretch,
 #if HAVE_LIBBS2B
     &af_info_bs2b,
 #endif
@@ -326,6 +329,13 @@ static void af_print_filter_chain(struct af_stream *s, struct af_instance *at,
         if (af == at)
             mp_snprintf_cat(b, sizeof(b), " <-");
         MP_MSG(s, msg_level, "%s\n", b);
+        if (af->stats.frames_in) {
+            MP_MSG(s, msg_level, "      %"PRId64" frames, %"PRId64" -> %"PRId64
+                   " samples, %.3f s in filter, %.3f s delay\n",
+                   af->stats.frames_in, af->stats.samples_in,
+                   af->stats.samples_out, af->stats.time / 1e6,
+                   af_buffered_delay(af));
+        }
 
         af = af->next;
     }
@@ -434,6 +444,14 @@ static int af_fix_format_conversion(struct af_stream *s,
     struct mp_audio actual = *prev->data;
     if (actual.format == in.format)
         return AF_FALSE;
+    // Some normal filters (like af_volume) can write other formats directly,
+    // which is cheaper than an extra conversion pass.
+    if (!af_is_conversion_filter(prev) &&
+        prev->control(prev, AF_CONTROL_SET_FORMAT, &in.format) == AF_OK)
+    {
+        *p_af = prev;
+        return AF_OK;
+    }
     int dstfmt = in.format;
     char *filter = af_find_conversion_filter(actual.format, &dstfmt);
     if (!filter)
@@ -640,6 +658,8 @@ struct af_stream *af_new(struct mpv_global *global)
 
 void af_destroy(struct af_stream *s)
 {
+    if (s->initialized > 0)
+        af_print_filter_chain(s, NULL, MSGL_V);
     af_uninit(s);
     talloc_free(s);
 }
@@ -683,15 +703,14 @@ int af_init(struct af_stream *s)
     return 0;
 }
 
-/* Add filter during execution. This function adds the filter "name"
-   to the stream s. The filter will be inserted somewhere nice in the
-   list of filters. The return value is a pointer to the new filter,
-   If the filter couldn't be added the return value is NULL. */
-struct af_instance *af_add(struct af_stream *s, char *name, char **args)
+static struct af_instance *af_add_at(struct af_stream *s, char *name,
+                                     char **args, bool at_end)
 {
     struct af_instance *new;
     // Insert the filter somewhere nice
-    if (af_is_conversion_filter(s->first->next))
+    if (at_end)
+        new = af_prepend(s, s->last, name, args);
+    else if (af_is_conversion_filter(s->first->next))
         new = af_append(s, s->first->next, name, args);
     else
         new = af_prepend(s, s->first->next, name, args);
@@ -710,6 +729,28 @@ struct af_instance *af_add(struct af_stream *s, char *name, char **args)
     return new;
 }
 
+/* Add filter during execution. This function adds the filter "name"
+   to the stream s. The filter will be inserted somewhere nice in the
+   list of filters. The return value is a pointer to the new filter,
+   If the filter couldn't be added the return value is NULL. */
+struct af_instance *af_add(struct af_stream *s, char *name, char **args)
+{
+    return af_add_at(s, name, args, false);
+}
+
+/* Like af_add(), but insert the filter at the end of the chain. Filters which
+   can output the final format (af_volume) then replace the conversion filter.
+   Falls back to af_add() with compressed (spdif) output, or if the chain
+   can't be configured this way. */
+struct af_instance *af_add_output_stage(struct af_stream *s, char *name,
+                                        char **args)
+{
+    struct af_instance *new = NULL;
+    if (!AF_FORMAT_IS_SPECIAL(s->filter_output.format))
+        new = af_add_at(s, name, args, true);
+    return new ? new : af_add_at(s, name, args, false);
+}
+
 struct af_instance *af_find_by_label(struct af_stream *s, char *label)
 {
     for (struct af_instance *af = s->first; af; af = af->next) {
@@ -748,6 +789,18 @@ double af_calc_delay(struct af_stream *s)
     return delay;
 }
 
+/* Delay of a single filter [seconds]: audio it holds internally, plus queued
+ * output frames not yet taken by the next filter. */
+double af_buffered_delay(struct af_instance *af)
+{
+    double delay = af->delay;
+    if (af->fmt_out.rate > 0) {
+        for (int n = 0; n < af->num_out_queued; n++)
+            delay += af->out_queued[n]->samples / (double)af->fmt_out.rate;
+    }
+    return delay;
+}
+
 /* Send control to all filters, starting with the last until one accepts the
  * command with AF_OK. Return the accepting filter. */
 struct af_instance *af_control_any_rev(struct af_stream *s, int cmd, void *arg)
@@ -776,6 +829,7 @@ void af_add_output_frame(struct af_instance *af, struct mp_audio *frame)
 {
     if (frame) {
         assert(mp_audio_config_equals(&af->fmt_out, frame));
+        af->stats.samples_out += frame->samples;
         MP_TARRAY_APPEND(af, af->out_queued, af->num_out_queued, frame);
     }
 }
@@ -783,7 +837,10 @@ void af_add_output_frame(struct af_instance *af, struct mp_audio *frame)
 static bool af_has_output_frame(struct af_instance *af)
 {
     if (!af->num_out_queued && af->filter_out) {
-        if (af->filter_out(af) < 0)
+        int64_t start = mp_time_us();
+        int r = af->filter_out(af);
+        af->stats.time += mp_time_us() - start;
+        if (r < 0)
             MP_ERR(af, "Error filtering frame.\n");
     }
     return af->num_out_queued > 0;
@@ -801,9 +858,14 @@ static struct mp_audio *af_dequeue_output_frame(struct af_instance *af)
 
 static int af_do_filter(struct af_instance *af, struct mp_audio *frame)
 {
-    if (frame)
+    if (frame) {
         assert(mp_audio_config_equals(&af->fmt_in, frame));
+        af->stats.frames_in += 1;
+        af->stats.samples_in += frame->samples;
+    }
+    int64_t start = mp_time_us();
     int r = af->filter_frame(af, frame);
+    af->stats.time += mp_time_us() - start;
     if (r < 0)
         MP_ERR(af, "Error filtering frame.\n");
     return r;
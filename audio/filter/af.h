@@ -55,6 +55,14 @@ struct af_info {
     const struct m_option *options;
 };
 
+// Accumulated by af.c around the filter callbacks.
+struct af_stats {
+    int64_t time;           // microseconds spent in filter_frame/filter_out
+    int64_t frames_in;
+    int64_t samples_in;
+    int64_t samples_out;
+};
+
 // Linked list of audio filters
 struct af_instance {
     const struct af_info *info;
@@ -85,6 +93,8 @@ struct af_instance {
     int num_out_queued;
 
     struct mp_audio_pool *out_pool;
+
+    struct af_stats stats;
 };
 
 // Current audio stream
@@ -142,6 +152,8 @@ void af_destroy(struct af_stream *s);
 int af_init(struct af_stream *s);
 void af_uninit(struct af_stream *s);
 struct af_instance *af_add(struct af_stream *s, char *name, char **args);
+struct af_instance *af_add_output_stage(struct af_stream *s, char *name,
+                                        char **args);
 int af_remove_by_label(struct af_stream *s, char *label);
 struct af_instance *af_find_by_label(struct af_stream *s, char *label);
 struct af_instance *af_control_any_rev(struct af_stream *s, int cmd, void *arg);
@@ -155,6 +167,7 @@ struct mp_audio *af_read_output_frame(struct af_stream *s);
 int af_make_writeable(struct af_instance *af, struct mp_audio *frame);
 
 double af_calc_delay(struct af_stream *s);
+double af_buffered_delay(struct af_instance *af);
 
 int af_test_output(struct af_instance *af, struct mp_audio *out);
 
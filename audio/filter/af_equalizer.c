@@ -31,6 +31,7 @@
 
 #include "common/common.h"
 #include "af.h"
+#include "dsp_kernels.h"
 
 #define L       2      // Storage for filter taps
 #define KM      10     // Max number of bands
@@ -63,8 +64,8 @@ typedef struct af_equalizer_s
 {
   float   a[KM][L];             // A weights
   float   b[KM][L];             // B weights
-  float   wq[AF_NCH][KM][L];    // Circular buffer for W data
   float   g[AF_NCH][KM];        // Gain factor for each channel and band
+  struct mp_dsp_iir *iir;       // The bands as a biquad cascade per channel
   int     K;                    // Number of used eq bands
   int     channels;             // Number of channels
   float   gain_factor;     // applied at output to avoid clipping
@@ -135,6 +136,27 @@ static int control(struct af_instance* af, int cmd, void* arg)
         s->gain_factor=1;
     }
 
+    /* Each band is y = x + g*(w + b1*w2) with w = b0*x + a0*w1 + a1*w2,
+       i.e. a direct path plus the bandpass as a biquad. Keeping the direct
+       path separate (instead of folding it into the biquad) preserves the
+       precision of the original loop. The output gain factor goes into the
+       first band. */
+    talloc_free(s->iir);
+    s->iir = mp_dsp_iir_create(af, mp_dsp_get(-1), af->data->nch, s->K);
+    for(int ch=0;ch<af->data->nch;ch++){
+      for(k=0;k<s->K;k++){
+        double g = s->g[ch][k], b0 = s->b[k][0], b1 = s->b[k][1];
+        double f = k == 0 ? s->gain_factor : 1.0;
+        mp_dsp_iir_set(s->iir, ch, k, &(struct mp_dsp_biquad){
+          .b0 = g*b0 * f,
+          .b2 = g*b0*b1 * f,
+          .a1 = -s->a[k][0],
+          .a2 = -s->a[k][1],
+          .d = f,
+        });
+      }
+    }
+
     return af_test_output(af,arg);
   }
   }
@@ -147,41 +169,18 @@ static int filter(struct af_instance* af, struct mp_audio* data)
   if (!c)
     return 0;
   af_equalizer_t*  s    = (af_equalizer_t*)af->priv;    // Setup
-  uint32_t         ci   = af->data->nch;                // Index for channels
-  uint32_t         nch  = af->data->nch;                // Number of channels
 
   if (af_make_writeable(af, data) < 0) {
     talloc_free(data);
     return -1;
   }
 
-  while(ci--){
-    float*      g   = s->g[ci];      // Gain factor
-    float*      in  = ((float*)c->planes[0])+ci;
-    float*      out = ((float*)c->planes[0])+ci;
-    float*      end = in + c->samples*c->nch; // Block loop end
-
-    while(in < end){
-      register int      k  = 0;         // Frequency band index
-      register float    yt = *in;       // Current input sample
-      in+=nch;
-
-      // Run the filters
-      for(;k<s->K;k++){
-        // Pointer to circular buffer wq
-        register float* wq = s->wq[ci][k];
-        // Calculate output from AR part of current filter
-        register float w=yt*s->b[k][0] + wq[0]*s->a[k][0] + wq[1]*s->a[k][1];
-        // Calculate output form MA part of current filter
-        yt+=(w + wq[1]*s->b[k][1])*g[k];
-        // Update circular buffer
-        wq[1] = wq[0];
-        wq[0] = w;
-      }
-      // Calculate output
-      *out=yt*s->gain_factor;
-      out+=nch;
-    }
+  if (s->K > 0) {
+    mp_dsp_iir_process(s->iir, c->planes[0], c->samples);
+  } else {
+    float* p = c->planes[0];
+    for(int i=0;i<c->samples*c->nch;i++)
+      p[i]*=s->gain_factor;
   }
   af_add_output_frame(af, data);
   return 0;
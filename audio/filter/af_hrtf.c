@@ -30,12 +30,32 @@
 #include <math.h>
 #include <libavutil/common.h>
 
+#include "common/common.h"
 #include "af.h"
 #include "dsp.h"
+#include "dsp_kernels.h"
 
 /* HRTF filter coefficients and adjustable parameters */
 #include "af_hrtf.h"
 
+/* Samples processed per block */
+#define HRTF_RUN 256
+
+/* Filter inputs, taken from the delay lines after the per sample
+   decoding */
+enum { S_LF, S_RF, S_LR, S_RR, S_CF, S_CR, S_BA_L, S_BA_R, NUM_SRC };
+
+/* Filters: input channel convolved with impulse response (see the notation
+   in filter()) */
+enum {
+    F_LF_AF, F_RF_OF, F_RF_AF, F_LF_OF,     /* all modes */
+    F_LR_AR, F_RR_OR, F_RR_AR, F_LR_OR,     /* 5/5+1 and matrix encoded */
+    F_CF,
+    F_CR,                                   /* rear center matrix */
+    F_BA_L, F_BA_R,                         /* bass compensation */
+    NUM_FIR
+};
+
 typedef struct af_hrtf_s {
     /* Lengths */
     int dlbuflen, hrflen, basslen;
@@ -72,28 +92,11 @@ typedef struct af_hrtf_s {
     int cyc_pos;
     int print_flag;
     int mode;
+    struct mp_dsp_fir *fir[NUM_FIR];
+    float src[NUM_SRC][HRTF_RUN];
+    float dst[NUM_FIR][HRTF_RUN];
 } af_hrtf_t;
 
-/* Convolution on a ring buffer
- *    nx:       length of the ring buffer
- *    nk:       length of the convolution kernel
- *    sx:       ring buffer
- *    sk:       convolution kernel
- *    offset:   offset on the ring buffer, can be
- */
-static float conv(const int nx, const int nk, const float *sx, const float *sk,
-                  const int offset)
-{
-    /* k = reminder of offset / nx */
-    int k = offset >= 0 ? offset % nx : nx + (offset % nx);
-
-    if(nk + k <= nx)
-        return af_filter_fir(nk, sx + k, sk);
-    else
-        return af_filter_fir(nk + k - nx, sx, sk + nx - k) +
-            af_filter_fir(nx - k, sx + k, sk);
-}
-
 /* Detect when the impulse response starts (significantly) */
 static int pulse_detect(const float *sx)
 {
@@ -308,6 +311,8 @@ static void reset(af_hrtf_t *s)
     clear_coeff(s, s->fwrbuf_r);
     clear_coeff(s, s->fwrbuf_lr);
     clear_coeff(s, s->fwrbuf_rr);
+    for (int n = 0; n < NUM_FIR; n++)
+        mp_dsp_fir_reset(s->fir[n]);
 }
 
 /* Initialization and runtime control */
@@ -364,6 +369,65 @@ static void uninit(struct af_instance *af)
         free(s->fwrbuf_rr);
 }
 
+/* Decode n input samples into the delay lines, and run the HRTF and bass
+   filters on them (s->dst) */
+static void filter_block(af_hrtf_t *s, short *in, int nch, int n)
+{
+    const int dblen = s->dlbuflen;
+    int rear = s->decode_mode == HRTF_MIX_51 ||
+               s->decode_mode == HRTF_MIX_MATRIX2CH;
+
+    for (int j = 0; j < n; j++) {
+        const int k = s->cyc_pos;
+
+        update_ch(s, in, k);
+
+        /* Simulate a 7.5 ms -20 dB echo of the center channel in the
+           front channels (like reflection from a room wall) - a kind of
+           psycho-acoustically "cheating" to focus the center front
+           channel, which is normally hard to be perceived as front */
+        s->lf[k] += CFECHOAMPL * s->cf[(k + CFECHODELAY) % dblen];
+        s->rf[k] += CFECHOAMPL * s->cf[(k + CFECHODELAY) % dblen];
+
+        if(rear && s->matrix_mode)
+           matrix_decode(in, k, 2, 3, 0, dblen,
+                         s->lr_fwr, s->rr_fwr,
+                         s->lrprr_fwr, s->lrmrr_fwr,
+                         &(s->adapt_lr_gain), &(s->adapt_rr_gain),
+                         &(s->adapt_lrprr_gain), &(s->adapt_lrmrr_gain),
+                         s->lr, s->rr, NULL, NULL, s->cr);
+
+        /* The delay lines are not modified at k anymore */
+        s->src[S_LF][j] = s->lf[k];
+        s->src[S_RF][j] = s->rf[k];
+        s->src[S_LR][j] = s->lr[k];
+        s->src[S_RR][j] = s->rr[k];
+        s->src[S_CF][j] = s->cf[k];
+        s->src[S_CR][j] = s->cr[k];
+        s->src[S_BA_L][j] = s->ba_l[k];
+        s->src[S_BA_R][j] = s->ba_r[k];
+
+        in += nch;
+        (s->cyc_pos)--;
+        if(s->cyc_pos < 0)
+            s->cyc_pos += dblen;
+    }
+
+    static const int fir_src[NUM_FIR] = {
+        [F_LF_AF] = S_LF, [F_RF_OF] = S_RF, [F_RF_AF] = S_RF,
+        [F_LF_OF] = S_LF, [F_LR_AR] = S_LR, [F_RR_OR] = S_RR,
+        [F_RR_AR] = S_RR, [F_LR_OR] = S_LR, [F_CF] = S_CF, [F_CR] = S_CR,
+        [F_BA_L] = S_BA_L, [F_BA_R] = S_BA_R,
+    };
+    for (int f = 0; f < NUM_FIR; f++) {
+        /* Skip the filters whose output is not used in this mode */
+        if ((f >= F_LR_AR && f <= F_CF && !rear) ||
+            (f == F_CR && !(rear && s->matrix_mode)))
+            continue;
+        mp_dsp_fir_process(s->fir[f], s->dst[f], s->src[fir_src[f]], n);
+    }
+}
+
 /* Filter data through filter
 
 Two "tricks" are used to compensate the "color" of the KEMAR data:
@@ -391,9 +455,7 @@ static int filter(struct af_instance *af, struct mp_audio *data)
 
     short *in = data->planes[0]; // Input audio data
     short *out = outframe->planes[0]; // Output audio data
-    short *end = in + data->samples * data->nch; // Loop end
     float common, left, right, diff, left_b, right_b;
-    const int dblen = s->dlbuflen, hlen = s->hrflen, blen = s->basslen;
 
     if(s->print_flag) {
         s->print_flag = 0;
@@ -439,123 +501,91 @@ static int filter(struct af_instance *af, struct mp_audio *data)
      * or: C = center, A = same side, O = opposite, F = front, R = rear
      */
 
-    while(in < end) {
-        const int k = s->cyc_pos;
-
-        update_ch(s, in, k);
-
-        /* Simulate a 7.5 ms -20 dB echo of the center channel in the
-           front channels (like reflection from a room wall) - a kind of
-           psycho-acoustically "cheating" to focus the center front
-           channel, which is normally hard to be perceived as front */
-        s->lf[k] += CFECHOAMPL * s->cf[(k + CFECHODELAY) % s->dlbuflen];
-        s->rf[k] += CFECHOAMPL * s->cf[(k + CFECHODELAY) % s->dlbuflen];
-
-        switch (s->decode_mode) {
-        case HRTF_MIX_51:
-        case HRTF_MIX_MATRIX2CH:
-           /* Mixer filter matrix */
-           common = conv(dblen, hlen, s->cf, s->cf_ir, k + s->cf_o);
-           if(s->matrix_mode) {
-              /* In matrix decoding mode, the rear channel gain must be
-                 renormalized, as there is an additional channel. */
-              matrix_decode(in, k, 2, 3, 0, s->dlbuflen,
-                            s->lr_fwr, s->rr_fwr,
-                            s->lrprr_fwr, s->lrmrr_fwr,
-                            &(s->adapt_lr_gain), &(s->adapt_rr_gain),
-                            &(s->adapt_lrprr_gain), &(s->adapt_lrmrr_gain),
-                            s->lr, s->rr, NULL, NULL, s->cr);
-              common +=
-                 conv(dblen, hlen, s->cr, s->cr_ir, k + s->cr_o) *
-                 M1_76DB;
-              left    =
-                 ( conv(dblen, hlen, s->lf, s->af_ir, k + s->af_o) +
-                   conv(dblen, hlen, s->rf, s->of_ir, k + s->of_o) +
-                   (conv(dblen, hlen, s->lr, s->ar_ir, k + s->ar_o) +
-                    conv(dblen, hlen, s->rr, s->or_ir, k + s->or_o)) *
-                   M1_76DB + common);
-              right   =
-                 ( conv(dblen, hlen, s->rf, s->af_ir, k + s->af_o) +
-                   conv(dblen, hlen, s->lf, s->of_ir, k + s->of_o) +
-                   (conv(dblen, hlen, s->rr, s->ar_ir, k + s->ar_o) +
-                    conv(dblen, hlen, s->lr, s->or_ir, k + s->or_o)) *
-                   M1_76DB + common);
-           } else {
-              left    =
-                 ( conv(dblen, hlen, s->lf, s->af_ir, k + s->af_o) +
-                   conv(dblen, hlen, s->rf, s->of_ir, k + s->of_o) +
-                   conv(dblen, hlen, s->lr, s->ar_ir, k + s->ar_o) +
-                   conv(dblen, hlen, s->rr, s->or_ir, k + s->or_o) +
-                   common);
-              right   =
-                 ( conv(dblen, hlen, s->rf, s->af_ir, k + s->af_o) +
-                   conv(dblen, hlen, s->lf, s->of_ir, k + s->of_o) +
-                   conv(dblen, hlen, s->rr, s->ar_ir, k + s->ar_o) +
-                   conv(dblen, hlen, s->lr, s->or_ir, k + s->or_o) +
-                   common);
-           }
-           break;
-        case HRTF_MIX_STEREO:
-           left    =
-              ( conv(dblen, hlen, s->lf, s->af_ir, k + s->af_o) +
-                conv(dblen, hlen, s->rf, s->of_ir, k + s->of_o));
-           right   =
-              ( conv(dblen, hlen, s->rf, s->af_ir, k + s->af_o) +
-                conv(dblen, hlen, s->lf, s->of_ir, k + s->of_o));
-           break;
-        default:
-            /* make gcc happy */
-            left = 0.0;
-            right = 0.0;
-            break;
-        }
-
-        /* Bass compensation for the lower frequency cut of the HRTF.  A
-           cross talk of the left and right channel is introduced to
-           match the directional characteristics of higher frequencies.
-           The bass will not have any real 3D perception, but that is
-           OK (note at 180 Hz, the wavelength is about 2 m, and any
-           spatial perception is impossible). */
-        left_b  = conv(dblen, blen, s->ba_l, s->ba_ir, k);
-        right_b = conv(dblen, blen, s->ba_r, s->ba_ir, k);
-        left  += (1 - BASSCROSS) * left_b  + BASSCROSS * right_b;
-        right += (1 - BASSCROSS) * right_b + BASSCROSS * left_b;
-        /* Also mix the LFE channel (if available) */
-        if(data->nch >= 6) {
-            left  += in[5] * M3_01DB;
-            right += in[5] * M3_01DB;
-        }
+    for (int pos = 0; pos < data->samples; pos += HRTF_RUN) {
+        int n = MPMIN(data->samples - pos, HRTF_RUN);
+        short *blk_in = in + pos * data->nch;
+        filter_block(s, blk_in, data->nch, n);
+
+        for (int j = 0; j < n; j++) {
+            const short *x = blk_in + j * data->nch;
+            short *y = out + (pos + j) * af->data->nch;
+            float (*d)[HRTF_RUN] = s->dst;
+
+            switch (s->decode_mode) {
+            case HRTF_MIX_51:
+            case HRTF_MIX_MATRIX2CH:
+               /* Mixer filter matrix */
+               common = d[F_CF][j];
+               if(s->matrix_mode) {
+                  /* In matrix decoding mode, the rear channel gain must be
+                     renormalized, as there is an additional channel. */
+                  common += d[F_CR][j] * M1_76DB;
+                  left    =
+                     ( d[F_LF_AF][j] + d[F_RF_OF][j] +
+                       (d[F_LR_AR][j] + d[F_RR_OR][j]) * M1_76DB + common);
+                  right   =
+                     ( d[F_RF_AF][j] + d[F_LF_OF][j] +
+                       (d[F_RR_AR][j] + d[F_LR_OR][j]) * M1_76DB + common);
+               } else {
+                  left    =
+                     ( d[F_LF_AF][j] + d[F_RF_OF][j] +
+                       d[F_LR_AR][j] + d[F_RR_OR][j] + common);
+                  right   =
+                     ( d[F_RF_AF][j] + d[F_LF_OF][j] +
+                       d[F_RR_AR][j] + d[F_LR_OR][j] + common);
+               }
+               break;
+            case HRTF_MIX_STEREO:
+               left    = d[F_LF_AF][j] + d[F_RF_OF][j];
+               right   = d[F_RF_AF][j] + d[F_LF_OF][j];
+               break;
+            default:
+                /* make gcc happy */
+                left = 0.0;
+                right = 0.0;
+                break;
+            }
 
-        /* Amplitude renormalization. */
-        left  *= AMPLNORM;
-        right *= AMPLNORM;
+            /* Bass compensation for the lower frequency cut of the HRTF.  A
+               cross talk of the left and right channel is introduced to
+               match the directional characteristics of higher frequencies.
+               The bass will not have any real 3D perception, but that is
+               OK (note at 180 Hz, the wavelength is about 2 m, and any
+               spatial perception is impossible). */
+            left_b  = d[F_BA_L][j];
+            right_b = d[F_BA_R][j];
+            left  += (1 - BASSCROSS) * left_b  + BASSCROSS * right_b;
+            right += (1 - BASSCROSS) * right_b + BASSCROSS * left_b;
+            /* Also mix the LFE channel (if available) */
+            if(data->nch >= 6) {
+                left  += x[5] * M3_01DB;
+                right += x[5] * M3_01DB;
+            }
 
-        switch (s->decode_mode) {
-        case HRTF_MIX_51:
-        case HRTF_MIX_STEREO:
-           /* "Cheating": linear stereo expansion to amplify the 3D
-              perception.  Note: Too much will destroy the acoustic space
-              and may even result in headaches. */
-           diff = STEXPAND2 * (left - right);
-           out[0] = av_clip_int16(left  + diff);
-           out[1] = av_clip_int16(right - diff);
-           break;
-        case HRTF_MIX_MATRIX2CH:
-           /* Do attempt any stereo expansion with matrix encoded
-              sources.  The L, R channels are already stereo expanded
-              by the steering, any further stereo expansion will sound
-              very unnatural. */
-           out[0] = av_clip_int16(left);
-           out[1] = av_clip_int16(right);
-           break;
+            /* Amplitude renormalization. */
+            left  *= AMPLNORM;
+            right *= AMPLNORM;
+
+            switch (s->decode_mode) {
+            case HRTF_MIX_51:
+            case HRTF_MIX_STEREO:
+               /* "Cheating": linear stereo expansion to amplify the 3D
+                  perception.  Note: Too much will destroy the acoustic
+                  space and may even result in headaches. */
+               diff = STEXPAND2 * (left - right);
+               y[0] = av_clip_int16(left  + diff);
+               y[1] = av_clip_int16(right - diff);
+               break;
+            case HRTF_MIX_MATRIX2CH:
+               /* Do attempt any stereo expansion with matrix encoded
+                  sources.  The L, R channels are already stereo expanded
+                  by the steering, any further stereo expansion will sound
+                  very unnatural. */
+               y[0] = av_clip_int16(left);
+               y[1] = av_clip_int16(right);
+               break;
+            }
         }
-
-        /* Next sample... */
-        in = &in[data->nch];
-        out = &out[af->data->nch];
-        (s->cyc_pos)--;
-        if(s->cyc_pos < 0)
-            s->cyc_pos += dblen;
     }
 
     talloc_free(data);
@@ -655,6 +685,27 @@ static int af_open(struct af_instance* af)
     for(i = 0; i < s->basslen; i++)
         s->ba_ir[i] *= BASSGAIN;
 
+    /* The conv(olution) offsets of the impulse responses become delays */
+    const struct { const float *ir; int o; } hrir[NUM_FIR] = {
+        [F_LF_AF] = {s->af_ir, s->af_o}, [F_RF_AF] = {s->af_ir, s->af_o},
+        [F_RF_OF] = {s->of_ir, s->of_o}, [F_LF_OF] = {s->of_ir, s->of_o},
+        [F_LR_AR] = {s->ar_ir, s->ar_o}, [F_RR_AR] = {s->ar_ir, s->ar_o},
+        [F_RR_OR] = {s->or_ir, s->or_o}, [F_LR_OR] = {s->or_ir, s->or_o},
+        [F_CF] = {s->cf_ir, s->cf_o}, [F_CR] = {s->cr_ir, s->cr_o},
+    };
+    for(i = 0; i < NUM_FIR; i++) {
+        if(i == F_BA_L || i == F_BA_R)
+            s->fir[i] = mp_dsp_fir_create(af, mp_dsp_get(-1), s->ba_ir,
+                                          s->basslen, 0, 0);
+        else
+            s->fir[i] = mp_dsp_fir_create(af, mp_dsp_get(-1), hrir[i].ir,
+                                          s->hrflen, hrir[i].o, 0);
+        if(!s->fir[i]) {
+            MP_ERR(af, "Memory allocation error.\n");
+            return AF_ERROR;
+        }
+    }
+
     return AF_OK;
 }
 
@@ -39,6 +39,7 @@
 #include "common/common.h"
 
 #include "af.h"
+#include "dsp_kernels.h"
 #include "options/m_option.h"
 
 // Data for specific instances of this filter
@@ -71,6 +72,8 @@ typedef struct af_scaletempo_s
     void *buf_pre_corr;
     void *table_window;
     int (*best_overlap_offset)(struct af_scaletempo_s *s);
+    const struct mp_dsp_funcs *dsp;
+    struct mp_dsp_xcorr *xcorr;     // if set, search with FFTs
     // command line
     float scale_nominal;
     float ms_stride;
@@ -131,12 +134,9 @@ static int best_overlap_offset_float(af_scaletempo_t *s)
         *ppc++ = *pw++ **po++;
 
     float *search_start = (float *)s->buf_queue + s->num_channels;
+    int len = s->samples_overlap - s->num_channels;
     for (int off = 0; off < s->frames_search; off++) {
-        float corr = 0;
-        float *ps = search_start;
-        ppc = s->buf_pre_corr;
-        for (int i = s->num_channels; i < s->samples_overlap; i++)
-            corr += *ppc++ **ps++;
+        float corr = s->dsp->dot(s->buf_pre_corr, search_start, len);
         if (corr > best_corr) {
             best_corr = corr;
             best_off  = off;
@@ -184,17 +184,53 @@ static int best_overlap_offset_s16(af_scaletempo_t *s)
     return best_off * 2 * s->num_channels;
 }
 
+// Same as best_overlap_offset_float(), but computes the correlation for all
+// offsets at once with FFTs, which is faster for large search windows.
+static int best_overlap_offset_fft_float(af_scaletempo_t *s)
+{
+    struct mp_dsp_xcorr *c = s->xcorr;
+    float *pw = s->table_window;
+    float *po = (float *)s->buf_overlap + s->num_channels;
+    for (int i = 0; i < c->a_len; i++)
+        c->a[i] = pw[i] * po[i];
+    memcpy(c->b, (float *)s->buf_queue + s->num_channels,
+           c->b_len * sizeof(float));
+
+    float *corr = mp_dsp_xcorr_run(c);
+    int best_off = 0;
+    for (int off = 1; off < s->frames_search; off++) {
+        if (corr[off * s->num_channels] > corr[best_off * s->num_channels])
+            best_off = off;
+    }
+    return best_off * 4 * s->num_channels;
+}
+
+static int best_overlap_offset_fft_s16(af_scaletempo_t *s)
+{
+    struct mp_dsp_xcorr *c = s->xcorr;
+    int32_t *pw = s->table_window;
+    int16_t *po = (int16_t *)s->buf_overlap + s->num_channels;
+    for (int i = 0; i < c->a_len; i++)
+        c->a[i] = (pw[i] * po[i]) >> 15;
+    int16_t *pq = (int16_t *)s->buf_queue + s->num_channels;
+    for (int i = 0; i < c->b_len; i++)
+        c->b[i] = pq[i];
+
+    float *corr = mp_dsp_xcorr_run(c);
+    int best_off = 0;
+    for (int off = 1; off < s->frames_search; off++) {
+        if (corr[off * s->num_channels] > corr[best_off * s->num_channels])
+            best_off = off;
+    }
+    return best_off * 2 * s->num_channels;
+}
+
 static void output_overlap_float(af_scaletempo_t *s, void *buf_out,
                                  int bytes_off)
 {
-    float *pout = buf_out;
-    float *pb   = s->table_blend;
-    float *po   = s->buf_overlap;
-    float *pin  = (float *)(s->buf_queue + bytes_off);
-    for (int i = 0; i < s->samples_overlap; i++) {
-        *pout++ = *po - *pb++ *(*po - *pin++);
-        po++;
-    }
+    float *pin = (float *)(s->buf_queue + bytes_off);
+    s->dsp->blend(buf_out, s->buf_overlap, pin, s->table_blend,
+                  s->samples_overlap);
 }
 
 static void output_overlap_s16(af_scaletempo_t *s, void *buf_out,
@@ -353,6 +389,8 @@ static int control(struct af_instance *af, int cmd, void *arg)
         }
 
         s->frames_search = (frames_overlap > 1) ? srate * s->ms_search : 0;
+        talloc_free(s->xcorr);
+        s->xcorr = NULL;
         if (s->frames_search <= 0)
             s->best_overlap_offset = NULL;
         else {
@@ -392,6 +430,18 @@ static int control(struct af_instance *af, int cmd, void *arg)
                 }
                 s->best_overlap_offset = best_overlap_offset_float;
             }
+            // The direct search costs a dot product per offset.
+            int len = (frames_overlap - 1) * nch;
+            int search_len = len + (s->frames_search - 1) * nch;
+            if ((int64_t)s->frames_search * len >
+                mp_dsp_xcorr_cost(len, search_len))
+            {
+                s->xcorr = mp_dsp_xcorr_create(NULL, len, search_len);
+                if (s->xcorr) {
+                    s->best_overlap_offset = use_int ?
+                        best_overlap_offset_fft_s16 : best_overlap_offset_fft_float;
+                }
+            }
         }
 
         s->bytes_per_frame = bps * nch;
@@ -410,14 +460,14 @@ static int control(struct af_instance *af, int cmd, void *arg)
 
         MP_DBG(af, ""
                "%.2f stride_in, %i stride_out, %i standing, "
-               "%i overlap, %i search, %i queue, %s mode\n",
+               "%i overlap, %i search, %i queue, %s mode%s\n",
                s->frames_stride_scaled,
                (int)(s->bytes_stride / nch / bps),
                (int)(s->bytes_standing / nch / bps),
                (int)(s->bytes_overlap / nch / bps),
                s->frames_search,
                (int)(s->bytes_queue / nch / bps),
-               (use_int ? "s16" : "float"));
+               (use_int ? "s16" : "float"), s->xcorr ? ", FFT search" : "");
 
         return af_test_output(af, (struct mp_audio *)arg);
     }
@@ -454,6 +504,7 @@ static void uninit(struct af_instance *af)
     free(s->buf_pre_corr);
     free(s->table_blend);
     free(s->table_window);
+    talloc_free(s->xcorr);
 }
 
 #define SCALE_TEMPO 1
@@ -468,6 +519,8 @@ static int af_open(struct af_instance *af)
     af->uninit    = uninit;
     af->filter_frame = filter;
 
+    s->dsp = mp_dsp_get(-1);
+
     s->speed_tempo = !!(s->speed_opt & SCALE_TEMPO);
     s->speed_pitch = !!(s->speed_opt & SCALE_PITCH);
 
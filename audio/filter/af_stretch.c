@@ -0,0 +1,137 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include "common/common.h"
+#include "af.h"
+#include "stretch.h"
+
+struct priv {
+    struct mp_stretch_opts opts;
+    double speed;
+    struct mp_stretch *st;
+};
+
+static int control(struct af_instance *af, int cmd, void *arg)
+{
+    struct priv *p = af->priv;
+    switch (cmd) {
+    case AF_CONTROL_REINIT: {
+        struct mp_audio *in = arg;
+        mp_audio_copy_config(af->data, in);
+        mp_audio_set_format(af->data, AF_FORMAT_FLOATP);
+
+        talloc_free(p->st);
+        p->st = mp_stretch_create(af, af->data->nch, af->data->rate, &p->opts);
+        if (!p->st)
+            return AF_ERROR;
+        mp_stretch_set_speed(p->st, p->speed);
+        af->delay = 0;
+        return af_test_output(af, in);
+    }
+    case AF_CONTROL_SET_PLAYBACK_SPEED:
+        p->speed = *(double *)arg;
+        if (p->st)
+            mp_stretch_set_speed(p->st, p->speed);
+        return AF_OK;
+    case AF_CONTROL_RESET:
+        if (p->st)
+            mp_stretch_reset(p->st);
+        af->delay = 0;
+        return AF_OK;
+    }
+    return AF_UNKNOWN;
+}
+
+static int filter(struct af_instance *af, struct mp_audio *data)
+{
+    struct priv *p = af->priv;
+
+    if (p->speed == 1.0) {
+        // The buffered audio is lost, like with scaletempo.
+        mp_stretch_reset(p->st);
+        af->delay = 0;
+        af_add_output_frame(af, data);
+        return 0;
+    }
+
+    // data==NULL is also sent if the decoder merely has to wait for more
+    // packets, so it can't be used to drain. Like with scaletempo, the
+    // buffered audio is lost at the end of the file.
+    float *planes[MP_NUM_CHANNELS];
+    if (data) {
+        for (int n = 0; n < data->num_planes; n++)
+            planes[n] = data->planes[n];
+        mp_stretch_push(p->st, planes, data->samples);
+    }
+
+    int samples = mp_stretch_max_output(p->st);
+    struct mp_audio *out = NULL;
+    if (samples > 0) {
+        out = mp_audio_pool_get(af->out_pool, af->data, samples);
+        if (!out) {
+            talloc_free(data);
+            return -1;
+        }
+        if (data)
+            mp_audio_copy_attributes(out, data);
+        for (int n = 0; n < out->num_planes; n++)
+            planes[n] = out->planes[n];
+        out->samples = mp_stretch_pull(p->st, planes, samples);
+    }
+
+    af->delay = mp_stretch_get_delay(p->st) / af->data->rate;
+
+    talloc_free(data);
+    if (out && out->samples) {
+        af_add_output_frame(af, out);
+    } else {
+        talloc_free(out);
+    }
+    return 0;
+}
+
+static int af_open(struct af_instance *af)
+{
+    af->control = control;
+    af->filter_frame = filter;
+    return AF_OK;
+}
+
+#define OPT_BASE_STRUCT struct priv
+
+const struct af_info af_info_stretch = {
+    .info = "Change audio tempo with a phase vocoder",
+    .name = "stretch",
+    .open = af_open,
+    .priv_size = sizeof(struct priv),
+    .priv_defaults = &(const struct priv) {
+        .opts = {
+            .window_ms = 46,
+            .phase_lock = 1,
+            .transients = 1,
+        },
+        .speed = 1.0,
+    },
+    .options = (const struct m_option[]) {
+        OPT_FLOATRANGE("window", opts.window_ms, 0, 10, 200),
+        OPT_FLAG("phase-lock", opts.phase_lock, 0),
+        OPT_FLAG("transients", opts.transients, 0),
+        {0}
+    },
+};
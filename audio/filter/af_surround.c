@@ -39,34 +39,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "common/common.h"
 #include "af.h"
 #include "dsp.h"
+#include "dsp_kernels.h"
 
 #define L  32    // Length of fir filter
 #define LD 65536 // Length of delay buffer
-
-// 32 Tap fir filter loop unrolled
-#define FIR(x,w,y) \
-  y = ( w[0] *x[0] +w[1] *x[1] +w[2] *x[2] +w[3] *x[3]  \
-      + w[4] *x[4] +w[5] *x[5] +w[6] *x[6] +w[7] *x[7]  \
-      + w[8] *x[8] +w[9] *x[9] +w[10]*x[10]+w[11]*x[11] \
-      + w[12]*x[12]+w[13]*x[13]+w[14]*x[14]+w[15]*x[15] \
-      + w[16]*x[16]+w[17]*x[17]+w[18]*x[18]+w[19]*x[19] \
-      + w[20]*x[20]+w[21]*x[21]+w[22]*x[22]+w[23]*x[23] \
-      + w[24]*x[24]+w[25]*x[25]+w[26]*x[26]+w[27]*x[27] \
-      + w[28]*x[28]+w[29]*x[29]+w[30]*x[30]+w[31]*x[31])
-
-// Add to circular queue macro + update index
-#ifdef SPLITREAR
-#define ADDQUE(qi,rq,lq,r,l)\
-  lq[qi]=lq[qi+L]=(l);\
-  rq[qi]=rq[qi+L]=(r);\
-  qi=(qi-1)&(L-1);
-#else
-#define ADDQUE(qi,lq,l)\
-  lq[qi]=lq[qi+L]=(l);\
-  qi=(qi-1)&(L-1);
-#endif
+#define RUN 256  // Samples filtered at once
 
 // Macro for updating queue index in delay queues
 #define UPDATEQI(qi) qi=(qi+1)&(LD-1)
@@ -74,17 +54,28 @@
 // instance data
 typedef struct af_surround_s
 {
-  float lq[2*L]; // Circular queue for filtering left rear channel
-  float rq[2*L]; // Circular queue for filtering right rear channel
   float w[L];    // FIR filter coefficients for surround sound 7kHz low-pass
+  struct mp_dsp_fir *fir_l; // Low-pass for the left rear channel
+  struct mp_dsp_fir *fir_r; // Low-pass for the right rear channel
   float* dr;     // Delay queue right rear channel
   float* dl;     // Delay queue left rear channel
   float  d;      // Delay time
-  int i;         // Position in circular buffer
   int wi;        // Write index for delay queue
   int ri;        // Read index for delay queue
 }af_surround_t;
 
+// The low-pass used to run on a circular queue that held the last L input
+// samples when it was applied (before the current sample was added), so w[0]
+// ended up on the oldest sample. Keep that response exactly.
+static struct mp_dsp_fir *create_fir(struct af_instance *af, const float *w)
+{
+  float taps[L];
+  for (int n = 0; n < L - 1; n++)
+    taps[n] = w[n + 1];
+  taps[L - 1] = w[0];
+  return mp_dsp_fir_create(af, mp_dsp_get(-1), taps, L, 1, 0);
+}
+
 // Initialization and runtime control
 static int control(struct af_instance* af, int cmd, void* arg)
 {
@@ -109,6 +100,13 @@ static int control(struct af_instance* af, int cmd, void* arg)
       return AF_ERROR;
     }
 
+    talloc_free(s->fir_l);
+    talloc_free(s->fir_r);
+    s->fir_l = create_fir(af, s->w);
+    s->fir_r = create_fir(af, s->w);
+    if (!s->fir_l || !s->fir_r)
+      return AF_ERROR;
+
     // Free previous delay queues
     free(s->dl);
     free(s->dr);
@@ -157,12 +155,13 @@ static int filter_frame(struct af_instance *af, struct mp_audio *data)
   const float*   m   = steering_matrix[0];
   float*         in  = data->planes[0];         // Input audio data
   float*         out = outframe->planes[0];     // Output audio data
-  float*         end = in + data->samples * data->nch;
-  int            i   = s->i;    // Filter queue index
   int            ri  = s->ri;   // Read index for delay queue
   int            wi  = s->wi;   // Write index for delay queue
+  float          sl[RUN], sr[RUN]; // Surround before/after the low-pass
+
+  for (int pos = 0; pos < data->samples; pos += RUN) {
+    int n = MPMIN(data->samples - pos, RUN);
 
-  while(in < end){
     /* Dominance:
        abs(in[0])  abs(in[1]);
        abs(in[0]+in[1])  abs(in[0]-in[1]);
@@ -182,44 +181,50 @@ static int filter_frame(struct af_instance *af, struct mp_audio *data)
        6dB (/2). This keeps the overall balance, but guarantees no
        overflow. */
 
-    // Output front left and right
-    out[0] = m[0]*in[0] + m[1]*in[1];
-    out[1] = m[2]*in[0] + m[3]*in[1];
+    // Calculate surround
+    for (int j = 0; j < n; j++) {
+      const float *x = &in[j * data->nch];
+#ifdef SPLITREAR
+      sl[j] = m[8]*x[0] + m[9]*x[1];
+      sr[j] = m[6]*x[0] + m[7]*x[1];
+#else
+      sl[j] = m[4]*x[0] + m[5]*x[1];
+#endif
+    }
 
     // Low-pass output @ 7kHz
-    FIR((&s->lq[i]), s->w, s->dl[wi]);
-
-    // Delay output by d ms
-    out[2] = s->dl[ri];
-
+    mp_dsp_fir_process(s->fir_l, sl, sl, n);
 #ifdef SPLITREAR
-    // Low-pass output @ 7kHz
-    FIR((&s->rq[i]), s->w, s->dr[wi]);
-
-    // Delay output by d ms
-    out[3] = s->dr[ri];
-#else
-    out[3] = -out[2];
+    mp_dsp_fir_process(s->fir_r, sr, sr, n);
 #endif
 
-    // Update delay queues indexes
-    UPDATEQI(ri);
-    UPDATEQI(wi);
+    for (int j = 0; j < n; j++) {
+      // Output front left and right
+      out[0] = m[0]*in[0] + m[1]*in[1];
+      out[1] = m[2]*in[0] + m[3]*in[1];
 
-    // Calculate and save surround in circular queue
+      // Delay output by d ms
+      s->dl[wi] = sl[j];
+      out[2] = s->dl[ri];
 #ifdef SPLITREAR
-    ADDQUE(i, s->rq, s->lq, m[6]*in[0]+m[7]*in[1], m[8]*in[0]+m[9]*in[1]);
+      s->dr[wi] = sr[j];
+      out[3] = s->dr[ri];
 #else
-    ADDQUE(i, s->lq, m[4]*in[0]+m[5]*in[1]);
+      out[3] = -out[2];
 #endif
 
-    // Next sample...
-    in = &in[data->nch];
-    out = &out[af->data->nch];
+      // Update delay queues indexes
+      UPDATEQI(ri);
+      UPDATEQI(wi);
+
+      // Next sample...
+      in = &in[data->nch];
+      out = &out[af->data->nch];
+    }
   }
 
   // Save indexes
-  s->i  = i; s->ri = ri; s->wi = wi;
+  s->ri = ri; s->wi = wi;
 
   talloc_free(data);
   af_add_output_frame(af, outframe);
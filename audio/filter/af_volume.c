@@ -28,6 +28,7 @@
 
 #include "common/common.h"
 #include "af.h"
+#include "dsp_kernels.h"
 #include "demux/demux.h"
 
 struct priv {
@@ -41,8 +42,21 @@ struct priv {
     int fast;                   // Use fix-point volume control
     int detach;                 // Detach if gain volume is neutral
     float cfg_volume;
+    int out_format;             // Requested with AF_CONTROL_SET_FORMAT
+    const struct mp_dsp_funcs *dsp;
 };
 
+// The formats which can be converted to/from while applying the volume.
+static int sample_type(int format)
+{
+    switch (af_fmt_from_planar(format)) {
+    case AF_FORMAT_S16:   return MP_DSP_S16;
+    case AF_FORMAT_S32:   return MP_DSP_S32;
+    case AF_FORMAT_FLOAT: return MP_DSP_FLOAT;
+    }
+    return -1;
+}
+
 static int control(struct af_instance *af, int cmd, void *arg)
 {
     struct priv *s = af->priv;
@@ -52,15 +66,20 @@ static int control(struct af_instance *af, int cmd, void *arg)
         struct mp_audio *in = arg;
 
         mp_audio_copy_config(af->data, in);
-        mp_audio_force_interleaved_format(af->data);
-
-        if (s->fast && af_fmt_from_planar(in->format) != AF_FORMAT_FLOAT) {
-            mp_audio_set_format(af->data, AF_FORMAT_S16);
+        if (s->out_format) {
+            // This filter is the last one, and writes the output format
+            // directly, which saves a separate conversion pass.
+            mp_audio_set_format(af->data, s->out_format);
         } else {
-            mp_audio_set_format(af->data, AF_FORMAT_FLOAT);
+            mp_audio_force_interleaved_format(af->data);
+            if (s->fast && af_fmt_from_planar(in->format) != AF_FORMAT_FLOAT) {
+                mp_audio_set_format(af->data, AF_FORMAT_S16);
+            } else {
+                mp_audio_set_format(af->data, AF_FORMAT_FLOAT);
+            }
+            if (af_fmt_is_planar(in->format))
+                mp_audio_set_format(af->data, af_fmt_to_planar(af->data->format));
         }
-        if (af_fmt_is_planar(in->format))
-            mp_audio_set_format(af->data, af_fmt_to_planar(af->data->format));
         s->rgain = 1.0;
         if ((s->rgain_track || s->rgain_album) && af->replaygain_data) {
             float gain, peak;
@@ -85,7 +104,19 @@ static int control(struct af_instance *af, int cmd, void *arg)
         }
         if (s->detach && fabs(s->level * s->rgain - 1.0) < 0.00001)
             return AF_DETACH;
-        return af_test_output(af, in);
+        if (sample_type(in->format) < 0) {
+            mp_audio_set_format(in, af_fmt_is_planar(in->format)
+                                    ? AF_FORMAT_FLOATP : AF_FORMAT_FLOAT);
+            return AF_FALSE;
+        }
+        return AF_OK;
+    }
+    case AF_CONTROL_SET_FORMAT: {
+        int format = *(int *)arg;
+        if (sample_type(format) < 0)
+            return AF_FALSE;
+        s->out_format = format;
+        return AF_OK;
     }
     case AF_CONTROL_SET_VOLUME:
         s->level = *(float *)arg;
@@ -97,45 +128,72 @@ static int control(struct af_instance *af, int cmd, void *arg)
     return AF_UNKNOWN;
 }
 
-static void filter_plane(struct af_instance *af, struct mp_audio *data, int p)
+static void filter_plane_s16(struct af_instance *af, struct mp_audio *data,
+                             int p)
 {
     struct priv *s = af->priv;
 
-    float level = s->level * s->rgain;
+    int vol = 256.0 * s->level * s->rgain;
     int num_samples = data->samples * data->spf;
-
-    if (af_fmt_from_planar(af->data->format) == AF_FORMAT_S16) {
-        int vol = 256.0 * level;
-        if (vol != 256) {
-            if (af_make_writeable(af, data) < 0)
-                return; // oom
-            int16_t *a = data->planes[p];
-            for (int i = 0; i < num_samples; i++) {
-                int x = (a[i] * vol) >> 8;
-                a[i] = MPCLAMP(x, SHRT_MIN, SHRT_MAX);
-            }
-        }
-    } else if (af_fmt_from_planar(af->data->format) == AF_FORMAT_FLOAT) {
-        float vol = level;
-        if (vol != 1.0) {
-            if (af_make_writeable(af, data) < 0)
-                return; // oom
-            float *a = data->planes[p];
-            for (int i = 0; i < num_samples; i++) {
-                float x = a[i] * vol;
-                a[i] = s->soft ? af_softclip(x) : MPCLAMP(x, -1.0, 1.0);
-            }
-        }
+    int16_t *a = data->planes[p];
+    for (int i = 0; i < num_samples; i++) {
+        int x = (a[i] * vol) >> 8;
+        a[i] = MPCLAMP(x, SHRT_MIN, SHRT_MAX);
     }
 }
 
 static int filter(struct af_instance *af, struct mp_audio *data)
 {
-    if (data) {
-        for (int n = 0; n < data->num_planes; n++)
-            filter_plane(af, data, n);
+    struct priv *s = af->priv;
+
+    if (!data)
+        return 0;
+
+    float level = s->level * s->rgain;
+    struct mp_audio *out = data;
+    if (data->format != af->data->format) {
+        out = mp_audio_pool_get(af->out_pool, af->data, data->samples);
+        if (!out) {
+            talloc_free(data);
+            return -1;
+        }
+        mp_audio_copy_attributes(out, data);
+    } else if (s->fast && af_fmt_from_planar(data->format) == AF_FORMAT_S16) {
+        if ((int)(256.0 * level) != 256) {
+            if (af_make_writeable(af, data) < 0) {
+                talloc_free(data);
+                return -1;
+            }
+            for (int n = 0; n < data->num_planes; n++)
+                filter_plane_s16(af, data, n);
+        }
         af_add_output_frame(af, data);
+        return 0;
+    } else if (level != 1.0) {
+        if (af_make_writeable(af, data) < 0) {
+            talloc_free(data);
+            return -1;
+        }
+    }
+
+    // Gain, clipping and format conversion in one pass.
+    if (out != data || level != 1.0) {
+        struct mp_dsp_convert_params p = {
+            .in_type = sample_type(data->format),
+            .out_type = sample_type(out->format),
+            .in_planar = af_fmt_is_planar(data->format),
+            .out_planar = af_fmt_is_planar(out->format),
+            .channels = data->nch,
+            .gain = level,
+            .softclip = s->soft,
+        };
+        mp_dsp_convert(s->dsp, &p, out->planes, data->planes, data->samples);
+    }
+    if (out != data) {
+        out->samples = data->samples;
+        talloc_free(data);
     }
+    af_add_output_frame(af, out);
     return 0;
 }
 
@@ -144,6 +202,7 @@ static int af_open(struct af_instance *af)
     struct priv *s = af->priv;
     af->control = control;
     af->filter_frame = filter;
+    s->dsp = mp_dsp_get(-1);
     af_from_dB(1, &s->cfg_volume, &s->level, 20.0, -200.0, 60.0);
     return AF_OK;
 }
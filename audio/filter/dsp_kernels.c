@@ -0,0 +1,987 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <libavcodec/avfft.h>
+#include <libavutil/cpu.h>
+#include <libavutil/mem.h>
+
+#include "common/common.h"
+#include "af.h"
+#include "dsp_kernels.h"
+
+// The SIMD code is compiled with per-function target attributes, so the rest
+// of the binary still runs on CPUs without these instruction sets.
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define HAVE_X86_INTRINSICS 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_INTRINSICS 0
+#endif
+
+static float dot_c(const float *a, const float *b, int n)
+{
+    float sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static void blend_c(float *dst, const float *a, const float *b, const float *t,
+                    int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] = a[i] - t[i] * (a[i] - b[i]);
+}
+
+static void gain_clip_c(float *dst, const float *src, float gain, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] = MPCLAMP(src[i] * gain, -1.0f, 1.0f);
+}
+
+static void from_s16_c(float *dst, const int16_t *src, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] = src[i] * (1.0f / (1 << 15));
+}
+
+static void from_s32_c(float *dst, const int32_t *src, int n)
+{
+    for (int i = 0; i < n; i++)
+        dst[i] = src[i] * (1.0f / (1U << 31));
+}
+
+static void to_s16_c(int16_t *dst, const float *src, int n)
+{
+    for (int i = 0; i < n; i++) {
+        float v = MPCLAMP(src[i] * (1 << 15), INT16_MIN, INT16_MAX);
+        dst[i] = lrintf(v);
+    }
+}
+
+static void to_s32_c(int32_t *dst, const float *src, int n)
+{
+    for (int i = 0; i < n; i++) {
+        float v = src[i] * (1U << 31);
+        if (v >= 2147483648.0f) {
+            dst[i] = INT32_MAX;
+        } else if (v <= -2147483648.0f) {
+            dst[i] = INT32_MIN;
+        } else {
+            dst[i] = lrintf(v);
+        }
+    }
+}
+
+static void spectrum_mac_c(float *acc, const float *a, const float *b, int n)
+{
+    // DC and Nyquist bins are real.
+    acc[0] += a[0] * b[0];
+    acc[1] += a[1] * b[1];
+    for (int i = 2; i < n; i += 2) {
+        acc[i] += a[i] * b[i] - a[i + 1] * b[i + 1];
+        acc[i + 1] += a[i] * b[i + 1] + a[i + 1] * b[i];
+    }
+}
+
+static void biquad4_c(float *x, int stride, int n, const float *c, float *z,
+                      int stages)
+{
+    for (int i = 0; i < n; i++) {
+        for (int l = 0; l < 4; l++) {
+            float v = x[i * stride + l];
+            for (int s = 0; s < stages; s++) {
+                const float *sc = c + s * 24 + l;
+                float *sz = z + s * 8 + l;
+                float y = sc[0] * v + sz[0];
+                sz[0] = sc[4] * v - sc[12] * y + sz[4];
+                sz[4] = sc[8] * v - sc[16] * y;
+                v = sc[20] * v + y;
+            }
+            x[i * stride + l] = v;
+        }
+    }
+}
+
+static const struct mp_dsp_funcs funcs_c = {
+    .name = "C",
+    .dot = dot_c,
+    .blend = blend_c,
+    .gain_clip = gain_clip_c,
+    .from_s16 = from_s16_c,
+    .from_s32 = from_s32_c,
+    .to_s16 = to_s16_c,
+    .to_s32 = to_s32_c,
+    .spectrum_mac = spectrum_mac_c,
+    .biquad4 = biquad4_c,
+};
+
+#if HAVE_X86_INTRINSICS
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX __attribute__((target("avx")))
+
+// 4 independent accumulators, to hide the latency of the additions.
+SSE2 static float dot_sse2(const float *a, const float *b, int n)
+{
+    __m128 s0 = _mm_setzero_ps(), s1 = s0, s2 = s0, s3 = s0;
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i),
+                                       _mm_loadu_ps(b + i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4),
+                                       _mm_loadu_ps(b + i + 4)));
+        s2 = _mm_add_ps(s2, _mm_mul_ps(_mm_loadu_ps(a + i + 8),
+                                       _mm_loadu_ps(b + i + 8)));
+        s3 = _mm_add_ps(s3, _mm_mul_ps(_mm_loadu_ps(a + i + 12),
+                                       _mm_loadu_ps(b + i + 12)));
+    }
+    for (; i + 4 <= n; i += 4)
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    float tmp[4];
+    _mm_storeu_ps(tmp, _mm_add_ps(_mm_add_ps(s0, s1), _mm_add_ps(s2, s3)));
+    float sum = (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+SSE2 static void blend_sse2(float *dst, const float *a, const float *b,
+                           const float *t, int n)
+{
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 va = _mm_loadu_ps(a + i);
+        __m128 d = _mm_sub_ps(va, _mm_loadu_ps(b + i));
+        _mm_storeu_ps(dst + i, _mm_sub_ps(va, _mm_mul_ps(_mm_loadu_ps(t + i), d)));
+    }
+    blend_c(dst + i, a + i, b + i, t + i, n - i);
+}
+
+SSE2 static void gain_clip_sse2(float *dst, const float *src, float gain,
+                                int n)
+{
+    __m128 g = _mm_set1_ps(gain), lo = _mm_set1_ps(-1), hi = _mm_set1_ps(1);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+        _mm_storeu_ps(dst + i, _mm_min_ps(_mm_max_ps(v, lo), hi));
+    }
+    gain_clip_c(dst + i, src + i, gain, n - i);
+}
+
+SSE2 static void from_s16_sse2(float *dst, const int16_t *src, int n)
+{
+    __m128 scale = _mm_set1_ps(1.0f / (1 << 15));
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        // Sign-extend by putting the samples into the upper 16 bits.
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    from_s16_c(dst + i, src + i, n - i);
+}
+
+SSE2 static void from_s32_sse2(float *dst, const int32_t *src, int n)
+{
+    __m128 scale = _mm_set1_ps(1.0f / (1U << 31));
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+    }
+    from_s32_c(dst + i, src + i, n - i);
+}
+
+// _mm_cvtps_epi32() rounds to nearest even like lrintf() (with the default
+// rounding mode), and _mm_packs_epi32() saturates.
+SSE2 static void to_s16_sse2(int16_t *dst, const float *src, int n)
+{
+    __m128 scale = _mm_set1_ps(1 << 15);
+    __m128 lo = _mm_set1_ps(INT16_MIN), hi = _mm_set1_ps(INT16_MAX);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+        a = _mm_min_ps(_mm_max_ps(a, lo), hi);
+        b = _mm_min_ps(_mm_max_ps(b, lo), hi);
+        __m128i r = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128((__m128i *)(dst + i), r);
+    }
+    to_s16_c(dst + i, src + i, n - i);
+}
+
+SSE2 static void to_s32_sse2(int32_t *dst, const float *src, int n)
+{
+    __m128 scale = _mm_set1_ps(1U << 31);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+        // Out of range values become INT32_MIN; flip the positive ones to
+        // INT32_MAX.
+        __m128i over = _mm_castps_si128(_mm_cmpge_ps(v, scale));
+        __m128i r = _mm_xor_si128(_mm_cvtps_epi32(v), over);
+        _mm_storeu_si128((__m128i *)(dst + i), r);
+    }
+    to_s32_c(dst + i, src + i, n - i);
+}
+
+// Complex multiplication of 2 pairs: (ar * br - ai * bi, ar * bi + ai * br).
+SSE2 static void spectrum_mac_sse2(float *acc, const float *a, const float *b,
+                                   int n)
+{
+    __m128 sign = _mm_castsi128_ps(_mm_set_epi32(0, 1u << 31, 0, 1u << 31));
+    float dc = acc[0] + a[0] * b[0], ny = acc[1] + a[1] * b[1];
+    int i = 2;
+    for (; i + 4 <= n; i += 4) {
+        __m128 va = _mm_loadu_ps(a + i), vb = _mm_loadu_ps(b + i);
+        __m128 re = _mm_shuffle_ps(va, va, _MM_SHUFFLE(2, 2, 0, 0));
+        __m128 im = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 3, 1, 1));
+        __m128 sw = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(2, 3, 0, 1));
+        __m128 r = _mm_add_ps(_mm_mul_ps(re, vb),
+                              _mm_xor_ps(_mm_mul_ps(im, sw), sign));
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), r));
+    }
+    for (; i < n; i += 2) {
+        float re = a[i] * b[i] - a[i + 1] * b[i + 1];
+        float im = a[i] * b[i + 1] + a[i + 1] * b[i];
+        acc[i] += re;
+        acc[i + 1] += im;
+    }
+    acc[0] = dc;
+    acc[1] = ny;
+}
+
+SSE2 static void biquad4_sse2(float *x, int stride, int n, const float *c,
+                              float *z, int stages)
+{
+    for (int i = 0; i < n; i++) {
+        __m128 v = _mm_loadu_ps(x + i * stride);
+        for (int s = 0; s < stages; s++) {
+            const float *sc = c + s * 24;
+            float *sz = z + s * 8;
+            __m128 y = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(sc), v),
+                                  _mm_loadu_ps(sz));
+            __m128 z0 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(sc + 4), v),
+                                              _mm_mul_ps(_mm_loadu_ps(sc + 12), y)),
+                                   _mm_loadu_ps(sz + 4));
+            __m128 z1 = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(sc + 8), v),
+                                   _mm_mul_ps(_mm_loadu_ps(sc + 16), y));
+            _mm_storeu_ps(sz, z0);
+            _mm_storeu_ps(sz + 4, z1);
+            v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(sc + 20), v), y);
+        }
+        _mm_storeu_ps(x + i * stride, v);
+    }
+}
+
+static const struct mp_dsp_funcs funcs_sse2 = {
+    .name = "SSE2",
+    .dot = dot_sse2,
+    .blend = blend_sse2,
+    .gain_clip = gain_clip_sse2,
+    .from_s16 = from_s16_sse2,
+    .from_s32 = from_s32_sse2,
+    .to_s16 = to_s16_sse2,
+    .to_s32 = to_s32_sse2,
+    .spectrum_mac = spectrum_mac_sse2,
+    .biquad4 = biquad4_sse2,
+};
+
+AVX static float dot_avx(const float *a, const float *b, int n)
+{
+    __m256 s0 = _mm256_setzero_ps(), s1 = s0, s2 = s0, s3 = s0;
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+                                             _mm256_loadu_ps(b + i)));
+        s1 = _mm256_add_ps(s1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8),
+                                             _mm256_loadu_ps(b + i + 8)));
+        s2 = _mm256_add_ps(s2, _mm256_mul_ps(_mm256_loadu_ps(a + i + 16),
+                                             _mm256_loadu_ps(b + i + 16)));
+        s3 = _mm256_add_ps(s3, _mm256_mul_ps(_mm256_loadu_ps(a + i + 24),
+                                             _mm256_loadu_ps(b + i + 24)));
+    }
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+                                             _mm256_loadu_ps(b + i)));
+    }
+    __m256 s = _mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3));
+    __m128 h = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+    float tmp[4];
+    _mm_storeu_ps(tmp, h);
+    float sum = (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+AVX static void blend_avx(float *dst, const float *a, const float *b,
+                          const float *t, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 va = _mm256_loadu_ps(a + i);
+        __m256 d = _mm256_sub_ps(va, _mm256_loadu_ps(b + i));
+        _mm256_storeu_ps(dst + i, _mm256_sub_ps(va,
+                                  _mm256_mul_ps(_mm256_loadu_ps(t + i), d)));
+    }
+    blend_c(dst + i, a + i, b + i, t + i, n - i);
+}
+
+AVX static void gain_clip_avx(float *dst, const float *src, float gain, int n)
+{
+    __m256 g = _mm256_set1_ps(gain);
+    __m256 lo = _mm256_set1_ps(-1), hi = _mm256_set1_ps(1);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_mul_ps(_mm256_loadu_ps(src + i), g);
+        _mm256_storeu_ps(dst + i, _mm256_min_ps(_mm256_max_ps(v, lo), hi));
+    }
+    gain_clip_c(dst + i, src + i, gain, n - i);
+}
+
+AVX static void spectrum_mac_avx(float *acc, const float *a, const float *b,
+                                 int n)
+{
+    __m256 sign = _mm256_castsi256_ps(_mm256_set1_epi64x(1ull << 31));
+    float dc = acc[0] + a[0] * b[0], ny = acc[1] + a[1] * b[1];
+    int i = 2;
+    for (; i + 8 <= n; i += 8) {
+        __m256 va = _mm256_loadu_ps(a + i), vb = _mm256_loadu_ps(b + i);
+        __m256 re = _mm256_moveldup_ps(va);
+        __m256 im = _mm256_movehdup_ps(va);
+        __m256 sw = _mm256_permute_ps(vb, _MM_SHUFFLE(2, 3, 0, 1));
+        __m256 r = _mm256_add_ps(_mm256_mul_ps(re, vb),
+                                 _mm256_xor_ps(_mm256_mul_ps(im, sw), sign));
+        _mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i), r));
+    }
+    for (; i < n; i += 2) {
+        float re = a[i] * b[i] - a[i + 1] * b[i + 1];
+        float im = a[i] * b[i + 1] + a[i + 1] * b[i];
+        acc[i] += re;
+        acc[i + 1] += im;
+    }
+    acc[0] = dc;
+    acc[1] = ny;
+}
+
+// AVX has no 256 bit integer operations, so the conversions are SSE2 only.
+// The biquads are recursive, so 8 lanes would only help with more than 4
+// channels; use the SSE2 version.
+static const struct mp_dsp_funcs funcs_avx = {
+    .name = "AVX",
+    .dot = dot_avx,
+    .blend = blend_avx,
+    .gain_clip = gain_clip_avx,
+    .from_s16 = from_s16_sse2,
+    .from_s32 = from_s32_sse2,
+    .to_s16 = to_s16_sse2,
+    .to_s32 = to_s32_sse2,
+    .spectrum_mac = spectrum_mac_avx,
+    .biquad4 = biquad4_sse2,
+};
+
+#endif
+
+const struct mp_dsp_funcs *mp_dsp_get(int max_level)
+{
+    if (max_level < 0 || max_level >= MP_DSP_COUNT)
+        max_level = MP_DSP_COUNT - 1;
+#if HAVE_X86_INTRINSICS
+    int flags = av_get_cpu_flags();
+    if (max_level >= MP_DSP_AVX && (flags & AV_CPU_FLAG_AVX))
+        return &funcs_avx;
+    if (max_level >= MP_DSP_SSE2 && (flags & AV_CPU_FLAG_SSE2))
+        return &funcs_sse2;
+#endif
+    return &funcs_c;
+}
+
+// Samples per channel converted at once. Small enough to keep the temporary
+// buffer in the L1 cache.
+#define CONVERT_CHUNK 256
+
+static int sample_size(int type)
+{
+    return type == MP_DSP_S16 ? 2 : 4;
+}
+
+static void load_samples(const struct mp_dsp_funcs *f, float *dst,
+                         const void *src, int type, int stride, int n)
+{
+    if (stride == 1) {
+        switch (type) {
+        case MP_DSP_S16:   f->from_s16(dst, src, n); break;
+        case MP_DSP_S32:   f->from_s32(dst, src, n); break;
+        case MP_DSP_FLOAT: memcpy(dst, src, n * sizeof(float)); break;
+        }
+        return;
+    }
+    // Deinterleaving: gather, then convert in the temporary buffer.
+    switch (type) {
+    case MP_DSP_S16: {
+        int16_t tmp[CONVERT_CHUNK];
+        for (int i = 0; i < n; i++)
+            tmp[i] = ((const int16_t *)src)[i * stride];
+        f->from_s16(dst, tmp, n);
+        break;
+    }
+    case MP_DSP_S32: {
+        int32_t tmp[CONVERT_CHUNK];
+        for (int i = 0; i < n; i++)
+            tmp[i] = ((const int32_t *)src)[i * stride];
+        f->from_s32(dst, tmp, n);
+        break;
+    }
+    case MP_DSP_FLOAT:
+        for (int i = 0; i < n; i++)
+            dst[i] = ((const float *)src)[i * stride];
+        break;
+    }
+}
+
+static void store_samples(const struct mp_dsp_funcs *f, void *dst,
+                          const float *src, int type, int stride, int n)
+{
+    if (stride == 1) {
+        switch (type) {
+        case MP_DSP_S16:   f->to_s16(dst, src, n); break;
+        case MP_DSP_S32:   f->to_s32(dst, src, n); break;
+        case MP_DSP_FLOAT: memcpy(dst, src, n * sizeof(float)); break;
+        }
+        return;
+    }
+    // Interleaving: convert in the temporary buffer, then scatter.
+    switch (type) {
+    case MP_DSP_S16: {
+        int16_t tmp[CONVERT_CHUNK];
+        f->to_s16(tmp, src, n);
+        for (int i = 0; i < n; i++)
+            ((int16_t *)dst)[i * stride] = tmp[i];
+        break;
+    }
+    case MP_DSP_S32: {
+        int32_t tmp[CONVERT_CHUNK];
+        f->to_s32(tmp, src, n);
+        for (int i = 0; i < n; i++)
+            ((int32_t *)dst)[i * stride] = tmp[i];
+        break;
+    }
+    case MP_DSP_FLOAT:
+        for (int i = 0; i < n; i++)
+            ((float *)dst)[i * stride] = src[i];
+        break;
+    }
+}
+
+static void apply_gain(const struct mp_dsp_funcs *f,
+                       const struct mp_dsp_convert_params *p, float *buf, int n)
+{
+    if (p->gain == 1.0f)
+        return;
+    if (p->softclip) {
+        for (int i = 0; i < n; i++)
+            buf[i] = af_softclip(buf[i] * p->gain);
+    } else {
+        f->gain_clip(buf, buf, p->gain, n);
+    }
+}
+
+void mp_dsp_convert(const struct mp_dsp_funcs *f,
+                    const struct mp_dsp_convert_params *p,
+                    void **dst, void **src, int samples)
+{
+    // If the layouts are the same, the channels don't need to be separated:
+    // process each plane as a single stream of samples.
+    bool same_layout = p->in_planar == p->out_planar || p->channels == 1;
+    int streams = same_layout ? (p->in_planar ? p->channels : 1) : p->channels;
+    int len = same_layout && !p->in_planar ? samples * p->channels : samples;
+    int in_stride = same_layout || p->in_planar ? 1 : p->channels;
+    int out_stride = same_layout || p->out_planar ? 1 : p->channels;
+    int in_size = sample_size(p->in_type), out_size = sample_size(p->out_type);
+
+    float buf[CONVERT_CHUNK];
+    for (int c = 0; c < streams; c++) {
+        const char *in = src[p->in_planar ? c : 0];
+        char *out = dst[p->out_planar ? c : 0];
+        if (!same_layout) {
+            // Interleaved side: the channel starts at its first sample.
+            if (!p->in_planar)
+                in += c * in_size;
+            if (!p->out_planar)
+                out += c * out_size;
+        }
+        for (int pos = 0; pos < len; pos += CONVERT_CHUNK) {
+            int n = MPMIN(len - pos, CONVERT_CHUNK);
+            const char *in_ptr = in + (size_t)pos * in_stride * in_size;
+            char *out_ptr = out + (size_t)pos * out_stride * out_size;
+            if (p->in_type == MP_DSP_FLOAT && p->out_type == MP_DSP_FLOAT &&
+                in_stride == 1 && out_stride == 1 && !p->softclip)
+            {
+                // Nothing to convert; avoid the copy to buf.
+                if (p->gain != 1.0f) {
+                    f->gain_clip((float *)out_ptr, (const float *)in_ptr,
+                                 p->gain, n);
+                } else if (out_ptr != in_ptr) {
+                    memcpy(out_ptr, in_ptr, n * sizeof(float));
+                }
+                continue;
+            }
+            load_samples(f, buf, in_ptr, p->in_type, in_stride, n);
+            apply_gain(f, p, buf, n);
+            store_samples(f, out_ptr, buf, p->out_type, out_stride, n);
+        }
+    }
+}
+
+struct mp_dsp_rfft {
+    int n;
+    RDFTContext *fwd, *inv;
+    float conj;     // -1 if libavcodec's imaginary parts have the other sign
+    float scale;    // makes the inverse exact
+};
+
+static void rfft_destroy(void *ptr)
+{
+    struct mp_dsp_rfft *f = ptr;
+    av_rdft_end(f->fwd);
+    av_rdft_end(f->inv);
+}
+
+struct mp_dsp_rfft *mp_dsp_rfft_create(void *ta_parent, int bits)
+{
+    if (bits < 4 || bits > 16)
+        return NULL;
+    struct mp_dsp_rfft *f = talloc_zero(ta_parent, struct mp_dsp_rfft);
+    talloc_set_destructor(f, rfft_destroy);
+    f->n = 1 << bits;
+    f->fwd = av_rdft_init(bits, DFT_R2C);
+    f->inv = av_rdft_init(bits, IDFT_C2R);
+    float *tmp = av_malloc(f->n * sizeof(float));
+    if (!f->fwd || !f->inv || !tmp) {
+        av_free(tmp);
+        talloc_free(f);
+        return NULL;
+    }
+    // The libavcodec API doesn't document the sign convention and scaling,
+    // so measure them: the transform of an impulse at x[1] has X[1] =
+    // e^(-2 pi i / n) with the convention used here.
+    memset(tmp, 0, f->n * sizeof(float));
+    tmp[1] = 1;
+    av_rdft_calc(f->fwd, tmp);
+    f->conj = tmp[3] > 0 ? -1 : 1;
+    av_rdft_calc(f->inv, tmp);
+    f->scale = 1.0 / tmp[1];
+    av_free(tmp);
+    return f;
+}
+
+void mp_dsp_rfft_forward(struct mp_dsp_rfft *f, float *data)
+{
+    av_rdft_calc(f->fwd, data);
+    if (f->conj < 0) {
+        for (int i = 3; i < f->n; i += 2)
+            data[i] = -data[i];
+    }
+}
+
+void mp_dsp_rfft_inverse(struct mp_dsp_rfft *f, float *data)
+{
+    if (f->conj < 0) {
+        for (int i = 3; i < f->n; i += 2)
+            data[i] = -data[i];
+    }
+    av_rdft_calc(f->inv, data);
+    for (int i = 0; i < f->n; i++)
+        data[i] *= f->scale;
+}
+
+struct mp_dsp_xcorr_priv {
+    int bits;
+    RDFTContext *fwd, *inv;
+};
+
+static void xcorr_destroy(void *ptr)
+{
+    struct mp_dsp_xcorr *c = ptr;
+    av_rdft_end(c->priv->fwd);
+    av_rdft_end(c->priv->inv);
+    av_free(c->a);
+    av_free(c->b);
+}
+
+// The FFT size: no wrap-around for any of the lags that are computed.
+// libavcodec supports 4 to 16 bits.
+static int xcorr_bits(int b_len)
+{
+    int bits = 4;
+    while ((1 << bits) < b_len)
+        bits++;
+    return bits;
+}
+
+struct mp_dsp_xcorr *mp_dsp_xcorr_create(void *ta_parent, int a_len, int b_len)
+{
+    if (a_len < 1 || b_len < a_len || xcorr_bits(b_len) > 16)
+        return NULL;
+    struct mp_dsp_xcorr *c = talloc_zero(ta_parent, struct mp_dsp_xcorr);
+    c->priv = talloc_zero(c, struct mp_dsp_xcorr_priv);
+    talloc_set_destructor(c, xcorr_destroy);
+    c->a_len = a_len;
+    c->b_len = b_len;
+    struct mp_dsp_xcorr_priv *p = c->priv;
+    p->bits = xcorr_bits(b_len);
+    p->fwd = av_rdft_init(p->bits, DFT_R2C);
+    p->inv = av_rdft_init(p->bits, IDFT_C2R);
+    c->a = av_malloc(sizeof(float) << p->bits);
+    c->b = av_malloc(sizeof(float) << p->bits);
+    if (!p->fwd || !p->inv || !c->a || !c->b) {
+        talloc_free(c);
+        return NULL;
+    }
+    return c;
+}
+
+float *mp_dsp_xcorr_run(struct mp_dsp_xcorr *c)
+{
+    struct mp_dsp_xcorr_priv *p = c->priv;
+    int n = 1 << p->bits;
+    float *a = c->a, *b = c->b;
+    memset(a + c->a_len, 0, (n - c->a_len) * sizeof(float));
+    memset(b + c->b_len, 0, (n - c->b_len) * sizeof(float));
+
+    av_rdft_calc(p->fwd, a);
+    av_rdft_calc(p->fwd, b);
+
+    // b = conj(a) * b; the first 2 values are the (real) DC and Nyquist bins.
+    b[0] *= a[0];
+    b[1] *= a[1];
+    for (int i = 2; i < n; i += 2) {
+        float re = a[i] * b[i] + a[i + 1] * b[i + 1];
+        float im = a[i] * b[i + 1] - a[i + 1] * b[i];
+        b[i] = re;
+        b[i + 1] = im;
+    }
+
+    av_rdft_calc(p->inv, b);
+    return b;
+}
+
+int64_t mp_dsp_xcorr_cost(int a_len, int b_len)
+{
+    // 3 real FFTs and the multiplication. The factor is a conservative
+    // estimate relative to the SSE dot product; TOOLS/bench/dsp_kernels
+    // shows whether the choice is right on a given machine.
+    int bits = xcorr_bits(b_len);
+    return (int64_t)6 * (bits + 1) << bits;
+}
+
+// Samples processed per mp_dsp_fir/mp_dsp_iir inner loop call.
+#define FIR_RUN 256
+
+struct mp_dsp_fir {
+    const struct mp_dsp_funcs *f;
+    // Direct part: dst[i] = dot(rtaps, hist + i), with hist_len past samples
+    // followed by the new ones in hist.
+    float *rtaps;
+    int num_rtaps;
+    float *hist;
+    int hist_len;
+    // FFT part, for the taps after the first partition.
+    int part;               // partition size, 0 if not used
+    int num_parts;
+    struct mp_dsp_rfft *fft;
+    float **taps_spec;      // num_parts spectra of (2 * part) floats
+    float **input_spec;     // the same number of past input spectra
+    int input_pos;          // index of the newest in input_spec
+    float *input;           // the previous and current input partitions
+    float *tail;            // FFT part of the output for current partition
+    float *work;            // 2 * part floats
+    int pos;                // position within the current partition
+};
+
+static void fir_destroy(void *ptr)
+{
+    struct mp_dsp_fir *fir = ptr;
+    for (int n = 0; n < fir->num_parts; n++) {
+        av_free(fir->taps_spec[n]);
+        av_free(fir->input_spec[n]);
+    }
+    av_free(fir->work);
+}
+
+// Cost per sample of the FFT convolution in units of dot product
+// multiply-adds, for len taps and the given partition size. The factors
+// are rough, and the same for all SIMD levels, although vectorization speeds
+// up the direct part more than the FFT. TOOLS/bench/dsp_kernels compares the
+// choice with the alternatives.
+static double fir_fft_cost(int len, int part)
+{
+    int bits = 1;
+    while ((1 << bits) < part * 2)
+        bits++;
+    int parts = (len - 1) / part;
+    // Per partition: 2 FFTs (and the scaling/copying around them), the
+    // spectrum multiplications, and the per call overhead.
+    double block = 2 * part * (3.6 * bits + 8 + 3 * parts) + 50 * (parts + 6);
+    // Plus the direct part for the first partition.
+    return part + block / part;
+}
+
+// The direct computation skips the delay, the FFT part doesn't.
+static int fir_choose_partition(int len, int num_taps)
+{
+    int best = 0;
+    double best_cost = num_taps;
+    for (int part = 16; part < len && part <= 8192; part *= 2) {
+        double cost = fir_fft_cost(len, part);
+        if (cost < best_cost) {
+            best = part;
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+struct mp_dsp_fir *mp_dsp_fir_create(void *ta_parent,
+                                     const struct mp_dsp_funcs *f,
+                                     const float *taps, int num_taps,
+                                     int delay, int partition)
+{
+    if (num_taps < 1 || delay < 0)
+        return NULL;
+    struct mp_dsp_fir *fir = talloc_zero(ta_parent, struct mp_dsp_fir);
+    talloc_set_destructor(fir, fir_destroy);
+    fir->f = f;
+
+    // The FFT part works on the taps with the delay as leading zeros.
+    int len = delay + num_taps;
+    int part = partition;
+    if (part == 0)
+        part = fir_choose_partition(len, num_taps);
+    if (part > 0 && (part < 8 || part > 32768 || (part & (part - 1)))) {
+        talloc_free(fir);
+        return NULL;
+    }
+    // Without taps after the first partition, it's just the direct part.
+    if (part < 0 || part >= len)
+        part = 0;
+
+    if (!part) {
+        fir->num_rtaps = num_taps;
+        fir->hist_len = delay + num_taps - 1;
+        fir->rtaps = talloc_array(fir, float, num_taps);
+        for (int n = 0; n < num_taps; n++)
+            fir->rtaps[n] = taps[num_taps - 1 - n];
+    } else {
+        float *padded = talloc_zero_array(fir, float, len);
+        memcpy(padded + delay, taps, num_taps * sizeof(float));
+
+        fir->part = part;
+        fir->num_parts = (len - 1) / part;
+        fir->num_rtaps = part;
+        fir->hist_len = part - 1;
+        fir->rtaps = talloc_array(fir, float, part);
+        for (int n = 0; n < part; n++)
+            fir->rtaps[n] = padded[part - 1 - n];
+
+        int bits = 1;
+        while ((1 << bits) < part * 2)
+            bits++;
+        fir->fft = mp_dsp_rfft_create(fir, bits);
+        fir->taps_spec = talloc_zero_array(fir, float *, fir->num_parts);
+        fir->input_spec = talloc_zero_array(fir, float *, fir->num_parts);
+        fir->work = av_malloc(2 * part * sizeof(float));
+        if (!fir->fft || !fir->work)
+            goto fail;
+        for (int n = 0; n < fir->num_parts; n++) {
+            float *t = fir->taps_spec[n] = av_malloc(2 * part * sizeof(float));
+            fir->input_spec[n] = av_malloc(2 * part * sizeof(float));
+            if (!t || !fir->input_spec[n])
+                goto fail;
+            // Partition n + 1 of the taps, zero padded.
+            int start = (n + 1) * part;
+            int cnt = MPMIN(part, len - start);
+            memset(t, 0, 2 * part * sizeof(float));
+            memcpy(t, padded + start, cnt * sizeof(float));
+            mp_dsp_rfft_forward(fir->fft, t);
+        }
+        fir->input = talloc_array(fir, float, 2 * part);
+        fir->tail = talloc_array(fir, float, part);
+        talloc_free(padded);
+    }
+    fir->hist = talloc_array(fir, float, fir->hist_len + FIR_RUN);
+    mp_dsp_fir_reset(fir);
+    return fir;
+
+fail:
+    talloc_free(fir);
+    return NULL;
+}
+
+void mp_dsp_fir_reset(struct mp_dsp_fir *fir)
+{
+    memset(fir->hist, 0, fir->hist_len * sizeof(float));
+    if (fir->part) {
+        for (int n = 0; n < fir->num_parts; n++)
+            memset(fir->input_spec[n], 0, 2 * fir->part * sizeof(float));
+        memset(fir->input, 0, 2 * fir->part * sizeof(float));
+        memset(fir->tail, 0, fir->part * sizeof(float));
+        fir->input_pos = 0;
+        fir->pos = 0;
+    }
+}
+
+int mp_dsp_fir_partition(struct mp_dsp_fir *fir)
+{
+    return fir->part;
+}
+
+// A partition of input is complete: compute the FFT part of the output for
+// the next one (sum of taps_spec[k] * input_spec[newest - k]).
+static void fir_next_partition(struct mp_dsp_fir *fir)
+{
+    int part = fir->part, size = 2 * part;
+    fir->input_pos = (fir->input_pos + 1) % fir->num_parts;
+    float *spec = fir->input_spec[fir->input_pos];
+    memcpy(spec, fir->input, size * sizeof(float));
+    mp_dsp_rfft_forward(fir->fft, spec);
+    memmove(fir->input, fir->input + part, part * sizeof(float));
+
+    float *acc = fir->work;
+    memset(acc, 0, size * sizeof(float));
+    for (int k = 0; k < fir->num_parts; k++) {
+        int idx = (fir->input_pos - k + fir->num_parts) % fir->num_parts;
+        fir->f->spectrum_mac(acc, fir->taps_spec[k], fir->input_spec[idx],
+                             size);
+    }
+    mp_dsp_rfft_inverse(fir->fft, acc);
+    // Overlap-save: the second half is the valid part.
+    memcpy(fir->tail, acc + part, part * sizeof(float));
+}
+
+void mp_dsp_fir_process(struct mp_dsp_fir *fir, float *dst, const float *src,
+                        int n)
+{
+    while (n > 0) {
+        int run = MPMIN(n, FIR_RUN);
+        if (fir->part)
+            run = MPMIN(run, fir->part - fir->pos);
+        float *hist = fir->hist;
+        memcpy(hist + fir->hist_len, src, run * sizeof(float));
+        if (fir->part)
+            memcpy(fir->input + fir->part + fir->pos, src, run * sizeof(float));
+        for (int i = 0; i < run; i++)
+            dst[i] = fir->f->dot(fir->rtaps, hist + i, fir->num_rtaps);
+        if (fir->part) {
+            for (int i = 0; i < run; i++)
+                dst[i] += fir->tail[fir->pos + i];
+            fir->pos += run;
+            if (fir->pos == fir->part) {
+                fir_next_partition(fir);
+                fir->pos = 0;
+            }
+        }
+        memmove(hist, hist + run, fir->hist_len * sizeof(float));
+        src += run;
+        dst += run;
+        n -= run;
+    }
+}
+
+struct mp_dsp_iir {
+    const struct mp_dsp_funcs *f;
+    int channels, stages;
+    // Per group of 4 channels: see mp_dsp_funcs.biquad4.
+    float *coeffs;
+    float *state;
+};
+
+struct mp_dsp_iir *mp_dsp_iir_create(void *ta_parent,
+                                     const struct mp_dsp_funcs *f,
+                                     int channels, int stages)
+{
+    struct mp_dsp_iir *iir = talloc_zero(ta_parent, struct mp_dsp_iir);
+    int groups = (channels + 3) / 4;
+    iir->f = f;
+    iir->channels = channels;
+    iir->stages = stages;
+    iir->coeffs = talloc_zero_array(iir, float, groups * stages * 24);
+    iir->state = talloc_zero_array(iir, float, groups * stages * 8);
+    for (int c = 0; c < groups * 4; c++) {
+        for (int s = 0; s < stages; s++)
+            mp_dsp_iir_set(iir, c, s, &(struct mp_dsp_biquad){.b0 = 1});
+    }
+    return iir;
+}
+
+// Also used for the padding lanes (channel >= iir->channels).
+void mp_dsp_iir_set(struct mp_dsp_iir *iir, int channel, int stage,
+                    const struct mp_dsp_biquad *c)
+{
+    float *p = iir->coeffs + ((channel / 4) * iir->stages + stage) * 24 +
+               channel % 4;
+    p[0] = c->b0;
+    p[4] = c->b1;
+    p[8] = c->b2;
+    p[12] = c->a1;
+    p[16] = c->a2;
+    p[20] = c->d;
+}
+
+void mp_dsp_iir_process(struct mp_dsp_iir *iir, float *data, int samples)
+{
+    int nch = iir->channels;
+    for (int g = 0; g * 4 < nch; g++) {
+        const float *c = iir->coeffs + g * iir->stages * 24;
+        float *z = iir->state + g * iir->stages * 8;
+        int lanes = MPMIN(nch - g * 4, 4);
+        if (lanes == 4) {
+            iir->f->biquad4(data + g * 4, nch, samples, c, z, iir->stages);
+            continue;
+        }
+        // Pad the remaining channels to 4 lanes.
+        float tmp[FIR_RUN * 4] = {0};
+        for (int pos = 0; pos < samples; pos += FIR_RUN) {
+            int n = MPMIN(samples - pos, FIR_RUN);
+            float *p = data + pos * nch + g * 4;
+            for (int i = 0; i < n; i++) {
+                for (int l = 0; l < lanes; l++)
+                    tmp[i * 4 + l] = p[i * nch + l];
+            }
+            iir->f->biquad4(tmp, 4, n, c, z, iir->stages);
+            for (int i = 0; i < n; i++) {
+                for (int l = 0; l < lanes; l++)
+                    p[i * nch + l] = tmp[i * 4 + l];
+            }
+        }
+    }
+}
+
+void mp_dsp_iir_reset(struct mp_dsp_iir *iir)
+{
+    int groups = (iir->channels + 3) / 4;
+    memset(iir->state, 0, groups * iir->stages * 8 * sizeof(float));
+}
@@ -0,0 +1,178 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_AF_DSP_KERNELS_H
+#define MP_AF_DSP_KERNELS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Vectorized inner loops shared by the audio filters. All functions work on
+// float samples, and accept any alignment. Results may differ from the C
+// versions within float rounding (the summation order is different).
+
+enum {
+    MP_DSP_C,
+    MP_DSP_SSE2,
+    MP_DSP_AVX,
+    MP_DSP_COUNT
+};
+
+struct mp_dsp_funcs {
+    const char *name;
+    // Return sum(a[i] * b[i]) for 0 <= i < n.
+    float (*dot)(const float *a, const float *b, int n);
+    // dst[i] = a[i] - t[i] * (a[i] - b[i]), i.e. a crossfade from a to b
+    // with the weights t. dst can be the same as a or b.
+    void (*blend)(float *dst, const float *a, const float *b, const float *t,
+                  int n);
+    // dst[i] = clamp(src[i] * gain, -1, 1). dst can be the same as src.
+    void (*gain_clip)(float *dst, const float *src, float gain, int n);
+    // Sample format conversions, with the same scaling, rounding and
+    // saturation as libswresample (e.g. s16 = clip(lrintf(f * 32768))).
+    void (*from_s16)(float *dst, const int16_t *src, int n);
+    void (*from_s32)(float *dst, const int32_t *src, int n);
+    void (*to_s16)(int16_t *dst, const float *src, int n);
+    void (*to_s32)(int32_t *dst, const float *src, int n);
+    // acc += a * b, for spectra of n floats packed as with mp_dsp_rfft.
+    void (*spectrum_mac)(float *acc, const float *a, const float *b, int n);
+    // Cascade of biquads (transposed direct form II) on 4 channels at once,
+    // one per SIMD lane. x[i * stride + l] is sample i of lane l; filtered in
+    // place. c contains 6 vectors of 4 floats (b0, b1, b2, a1, a2, d) per
+    // stage, z 2 vectors of 4 floats (the state) per stage.
+    void (*biquad4)(float *x, int stride, int n, const float *c, float *z,
+                    int stages);
+};
+
+// Return the fastest implementation supported by the CPU, but not above
+// max_level (one of MP_DSP_*; -1 for no limit). Never NULL.
+const struct mp_dsp_funcs *mp_dsp_get(int max_level);
+
+// Sample types for mp_dsp_convert().
+enum mp_dsp_sample_type {
+    MP_DSP_S16,
+    MP_DSP_S32,
+    MP_DSP_FLOAT,
+};
+
+struct mp_dsp_convert_params {
+    int in_type, out_type;          // MP_DSP_S16 etc.
+    bool in_planar, out_planar;
+    int channels;
+    // If gain is not 1.0, the samples are multiplied with it and clipped to
+    // [-1, 1] (with af_softclip() if softclip is set), like af_volume does.
+    float gain;
+    bool softclip;
+};
+
+// Convert samples from src to dst, applying gain and clipping, in a single
+// pass over memory (the intermediate float samples stay in the L1 cache).
+// src and dst are plane pointers (one plane if not planar). Can be done in
+// place if both have the same type and layout.
+void mp_dsp_convert(const struct mp_dsp_funcs *f,
+                    const struct mp_dsp_convert_params *p,
+                    void **dst, void **src, int samples);
+
+// Real FFT of size 1 << bits (4 <= bits <= 16), using libavcodec. The
+// spectrum is packed as in libavcodec: data[0] and data[1] are the (real) DC
+// and Nyquist bins, followed by (re, im) pairs for the bins 1 to n/2-1. Unlike
+// with libavcodec, the sign convention is always X[k] = sum(x[j] e^(-2 pi i j k
+// / n)), and the inverse includes the 1/n scaling, so it is the exact inverse.
+// The data must be allocated with av_malloc() (SIMD alignment).
+struct mp_dsp_rfft;
+
+// Returns NULL on failure.
+struct mp_dsp_rfft *mp_dsp_rfft_create(void *ta_parent, int bits);
+void mp_dsp_rfft_forward(struct mp_dsp_rfft *f, float *data);
+void mp_dsp_rfft_inverse(struct mp_dsp_rfft *f, float *data);
+
+// Cross-correlation with FFTs:
+//   r[d] = sum(a[i] * b[i + d]) for 0 <= i < a_len, 0 <= d <= b_len - a_len
+struct mp_dsp_xcorr {
+    int a_len, b_len;
+    // Input buffers; the caller writes a_len and b_len samples.
+    float *a, *b;
+
+    struct mp_dsp_xcorr_priv *priv;
+};
+
+// Returns NULL if b_len < a_len, if b_len is larger than 65536, or on failure.
+struct mp_dsp_xcorr *mp_dsp_xcorr_create(void *ta_parent, int a_len, int b_len);
+
+// Compute the correlation of the current contents of c->a and c->b. Returns
+// r[0..b_len-a_len], which is valid until the next call. The input buffers
+// are overwritten. The result is scaled by an arbitrary positive factor, so
+// it's only useful for comparing values with each other.
+float *mp_dsp_xcorr_run(struct mp_dsp_xcorr *c);
+
+// Rough cost of mp_dsp_xcorr_run(), in the same unit as a plain dot product
+// of that many samples (as in mp_dsp_funcs.dot). For choosing between
+// mp_dsp_xcorr_run() and direct computation.
+int64_t mp_dsp_xcorr_cost(int a_len, int b_len);
+
+// FIR filter for a stream of samples:
+//   dst[t] = sum(taps[j] * src[t - delay - j]) for 0 <= j < num_taps
+// Short filters are computed directly. Longer ones use uniformly partitioned
+// FFT convolution for all but the first partition, which is still computed
+// directly, so that there is no added latency either way.
+struct mp_dsp_fir;
+
+// partition: 0 to choose automatically, -1 to force direct computation, or a
+// power of 2 >= 8 to force FFT convolution with that partition size.
+// Returns NULL on failure.
+struct mp_dsp_fir *mp_dsp_fir_create(void *ta_parent,
+                                     const struct mp_dsp_funcs *f,
+                                     const float *taps, int num_taps,
+                                     int delay, int partition);
+
+// Filter the next n samples. dst can be the same as src.
+void mp_dsp_fir_process(struct mp_dsp_fir *fir, float *dst, const float *src,
+                        int n);
+
+// Forget the past input.
+void mp_dsp_fir_reset(struct mp_dsp_fir *fir);
+
+// Partition size used for FFT convolution, or 0 if computed directly.
+int mp_dsp_fir_partition(struct mp_dsp_fir *fir);
+
+// Biquad (a0 normalized to 1), with an optional parallel direct path:
+//   v[t] = b0 x[t] + b1 x[t-1] + b2 x[t-2] - a1 v[t-1] - a2 v[t-2]
+//   y[t] = v[t] + d x[t]
+// d is the same as adding it to b0, but keeps filters of the form
+// x + gain * bandpass(x) precise with float samples.
+struct mp_dsp_biquad {
+    double b0, b1, b2, a1, a2, d;
+};
+
+// Cascades of biquads, one per channel, for interleaved audio. The channels
+// are processed in parallel (mp_dsp_funcs.biquad4).
+struct mp_dsp_iir;
+
+// All stages are initialized to pass through.
+struct mp_dsp_iir *mp_dsp_iir_create(void *ta_parent,
+                                     const struct mp_dsp_funcs *f,
+                                     int channels, int stages);
+void mp_dsp_iir_set(struct mp_dsp_iir *iir, int channel, int stage,
+                    const struct mp_dsp_biquad *c);
+
+// Filter interleaved samples in place.
+void mp_dsp_iir_process(struct mp_dsp_iir *iir, float *data, int samples);
+
+// Clear the filter state.
+void mp_dsp_iir_reset(struct mp_dsp_iir *iir);
+
+#endif
@@ -0,0 +1,364 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Phase vocoder: the input is cut into overlapping windowed frames, which are
+ * transformed to the frequency domain, and written back with a different
+ * overlap (the analysis hop is speed times the synthesis hop). The phase of
+ * each bin is advanced according to its measured instantaneous frequency,
+ * so that sinusoids continue smoothly across frames.
+ *
+ * Two refinements over the textbook version:
+ *  - Identity phase locking (Laroche & Dolson): only spectral peaks get a
+ *    new phase; the bins around each peak keep their phase relation to it.
+ *    This greatly reduces the typical "phasy" sound.
+ *  - Transient detection: on onsets (large jumps in spectral flux), the
+ *    phases are reset to the analysis phases, which keeps attacks sharp
+ *    instead of smearing them over the window.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <libavutil/mem.h>
+
+#include "common/common.h"
+#include "dsp_kernels.h"
+#include "stretch.h"
+
+#define MIN_BITS 8
+#define MAX_BITS 14
+
+// Onset if the spectral flux is this much higher than its running average.
+#define TRANSIENT_RATIO 2.5f
+
+struct chan {
+    float *in;              // input FIFO
+    float *acc;             // overlap-add buffer (n samples)
+    float *mag, *prev_mag;
+    float *phase, *prev_phase;
+    float *synth_phase;
+};
+
+struct mp_stretch {
+    struct mp_stretch_opts opts;
+    int nch, rate;
+    int n, hop, bins;
+    double speed;
+    struct mp_dsp_rfft *fft;
+    float *window;
+    float *buf;             // FFT work buffer
+    float norm;             // overlap-add gain compensation
+    int *peaks;
+    struct chan *ch;
+
+    int in_len, in_alloc;   // samples in each input FIFO
+    double in_pos;          // position of the next analysis frame
+    int last_frame_pos;     // position of the previous analysis frame
+    bool have_prev;         // prev_mag/prev_phase are valid
+    int out_avail;          // finished samples at the start of acc
+    int out_pos;            // of those, samples already returned
+    float flux_avg;
+
+    bool draining;
+    double out_expected;    // output samples for the input pushed so far
+};
+
+static void destroy(void *ptr)
+{
+    struct mp_stretch *s = ptr;
+    av_free(s->buf);
+}
+
+static float wrap_phase(float p)
+{
+    return p - (float)(2 * M_PI) * floorf(p / (float)(2 * M_PI) + 0.5f);
+}
+
+struct mp_stretch *mp_stretch_create(void *ta_parent, int nch, int rate,
+                                     const struct mp_stretch_opts *opts)
+{
+    if (nch < 1 || rate < 1)
+        return NULL;
+    struct mp_stretch *s = talloc_zero(ta_parent, struct mp_stretch);
+    talloc_set_destructor(s, destroy);
+    s->opts = *opts;
+    s->nch = nch;
+    s->rate = rate;
+    s->speed = 1.0;
+
+    int bits = lrint(log2(rate * opts->window_ms / 1000.0));
+    bits = MPCLAMP(bits, MIN_BITS, MAX_BITS);
+    s->n = 1 << bits;
+    s->hop = s->n / 4;
+    s->bins = s->n / 2 + 1;
+    s->fft = mp_dsp_rfft_create(s, bits);
+    s->buf = av_malloc(s->n * sizeof(float));
+    if (!s->fft || !s->buf) {
+        talloc_free(s);
+        return NULL;
+    }
+
+    // Periodic Hann window, applied before analysis and after synthesis. The
+    // squared window sums to 1.5 at 75% overlap.
+    s->window = talloc_array(s, float, s->n);
+    for (int i = 0; i < s->n; i++)
+        s->window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / s->n);
+    s->norm = 1 / 1.5f;
+    s->peaks = talloc_array(s, int, s->bins);
+
+    s->ch = talloc_zero_array(s, struct chan, nch);
+    for (int c = 0; c < nch; c++) {
+        struct chan *ch = &s->ch[c];
+        ch->acc = talloc_zero_array(s, float, s->n);
+        ch->mag = talloc_zero_array(s, float, s->bins);
+        ch->prev_mag = talloc_zero_array(s, float, s->bins);
+        ch->phase = talloc_zero_array(s, float, s->bins);
+        ch->prev_phase = talloc_zero_array(s, float, s->bins);
+        ch->synth_phase = talloc_zero_array(s, float, s->bins);
+    }
+    return s;
+}
+
+void mp_stretch_set_speed(struct mp_stretch *s, double speed)
+{
+    s->speed = MPMAX(speed, 0.01);
+}
+
+void mp_stretch_reset(struct mp_stretch *s)
+{
+    s->in_len = 0;
+    s->in_pos = 0;
+    s->last_frame_pos = 0;
+    s->have_prev = false;
+    s->out_avail = s->out_pos = 0;
+    s->flux_avg = 0;
+    s->draining = false;
+    s->out_expected = 0;
+    for (int c = 0; c < s->nch; c++)
+        memset(s->ch[c].acc, 0, s->n * sizeof(float));
+}
+
+static void append(struct mp_stretch *s, float **planes, int samples)
+{
+    if (s->in_len + samples > s->in_alloc) {
+        s->in_alloc = s->in_len + samples;
+        for (int c = 0; c < s->nch; c++)
+            s->ch[c].in = talloc_realloc(s, s->ch[c].in, float, s->in_alloc);
+    }
+    for (int c = 0; c < s->nch; c++) {
+        float *dst = s->ch[c].in + s->in_len;
+        if (planes) {
+            memcpy(dst, planes[c], samples * sizeof(float));
+        } else {
+            memset(dst, 0, samples * sizeof(float));
+        }
+    }
+    s->in_len += samples;
+}
+
+void mp_stretch_push(struct mp_stretch *s, float **planes, int samples)
+{
+    if (samples <= 0)
+        return;
+    // New input after a drain starts over. The silence appended by the drain
+    // must not end up in the output.
+    if (s->draining)
+        mp_stretch_reset(s);
+    append(s, planes, samples);
+    s->out_expected += samples / s->speed;
+}
+
+void mp_stretch_drain(struct mp_stretch *s)
+{
+    if (s->draining)
+        return;
+    // Enough silence to push the last real input sample through the window.
+    append(s, NULL, s->n);
+    s->draining = true;
+}
+
+// Analyze the frame at pos into ch->mag/ch->phase, and return its spectral
+// flux (increase of magnitudes relative to the previous frame).
+static float analyze(struct mp_stretch *s, struct chan *ch, int pos)
+{
+    float *buf = s->buf;
+    for (int i = 0; i < s->n; i++)
+        buf[i] = ch->in[pos + i] * s->window[i];
+    mp_dsp_rfft_forward(s->fft, buf);
+
+    ch->mag[0] = fabsf(buf[0]);
+    ch->phase[0] = buf[0] < 0 ? M_PI : 0;
+    ch->mag[s->bins - 1] = fabsf(buf[1]);
+    ch->phase[s->bins - 1] = buf[1] < 0 ? M_PI : 0;
+    for (int k = 1; k < s->bins - 1; k++) {
+        float re = buf[k * 2], im = buf[k * 2 + 1];
+        ch->mag[k] = sqrtf(re * re + im * im);
+        ch->phase[k] = atan2f(im, re);
+    }
+
+    float flux = 0;
+    for (int k = 0; k < s->bins; k++)
+        flux += MPMAX(ch->mag[k] - ch->prev_mag[k], 0);
+    return flux;
+}
+
+// Compute ch->synth_phase for the current frame; ha is the analysis hop.
+static void advance_phases(struct mp_stretch *s, struct chan *ch, int ha)
+{
+    float *mag = ch->mag, *phase = ch->phase, *synth = ch->synth_phase;
+    int num_peaks = 0;
+    if (s->opts.phase_lock) {
+        for (int k = 1; k < s->bins - 1; k++) {
+            if (mag[k] > mag[k - 1] && mag[k] >= mag[k + 1])
+                s->peaks[num_peaks++] = k;
+        }
+    }
+    bool lock = num_peaks > 0;
+    if (!lock) {
+        for (int k = 0; k < s->bins; k++)
+            s->peaks[k] = k;
+        num_peaks = s->bins;
+    }
+
+    // Propagate the phases of the peaks with their instantaneous frequency.
+    for (int i = 0; i < num_peaks; i++) {
+        int k = s->peaks[i];
+        float omega = 2 * M_PI * k / s->n;
+        float advance = omega * s->hop;
+        if (ha > 0) {
+            float dphi = wrap_phase(phase[k] - ch->prev_phase[k] - omega * ha);
+            advance += dphi * s->hop / ha;
+        }
+        synth[k] = wrap_phase(synth[k] + advance);
+    }
+    if (!lock)
+        return;
+
+    // All other bins keep their phase relative to the closest peak.
+    int cur = 0;
+    for (int k = 0; k < s->bins; k++) {
+        while (cur + 1 < num_peaks &&
+               s->peaks[cur + 1] - k < k - s->peaks[cur])
+            cur++;
+        int p = s->peaks[cur];
+        if (k != p)
+            synth[k] = synth[p] + phase[k] - phase[p];
+    }
+}
+
+static void synthesize(struct mp_stretch *s, struct chan *ch)
+{
+    float *buf = s->buf;
+    buf[0] = ch->mag[0] * cosf(ch->synth_phase[0]);
+    buf[1] = ch->mag[s->bins - 1] * cosf(ch->synth_phase[s->bins - 1]);
+    for (int k = 1; k < s->bins - 1; k++) {
+        buf[k * 2] = ch->mag[k] * cosf(ch->synth_phase[k]);
+        buf[k * 2 + 1] = ch->mag[k] * sinf(ch->synth_phase[k]);
+    }
+    mp_dsp_rfft_inverse(s->fft, buf);
+    for (int i = 0; i < s->n; i++)
+        ch->acc[i] += buf[i] * s->window[i] * s->norm;
+}
+
+// Process the next analysis frame, which adds hop finished output samples.
+static bool process_frame(struct mp_stretch *s)
+{
+    int pos = (int)s->in_pos;
+    if (pos + s->n > s->in_len)
+        return false;
+    int ha = pos - s->last_frame_pos;
+
+    float flux = 0;
+    for (int c = 0; c < s->nch; c++)
+        flux += analyze(s, &s->ch[c], pos);
+    // The decision is made for all channels together, so that the stereo
+    // image stays stable.
+    bool transient = s->opts.transients && s->have_prev &&
+                     flux > TRANSIENT_RATIO * s->flux_avg && flux > 1e-3f;
+    s->flux_avg = s->flux_avg * 0.9f + flux * 0.1f;
+
+    for (int c = 0; c < s->nch; c++) {
+        struct chan *ch = &s->ch[c];
+        if (!s->have_prev || transient) {
+            memcpy(ch->synth_phase, ch->phase, s->bins * sizeof(float));
+        } else {
+            advance_phases(s, ch, ha);
+        }
+        synthesize(s, ch);
+        MPSWAP(float *, ch->mag, ch->prev_mag);
+        MPSWAP(float *, ch->phase, ch->prev_phase);
+    }
+    s->have_prev = true;
+    s->out_avail = s->hop;
+    s->out_pos = 0;
+
+    // Drop input that isn't needed anymore.
+    s->last_frame_pos = pos;
+    s->in_pos += s->hop * s->speed;
+    for (int c = 0; c < s->nch; c++)
+        memmove(s->ch[c].in, s->ch[c].in + pos, (s->in_len - pos) * sizeof(float));
+    s->in_len -= pos;
+    s->in_pos -= pos;
+    s->last_frame_pos = 0;
+    return true;
+}
+
+int mp_stretch_pull(struct mp_stretch *s, float **planes, int max_samples)
+{
+    if (s->draining)
+        max_samples = MPMIN(max_samples, MPMAX(lrint(s->out_expected), 0));
+    int done = 0;
+    while (done < max_samples) {
+        if (s->out_pos == s->out_avail) {
+            if (s->out_avail) {
+                for (int c = 0; c < s->nch; c++) {
+                    float *acc = s->ch[c].acc;
+                    memmove(acc, acc + s->hop, (s->n - s->hop) * sizeof(float));
+                    memset(acc + s->n - s->hop, 0, s->hop * sizeof(float));
+                }
+                s->out_avail = s->out_pos = 0;
+            }
+            if (!process_frame(s))
+                break;
+        }
+        int copy = MPMIN(max_samples - done, s->out_avail - s->out_pos);
+        for (int c = 0; c < s->nch; c++) {
+            memcpy(planes[c] + done, s->ch[c].acc + s->out_pos,
+                   copy * sizeof(float));
+        }
+        s->out_pos += copy;
+        done += copy;
+    }
+    s->out_expected -= done;
+    return done;
+}
+
+int mp_stretch_max_output(struct mp_stretch *s)
+{
+    int out = s->out_avail - s->out_pos;
+    double left = s->in_len - s->n - s->in_pos;
+    if (left >= 0)
+        out += ((int)(left / (s->hop * s->speed)) + 2) * s->hop;
+    return out;
+}
+
+double mp_stretch_get_delay(struct mp_stretch *s)
+{
+    double pos = s->last_frame_pos + s->out_pos * s->speed;
+    return MPMAX(s->in_len - pos, 0);
+}
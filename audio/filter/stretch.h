@@ -0,0 +1,64 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_AF_STRETCH_H
+#define MP_AF_STRETCH_H
+
+#include <stdbool.h>
+
+// Phase vocoder time stretcher (changes tempo, keeps pitch). Works on planar
+// float audio.
+struct mp_stretch;
+
+struct mp_stretch_opts {
+    float window_ms;        // analysis window (rounded to a power of 2)
+    int phase_lock;         // identity phase locking (less "phasiness")
+    int transients;         // reset phases on onsets (sharper attacks)
+};
+
+// Returns NULL on failure.
+struct mp_stretch *mp_stretch_create(void *ta_parent, int nch, int rate,
+                                     const struct mp_stretch_opts *opts);
+
+// speed > 1 makes the output shorter.
+void mp_stretch_set_speed(struct mp_stretch *s, double speed);
+
+// Append input samples (planes[0..nch-1]).
+void mp_stretch_push(struct mp_stretch *s, float **planes, int samples);
+
+// Signal end of input: the remaining input is flushed by the following
+// mp_stretch_pull() calls. If mp_stretch_push() is called afterwards, output
+// that wasn't pulled yet is dropped, and processing starts over.
+void mp_stretch_drain(struct mp_stretch *s);
+
+// Write up to max_samples of output to planes[]; returns the number of samples
+// written. Returns less than max_samples only if more input is needed (or
+// everything was drained).
+int mp_stretch_pull(struct mp_stretch *s, float **planes, int max_samples);
+
+// Upper bound for what mp_stretch_pull() can return with the input buffered
+// right now.
+int mp_stretch_max_output(struct mp_stretch *s);
+
+// Input buffered without corresponding output, in samples of input. At most
+// the window size, plus the last mp_stretch_push() call.
+double mp_stretch_get_delay(struct mp_stretch *s);
+
+// Drop all buffered data.
+void mp_stretch_reset(struct mp_stretch *s);
+
+#endif
@@ -0,0 +1,211 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+
+#include "talloc.h"
+#include "common/common.h"
+#include "chmap.h"
+#include "audio/filter/dsp_kernels.h"
+#include "loudness.h"
+
+// Samples filtered at once.
+#define CHUNK 1024
+
+struct mp_loudness {
+    int nch;
+    float weights[MP_NUM_CHANNELS];
+    struct mp_dsp_iir *kweight;
+    float *tmp;             // CHUNK * nch
+    float peak;
+    // Blocks are 4 sub-blocks of 100 ms; a new block starts every sub-block.
+    int sub_len;            // samples per sub-block
+    int sub_pos;            // samples in the current sub-block
+    double sub_acc;         // weighted sum of squares of the current one
+    double subs[3];         // sums of the last 3 complete sub-blocks
+    int num_subs;           // number of complete sub-blocks (up to 3)
+    // Mean square (weighted sum over channels) of each complete block.
+    double *blocks;
+    int num_blocks;
+};
+
+// BS.1770 channel weights: surround channels +1.5 dB, LFE not counted.
+static float channel_weight(int speaker)
+{
+    switch (speaker) {
+    case MP_SPEAKER_ID_LFE:
+    case MP_SPEAKER_ID_LFE2:
+        return 0;
+    case MP_SPEAKER_ID_BL:
+    case MP_SPEAKER_ID_BR:
+    case MP_SPEAKER_ID_SL:
+    case MP_SPEAKER_ID_SR:
+        return 1.41;
+    default:
+        return 1;
+    }
+}
+
+// The K-weighting filter (high shelf and high pass), designed for the given
+// rate from the analog prototype, so that it matches the coefficients BS.1770
+// lists for 48 kHz.
+static void kweight_design(int rate, struct mp_dsp_biquad *shelf,
+                           struct mp_dsp_biquad *hp)
+{
+    double f0 = 1681.974450955533, gain = 3.999843853973347;
+    double q = 0.7071752369554196;
+    double k = tan(M_PI * f0 / rate);
+    double vh = pow(10.0, gain / 20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    *shelf = (struct mp_dsp_biquad){
+        .b0 = (vh + vb * k / q + k * k) / a0,
+        .b1 = 2.0 * (k * k - vh) / a0,
+        .b2 = (vh - vb * k / q + k * k) / a0,
+        .a1 = 2.0 * (k * k - 1.0) / a0,
+        .a2 = (1.0 - k / q + k * k) / a0,
+    };
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = tan(M_PI * f0 / rate);
+    a0 = 1.0 + k / q + k * k;
+    *hp = (struct mp_dsp_biquad){
+        .b0 = 1.0, .b1 = -2.0, .b2 = 1.0,
+        .a1 = 2.0 * (k * k - 1.0) / a0,
+        .a2 = (1.0 - k / q + k * k) / a0,
+    };
+}
+
+struct mp_loudness *mp_loudness_create(void *ta_parent, int rate,
+                                       struct mp_chmap *channels)
+{
+    assert(rate > 0 && channels->num > 0);
+    struct mp_loudness *m = talloc_zero(ta_parent, struct mp_loudness);
+    m->nch = channels->num;
+    for (int c = 0; c < m->nch; c++)
+        m->weights[c] = channel_weight(channels->speaker[c]);
+    m->sub_len = MPMAX(lrint(rate / 10.0), 1);
+    m->tmp = talloc_array(m, float, CHUNK * m->nch);
+
+    struct mp_dsp_biquad shelf, hp;
+    kweight_design(rate, &shelf, &hp);
+    m->kweight = mp_dsp_iir_create(m, mp_dsp_get(-1), m->nch, 2);
+    for (int c = 0; c < m->nch; c++) {
+        mp_dsp_iir_set(m->kweight, c, 0, &shelf);
+        mp_dsp_iir_set(m->kweight, c, 1, &hp);
+    }
+    return m;
+}
+
+static void add_filtered(struct mp_loudness *m, const float *data, int samples)
+{
+    int nch = m->nch;
+    while (samples > 0) {
+        int n = MPMIN(samples, m->sub_len - m->sub_pos);
+        double acc = 0;
+        for (int c = 0; c < nch; c++) {
+            if (!m->weights[c])
+                continue;
+            double sum = 0;
+            for (int i = 0; i < n; i++)
+                sum += data[i * nch + c] * data[i * nch + c];
+            acc += m->weights[c] * sum;
+        }
+        m->sub_acc += acc;
+        m->sub_pos += n;
+        data += n * nch;
+        samples -= n;
+
+        if (m->sub_pos == m->sub_len) {
+            if (m->num_subs == 3) {
+                double sum = m->subs[0] + m->subs[1] + m->subs[2] + m->sub_acc;
+                MP_TARRAY_APPEND(m, m->blocks, m->num_blocks,
+                                 sum / (4.0 * m->sub_len));
+                m->subs[0] = m->subs[1];
+                m->subs[1] = m->subs[2];
+                m->subs[2] = m->sub_acc;
+            } else {
+                m->subs[m->num_subs++] = m->sub_acc;
+            }
+            m->sub_acc = 0;
+            m->sub_pos = 0;
+        }
+    }
+}
+
+void mp_loudness_add(struct mp_loudness *m, const float *data, int samples)
+{
+    int nch = m->nch;
+    for (int i = 0; i < samples * nch; i++)
+        m->peak = MPMAX(m->peak, fabsf(data[i]));
+    while (samples > 0) {
+        int n = MPMIN(samples, CHUNK);
+        memcpy(m->tmp, data, n * nch * sizeof(float));
+        mp_dsp_iir_process(m->kweight, m->tmp, n);
+        add_filtered(m, m->tmp, n);
+        data += n * nch;
+        samples -= n;
+    }
+}
+
+static double block_loudness(double z)
+{
+    return -0.691 + 10 * log10(z);
+}
+
+double mp_loudness_integrated_multi(struct mp_loudness **m, int num)
+{
+    // Absolute gate, then relative gate 10 LU below the absolute-gated
+    // loudness.
+    double sum = 0, z_abs = pow(10, (-70 + 0.691) / 10);
+    int count = 0;
+    for (int n = 0; n < num; n++) {
+        for (int i = 0; i < m[n]->num_blocks; i++) {
+            if (m[n]->blocks[i] > z_abs) {
+                sum += m[n]->blocks[i];
+                count++;
+            }
+        }
+    }
+    if (!count)
+        return -HUGE_VAL;
+    double z_rel = MPMAX(sum / count * pow(10, -10 / 10.0), z_abs);
+    sum = 0;
+    count = 0;
+    for (int n = 0; n < num; n++) {
+        for (int i = 0; i < m[n]->num_blocks; i++) {
+            if (m[n]->blocks[i] > z_rel) {
+                sum += m[n]->blocks[i];
+                count++;
+            }
+        }
+    }
+    return count ? block_loudness(sum / count) : -HUGE_VAL;
+}
+
+double mp_loudness_integrated(struct mp_loudness *m)
+{
+    return mp_loudness_integrated_multi(&m, 1);
+}
+
+float mp_loudness_peak(struct mp_loudness *m)
+{
+    return m->peak;
+}
@@ -0,0 +1,45 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_AUDIO_LOUDNESS_H
+#define MP_AUDIO_LOUDNESS_H
+
+struct mp_chmap;
+
+// Integrated loudness as specified by ITU-R BS.1770 and EBU R128 (K-weighted,
+// 400 ms blocks with 75% overlap, absolute gate at -70 LUFS and relative gate
+// at -10 LU), plus the sample peak.
+struct mp_loudness;
+
+struct mp_loudness *mp_loudness_create(void *ta_parent, int rate,
+                                       struct mp_chmap *channels);
+
+// Add interleaved float samples.
+void mp_loudness_add(struct mp_loudness *m, const float *data, int samples);
+
+// Integrated loudness in LUFS of everything added so far. -HUGE_VAL if there
+// was nothing above the absolute gate.
+double mp_loudness_integrated(struct mp_loudness *m);
+
+// Integrated loudness of the concatenation of several measurements (e.g. the
+// tracks of an album).
+double mp_loudness_integrated_multi(struct mp_loudness **m, int num);
+
+// Maximum absolute sample value added so far.
+float mp_loudness_peak(struct mp_loudness *m);
+
+#endif
@@ -130,7 +130,7 @@ static void setvolume_internal(struct mixer *mixer, float l, float r)
     float gain = (l + r) / 2.0 / 100.0 * mixer->opts->softvol_max / 100.0;
     if (!af_control_any_rev(mixer->af, AF_CONTROL_SET_VOLUME, &gain)) {
         MP_VERBOSE(mixer, "Inserting volume filter.\n");
-        if (!(af_add(mixer->af, "volume", NULL)
+        if (!(af_add_output_stage(mixer->af, "volume", NULL)
               && af_control_any_rev(mixer->af, AF_CONTROL_SET_VOLUME, &gain)))
             MP_ERR(mixer, "No volume control available.\n");
     }
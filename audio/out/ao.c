@@ -143,6 +143,7 @@ static struct ao *ao_alloc(bool probing, struct mpv_global *global,
         .input_ctx = input_ctx,
         .log = mp_log_new(ao, log, name),
         .def_buffer = opts->audio_buffer,
+        .smooth_delay = opts->audio_smooth_delay,
     };
     struct m_config *config = m_config_from_obj_desc(ao, ao->log, &desc);
     if (m_config_apply_defaults(config, name, opts->ao_defs) < 0)
@@ -322,6 +323,15 @@ int ao_play(struct ao *ao, void **data, int samples, int flags)
     return ao->api->play(ao, data, samples, flags);
 }
 
+// Like ao_play(), but with a frame in the AO's format. If the frame's data is
+// refcounted, the AO can queue a reference instead of copying it.
+int ao_play_frame(struct ao *ao, struct mp_audio *frame, int flags)
+{
+    if (ao->api->play_frame)
+        return ao->api->play_frame(ao, frame, flags);
+    return ao_play(ao, frame->planes, frame->samples, flags);
+}
+
 int ao_control(struct ao *ao, enum aocontrol cmd, void *arg)
 {
     return ao->api->control ? ao->api->control(ao, cmd, arg) : CONTROL_UNKNOWN;
@@ -337,6 +347,13 @@ double ao_get_delay(struct ao *ao)
     return ao->api->get_delay(ao);
 }
 
+// Return statistics of the device delay estimator (see ao_timing.h). Returns
+// false if not available, e.g. because the AO is untimed.
+bool ao_get_timing_stats(struct ao *ao, struct ao_timing_stats *st)
+{
+    return ao->api->get_timing ? ao->api->get_timing(ao, st) : false;
+}
+
 // Return free size of the internal audio buffer. This controls how much audio
 // the core should decode and try to queue with ao_play().
 int ao_get_space(struct ao *ao)
@@ -394,7 +411,7 @@ int ao_query_and_reset_events(struct ao *ao, int events)
 void ao_request_reload(struct ao *ao)
 {
     atomic_store(&ao->request_reload, true);
-    mp_input_wakeup(ao->input_ctx);
+    mp_input_wakeup_src(ao->input_ctx, MP_WAKEUP_AO);
 }
 
 bool ao_chmap_sel_adjust(struct ao *ao, const struct mp_chmap_sel *s,
@@ -70,6 +70,7 @@ struct mpv_global;
 struct input_ctx;
 struct encode_lavc_context;
 struct mp_audio;
+struct ao_timing_stats;
 
 struct ao *ao_init_best(struct mpv_global *global,
                         struct input_ctx *input_ctx,
@@ -81,8 +82,10 @@ const char *ao_get_name(struct ao *ao);
 const char *ao_get_description(struct ao *ao);
 bool ao_untimed(struct ao *ao);
 int ao_play(struct ao *ao, void **data, int samples, int flags);
+int ao_play_frame(struct ao *ao, struct mp_audio *frame, int flags);
 int ao_control(struct ao *ao, enum aocontrol cmd, void *arg);
 double ao_get_delay(struct ao *ao);
+bool ao_get_timing_stats(struct ao *ao, struct ao_timing_stats *st);
 int ao_get_space(struct ao *ao);
 void ao_reset(struct ao *ao);
 void ao_pause(struct ao *ao);
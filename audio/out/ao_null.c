@@ -50,6 +50,7 @@ struct priv {
     float latency_sec;  // seconds
     float latency;      // samples
     int broken_eof;
+    float jitter;       // seconds
 
     // Minimal unit of audio samples that can be written at once. If play() is
     // called with sizes not aligned to this, a rounded size will be returned.
@@ -191,6 +192,12 @@ static double get_delay(struct ao *ao)
     if (priv->broken_eof && priv->buffered < priv->latency)
         delay = priv->latency;
 
+    // Simulate devices which report the delay imprecisely.
+    if (priv->jitter > 0) {
+        double r = rand() / (double)RAND_MAX * 2 - 1;
+        delay = MPMAX(delay + r * priv->jitter * ao->samplerate, 0);
+    }
+
     return delay  / (double)ao->samplerate;
 }
 
@@ -221,6 +228,7 @@ const struct ao_driver audio_out_null = {
         OPT_FLOATRANGE("speed", speed, 0, 0, 10000),
         OPT_FLOATRANGE("latency", latency_sec, 0, 0, 100),
         OPT_FLAG("broken-eof", broken_eof, 0),
+        OPT_FLOATRANGE("jitter", jitter, 0, 0, 1),
         {0}
     },
 };
@@ -0,0 +1,142 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <assert.h>
+
+#include "talloc.h"
+#include "common/common.h"
+#include "ao_timing.h"
+
+// Time constant of the observation weights (seconds).
+#define TAU 5.0
+
+// Minimum weighted standard deviation of the observation times (seconds)
+// before the slope is estimated. Until then, the nominal rate is assumed.
+#define MIN_SPREAD 0.25
+
+// An observation further off the fit than this (seconds), or 8 times the
+// jitter if that is larger, means the device position jumped (underrun,
+// device restart), and the fit is restarted.
+#define MIN_RESYNC 0.04
+
+struct ao_timing {
+    int rate;
+    bool valid;
+    int64_t ref_time;       // time of the last observation
+    double ref_pos;         // played position at ref_time (samples)
+    // Exponentially weighted sums over the observations. Time (seconds) and
+    // position (samples) are relative to the last observation, which keeps
+    // the sums small and the fit at the current time precise.
+    double sw, st, sp, stt, stp;
+    double err2;            // smoothed squared error (seconds^2)
+    bool have_slope;
+    struct ao_timing_stats stats;
+};
+
+struct ao_timing *ao_timing_create(void *ta_parent, int samplerate)
+{
+    assert(samplerate > 0);
+    struct ao_timing *t = talloc_zero(ta_parent, struct ao_timing);
+    t->rate = samplerate;
+    return t;
+}
+
+void ao_timing_reset(struct ao_timing *t)
+{
+    t->valid = false;
+}
+
+// Fit p(x) = offset + slope * x, with x relative to ref_time.
+static void fit(struct ao_timing *t, double *slope, double *offset)
+{
+    double mt = t->st / t->sw, mp = t->sp / t->sw;
+    double var = t->stt / t->sw - mt * mt;
+    double s = t->rate;
+    t->have_slope = false;
+    if (var >= MIN_SPREAD * MIN_SPREAD) {
+        double v = (t->stp / t->sw - mt * mp) / var;
+        if (v > 0) {
+            s = v;
+            t->have_slope = true;
+        }
+    }
+    *slope = s;
+    *offset = mp - s * mt;
+}
+
+void ao_timing_update(struct ao_timing *t, int64_t now, int64_t written,
+                      double delay)
+{
+    double pos = written - delay * t->rate;
+    double slope, offset;
+    t->stats.observations++;
+
+    if (t->valid) {
+        double x = (now - t->ref_time) / 1e6;
+        fit(t, &slope, &offset);
+        double err = (pos - t->ref_pos - (offset + slope * x)) / t->rate;
+        if (fabs(err) > MPMAX(MIN_RESYNC, 8 * sqrt(t->err2))) {
+            t->stats.resyncs++;
+            t->valid = false;
+        } else {
+            t->err2 += (err * err - t->err2) / 16;
+            // Move the origin to the new observation, age the old ones, and
+            // add the new one (at the origin).
+            double y = pos - t->ref_pos;
+            t->stt += x * x * t->sw - 2 * x * t->st;
+            t->stp += x * y * t->sw - x * t->sp - y * t->st;
+            t->st -= x * t->sw;
+            t->sp -= y * t->sw;
+            double decay = exp(-MPMAX(x, 0) / TAU);
+            t->sw = t->sw * decay + 1;
+            t->st *= decay;
+            t->sp *= decay;
+            t->stt *= decay;
+            t->stp *= decay;
+        }
+    }
+
+    if (!t->valid) {
+        t->sw = 1;
+        t->st = t->sp = t->stt = t->stp = 0;
+        t->valid = true;
+    }
+    t->ref_time = now;
+    t->ref_pos = pos;
+
+    fit(t, &slope, &offset);
+    t->stats.latency = MPMAX(written - (pos + offset), 0) / t->rate;
+    t->stats.drift = t->have_slope ? slope / t->rate - 1 : 0;
+    t->stats.jitter = sqrt(t->err2);
+}
+
+double ao_timing_get_delay(struct ao_timing *t, int64_t now, int64_t written)
+{
+    if (!t->valid)
+        return -1;
+    double slope, offset;
+    fit(t, &slope, &offset);
+    double x = (now - t->ref_time) / 1e6;
+    double pos = t->ref_pos + offset + slope * x;
+    return MPMAX(written - pos, 0) / t->rate;
+}
+
+void ao_timing_get_stats(struct ao_timing *t, struct ao_timing_stats *st)
+{
+    *st = t->stats;
+}
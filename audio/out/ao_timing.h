@@ -0,0 +1,60 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_AO_TIMING_H
+#define MP_AO_TIMING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Estimates which sample the audio device is playing at a given time, from
+// the delays reported by the device. Each observation is a pair of system
+// time and (written samples, device delay); a line is fitted through the
+// played positions, weighting recent observations more. This smooths coarse
+// or noisy delay reports, and the slope of the line is the device clock rate
+// as seen by the system clock.
+//
+// All times are in microseconds, with mp_time_us() as reference, but the
+// caller passes them in, so any clock can be used. Not thread-safe.
+struct ao_timing;
+
+struct ao_timing_stats {
+    int64_t observations;   // since creation
+    int64_t resyncs;        // times the fit was discarded (jumps, underruns)
+    double latency;         // smoothed device delay at the last observation
+    double drift;           // device clock rate / nominal rate - 1
+    double jitter;          // RMS error of observations vs. fit (seconds)
+};
+
+struct ao_timing *ao_timing_create(void *ta_parent, int samplerate);
+
+// Forget all observations, e.g. after the device was reset or paused.
+void ao_timing_reset(struct ao_timing *t);
+
+// At time now, written samples had been sent to the device in total (since
+// the last reset), and the last of them will be played after delay seconds.
+void ao_timing_update(struct ao_timing *t, int64_t now, int64_t written,
+                      double delay);
+
+// Return the estimated device delay at time now, given written samples sent
+// to the device in total. Returns a negative value if there is no estimate
+// yet.
+double ao_timing_get_delay(struct ao_timing *t, int64_t now, int64_t written);
+
+void ao_timing_get_stats(struct ao_timing *t, struct ao_timing_stats *st);
+
+#endif
@@ -38,6 +38,7 @@ struct ao {
     bool untimed;               // don't assume realtime playback
     int device_buffer;          // device buffer in samples (guessed by
                                 // common init code if not set by driver)
+    bool smooth_delay;          // use the ao_timing estimate as device delay
     const struct ao_driver *api; // entrypoints to the wrapper (push.c/pull.c)
     const struct ao_driver *driver;
     void *priv;
@@ -134,6 +135,10 @@ struct ao_driver {
     int (*get_space)(struct ao *ao);
     // push based: see ao_play()
     int (*play)(struct ao *ao, void **data, int samples, int flags);
+    // push API only (not for drivers): see ao_play_frame()
+    int (*play_frame)(struct ao *ao, struct mp_audio *frame, int flags);
+    // push/pull API only (not for drivers): see ao_get_timing_stats()
+    bool (*get_timing)(struct ao *ao, struct ao_timing_stats *st);
     // push based: see ao_get_delay()
     double (*get_delay)(struct ao *ao);
     // push based: block until all queued audio is played (optional)
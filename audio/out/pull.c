@@ -17,9 +17,11 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <assert.h>
 
 #include "ao.h"
+#include "ao_timing.h"
 #include "internal.h"
 #include "audio/format.h"
 
@@ -31,7 +33,7 @@
 #include "osdep/timer.h"
 #include "osdep/threads.h"
 #include "osdep/atomics.h"
-#include "misc/ring.h"
+#include "audio/audio_ring.h"
 
 /*
  * Note: there is some stupid stuff in this file in order to avoid mutexes.
@@ -49,14 +51,24 @@ enum {
 #define IS_PLAYING(st) ((st) == AO_STATE_PLAY || (st) == AO_STATE_BUSY)
 
 struct ao_pull_state {
-    // Be very careful with the order when accessing planes.
-    struct mp_ring *buffers[MP_NUM_CHANNELS];
+    // Audio data from the playloop to the callback (wait-free).
+    struct mp_audio_ring *buffer;
 
     // AO_STATE_*
     atomic_int state;
 
     // Device delay of the last written sample, in realtime.
     atomic_llong end_time_us;
+    // Samples read by the callback since the last reset. Together with
+    // end_time_us, it is updated under a sequence counter (odd while the
+    // callback is writing them), so that readers see a consistent pair.
+    atomic_llong read_samples;
+    atomic_uint_least32_t seq;
+
+    // --- not accessed by the callback
+    pthread_mutex_t timing_lock;
+    struct ao_timing *timing;
+    uint32_t timing_seq;        // seq of the last observation fed to timing
 };
 
 static void set_state(struct ao *ao, int new_state)
@@ -77,26 +89,14 @@ static void set_state(struct ao *ao, int new_state)
 static int get_space(struct ao *ao)
 {
     struct ao_pull_state *p = ao->api_priv;
-    // Since the reader will read the last plane last, its free space is the
-    // minimum free space across all planes.
-    return mp_ring_available(p->buffers[ao->num_planes - 1]) / ao->sstride;
+    return mp_audio_ring_available(p->buffer);
 }
 
 static int play(struct ao *ao, void **data, int samples, int flags)
 {
     struct ao_pull_state *p = ao->api_priv;
 
-    int write_samples = get_space(ao);
-    write_samples = MPMIN(write_samples, samples);
-
-    // Write starting from the last plane - this way, the first plane will
-    // always contain the minimum amount of data readable across all planes
-    // (assumes the reader starts with the first plane).
-    int write_bytes = write_samples * ao->sstride;
-    for (int n = ao->num_planes - 1; n >= 0; n--) {
-        int r = mp_ring_write(p->buffers[n], data[n], write_bytes);
-        assert(r == write_bytes);
-    }
+    int write_samples = mp_audio_ring_write(p->buffer, data, samples);
 
     int state = atomic_load(&p->state);
     if (!IS_PLAYING(state)) {
@@ -129,21 +129,19 @@ int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
                                         AO_STATE_BUSY))
         goto end;
 
-    // Since the writer will write the first plane last, its buffered amount
-    // of data is the minimum amount across all planes.
-    int buffered_bytes = mp_ring_buffered(p->buffers[0]);
-    bytes = MPMIN(buffered_bytes, full_bytes);
+    int read = mp_audio_ring_read(p->buffer, data, samples);
+    bytes = read * ao->sstride;
 
-    if (bytes > 0)
+    if (read > 0) {
+        atomic_fetch_add(&p->seq, 1);
+        atomic_store(&p->read_samples, atomic_load(&p->read_samples) + read);
         atomic_store(&p->end_time_us, out_time_us);
-
-    for (int n = 0; n < ao->num_planes; n++) {
-        int r = mp_ring_read(p->buffers[n], data[n], bytes);
-        bytes = MPMIN(bytes, r);
+        atomic_fetch_add(&p->seq, 1);
     }
 
     // Half of the buffer played -> request more.
-    need_wakeup = buffered_bytes - bytes <= mp_ring_size(p->buffers[0]) / 2;
+    need_wakeup = mp_audio_ring_buffered(p->buffer) <=
+                  mp_audio_ring_size(p->buffer) / 2;
 
     // Should never fail.
     atomic_compare_exchange_strong(&p->state, &(int){AO_STATE_BUSY}, AO_STATE_PLAY);
@@ -151,11 +149,14 @@ int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
 end:
 
     if (need_wakeup)
-        mp_input_wakeup_nolock(ao->input_ctx);
+        mp_input_wakeup_src(ao->input_ctx, MP_WAKEUP_AO);
 
     // pad with silence (underflow/paused/eof)
     for (int n = 0; n < ao->num_planes; n++)
-        af_fill_silence(data[n], full_bytes - bytes, ao->format);
+    {
+        af_fill_silence((char *)data[n] + bytes, full_bytes - bytes,
+                        ao->format);
+    }
 
     return bytes / ao->sstride;
 }
@@ -176,10 +177,55 @@ static double get_delay(struct ao *ao)
 {
     struct ao_pull_state *p = ao->api_priv;
 
-    int64_t end = atomic_load(&p->end_time_us);
+    // The callback's update is a few instructions, so this hardly ever loops.
+    uint32_t seq;
+    int64_t end, read;
+    do {
+        seq = atomic_load(&p->seq);
+        read = atomic_load(&p->read_samples);
+        end = atomic_load(&p->end_time_us);
+    } while ((seq & 1) || atomic_load(&p->seq) != seq);
+
     int64_t now = mp_time_us();
     double driver_delay = MPMAX(0, (end - now) / (1000.0 * 1000.0));
-    return mp_ring_buffered(p->buffers[0]) / (double)ao->bps + driver_delay;
+
+    if (!ao->untimed && read > 0) {
+        pthread_mutex_lock(&p->timing_lock);
+        // Each callback is one observation: the last sample read is played
+        // at end.
+        if (seq != p->timing_seq) {
+            ao_timing_update(p->timing, end, read, 0);
+            p->timing_seq = seq;
+        }
+        if (ao->smooth_delay) {
+            double est = ao_timing_get_delay(p->timing, now, read);
+            if (est >= 0)
+                driver_delay = est;
+        }
+        pthread_mutex_unlock(&p->timing_lock);
+    }
+
+    return mp_audio_ring_buffered(p->buffer) / (double)ao->samplerate +
+           driver_delay;
+}
+
+static bool get_timing(struct ao *ao, struct ao_timing_stats *st)
+{
+    struct ao_pull_state *p = ao->api_priv;
+    if (ao->untimed)
+        return false;
+    pthread_mutex_lock(&p->timing_lock);
+    ao_timing_get_stats(p->timing, st);
+    pthread_mutex_unlock(&p->timing_lock);
+    return true;
+}
+
+static void reset_timing(struct ao *ao)
+{
+    struct ao_pull_state *p = ao->api_priv;
+    pthread_mutex_lock(&p->timing_lock);
+    ao_timing_reset(p->timing);
+    pthread_mutex_unlock(&p->timing_lock);
 }
 
 static void reset(struct ao *ao)
@@ -188,9 +234,10 @@ static void reset(struct ao *ao)
     if (ao->driver->reset)
         ao->driver->reset(ao); // assumes the audio callback thread is stopped
     set_state(ao, AO_STATE_NONE);
-    for (int n = 0; n < ao->num_planes; n++)
-        mp_ring_reset(p->buffers[n]);
+    mp_audio_ring_reset(p->buffer);
     atomic_store(&p->end_time_us, 0);
+    atomic_store(&p->read_samples, 0);
+    reset_timing(ao);
 }
 
 static void pause(struct ao *ao)
@@ -198,10 +245,12 @@ static void pause(struct ao *ao)
     if (ao->driver->reset)
         ao->driver->reset(ao);
     set_state(ao, AO_STATE_NONE);
+    reset_timing(ao);
 }
 
 static void resume(struct ao *ao)
 {
+    reset_timing(ao);
     set_state(ao, AO_STATE_PLAY);
     ao->driver->resume(ao);
 }
@@ -220,20 +269,24 @@ static bool get_eof(struct ao *ao)
     struct ao_pull_state *p = ao->api_priv;
     // For simplicity, ignore the latency. Otherwise, we would have to run an
     // extra thread to time it.
-    return mp_ring_buffered(p->buffers[0]) == 0;
+    return mp_audio_ring_buffered(p->buffer) == 0;
 }
 
 static void uninit(struct ao *ao)
 {
+    struct ao_pull_state *p = ao->api_priv;
     ao->driver->uninit(ao);
+    pthread_mutex_destroy(&p->timing_lock);
 }
 
 static int init(struct ao *ao)
 {
     struct ao_pull_state *p = ao->api_priv;
-    for (int n = 0; n < ao->num_planes; n++)
-        p->buffers[n] = mp_ring_new(ao, ao->buffer * ao->sstride);
+    p->buffer = mp_audio_ring_create(ao, ao->num_planes, ao->sstride,
+                                     ao->buffer);
     atomic_store(&p->state, AO_STATE_NONE);
+    pthread_mutex_init(&p->timing_lock, NULL);
+    p->timing = ao_timing_create(ao, ao->samplerate);
     assert(ao->driver->resume);
     return 0;
 }
@@ -247,6 +300,7 @@ const struct ao_driver ao_api_pull = {
     .get_space = get_space,
     .play = play,
     .get_delay = get_delay,
+    .get_timing = get_timing,
     .get_eof = get_eof,
     .pause = pause,
     .resume = resume,
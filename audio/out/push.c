@@ -25,6 +25,7 @@
 #include "osdep/io.h"
 
 #include "ao.h"
+#include "ao_timing.h"
 #include "internal.h"
 #include "audio/format.h"
 
@@ -59,6 +60,11 @@ struct ao_push_state {
     bool final_chunk;
     double expected_end_time;
 
+    // Samples passed to the driver since the last reset, and the estimator
+    // fed with the driver's delay reports.
+    int64_t written;
+    struct ao_timing *timing;
+
     int wakeup_pipe[2];
 };
 
@@ -84,13 +90,30 @@ static int control(struct ao *ao, enum aocontrol cmd, void *arg)
     return r;
 }
 
+// Query the driver's delay, and record it in the estimator. While paused,
+// the device position doesn't advance, so such reports are not used.
+static double update_driver_delay(struct ao *ao)
+{
+    struct ao_push_state *p = ao->api_priv;
+    if (!ao->driver->get_delay)
+        return 0;
+    double delay = ao->driver->get_delay(ao);
+    if (!ao->untimed && !p->paused && p->written > 0) {
+        int64_t now = mp_time_us();
+        ao_timing_update(p->timing, now, p->written, delay);
+        if (ao->smooth_delay) {
+            double est = ao_timing_get_delay(p->timing, now, p->written);
+            if (est >= 0)
+                delay = est;
+        }
+    }
+    return delay;
+}
+
 static double unlocked_get_delay(struct ao *ao)
 {
     struct ao_push_state *p = ao->api_priv;
-    double driver_delay = 0;
-    if (ao->driver->get_delay)
-        driver_delay = ao->driver->get_delay(ao);
-    return driver_delay + mp_audio_buffer_seconds(p->buffer);
+    return update_driver_delay(ao) + mp_audio_buffer_seconds(p->buffer);
 }
 
 static double get_delay(struct ao *ao)
@@ -109,6 +132,8 @@ static void reset(struct ao *ao)
     if (ao->driver->reset)
         ao->driver->reset(ao);
     mp_audio_buffer_clear(p->buffer);
+    p->written = 0;
+    ao_timing_reset(p->timing);
     p->paused = false;
     if (p->still_playing)
         wakeup_playthread(ao);
@@ -122,6 +147,7 @@ static void audio_pause(struct ao *ao)
     pthread_mutex_lock(&p->lock);
     if (ao->driver->pause)
         ao->driver->pause(ao);
+    ao_timing_reset(p->timing);
     p->paused = true;
     wakeup_playthread(ao);
     pthread_mutex_unlock(&p->lock);
@@ -133,6 +159,7 @@ static void resume(struct ao *ao)
     pthread_mutex_lock(&p->lock);
     if (ao->driver->resume)
         ao->driver->resume(ao);
+    ao_timing_reset(p->timing);
     p->paused = false;
     p->expected_end_time = 0;
     wakeup_playthread(ao);
@@ -199,6 +226,17 @@ static int get_space(struct ao *ao)
     return space;
 }
 
+static bool get_timing(struct ao *ao, struct ao_timing_stats *st)
+{
+    struct ao_push_state *p = ao->api_priv;
+    if (ao->untimed || !ao->driver->get_delay)
+        return false;
+    pthread_mutex_lock(&p->lock);
+    ao_timing_get_stats(p->timing, st);
+    pthread_mutex_unlock(&p->lock);
+    return true;
+}
+
 static bool get_eof(struct ao *ao)
 {
     struct ao_push_state *p = ao->api_priv;
@@ -208,12 +246,14 @@ static bool get_eof(struct ao *ao)
     return eof;
 }
 
-static int play(struct ao *ao, void **data, int samples, int flags)
+// If the frame is refcounted, the buffer references it instead of copying.
+static int play_frame(struct ao *ao, struct mp_audio *frame, int flags)
 {
     struct ao_push_state *p = ao->api_priv;
 
     pthread_mutex_lock(&p->lock);
 
+    int samples = frame->samples;
     int write_samples = mp_audio_buffer_get_write_available(p->buffer);
     write_samples = MPMIN(write_samples, samples);
 
@@ -223,10 +263,7 @@ static int play(struct ao *ao, void **data, int samples, int flags)
         flags = flags & ~AOPLAY_FINAL_CHUNK;
     bool is_final = flags & AOPLAY_FINAL_CHUNK;
 
-    struct mp_audio audio;
-    mp_audio_buffer_get_format(p->buffer, &audio);
-    for (int n = 0; n < ao->num_planes; n++)
-        audio.planes[n] = data[n];
+    struct mp_audio audio = *frame;
     audio.samples = write_samples;
     mp_audio_buffer_append(p->buffer, &audio);
 
@@ -247,15 +284,28 @@ static int play(struct ao *ao, void **data, int samples, int flags)
     return write_samples;
 }
 
+static int play(struct ao *ao, void **data, int samples, int flags)
+{
+    struct ao_push_state *p = ao->api_priv;
+    struct mp_audio audio;
+    mp_audio_buffer_get_format(p->buffer, &audio);
+    for (int n = 0; n < ao->num_planes; n++)
+        audio.planes[n] = data[n];
+    audio.samples = samples;
+    return play_frame(ao, &audio, flags);
+}
+
 // called locked
 static void ao_play_data(struct ao *ao)
 {
     struct ao_push_state *p = ao->api_priv;
-    struct mp_audio data;
-    mp_audio_buffer_peek(p->buffer, &data);
-    int max = data.samples;
+    int max = mp_audio_buffer_samples(p->buffer);
     int space = ao->driver->get_space(ao);
     space = MPMAX(space, 0);
+    // The driver needs a single block of memory. This merges (copies) frames
+    // only if the first queued frame is smaller than what the device takes.
+    struct mp_audio data;
+    mp_audio_buffer_peek_contiguous(p->buffer, space, &data);
     if (data.samples > space)
         data.samples = space;
     int flags = 0;
@@ -278,8 +328,11 @@ static void ao_play_data(struct ao *ao)
         r = max;
     }
     mp_audio_buffer_skip(p->buffer, r);
-    if (r > 0)
+    if (r > 0) {
         p->expected_end_time = 0;
+        p->written += r;
+        update_driver_delay(ao);
+    }
     // Nothing written, but more input data than space - this must mean the
     // AO's get_space() doesn't do period alignment correctly.
     bool stuck = r == 0 && max >= space && space > 0;
@@ -294,7 +347,7 @@ static void ao_play_data(struct ao *ao)
     int needed = unlocked_get_space(ao);
     bool more = needed >= (r == space ? ao->device_buffer / 4 : 1) && !stuck;
     if (more)
-        mp_input_wakeup(ao->input_ctx); // request more data
+        mp_input_wakeup_src(ao->input_ctx, MP_WAKEUP_AO); // request more data
     MP_TRACE(ao, "in=%d flags=%d space=%d r=%d wa=%d needed=%d more=%d\n",
              max, flags, space, r, p->wait_on_ao, needed, more);
 }
@@ -336,7 +389,7 @@ static void *playthread(void *arg)
                 }
 
                 if (was_playing && !p->still_playing)
-                    mp_input_wakeup(ao->input_ctx);
+                    mp_input_wakeup_src(ao->input_ctx, MP_WAKEUP_AO);
                 pthread_cond_signal(&p->wakeup); // for draining
 
                 if (p->still_playing && timeout > 0) {
@@ -404,6 +457,7 @@ static int init(struct ao *ao)
         goto err;
     }
 
+    p->timing = ao_timing_create(ao, ao->samplerate);
     p->buffer = mp_audio_buffer_create(ao);
     mp_audio_buffer_reinit_fmt(p->buffer, ao->format,
                                &ao->channels, ao->samplerate);
@@ -423,7 +477,9 @@ const struct ao_driver ao_api_push = {
     .reset = reset,
     .get_space = get_space,
     .play = play,
+    .play_frame = play_frame,
     .get_delay = get_delay,
+    .get_timing = get_timing,
     .pause = audio_pause,
     .resume = resume,
     .drain = drain,
@@ -589,6 +589,14 @@ int demux_read_packet_async(struct sh_stream *sh, struct demux_packet **out_pkt)
     return r;
 }
 
+// Whether demux_read_packet_async() on this stream only takes packets queued by
+// the demuxer thread. Then it can be called from another thread than the
+// rest of the demuxer API.
+bool demux_stream_is_threaded(struct sh_stream *sh)
+{
+    return sh && sh->ds && sh->ds->in->threading;
+}
+
 // Return the pts of the next packet that demux_read_packet() would return.
 // Might block. Sometimes used to force a packet read, without removing any
 // packets from the queue.
@@ -36,6 +36,7 @@
 
 #include "osdep/io.h"
 #include "osdep/semaphore.h"
+#include "osdep/atomics.h"
 #include "misc/rendezvous.h"
 
 #include "input.h"
@@ -98,6 +99,7 @@ struct cmd_queue {
 struct input_ctx {
     pthread_mutex_t mutex;
     sem_t wakeup;
+    atomic_llong wakeup_counts[MP_WAKEUP_SRC_COUNT];
     struct mp_log *log;
     struct mpv_global *global;
     struct input_opts *opts;
@@ -147,6 +149,27 @@ struct input_ctx {
     struct cmd_queue cmd_queue;
 
     struct mp_cancel *cancel;
+
+    // Wakeup statistics; only accessed by the thread calling mp_input_wait()
+    int64_t wait_count;
+    int64_t last_wait_end;  // mp_time_us() when the last wait returned
+    int64_t sleep_us, active_us;
+    int64_t next_stats_log;
+    struct mp_input_wakeup_stats last_stats;
+};
+
+// Interval for the wakeup statistics log message (in microseconds).
+#define WAKEUP_STATS_LOG_INTERVAL (10 * 1000 * 1000)
+
+const char *const mp_wakeup_src_names[MP_WAKEUP_SRC_COUNT] = {
+    [MP_WAKEUP_OTHER]       = "other",
+    [MP_WAKEUP_INPUT]       = "input",
+    [MP_WAKEUP_DISPATCH]    = "dispatch",
+    [MP_WAKEUP_CLIENT]      = "client",
+    [MP_WAKEUP_DEMUX]       = "demux",
+    [MP_WAKEUP_AO]          = "ao",
+    [MP_WAKEUP_VO]          = "vo",
+    [MP_WAKEUP_TIMEOUT]     = "timeout",
 };
 
 static int parse_config(struct input_ctx *ictx, bool builtin, bstr data,
@@ -567,7 +590,7 @@ static void interpret_key(struct input_ctx *ictx, int code, double scale)
 
     if (MP_KEY_DEPENDS_ON_MOUSE_POS(code & ~MP_KEY_MODIFIER_MASK)) {
         ictx->mouse_event_counter++;
-        mp_input_wakeup(ictx);
+        mp_input_wakeup_src(ictx, MP_WAKEUP_INPUT);
     }
 
     struct mp_cmd *cmd = NULL;
@@ -587,7 +610,8 @@ static void interpret_key(struct input_ctx *ictx, int code, double scale)
         ictx->last_key_down = code;
         ictx->last_key_down_time = mp_time_us();
         ictx->ar_state = 0;
-        mp_input_wakeup(ictx); // possibly start timer for autorepeat
+        // possibly start timer for autorepeat
+        mp_input_wakeup_src(ictx, MP_WAKEUP_INPUT);
     } else if (state == MP_KEY_STATE_UP) {
         // Most VOs send RELEASE_ALL anyway
         release_down_cmd(ictx, false);
@@ -802,7 +826,7 @@ int mp_input_queue_cmd(struct input_ctx *ictx, mp_cmd_t *cmd)
         if (ictx->cancel && test_abort_cmd(ictx, cmd))
             mp_cancel_trigger(ictx->cancel);
         queue_add_tail(&ictx->cmd_queue, cmd);
-        mp_input_wakeup(ictx);
+        mp_input_wakeup_src(ictx, MP_WAKEUP_INPUT);
     }
     input_unlock(ictx);
     return 1;
@@ -842,8 +866,39 @@ static mp_cmd_t *check_autorepeat(struct input_ctx *ictx)
     return NULL;
 }
 
+static void log_wakeup_stats(struct input_ctx *ictx, int64_t now)
+{
+    if (!ictx->next_stats_log) {
+        ictx->next_stats_log = now + WAKEUP_STATS_LOG_INTERVAL;
+        return;
+    }
+    if (now < ictx->next_stats_log || !mp_msg_test(ictx->log, MSGL_DEBUG))
+        return;
+    ictx->next_stats_log = now + WAKEUP_STATS_LOG_INTERVAL;
+
+    struct mp_input_wakeup_stats st, *last = &ictx->last_stats;
+    mp_input_get_wakeup_stats(ictx, &st);
+    double sleep = st.sleep_time - last->sleep_time;
+    double active = st.active_time - last->active_time;
+    char buf[256] = {0};
+    for (int n = 0; n < MP_WAKEUP_SRC_COUNT; n++) {
+        mp_snprintf_cat(buf, sizeof(buf), " %s=%"PRId64, mp_wakeup_src_names[n],
+                        st.wakeups[n] - last->wakeups[n]);
+    }
+    MP_DBG(ictx, "Wakeups: iterations=%"PRId64"%s, active %.1f%%\n",
+           st.iterations - last->iterations, buf,
+           sleep + active > 0 ? active / (sleep + active) * 100 : 0);
+    *last = st;
+}
+
 void mp_input_wait(struct input_ctx *ictx, double seconds)
 {
+    int64_t start = mp_time_us();
+    if (ictx->last_wait_end)
+        ictx->active_us += start - ictx->last_wait_end;
+    ictx->wait_count++;
+    log_wakeup_stats(ictx, start);
+
     input_lock(ictx);
     adjust_max_wait_time(ictx, &seconds);
     input_unlock(ictx);
@@ -852,23 +907,46 @@ void mp_input_wait(struct input_ctx *ictx, double seconds)
     if (seconds > 0) {
         MP_STATS(ictx, "start sleep");
         struct timespec ts =
-            mp_time_us_to_timespec(mp_add_timeout(mp_time_us(), seconds));
-        sem_timedwait(&ictx->wakeup, &ts);
+            mp_time_us_to_timespec(mp_add_timeout(start, seconds));
+        if (sem_timedwait(&ictx->wakeup, &ts) && errno == ETIMEDOUT)
+            atomic_fetch_add(&ictx->wakeup_counts[MP_WAKEUP_TIMEOUT], 1);
         MP_STATS(ictx, "end sleep");
     }
+
+    ictx->last_wait_end = mp_time_us();
+    ictx->sleep_us += ictx->last_wait_end - start;
 }
 
 void mp_input_wakeup_nolock(struct input_ctx *ictx)
 {
+    mp_input_wakeup_src(ictx, MP_WAKEUP_OTHER);
+}
+
+void mp_input_wakeup(struct input_ctx *ictx)
+{
+    mp_input_wakeup_nolock(ictx);
+}
+
+void mp_input_wakeup_src(struct input_ctx *ictx, enum mp_wakeup_src src)
+{
+    assert(src >= 0 && src < MP_WAKEUP_SRC_COUNT);
+    atomic_fetch_add(&ictx->wakeup_counts[src], 1);
     // Some audio APIs discourage use of locking in their audio callback,
-    // and these audio callbacks happen to call mp_input_wakeup_nolock()
+    // and these audio callbacks happen to call mp_input_wakeup_src()
     // when new data is needed. This is why we use semaphores here.
     sem_post(&ictx->wakeup);
 }
 
-void mp_input_wakeup(struct input_ctx *ictx)
+void mp_input_get_wakeup_stats(struct input_ctx *ictx,
+                               struct mp_input_wakeup_stats *stats)
 {
-    mp_input_wakeup_nolock(ictx);
+    *stats = (struct mp_input_wakeup_stats){
+        .iterations = ictx->wait_count,
+        .sleep_time = ictx->sleep_us / 1e6,
+        .active_time = ictx->active_us / 1e6,
+    };
+    for (int n = 0; n < MP_WAKEUP_SRC_COUNT; n++)
+        stats->wakeups[n] = atomic_load(&ictx->wakeup_counts[n]);
 }
 
 mp_cmd_t *mp_input_read_cmd(struct input_ctx *ictx)
@@ -242,6 +242,37 @@ void mp_input_wakeup(struct input_ctx *ictx);
 
 void mp_input_wakeup_nolock(struct input_ctx *ictx);
 
+// Where a wakeup came from. Only used for statistics.
+enum mp_wakeup_src {
+    MP_WAKEUP_OTHER,
+    MP_WAKEUP_INPUT,        // user input and commands
+    MP_WAKEUP_DISPATCH,     // requests from client API threads
+    MP_WAKEUP_CLIENT,       // other client API activity
+    MP_WAKEUP_DEMUX,        // demuxer thread has new packets
+    MP_WAKEUP_AO,
+    MP_WAKEUP_VO,
+    MP_WAKEUP_TIMEOUT,      // sleep ended because the timeout was reached
+    MP_WAKEUP_SRC_COUNT
+};
+
+extern const char *const mp_wakeup_src_names[MP_WAKEUP_SRC_COUNT];
+
+// Same as mp_input_wakeup(), but account the wakeup to the given source.
+// This doesn't lock, so it can be used from audio callbacks too.
+void mp_input_wakeup_src(struct input_ctx *ictx, enum mp_wakeup_src src);
+
+struct mp_input_wakeup_stats {
+    int64_t wakeups[MP_WAKEUP_SRC_COUNT]; // number of wakeup requests
+    int64_t iterations;     // number of mp_input_wait() calls
+    double sleep_time;      // seconds spent in mp_input_wait()
+    double active_time;     // seconds spent between mp_input_wait() calls
+};
+
+// Get the accumulated stats. Must be called from the thread calling
+// mp_input_wait().
+void mp_input_get_wakeup_stats(struct input_ctx *ictx,
+                               struct mp_input_wakeup_stats *stats);
+
 // Used to asynchronously abort playback. Needed because the core still can
 // block on network in some situations.
 struct mp_cancel;
@@ -52,6 +52,13 @@ struct mp_ipc_ctx {
     int death_pipe[2];
 };
 
+enum line_state {
+    LINE_START,     // nothing of the current line seen yet
+    LINE_JSON,      // JSON command, fed to the parser as it arrives
+    LINE_TEXT,      // text command, collected until the end of the line
+    LINE_SKIP,      // ignore the rest of the line
+};
+
 struct client_arg {
     struct mp_log *log;
     struct mpv_handle *client;
@@ -61,6 +68,10 @@ struct client_arg {
     bool close_client_fd;
 
     bool writable;
+
+    enum line_state line;
+    struct json_parser *parser;
+    bstr text;
 };
 
 static mpv_node *mpv_node_map_get(mpv_node *src, const char *key)
@@ -231,29 +242,27 @@ static char *json_encode_event(mpv_event *event)
     return output;
 }
 
-// Function is allowed to modify src[n].
+// msg_node is NULL if the command could not be parsed.
 static char *json_execute_command(struct client_arg *arg, void *ta_parent,
-                                  char *src)
+                                  mpv_node *msg_node)
 {
     int rc;
     const char *cmd = NULL;
 
-    mpv_node msg_node;
     mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
 
-    rc = json_parse(ta_parent, &msg_node, &src, 3);
-    if (rc < 0) {
+    if (!msg_node) {
         MP_ERR(arg, "malformed JSON received\n");
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
     }
 
-    if (msg_node.format != MPV_FORMAT_NODE_MAP) {
+    if (msg_node->format != MPV_FORMAT_NODE_MAP) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
     }
 
-    mpv_node *cmd_node = mpv_node_map_get(&msg_node, "command");
+    mpv_node *cmd_node = mpv_node_map_get(msg_node, "command");
     if (!cmd_node ||
         (cmd_node->format != MPV_FORMAT_NODE_ARRAY) ||
         !cmd_node->u.list->num)
@@ -506,6 +515,74 @@ static int ipc_write(int fd, const char *buf, size_t count)
     return 0;
 }
 
+// Process data read from the client. JSON commands are parsed incrementally
+// as the data arrives, and executed as soon as they are complete. Each
+// command must still be on its own line. Returns false on write errors.
+static bool client_feed(struct client_arg *arg, bstr data)
+{
+    while (data.len) {
+        if (arg->line == LINE_START) {
+            unsigned char c = data.start[0];
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+                data = bstr_cut(data, 1);
+                continue;
+            }
+            arg->line = c == '{' ? LINE_JSON : c == '#' ? LINE_SKIP : LINE_TEXT;
+        }
+
+        int nl = bstrchr(data, '\n');
+        bstr line = nl < 0 ? data : bstr_splice(data, 0, nl);
+        data = nl < 0 ? (bstr){0} : bstr_cut(data, nl + 1);
+
+        void *tmp = talloc_new(NULL);
+        char *reply_msg = NULL;
+        switch (arg->line) {
+        case LINE_JSON: {
+            int r = json_parser_feed(arg->parser, &line);
+            // A JSON command must not continue on the next line.
+            if (r == 0 && nl >= 0)
+                r = json_parser_finish(arg->parser);
+            if (r == 0)
+                break;
+            mpv_node msg_node;
+            if (r > 0) {
+                talloc_steal(tmp, json_parser_get(arg->parser, &msg_node));
+            } else {
+                json_parser_reset(arg->parser);
+            }
+            reply_msg = json_execute_command(arg, tmp, r > 0 ? &msg_node : NULL);
+            // Anything after the command on the same line is ignored.
+            arg->line = nl < 0 ? LINE_SKIP : LINE_START;
+            break;
+        }
+        case LINE_TEXT:
+            bstr_xappend(arg, &arg->text, line);
+            if (nl < 0)
+                break;
+            reply_msg = text_execute_command(arg, tmp, bstrto0(tmp, arg->text));
+            arg->text.len = 0;
+            arg->line = LINE_START;
+            break;
+        case LINE_SKIP:
+            if (nl >= 0)
+                arg->line = LINE_START;
+            break;
+        case LINE_START:
+            break;
+        }
+
+        if (reply_msg && arg->writable) {
+            if (ipc_write(arg->client_fd, reply_msg, strlen(reply_msg)) < 0) {
+                MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
+                talloc_free(tmp);
+                return false;
+            }
+        }
+        talloc_free(tmp);
+    }
+    return true;
+}
+
 static void *client_thread(void *p)
 {
     pthread_detach(pthread_self());
@@ -513,7 +590,7 @@ static void *client_thread(void *p)
     int rc;
 
     struct client_arg *arg = p;
-    bstr client_msg = { talloc_strdup(NULL, ""), 0 };
+    arg->parser = json_parser_create(arg, 3);
 
     mpthread_set_name(arg->client_name);
 
@@ -591,47 +668,15 @@ static void *client_thread(void *p)
 
                 append.len = bytes;
 
-                bstr_xappend(NULL, &client_msg, append);
-
-                while (bstrchr(client_msg, '\n') != -1) {
-                    void *tmp = talloc_new(NULL);
-                    bstr rest;
-                    bstr line = bstr_getline(client_msg, &rest);
-                    char *line0 = bstrto0(tmp, line);
-                    talloc_steal(tmp, client_msg.start);
-                    client_msg = bstrdup(NULL, rest);
-
-                    json_skip_whitespace(&line0);
-
-                    char *reply_msg = NULL;
-                    if (line0[0] == '\0' || line0[0] == '#') {
-                        // skip
-                    } else if (line0[0] == '{') {
-                        reply_msg = json_execute_command(arg, tmp, line0);
-                    } else {
-                        reply_msg = text_execute_command(arg, tmp, line0);
-                    }
-
-                    if (reply_msg && arg->writable) {
-                        rc = ipc_write(arg->client_fd, reply_msg,
-                                       strlen(reply_msg));
-                        if (rc < 0) {
-                            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                            talloc_free(tmp);
-                            goto done;
-                        }
-                    }
-
-                    talloc_free(tmp);
-                }
+                if (!client_feed(arg, append))
+                    goto done;
             }
         }
     }
 
 done:
-    if (client_msg.len > 0)
+    if (arg->line == LINE_JSON || arg->line == LINE_TEXT)
         MP_WARN(arg, "Ignoring unterminated command on disconnect.\n");
-    talloc_free(client_msg.start);
     if (arg->close_client_fd)
         close(arg->client_fd);
     mpv_detach_destroy(arg->client);
@@ -0,0 +1,92 @@
+/* Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef MPV_CLIENT_API_STATUS_PAGE_H_
+#define MPV_CLIENT_API_STATUS_PAGE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Warning: this API is not stable yet.
+ *
+ * Overview
+ * --------
+ *
+ * With --status-page=<file>, the player maps the given file into memory, and
+ * writes a struct mpv_status_page to its start on every playloop iteration.
+ * Other processes can mmap() the same file (read-only is enough) and poll
+ * it at any rate. This doesn't require any system calls or communication
+ * with the player, and can't block or slow down playback. Pointing the path
+ * to a tmpfs (such as /dev/shm on Linux) avoids any disk I/O.
+ *
+ * The page uses a sequence lock. The player increments seq before and after
+ * each update, so an odd value means an update is in progress. A reader has
+ * to retry until it got a consistent copy:
+ *
+ *      struct mpv_status_page copy;
+ *      uint32_t seq;
+ *      do {
+ *          seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+ *          memcpy(&copy, (void *)page, sizeof(copy));
+ *          __atomic_thread_fence(__ATOMIC_ACQUIRE);
+ *      } while ((seq & 1) || seq != __atomic_load_n(&page->seq,
+ *                                                   __ATOMIC_RELAXED));
+ *
+ * An existing file is reused in place and never truncated, so readers can
+ * keep it mapped across player restarts.
+ *
+ * Readers should check magic and version, and must not assume the file is
+ * larger than the size field. New fields are only appended at the end, and
+ * increment the version.
+ *
+ * Unknown or unavailable floating point values are set to NAN.
+ */
+
+#define MPV_STATUS_PAGE_MAGIC 0x6d707673 // "mpvs" (little endian)
+#define MPV_STATUS_PAGE_VERSION 1
+
+#define MPV_STATUS_PAGE_PATH_SIZE 1024
+
+struct mpv_status_page {
+    uint32_t magic;         // MPV_STATUS_PAGE_MAGIC
+    uint32_t version;       // MPV_STATUS_PAGE_VERSION
+    uint32_t size;          // sizeof(struct mpv_status_page)
+    uint32_t seq;           // sequence lock (see above)
+    uint64_t update_count;  // incremented on every update
+    // Same as the properties of the same name.
+    double time_pos;
+    double duration;
+    double avsync;
+    double total_avsync_change;
+    double speed;
+    double cache_percent;   // updated a few times per second only
+    int32_t pause;
+    int32_t paused_for_cache;
+    int32_t idle;           // 1 if no file is loaded
+    int32_t drop_frame_count;
+    int32_t playlist_pos;
+    int32_t reserved;
+    // Currently playing file (same as "path" property), 0-terminated and
+    // possibly truncated. Empty if no file is loaded.
+    char path[MPV_STATUS_PAGE_PATH_SIZE];
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -24,6 +24,12 @@
  *
  * Does not support extensions like unquoted string literals.
  *
+ * The parser is a non-recursive state machine, which can be fed with input
+ * in arbitrary pieces (e.g. as returned by read() on a socket). Each byte is
+ * looked at only once. All memory of a parsed document (nodes, lists and
+ * strings) is allocated from a single arena, which is one talloc allocation
+ * from the caller's point of view.
+ *
  * Also see: http://tools.ietf.org/html/rfc4627
  *
  * JSON writer:
@@ -35,7 +41,8 @@
  * a "fixup" pass on the input data. The latter could for example change
  * invalid UTF-8 sequences to replacement characters.
  *
- * Currently, will insert \u literals for characters 0-31, '"', '\', and write
+ * Currently, will insert short escapes for '"', '\' and the control characters
+ * that have one, \u literals for all other characters 0-31, and write
  * everything else literally.
  */
 
@@ -51,205 +58,503 @@
 
 #include "json.h"
 
-static bool eat_c(char **s, char c)
+// Arena chunks start small (most IPC messages are tiny), and grow up to this.
+#define ARENA_MIN_CHUNK 512
+#define ARENA_MAX_CHUNK (64 * 1024)
+#define ARENA_ALIGN 16
+
+enum lex_state {
+    LEX_NONE,       // between tokens
+    LEX_STRING,     // inside a "..." literal
+    LEX_LITERAL,    // inside a number, or true/false/null
+};
+
+enum parse_state {
+    EXPECT_VALUE,           // top-level, after ':', after ',' in arrays
+    EXPECT_VALUE_OR_END,    // after '['
+    EXPECT_KEY,             // after ',' in objects
+    EXPECT_KEY_OR_END,      // after '{'
+    EXPECT_COLON,           // after an object key
+    EXPECT_COMMA_OR_END,    // after a value inside of a container
+    EXPECT_DONE,            // top-level value is complete
+};
+
+struct json_frame {
+    bool is_obj;
+    int first;          // index of the first element in json_parser.values
+    char *key;          // key of the container itself (if parent is an object)
+};
+
+struct json_parser {
+    int max_depth;
+    bool error;
+
+    enum lex_state lex;
+    bool lex_escape;    // previous byte was a '\' in LEX_STRING
+    bool lex_has_escapes;
+    bool lex_is_key;
+    bstr tok;           // raw bytes of the current string or literal token
+    bstr scratch;       // unescaped string (reused between tokens)
+
+    enum parse_state state;
+    struct json_frame *frames;
+    int num_frames;
+    // Elements of all open containers. On container end, they're copied to
+    // the arena, so these arrays are reused for the whole parser lifetime.
+    struct mpv_node *values;
+    char **keys;
+    int num_values;
+    char *pending_key;
+    struct mpv_node result;
+
+    // Arena for the current document. All chunks are children of doc.
+    void *doc;
+    char *arena_cur;
+    size_t arena_avail;
+    size_t arena_next;
+};
+
+static void *arena_alloc(struct json_parser *p, size_t size)
 {
-    if (**s == c) {
-        *s += 1;
-        return true;
+    size = MP_ALIGN_UP(size, ARENA_ALIGN);
+    if (size > p->arena_avail) {
+        if (!p->doc)
+            p->doc = talloc_new(p);
+        size_t chunk = MPMAX(p->arena_next, size);
+        p->arena_cur = talloc_size(p->doc, chunk);
+        p->arena_avail = chunk;
+        p->arena_next = MPMIN(p->arena_next * 2, ARENA_MAX_CHUNK);
     }
-    return false;
+    void *res = p->arena_cur;
+    p->arena_cur += size;
+    p->arena_avail -= size;
+    return res;
 }
 
-static void eat_ws(char **src)
+static char *arena_strndup(struct json_parser *p, bstr s)
 {
-    while (1) {
-        char c = **src;
-        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
-            return;
-        *src += 1;
+    char *res = arena_alloc(p, s.len + 1);
+    if (s.len)
+        memcpy(res, s.start, s.len);
+    res[s.len] = '\0';
+    return res;
+}
+
+static void reset_document(struct json_parser *p)
+{
+    p->error = false;
+    p->lex = LEX_NONE;
+    p->state = EXPECT_VALUE;
+    p->num_frames = 0;
+    p->num_values = 0;
+    p->pending_key = NULL;
+    p->result = (struct mpv_node){0};
+    p->doc = NULL;
+    p->arena_cur = NULL;
+    p->arena_avail = 0;
+    p->arena_next = ARENA_MIN_CHUNK;
+}
+
+// Create an incremental parser. max_depth limits the JSON tree depth (a
+// scalar at top-level has depth 1). Free it with talloc_free().
+struct json_parser *json_parser_create(void *ta_parent, int max_depth)
+{
+    struct json_parser *p = talloc_zero(ta_parent, struct json_parser);
+    p->max_depth = max_depth;
+    p->scratch.start = talloc_size(p, 64);
+    reset_document(p);
+    return p;
+}
+
+// Discard the current (partial or complete) document and any error state.
+void json_parser_reset(struct json_parser *p)
+{
+    talloc_free(p->doc);
+    reset_document(p);
+}
+
+// Return the parsed document, and reset the parser for the next one. Must
+// only be called after json_parser_feed() or json_parser_finish() reported a
+// complete document. All memory referenced by *dst is owned by the returned
+// talloc context (which can be NULL if no memory was needed). The caller
+// frees or reparents it.
+void *json_parser_get(struct json_parser *p, struct mpv_node *dst)
+{
+    assert(p->state == EXPECT_DONE && !p->error);
+    *dst = p->result;
+    void *doc = p->doc;
+    talloc_steal(NULL, doc);
+    reset_document(p);
+    return doc;
+}
+
+static bool begin_value(struct json_parser *p)
+{
+    if (p->state != EXPECT_VALUE && p->state != EXPECT_VALUE_OR_END)
+        return false;
+    return p->num_frames + 1 <= p->max_depth;
+}
+
+static void push_value(struct json_parser *p, struct mpv_node *node)
+{
+    if (!p->num_frames) {
+        p->result = *node;
+        p->state = EXPECT_DONE;
+        return;
     }
+    MP_TARRAY_GROW(p, p->values, p->num_values);
+    MP_TARRAY_GROW(p, p->keys, p->num_values);
+    p->values[p->num_values] = *node;
+    p->keys[p->num_values] = p->pending_key;
+    p->num_values++;
+    p->pending_key = NULL;
+    p->state = EXPECT_COMMA_OR_END;
 }
 
-void json_skip_whitespace(char **src)
+static bool begin_container(struct json_parser *p, bool is_obj)
 {
-    eat_ws(src);
+    if (!begin_value(p))
+        return false;
+    MP_TARRAY_APPEND(p, p->frames, p->num_frames, (struct json_frame){
+        .is_obj = is_obj,
+        .first = p->num_values,
+        .key = p->pending_key,
+    });
+    p->pending_key = NULL;
+    p->state = is_obj ? EXPECT_KEY_OR_END : EXPECT_VALUE_OR_END;
+    return true;
 }
 
-static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
+static bool end_container(struct json_parser *p, bool is_obj)
 {
-    if (!eat_c(src, '"'))
-        return -1; // not a string
-    char *str = *src;
-    char *cur = str;
-    bool has_escapes = false;
-    while (cur[0] && cur[0] != '"') {
-        if (cur[0] == '\\') {
-            has_escapes = true;
-            // skip >\"< and >\\< (latter to handle >\\"< correctly)
-            if (cur[1] == '"' || cur[1] == '\\')
-                cur++;
+    if (!p->num_frames)
+        return false;
+    struct json_frame *f = &p->frames[p->num_frames - 1];
+    enum parse_state empty = is_obj ? EXPECT_KEY_OR_END : EXPECT_VALUE_OR_END;
+    if (f->is_obj != is_obj ||
+        (p->state != EXPECT_COMMA_OR_END && p->state != empty))
+        return false;
+    int num = p->num_values - f->first;
+    struct mpv_node_list *list = arena_alloc(p, sizeof(*list));
+    *list = (struct mpv_node_list){ .num = num };
+    if (num) {
+        list->values = arena_alloc(p, num * sizeof(list->values[0]));
+        memcpy(list->values, &p->values[f->first],
+               num * sizeof(list->values[0]));
+        if (is_obj) {
+            list->keys = arena_alloc(p, num * sizeof(list->keys[0]));
+            memcpy(list->keys, &p->keys[f->first], num * sizeof(list->keys[0]));
         }
-        cur++;
     }
-    if (cur[0] != '"')
-        return -1; // invalid termination
-    // Mutate input string so we have a null-terminated string to the literal.
-    // This is a stupid micro-optimization, so we can avoid allocation.
-    cur[0] = '\0';
-    *src = cur + 1;
-    if (has_escapes) {
-        bstr unescaped = {0};
-        bstr r = bstr0(str);
-        if (!mp_append_escaped_string(ta_parent, &unescaped, &r))
-            return -1; // broken escapes
-        str = unescaped.start; // the function guarantees null-termination
+    p->num_values = f->first;
+    p->pending_key = f->key;
+    p->num_frames--;
+    struct mpv_node node = {
+        .format = is_obj ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY,
+        .u.list = list,
+    };
+    push_value(p, &node);
+    return true;
+}
+
+static bool finish_string(struct json_parser *p)
+{
+    bstr str = p->tok;
+    if (p->lex_has_escapes) {
+        p->scratch.len = 0;
+        bstr raw = p->tok;
+        if (!mp_append_escaped_string(p, &p->scratch, &raw) || raw.len)
+            return false; // broken escapes
+        str = p->scratch;
     }
-    dst->format = MPV_FORMAT_STRING;
-    dst->u.string = str;
-    return 0;
+    char *s = arena_strndup(p, str);
+    if (p->lex_is_key) {
+        p->pending_key = s;
+        p->state = EXPECT_COLON;
+    } else {
+        push_value(p, &(struct mpv_node){
+            .format = MPV_FORMAT_STRING,
+            .u.string = s,
+        });
+    }
+    return true;
 }
 
-static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
-                    int max_depth)
+static bool finish_literal(struct json_parser *p)
 {
-    bool is_arr = eat_c(src, '[');
-    bool is_obj = !is_arr && eat_c(src, '{');
-    if (!is_arr && !is_obj)
-        return -1; // not an array or object
-    char term = is_obj ? '}' : ']';
-    struct mpv_node_list *list = talloc_zero(ta_parent, struct mpv_node_list);
-    while (1) {
-        eat_ws(src);
-        if (eat_c(src, term))
+    // bstr_xappend() always 0-terminates, and the token is never empty.
+    char *s = p->tok.start;
+    char *end = s + p->tok.len;
+    struct mpv_node node = {0};
+    if (strcmp(s, "null") == 0) {
+        node.format = MPV_FORMAT_NONE;
+    } else if (strcmp(s, "true") == 0) {
+        node.format = MPV_FORMAT_FLAG;
+        node.u.flag = 1;
+    } else if (strcmp(s, "false") == 0) {
+        node.format = MPV_FORMAT_FLAG;
+        node.u.flag = 0;
+    } else {
+        // The number could be either a float or an int. JSON doesn't make a
+        // difference, but the client API does.
+        char *nsrci = s, *nsrcf = s;
+        errno = 0;
+        long long int numi = strtoll(s, &nsrci, 0);
+        if (errno)
+            nsrci = s;
+        errno = 0;
+        double numf = strtod(s, &nsrcf);
+        if (errno)
+            nsrcf = s;
+        if (nsrci == end && nsrci >= nsrcf) {
+            node.format = MPV_FORMAT_INT64; // long long is usually 64 bits
+            node.u.int64 = numi;
+        } else if (nsrcf == end && isfinite(numf)) {
+            node.format = MPV_FORMAT_DOUBLE;
+            node.u.double_ = numf;
+        } else {
+            return false;
+        }
+    }
+    push_value(p, &node);
+    return true;
+}
+
+static bool is_literal_char(unsigned char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+           (c >= 'A' && c <= 'Z') || c == '-' || c == '+' || c == '.';
+}
+
+static bool is_ws(unsigned char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Consume the start of *data, until either a complete document was parsed, or
+// all data was consumed. *data is advanced past the consumed bytes.
+// Returns:
+//   1: a document is complete (use json_parser_get())
+//   0: more data is needed
+//  -1: syntax error (use json_parser_reset() to parse the next document)
+// Note that a top-level number can end only on a delimiter, or when calling
+// json_parser_finish().
+int json_parser_feed(struct json_parser *p, bstr *data)
+{
+    if (p->error)
+        return -1;
+    while (data->len && p->state != EXPECT_DONE) {
+        if (p->lex == LEX_STRING) {
+            size_t n = 0;
+            bool escape = p->lex_escape;
+            while (n < data->len) {
+                unsigned char c = data->start[n];
+                if (escape) {
+                    escape = false;
+                } else if (c == '\\') {
+                    escape = true;
+                    p->lex_has_escapes = true;
+                } else if (c == '"') {
+                    break;
+                }
+                n++;
+            }
+            p->lex_escape = escape;
+            bstr_xappend(p, &p->tok, bstr_splice(*data, 0, n));
+            *data = bstr_cut(*data, n);
+            if (!data->len)
+                break;
+            *data = bstr_cut(*data, 1); // closing '"'
+            p->lex = LEX_NONE;
+            if (!finish_string(p))
+                goto error;
+            continue;
+        }
+        if (p->lex == LEX_LITERAL) {
+            size_t n = 0;
+            while (n < data->len && is_literal_char(data->start[n]))
+                n++;
+            bstr_xappend(p, &p->tok, bstr_splice(*data, 0, n));
+            *data = bstr_cut(*data, n);
+            if (!data->len)
+                break;
+            p->lex = LEX_NONE;
+            if (!finish_literal(p))
+                goto error;
+            continue;
+        }
+
+        unsigned char c = data->start[0];
+        if (is_ws(c)) {
+            *data = bstr_cut(*data, 1);
+            continue;
+        }
+        if (c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' ||
+            c == 'n')
+        {
+            // Token is consumed by the LEX_LITERAL case.
+            if (!begin_value(p))
+                goto error;
+            p->lex = LEX_LITERAL;
+            p->tok.len = 0;
+            continue;
+        }
+        *data = bstr_cut(*data, 1);
+        switch (c) {
+        case '"':
+            p->lex_is_key = p->state == EXPECT_KEY ||
+                            p->state == EXPECT_KEY_OR_END;
+            if (!p->lex_is_key && !begin_value(p))
+                goto error;
+            p->lex = LEX_STRING;
+            p->lex_escape = false;
+            p->lex_has_escapes = false;
+            p->tok.len = 0;
             break;
-        if (list->num > 0 && !eat_c(src, ','))
-            return -1; // missing ','
-        eat_ws(src);
-        if (is_obj) {
-            struct mpv_node keynode;
-            if (read_str(list, &keynode, src) < 0)
-                return -1; // key is not a string
-            eat_ws(src);
-            if (!eat_c(src, ':'))
-                return -1; // ':' missing
-            eat_ws(src);
-            MP_TARRAY_GROW(list, list->keys, list->num);
-            list->keys[list->num] = keynode.u.string;
+        case '[':
+        case '{':
+            if (!begin_container(p, c == '{'))
+                goto error;
+            break;
+        case ']':
+        case '}':
+            if (!end_container(p, c == '}'))
+                goto error;
+            break;
+        case ',':
+            if (p->state != EXPECT_COMMA_OR_END)
+                goto error;
+            p->state = p->frames[p->num_frames - 1].is_obj ? EXPECT_KEY
+                                                          : EXPECT_VALUE;
+            break;
+        case ':':
+            if (p->state != EXPECT_COLON)
+                goto error;
+            p->state = EXPECT_VALUE;
+            break;
+        default:
+            goto error; // character doesn't start a valid token
         }
-        MP_TARRAY_GROW(list, list->values, list->num);
-        if (json_parse(ta_parent, &list->values[list->num], src, max_depth) < 0)
+    }
+    return p->state == EXPECT_DONE ? 1 : 0;
+error:
+    p->error = true;
+    return -1;
+}
+
+// Signal the end of input. This completes a pending top-level number.
+// Returns 1 if a document is complete, -1 otherwise (error or early EOF).
+int json_parser_finish(struct json_parser *p)
+{
+    if (p->error)
+        return -1;
+    if (p->lex == LEX_LITERAL) {
+        p->lex = LEX_NONE;
+        if (!finish_literal(p)) {
+            p->error = true;
             return -1;
-        list->num++;
+        }
     }
-    dst->format = is_obj ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY;
-    dst->u.list = list;
-    return 0;
+    return p->state == EXPECT_DONE ? 1 : -1;
+}
+
+void json_skip_whitespace(char **src)
+{
+    while (is_ws(**src))
+        *src += 1;
 }
 
 /* Parse the string in *src as JSON, and write the result into *dst.
- * max_depth limits the recursion and JSON tree depth.
- * Warning: this overwrites the input string (what *src points to)!
+ * max_depth limits the JSON tree depth.
  * Returns:
  *   0: success, *dst is valid, *src points to the end (the caller must check
  *      whether *src really terminates)
- *  -1: failure, *dst is invalid, there may be dead allocs under ta_parent
- *      (ta_free_children(ta_parent) is the only way to free them)
- * The input string can be mutated in both cases. *dst might contain string
- * elements, which point into the (mutated) input string.
+ *  -1: failure, *dst is invalid
+ * On success, all memory referenced by *dst is allocated as a child of
+ * ta_parent. The input string is not modified.
  */
 int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
 {
-    max_depth -= 1;
-    if (max_depth < 0)
-        return -1;
+    struct json_parser *p = json_parser_create(NULL, max_depth);
+    bstr data = bstr0(*src);
+    int r = json_parser_feed(p, &data);
+    if (r == 0)
+        r = json_parser_finish(p);
+    if (r > 0) {
+        *src = data.start;
+        talloc_steal(ta_parent, json_parser_get(p, dst));
+    }
+    talloc_free(p);
+    return r > 0 ? 0 : -1;
+}
 
-    eat_ws(src);
 
-    char c = **src;
-    if (!c)
-        return -1; // early EOF
-    if (c == 'n' && strncmp(*src, "null", 4) == 0) {
-        *src += 4;
-        dst->format = MPV_FORMAT_NONE;
-        return 0;
-    } else if (c == 't' && strncmp(*src, "true", 4) == 0) {
-        *src += 4;
-        dst->format = MPV_FORMAT_FLAG;
-        dst->u.flag = 1;
-        return 0;
-    } else if (c == 'f' && strncmp(*src, "false", 5) == 0) {
-        *src += 5;
-        dst->format = MPV_FORMAT_FLAG;
-        dst->u.flag = 0;
-        return 0;
-    } else if (c == '"') {
-        return read_str(ta_parent, dst, src);
-    } else if (c == '[' || c == '{') {
-        return read_sub(ta_parent, dst, src, max_depth);
-    } else if (c == '-' || (c >= '0' && c <= '9')) {
-        // The number could be either a float or an int. JSON doesn't make a
-        // difference, but the client API does.
-        char *nsrci = *src, *nsrcf = *src;
-        errno = 0;
-        long long int numi = strtoll(*src, &nsrci, 0);
-        if (errno)
-            nsrci = *src;
-        errno = 0;
-        double numf = strtod(*src, &nsrcf);
-        if (errno)
-            nsrcf = *src;
-        if (nsrci >= nsrcf) {
-            *src = nsrci;
-            dst->format = MPV_FORMAT_INT64; // long long is usually 64 bits
-            dst->u.int64 = numi;
-            return 0;
-        }
-        if (nsrcf > *src && isfinite(numf)) {
-            *src = nsrcf;
-            dst->format = MPV_FORMAT_DOUBLE;
-            dst->u.double_ = numf;
-            return 0;
-        }
-        return -1;
-    }
-    return -1; // character doesn't start a valid token
+static void append_bytes(bstr *b, const char *s, size_t len)
+{
+    bstr_xappend(NULL, b, (bstr){(unsigned char *)s, len});
 }
 
+#define APPEND(b, s) append_bytes(b, "" s, sizeof(s) - 1)
 
-#define APPEND(b, s) bstr_xappend(NULL, (b), bstr0(s))
+// Character after the '\' for chars which have a short escape, and 0 for
+// chars >= 32 which can be written literally.
+static const char json_escapes[256] = {
+    ['"'] = '"', ['\\'] = '\\', ['\b'] = 'b', ['\f'] = 'f', ['\n'] = 'n',
+    ['\r'] = 'r', ['\t'] = 't',
+};
 
 static void write_json_str(bstr *b, char *str)
 {
+    static const char hex[] = "0123456789abcdef";
     APPEND(b, "\"");
     while (1) {
-        char *cur = str;
-        while (cur[0] && cur[0] >= 32 && cur[0] != '"' && cur[0] != '\\')
+        unsigned char *cur = (unsigned char *)str;
+        while (cur[0] >= 32 && !json_escapes[cur[0]])
             cur++;
+        append_bytes(b, str, (char *)cur - str);
         if (!cur[0])
             break;
-        bstr_xappend(NULL, b, (bstr){str, cur - str});
-        bstr_xappend_asprintf(NULL, b, "\\u%04x", (unsigned char)cur[0]);
-        str = cur + 1;
+        char esc = json_escapes[cur[0]];
+        if (esc) {
+            char buf[2] = {'\\', esc};
+            append_bytes(b, buf, 2);
+        } else {
+            char buf[6] = {'\\', 'u', '0', '0', hex[cur[0] >> 4],
+                           hex[cur[0] & 15]};
+            append_bytes(b, buf, 6);
+        }
+        str = (char *)cur + 1;
     }
-    APPEND(b, str);
     APPEND(b, "\"");
 }
 
 static int json_append(bstr *b, const struct mpv_node *src)
 {
+    char buf[80];
     switch (src->format) {
     case MPV_FORMAT_NONE:
         APPEND(b, "null");
         return 0;
     case MPV_FORMAT_FLAG:
-        APPEND(b, src->u.flag ? "true" : "false");
+        if (src->u.flag) {
+            APPEND(b, "true");
+        } else {
+            APPEND(b, "false");
+        }
         return 0;
     case MPV_FORMAT_INT64:
-        bstr_xappend_asprintf(NULL, b, "%"PRId64, src->u.int64);
+        append_bytes(b, buf, snprintf(buf, sizeof(buf), "%"PRId64,
+                                      src->u.int64));
         return 0;
-    case MPV_FORMAT_DOUBLE:
-        bstr_xappend_asprintf(NULL, b, "%f", src->u.double_);
+    case MPV_FORMAT_DOUBLE: {
+        int len = snprintf(buf, sizeof(buf), "%f", src->u.double_);
+        if (len < sizeof(buf)) {
+            append_bytes(b, buf, len);
+        } else {
+            bstr_xappend_asprintf(NULL, b, "%f", src->u.double_);
+        }
         return 0;
+    }
     case MPV_FORMAT_STRING:
         write_json_str(b, src->u.string);
         return 0;
@@ -257,7 +562,7 @@ static int json_append(bstr *b, const struct mpv_node *src)
     case MPV_FORMAT_NODE_MAP: {
         struct mpv_node_list *list = src->u.list;
         bool is_obj = src->format == MPV_FORMAT_NODE_MAP;
-        APPEND(b, is_obj ? "{" : "[");
+        append_bytes(b, is_obj ? "{" : "[", 1);
         for (int n = 0; n < list->num; n++) {
             if (n)
                 APPEND(b, ",");
@@ -267,7 +572,7 @@ static int json_append(bstr *b, const struct mpv_node *src)
             }
             json_append(b, &list->values[n]);
         }
-        APPEND(b, is_obj ? "}" : "]");
+        append_bytes(b, is_obj ? "}" : "]", 1);
         return 0;
     }
     }
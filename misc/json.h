@@ -20,6 +20,14 @@
 
 // We reuse mpv_node.
 #include "libmpv/client.h"
+#include "misc/bstr.h"
+
+struct json_parser;
+struct json_parser *json_parser_create(void *ta_parent, int max_depth);
+int json_parser_feed(struct json_parser *p, bstr *data);
+int json_parser_finish(struct json_parser *p);
+void *json_parser_get(struct json_parser *p, struct mpv_node *dst);
+void json_parser_reset(struct json_parser *p);
 
 int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth);
 void json_skip_whitespace(char **src);
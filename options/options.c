@@ -146,6 +146,7 @@ const m_option_t mp_opts[] = {
     OPT_INTRANGE("cache-seek-min", stream_cache.seek_min, 0, 0, 0x7fffffff),
     OPT_STRING("cache-file", stream_cache.file, M_OPT_FILE),
     OPT_INTRANGE("cache-file-size", stream_cache.file_max, 0, 0, 0x7fffffff),
+    OPT_INTRANGE("cache-process-max", stream_cache.process_max, 0, 0, 0x7fffffff),
 
 #if HAVE_DVDREAD || HAVE_DVDNAV
     OPT_STRING("dvd-device", dvd_device, M_OPT_FILE),
@@ -260,6 +261,8 @@ const m_option_t mp_opts[] = {
                .min = 0.01, .max = 100.0),
 
     OPT_FLAG("audio-pitch-correction", pitch_correction, 0),
+    OPT_CHOICE("audio-pitch-correction-filter", pitch_correction_filter, 0,
+               ({"scaletempo", 0}, {"stretch", 1})),
 
     // set a-v distance
     OPT_FLOATRANGE("audio-delay", audio_delay, 0, -100.0, 100.0),
@@ -269,6 +272,8 @@ const m_option_t mp_opts[] = {
     OPT_SETTINGSLIST("af-defaults", af_defs, 0, &af_obj_list),
     OPT_SETTINGSLIST("af*", af_settings, M_OPT_FIXED, &af_obj_list),
     OPT_SETTINGSLIST("vf-defaults", vf_defs, 0, &vf_obj_list),
+    OPT_FLAG("vf-pipeline", vf_pipeline, 0),
+    OPT_INTRANGE("image-pool-max", image_pool_max, 0, 0, 0x7fffffff),
     OPT_SETTINGSLIST("vf*", vf_settings, M_OPT_FIXED, &vf_obj_list),
 
     OPT_CHOICE("deinterlace", deinterlace, M_OPT_OPTIONAL_PARAM | M_OPT_FIXED,
@@ -277,7 +282,9 @@ const m_option_t mp_opts[] = {
                 {"yes", 1}, {"", 1})),
 
     OPT_STRING("ad", audio_decoders, 0),
+    OPT_DOUBLE("ad-queue", ad_queue, M_OPT_RANGE, .min = 0, .max = 10),
     OPT_STRING("vd", video_decoders, 0),
+    OPT_INTRANGE("vd-queue", vd_queue, 0, 0, 64),
 
     OPT_FLAG("ad-spdif-dtshd", dtshd, 0),
 
@@ -391,6 +398,7 @@ const m_option_t mp_opts[] = {
                 {"weak", -1})),
     OPT_DOUBLE("audio-buffer", audio_buffer, M_OPT_MIN | M_OPT_MAX,
                .min = 0, .max = 10),
+    OPT_FLAG("audio-smooth-delay", audio_smooth_delay, 0),
 
     OPT_GEOMETRY("geometry", vo.geometry, 0),
     OPT_SIZE_BOX("autofit", vo.autofit, 0),
@@ -508,6 +516,8 @@ const m_option_t mp_opts[] = {
     OPT_FLAG("save-position-on-quit", position_save_on_quit, 0),
     OPT_FLAG("write-filename-in-watch-later-config", write_filename_in_watch_later_config, 0),
     OPT_FLAG("ignore-path-in-watch-later-config", ignore_path_in_watch_later_config, 0),
+    OPT_FLAG("replaygain-scan", replaygain_scan, M_OPT_FIXED),
+    OPT_FLAG("replaygain-db", replaygain_db, 0),
 
     OPT_FLAG("ordered-chapters", ordered_chapters, 0),
     OPT_STRING("ordered-chapters-files", ordered_chapters_files, M_OPT_FILE),
@@ -558,6 +568,7 @@ const m_option_t mp_opts[] = {
 
     OPT_STRING("input-file", input_file, M_OPT_FILE | M_OPT_GLOBAL),
     OPT_STRING("input-unix-socket", ipc_path, M_OPT_FILE),
+    OPT_STRING("status-page", status_page_path, M_OPT_FILE),
 
     OPT_SUBSTRUCT("screenshot", screenshot_image_opts, image_writer_conf, 0),
     OPT_STRING("screenshot-template", screenshot_template, 0),
@@ -717,6 +728,7 @@ const struct MPOpts mp_default_opts = {
     .hr_seek_framedrop = 1,
     .load_config = 1,
     .position_resume = 1,
+    .replaygain_db = 1,
     .stream_cache = {
         .size = -1,
         .def_size = 25000,
@@ -724,6 +736,7 @@ const struct MPOpts mp_default_opts = {
         .seek_min = 500,
         .file_max = 1024 * 1024,
     },
+    .image_pool_max = 64 * 1024,
     .demuxer_thread = 1,
     .demuxer_min_packs = 0,
     .demuxer_min_bytes = 0,
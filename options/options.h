@@ -50,6 +50,7 @@ struct mp_cache_opts {
     int seek_min;
     char *file;
     int file_max;
+    int process_max;
 };
 
 typedef struct MPOpts {
@@ -82,6 +83,7 @@ typedef struct MPOpts {
     float softvol_max;
     int gapless_audio;
     double audio_buffer;
+    int audio_smooth_delay;
 
     mp_vo_opts vo;
     int allow_win_drag;
@@ -110,7 +112,9 @@ typedef struct MPOpts {
     int video_stereo_mode;
 
     char *audio_decoders;
+    double ad_queue;
     char *video_decoders;
+    int vd_queue;
 
     int osd_level;
     int osd_duration;
@@ -171,6 +175,8 @@ typedef struct MPOpts {
     int position_save_on_quit;
     int write_filename_in_watch_later_config;
     int ignore_path_in_watch_later_config;
+    int replaygain_scan;
+    int replaygain_db;
     int pause;
     int keep_open;
     int audio_id;
@@ -222,7 +228,10 @@ typedef struct MPOpts {
     int dtshd;
     double playback_speed;
     int pitch_correction;
+    int pitch_correction_filter;
     struct m_obj_settings *vf_settings, *vf_defs;
+    int vf_pipeline;
+    int image_pool_max;
     struct m_obj_settings *af_settings, *af_defs;
     int deinterlace;
     float movie_aspect;
@@ -305,6 +314,7 @@ typedef struct MPOpts {
 
     char *ipc_path;
     char *input_file;
+    char *status_page_path;
 } MPOpts;
 
 extern const m_option_t mp_opts[];
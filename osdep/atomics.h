@@ -41,6 +41,21 @@ typedef struct { volatile unsigned long long v; } atomic_ullong;
 #define ATOMIC_VAR_INIT(x) \
     {.v = (x)}
 
+#if HAVE_ATOMIC_BUILTINS
+#define MP_MO(x) __ATOMIC_ ## x
+#else
+#define MP_MO(x) 0
+#endif
+
+typedef enum {
+    memory_order_relaxed = MP_MO(RELAXED),
+    memory_order_acquire = MP_MO(ACQUIRE),
+    memory_order_release = MP_MO(RELEASE),
+    memory_order_seq_cst = MP_MO(SEQ_CST),
+} memory_order;
+
+#undef MP_MO
+
 #if HAVE_ATOMIC_BUILTINS
 
 #define atomic_load(p) \
@@ -52,6 +67,12 @@ typedef struct { volatile unsigned long long v; } atomic_ullong;
 #define atomic_compare_exchange_strong(a, b, c) \
     __atomic_compare_exchange_n(&(a)->v, b, c, 0, __ATOMIC_SEQ_CST, \
     __ATOMIC_SEQ_CST)
+#define atomic_load_explicit(p, order) \
+    __atomic_load_n(&(p)->v, order)
+#define atomic_store_explicit(p, val, order) \
+    __atomic_store_n(&(p)->v, val, order)
+#define atomic_thread_fence(order) \
+    __atomic_thread_fence(order)
 
 #elif HAVE_SYNC_BUILTINS
 
@@ -67,6 +88,10 @@ typedef struct { volatile unsigned long long v; } atomic_ullong;
        bool ok_ = val_ == *(old);       \
        if (!ok_) *(old) = val_;         \
        ok_; })
+// Stronger than required.
+#define atomic_load_explicit(p, order) atomic_load(p)
+#define atomic_store_explicit(p, val, order) atomic_store(p, val)
+#define atomic_thread_fence(order) __sync_synchronize()
 
 #else
 
@@ -77,6 +102,9 @@ typedef struct { volatile unsigned long long v; } atomic_ullong;
 #define atomic_fetch_add(a, b) (((a)->v += (b)) - (b))
 #define atomic_compare_exchange_strong(p, old, new) \
     ((p)->v == *(old) ? ((p)->v = (new), 1) : (*(old) = (p)->v, 0))
+#define atomic_load_explicit(p, order) atomic_load(p)
+#define atomic_store_explicit(p, val, order) atomic_store(p, val)
+#define atomic_thread_fence(order) ((void)0)
 
 #undef HAVE_ATOMICS
 #define HAVE_ATOMICS 0
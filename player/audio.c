@@ -68,6 +68,7 @@ static int recreate_audio_filters(struct MPContext *mpctx)
     struct af_stream *afs = mpctx->d_audio->afilter;
 
     double speed = opts->playback_speed;
+    mpctx->d_audio->playback_speed = speed;
 
     if (speed != 1.0) {
         int method = AF_CONTROL_SET_PLAYBACK_SPEED_RESAMPLE;
@@ -82,8 +83,11 @@ static int recreate_audio_filters(struct MPContext *mpctx)
             // filter either.
             if (!af_control_any_rev(afs, AF_CONTROL_SET_PLAYBACK_SPEED, &speed))
             {
-                char *filter = method == AF_CONTROL_SET_PLAYBACK_SPEED
-                             ? "scaletempo" : "forcespeed";
+                char *filter = "forcespeed";
+                if (method == AF_CONTROL_SET_PLAYBACK_SPEED) {
+                    filter = opts->pitch_correction_filter
+                           ? "stretch" : "scaletempo";
+                }
                 if (try_filter(mpctx, filter, "playback-speed", NULL) < 0)
                     return -1;
                 // Try again.
@@ -115,6 +119,7 @@ int reinit_audio_filters(struct MPContext *mpctx)
     if (!d_audio)
         return 0;
 
+    lock_audio_chain(mpctx);
     af_uninit(mpctx->d_audio->afilter);
     if (af_init(mpctx->d_audio->afilter) < 0)
         return -1;
@@ -128,6 +133,9 @@ void set_playback_speed(struct MPContext *mpctx, double new_speed)
 {
     struct MPOpts *opts = mpctx->opts;
 
+    // The decoder thread reads the speed too.
+    lock_audio_chain(mpctx);
+
     // Adjust time until next frame flip for nosound mode
     mpctx->time_frame *= opts->playback_speed / new_speed;
 
@@ -141,6 +149,7 @@ void set_playback_speed(struct MPContext *mpctx, double new_speed)
 
 void reset_audio_state(struct MPContext *mpctx)
 {
+    lock_audio_chain(mpctx);
     if (mpctx->d_audio)
         audio_reset_decoding(mpctx->d_audio);
     if (mpctx->ao_buffer)
@@ -165,6 +174,7 @@ void uninit_audio_out(struct MPContext *mpctx)
 void uninit_audio_chain(struct MPContext *mpctx)
 {
     if (mpctx->d_audio) {
+        lock_audio_chain(mpctx);
         mixer_uninit_audio(mpctx->mixer);
         audio_uninit(mpctx->d_audio);
         mpctx->d_audio = NULL;
@@ -175,11 +185,43 @@ void uninit_audio_chain(struct MPContext *mpctx)
     }
 }
 
+// Whether sample format conversion from a to b loses nothing.
+static bool lossless_conversion(int a, int b)
+{
+    int a_bits = af_fmt2bits(a), b_bits = af_fmt2bits(b);
+    if (af_fmt_is_float(b)) {
+        // The mantissa of a float is 24 bits, 53 for double.
+        return af_fmt_is_float(a) ? a_bits <= b_bits
+                                  : a_bits <= (b_bits > 32 ? 53 : 24);
+    }
+    return !af_fmt_is_float(a) && a_bits <= b_bits;
+}
+
+// Weak gapless audio: whether the AO can stay open for audio decoded with the
+// given format. Only a lossless sample format conversion is allowed in
+// addition to the decoder format the AO was opened for.
+static bool can_keep_ao(struct MPContext *mpctx, struct mp_audio *in_format)
+{
+    struct mp_audio *ao_in = mpctx->ao_decoder_fmt;
+    if (mp_audio_config_equals(ao_in, in_format))
+        return true;
+    if (ao_in->rate != in_format->rate ||
+        !mp_chmap_equals(&ao_in->channels, &in_format->channels))
+        return false;
+    struct mp_audio out_format;
+    ao_get_format(mpctx->ao, &out_format);
+    if (AF_FORMAT_IS_SPECIAL(in_format->format) ||
+        AF_FORMAT_IS_SPECIAL(out_format.format))
+        return false;
+    return lossless_conversion(in_format->format, out_format.format);
+}
+
 void reinit_audio_chain(struct MPContext *mpctx)
 {
     struct MPOpts *opts = mpctx->opts;
     struct track *track = mpctx->current_track[0][STREAM_AUDIO];
     struct sh_stream *sh = track ? track->stream : NULL;
+    lock_audio_chain(mpctx);
     if (!sh) {
         uninit_audio_out(mpctx);
         goto no_audio;
@@ -195,6 +237,15 @@ void reinit_audio_chain(struct MPContext *mpctx)
         mpctx->d_audio->header = sh;
         mpctx->d_audio->pool = mp_audio_pool_create(mpctx->d_audio);
         mpctx->d_audio->afilter = af_new(mpctx->global);
+        // Use gain from a previous --replaygain-scan if the file has no tags.
+        if (!sh->audio->replaygain_data && opts->replaygain_db &&
+            !mpctx->timeline)
+        {
+            char *filename = track->is_external ? track->external_filename
+                                                : mpctx->filename;
+            sh->audio->replaygain_data =
+                mp_replaygain_lookup(mpctx, sh, filename);
+        }
         mpctx->d_audio->afilter->replaygain_data = sh->audio->replaygain_data;
         mpctx->ao_buffer = mp_audio_buffer_create(NULL);
         if (!audio_init_best_codec(mpctx->d_audio, opts->audio_decoders))
@@ -220,7 +271,7 @@ void reinit_audio_chain(struct MPContext *mpctx)
 
     // Weak gapless audio: drain AO on decoder format changes
     if (mpctx->ao_decoder_fmt && mpctx->ao && opts->gapless_audio < 0 &&
-        !mp_audio_config_equals(mpctx->ao_decoder_fmt, &in_format))
+        !can_keep_ao(mpctx, &in_format))
     {
         uninit_audio_out(mpctx);
     }
@@ -284,6 +335,18 @@ void reinit_audio_chain(struct MPContext *mpctx)
 
     set_playback_speed(mpctx, opts->playback_speed);
 
+    // The decoder reads packets on its own, which is safe from another thread
+    // only if the demuxer is threaded.
+    if (opts->ad_queue > 0 && !mpctx->d_audio->thread &&
+        !AF_FORMAT_IS_SPECIAL(afs->output.format) &&
+        demux_stream_is_threaded(sh))
+    {
+        mpctx->d_audio->wakeup_cb = wakeup_playloop;
+        mpctx->d_audio->wakeup_cb_ctx = mpctx;
+        if (!audio_start_thread(mpctx->d_audio, opts->ad_queue))
+            MP_WARN(mpctx, "Could not start audio decoder thread.\n");
+    }
+
     return;
 
 init_error:
@@ -294,6 +357,27 @@ no_audio:
         error_on_track(mpctx, track);
 }
 
+// With the audio decoder thread, the playback thread must call
+// lock_audio_chain() before it accesses the audio decoder or filter chain
+// (mpctx->d_audio, the mixer), and the chain stays locked until
+// unlock_audio_chain(). The playloop unlocks it before the parts which can
+// take long (video decoding and sleeping), but doesn't lock it again after
+// them: that would wait for the chunk the decoder thread is working on.
+// Instead, everything that touches the chain locks it on demand: commands,
+// audio properties, and the functions in this file. The steady state of
+// do_fill_audio_out_buffers() only reads the decoder thread's queue.
+void unlock_audio_chain(struct MPContext *mpctx)
+{
+    if (mpctx->d_audio)
+        audio_thread_resume(mpctx->d_audio);
+}
+
+void lock_audio_chain(struct MPContext *mpctx)
+{
+    if (mpctx->d_audio)
+        audio_thread_pause(mpctx->d_audio);
+}
+
 // Return pts value corresponding to the end point of audio written to the
 // ao so far.
 double written_audio_pts(struct MPContext *mpctx)
@@ -302,38 +386,24 @@ double written_audio_pts(struct MPContext *mpctx)
     if (!d_audio)
         return MP_NOPTS_VALUE;
 
-    struct mp_audio in_format = d_audio->decode_format;
-
-    if (!mp_audio_config_valid(&in_format) || d_audio->afilter->initialized < 1)
-        return MP_NOPTS_VALUE;
+    // Data that was ready for ao but was buffered because ao didn't fully
+    // accept everything to internal buffers yet
+    double buffered_output = mp_audio_buffer_seconds(mpctx->ao_buffer);
 
-    // first calculate the end pts of audio that has been output by decoder
-    double a_pts = d_audio->pts;
+    double a_pts, queued = 0;
+    if (d_audio->thread) {
+        // Also subtract audio queued by the decoder thread. This is already
+        // in source time, as it may have been filtered with another speed.
+        a_pts = audio_thread_get_pts(d_audio, &queued);
+    } else {
+        a_pts = audio_get_output_pts(d_audio);
+    }
     if (a_pts == MP_NOPTS_VALUE)
         return MP_NOPTS_VALUE;
 
-    // d_audio->pts is the timestamp of the latest input packet with
-    // known pts that the decoder has decoded. d_audio->pts_bytes is
-    // the amount of bytes the decoder has written after that timestamp.
-    a_pts += d_audio->pts_offset / (double)in_format.rate;
-
-    // Now a_pts hopefully holds the pts for end of audio from decoder.
-    // Subtract data in buffers between decoder and audio out.
-
-    // Decoded but not filtered
-    if (d_audio->waiting)
-        a_pts -= d_audio->waiting->samples / (double)in_format.rate;
-
-    // Data buffered in audio filters, measured in seconds of "missing" output
-    double buffered_output = af_calc_delay(d_audio->afilter);
-
-    // Data that was ready for ao but was buffered because ao didn't fully
-    // accept everything to internal buffers yet
-    buffered_output += mp_audio_buffer_seconds(mpctx->ao_buffer);
-
     // Filters divide audio length by playback_speed, so multiply by it
     // to get the length in original units without speedup or slowdown
-    a_pts -= buffered_output * mpctx->opts->playback_speed;
+    a_pts -= buffered_output * mpctx->opts->playback_speed + queued;
 
     return a_pts +
         get_track_video_offset(mpctx, mpctx->current_track[0][STREAM_AUDIO]);
@@ -362,7 +432,7 @@ static int write_to_ao(struct MPContext *mpctx, struct mp_audio *data, int flags
     if (data->samples == 0)
         return 0;
     double real_samplerate = out_format.rate / mpctx->opts->playback_speed;
-    int played = ao_play(mpctx->ao, data->planes, data->samples, flags);
+    int played = ao_play_frame(mpctx->ao, data, flags);
     assert(played <= data->samples);
     if (played > 0) {
         mpctx->shown_aframes += played;
@@ -448,6 +518,10 @@ static void do_fill_audio_out_buffers(struct MPContext *mpctx, double endpts)
     if (!d_audio)
         return;
 
+    // (afilter->initialized is only written by the playback thread.)
+    if (!d_audio->thread || d_audio->afilter->initialized < 1 || !mpctx->ao)
+        lock_audio_chain(mpctx);
+
     if (d_audio->afilter->initialized < 1 || !mpctx->ao) {
         // Probe the initial audio format. Returns AD_OK (and does nothing) if
         // the format is already known.
@@ -491,7 +565,20 @@ static void do_fill_audio_out_buffers(struct MPContext *mpctx, double endpts)
 
     int status = AD_OK;
     if (playsize > mp_audio_buffer_samples(mpctx->ao_buffer)) {
-        status = audio_decode(d_audio, mpctx->ao_buffer, playsize);
+        if (d_audio->thread) {
+            status = audio_thread_read(d_audio, mpctx->ao_buffer, playsize);
+            // Count it once if the decoder thread didn't keep up with the AO.
+            bool underrun = status == AD_WAIT &&
+                            mpctx->audio_status == STATUS_PLAYING &&
+                            !mp_audio_buffer_samples(mpctx->ao_buffer);
+            if (underrun && !d_audio->in_underrun) {
+                d_audio->underruns += 1;
+                MP_VERBOSE(mpctx, "Audio decoder thread underrun.\n");
+            }
+            d_audio->in_underrun = underrun;
+        } else {
+            status = audio_decode(d_audio, mpctx->ao_buffer, playsize);
+        }
         if (status == AD_WAIT)
             return;
         if (status == AD_NEW_FMT) {
@@ -583,12 +670,26 @@ static void do_fill_audio_out_buffers(struct MPContext *mpctx, double endpts)
     if (mpctx->paused)
         playsize = 0;
 
-    struct mp_audio data;
-    mp_audio_buffer_peek(mpctx->ao_buffer, &data);
-    data.samples = MPMIN(data.samples, playsize);
-    int played = write_to_ao(mpctx, &data, playflags, written_audio_pts(mpctx));
-    assert(played >= 0 && played <= data.samples);
-    mp_audio_buffer_skip(mpctx->ao_buffer, played);
+    // Pass the buffered frames one by one, so the AO can reference them.
+    int played = 0;
+    do {
+        struct mp_audio data;
+        mp_audio_buffer_peek(mpctx->ao_buffer, &data);
+        data.samples = MPMIN(data.samples, playsize - played);
+        int flags = played + data.samples == playsize ? playflags : 0;
+        int r = write_to_ao(mpctx, &data, flags, written_audio_pts(mpctx));
+        assert(r >= 0 && r <= data.samples);
+        mp_audio_buffer_skip(mpctx->ao_buffer, r);
+        played += r;
+        if (r < data.samples || !r)
+            break;
+    } while (played < playsize);
+
+    // The AO didn't take everything (including the final chunk flag). The
+    // rest must be written before EOF, or it would be lost when the next
+    // file replaces ao_buffer with gapless audio.
+    if (played < playsize)
+        audio_eof = false;
 
     mpctx->audio_status = STATUS_PLAYING;
     if (audio_eof) {
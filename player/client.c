@@ -55,6 +55,30 @@
  *
  */
 
+// Properties which are polled by clients a lot, and which are cheap to get.
+// Reading them doesn't need to stop the playback thread if it's idle. They
+// must depend on playback thread state only: anything updated by other
+// threads (like the cache fill state) would go stale while the playback
+// thread sleeps.
+static const char *const snapshot_properties[] = {
+    "time-pos", "playback-time", "percent-pos", "time-remaining", "length",
+    "pause", "core-idle", "idle", "paused-for-cache", "seeking",
+    "eof-reached", "avsync", "total-avsync-change", "drop-frame-count",
+    "speed", "path", "playlist-pos",
+};
+
+#define NUM_SNAPSHOT_PROPERTIES MP_ARRAY_SIZE(snapshot_properties)
+
+// Only properties read by a client within this time (in microseconds) are
+// put into the snapshot.
+#define SNAPSHOT_KEEP_US (1000 * 1000)
+
+struct snapshot_entry {
+    bool valid;             // property was evaluated for this snapshot
+    int err;                // M_PROPERTY_* return value of M_PROPERTY_GET_NODE
+    struct mpv_node node;   // if err == M_PROPERTY_OK
+};
+
 struct mp_client_api {
     struct MPContext *mpctx;
 
@@ -64,8 +88,18 @@ struct mp_client_api {
     struct mpv_handle **clients;
     int num_clients;
     uint64_t event_masks;   // combined events of all clients, or 0 if unknown
+
+    // Values of snapshot_properties[], published by the playback thread while
+    // it's sleeping (see mp_client_publish_snapshot()).
+    pthread_mutex_t snapshot_lock;
+
+    // -- protected by snapshot_lock
+    struct snapshot_entry *snapshot; // NULL if invalid
+    // mp_time_us() of the last client read of each property (0 if never)
+    int64_t snapshot_read[NUM_SNAPSHOT_PROPERTIES];
 };
 
+
 struct observe_property {
     char *name;
     int id;                 // ==mp_get_property_id(name)
@@ -138,6 +172,18 @@ void mp_clients_init(struct MPContext *mpctx)
         .mpctx = mpctx,
     };
     pthread_mutex_init(&mpctx->clients->lock, NULL);
+    pthread_mutex_init(&mpctx->clients->snapshot_lock, NULL);
+}
+
+static void free_snapshot(struct snapshot_entry *snapshot)
+{
+    if (!snapshot)
+        return;
+    for (int n = 0; n < NUM_SNAPSHOT_PROPERTIES; n++) {
+        if (snapshot[n].valid && snapshot[n].err == M_PROPERTY_OK)
+            mpv_free_node_contents(&snapshot[n].node);
+    }
+    talloc_free(snapshot);
 }
 
 void mp_clients_destroy(struct MPContext *mpctx)
@@ -145,6 +191,8 @@ void mp_clients_destroy(struct MPContext *mpctx)
     if (!mpctx->clients)
         return;
     assert(mpctx->clients->num_clients == 0);
+    free_snapshot(mpctx->clients->snapshot);
+    pthread_mutex_destroy(&mpctx->clients->snapshot_lock);
     pthread_mutex_destroy(&mpctx->clients->lock);
     talloc_free(mpctx->clients);
     mpctx->clients = NULL;
@@ -400,7 +448,7 @@ void mpv_detach_destroy(mpv_handle *ctx)
             // shutdown_clients() sleeps to avoid wasting CPU.
             // mp_hook_test_completion() also relies on this a bit.
             if (clients->mpctx->input)
-                mp_input_wakeup(clients->mpctx->input);
+                mp_input_wakeup_src(clients->mpctx->input, MP_WAKEUP_CLIENT);
             break;
         }
     }
@@ -736,7 +784,7 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
     pthread_mutex_lock(&ctx->lock);
 
     if (!ctx->fuzzy_initialized && ctx->clients->mpctx->input)
-        mp_input_wakeup(ctx->clients->mpctx->input);
+        mp_input_wakeup_src(ctx->clients->mpctx->input, MP_WAKEUP_CLIENT);
     ctx->fuzzy_initialized = true;
 
     if (timeout < 0)
@@ -1256,6 +1304,118 @@ static void getproperty_fn(void *arg)
     }
 }
 
+// Called by the playback thread right before it goes to sleep. Until the next
+// mp_client_invalidate_snapshot() call, nothing can change the core state, so
+// the snapshot is exactly what a locked property read would return.
+// Only properties which clients polled recently are evaluated; reading any
+// other property misses the snapshot and adds it for the next time.
+void mp_client_publish_snapshot(struct MPContext *mpctx)
+{
+    struct mp_client_api *clients = mpctx->clients;
+    bool wanted[NUM_SNAPSHOT_PROPERTIES];
+    bool any = false;
+    int64_t now = mp_time_us();
+
+    pthread_mutex_lock(&clients->snapshot_lock);
+    for (int n = 0; n < NUM_SNAPSHOT_PROPERTIES; n++) {
+        int64_t t = clients->snapshot_read[n];
+        wanted[n] = t && now - t < SNAPSHOT_KEEP_US;
+        any |= wanted[n];
+    }
+    pthread_mutex_unlock(&clients->snapshot_lock);
+
+    // Don't bother if nobody polls properties.
+    if (!any)
+        return;
+
+    struct snapshot_entry *snapshot =
+        talloc_zero_array(NULL, struct snapshot_entry, NUM_SNAPSHOT_PROPERTIES);
+    for (int n = 0; n < NUM_SNAPSHOT_PROPERTIES; n++) {
+        struct snapshot_entry *e = &snapshot[n];
+        if (!wanted[n])
+            continue;
+        e->valid = true;
+        e->err = mp_property_do(snapshot_properties[n], M_PROPERTY_GET_NODE,
+                                &e->node, mpctx);
+    }
+
+    pthread_mutex_lock(&clients->snapshot_lock);
+    struct snapshot_entry *old = clients->snapshot;
+    clients->snapshot = snapshot;
+    pthread_mutex_unlock(&clients->snapshot_lock);
+
+    free_snapshot(old);
+}
+
+// Called by the playback thread when it wakes up.
+void mp_client_invalidate_snapshot(struct MPContext *mpctx)
+{
+    struct mp_client_api *clients = mpctx->clients;
+
+    pthread_mutex_lock(&clients->snapshot_lock);
+    struct snapshot_entry *old = clients->snapshot;
+    clients->snapshot = NULL;
+    pthread_mutex_unlock(&clients->snapshot_lock);
+
+    free_snapshot(old);
+}
+
+// Try to read the property from the snapshot. Returns false if the property
+// must be read with the core locked instead.
+static bool get_snapshot_property(mpv_handle *ctx, const char *name,
+                                  mpv_format format, void *data, int *status)
+{
+    struct mp_client_api *clients = ctx->clients;
+
+    // String conversion is not necessarily cheap; leave it to the core.
+    if (format == MPV_FORMAT_STRING || format == MPV_FORMAT_OSD_STRING)
+        return false;
+
+    int index = -1;
+    for (int n = 0; n < NUM_SNAPSHOT_PROPERTIES; n++) {
+        if (strcmp(snapshot_properties[n], name) == 0) {
+            index = n;
+            break;
+        }
+    }
+    if (index < 0)
+        return false;
+
+    const struct m_option *type = get_mp_type(MPV_FORMAT_NODE);
+    struct mpv_node node = {{0}};
+    bool found = false;
+    int err = 0;
+
+    pthread_mutex_lock(&clients->snapshot_lock);
+    clients->snapshot_read[index] = mp_time_us();
+    if (clients->snapshot && clients->snapshot[index].valid) {
+        struct snapshot_entry *e = &clients->snapshot[index];
+        found = true;
+        err = e->err;
+        if (err == M_PROPERTY_OK)
+            m_option_copy(type, &node, &e->node);
+    }
+    pthread_mutex_unlock(&clients->snapshot_lock);
+
+    // (Falling back to GET_STRING is done in getproperty_fn.)
+    if (!found || err == M_PROPERTY_NOT_IMPLEMENTED)
+        return false;
+
+    if (err == M_PROPERTY_OK) {
+        if (format == MPV_FORMAT_NODE) {
+            *(struct mpv_node *)data = node;
+        } else {
+            if (!conv_node_to_format(data, format, &node)) {
+                err = M_PROPERTY_INVALID_FORMAT;
+                mpv_free_node_contents(&node);
+            }
+        }
+    }
+
+    *status = translate_property_error(err);
+    return true;
+}
+
 int mpv_get_property(mpv_handle *ctx, const char *name, mpv_format format,
                      void *data)
 {
@@ -1266,6 +1426,10 @@ int mpv_get_property(mpv_handle *ctx, const char *name, mpv_format format,
     if (!get_mp_type_get(format))
         return MPV_ERROR_PROPERTY_FORMAT;
 
+    int status;
+    if (get_snapshot_property(ctx, name, format, data, &status))
+        return status;
+
     struct getproperty_request req = {
         .mpctx = ctx->mpctx,
         .name = name,
@@ -52,9 +52,11 @@
 #include "video/decode/vd.h"
 #include "video/out/vo.h"
 #include "video/csputils.h"
+#include "video/mp_image_pool.h"
 #include "audio/mixer.h"
 #include "audio/audio_buffer.h"
 #include "audio/out/ao.h"
+#include "audio/out/ao_timing.h"
 #include "audio/filter/af.h"
 #include "video/decode/dec_video.h"
 #include "audio/decode/dec_audio.h"
@@ -176,7 +178,7 @@ void mp_hook_run(struct MPContext *mpctx, char *client, char *type)
     next->active = true;
     if (!send_hook_msg(mpctx, next, "hook_run")) {
         hook_remove(mpctx, index);
-        mp_input_wakeup(mpctx->input); // repeat next iteration to finish
+        mp_input_wakeup_src(mpctx->input, MP_WAKEUP_CLIENT); // repeat next iteration to finish
     }
 }
 
@@ -532,6 +534,52 @@ static int mp_property_drop_frame_cnt(void *ctx, struct m_property *prop,
     return m_property_int_ro(action, arg, mpctx->dropped_frames_total);
 }
 
+/// Playloop wakeup statistics (RO)
+static int mp_property_wakeup_stats(void *ctx, struct m_property *prop,
+                                    int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct mp_input_wakeup_stats st;
+    mp_input_get_wakeup_stats(mpctx->input, &st);
+
+    char names[MP_WAKEUP_SRC_COUNT][32];
+    struct m_sub_property props[MP_WAKEUP_SRC_COUNT + 4] = {
+        {"iterations",  SUB_PROP_INT64(st.iterations)},
+        {"sleep-time",  SUB_PROP_DOUBLE(st.sleep_time)},
+        {"active-time", SUB_PROP_DOUBLE(st.active_time)},
+    };
+    for (int n = 0; n < MP_WAKEUP_SRC_COUNT; n++) {
+        snprintf(names[n], sizeof(names[n]), "wakeups-%s", mp_wakeup_src_names[n]);
+        props[3 + n] = (struct m_sub_property){
+            names[n], SUB_PROP_INT64(st.wakeups[n]),
+        };
+    }
+
+    return m_property_read_sub(props, action, arg);
+}
+
+/// Process-wide image buffer cache statistics (RO)
+static int mp_property_image_pool_stats(void *ctx, struct m_property *prop,
+                                        int action, void *arg)
+{
+    struct mp_image_buffer_stats st;
+    mp_image_buffer_get_stats(&st);
+    int64_t total = st.hits + st.misses;
+
+    struct m_sub_property props[] = {
+        {"hits",            SUB_PROP_INT64(st.hits)},
+        {"misses",          SUB_PROP_INT64(st.misses)},
+        {"evictions",       SUB_PROP_INT64(st.evictions)},
+        {"reuse",           SUB_PROP_DOUBLE(total ? st.hits * 100.0 / total : 0)},
+        {"cached-bytes",    SUB_PROP_INT64(st.cached_bytes)},
+        {"cached-count",    SUB_PROP_INT(st.cached_count)},
+        {"limit",           SUB_PROP_INT64(st.limit)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
 static int mp_property_vo_drop_frame_count(void *ctx, struct m_property *prop,
                                            int action, void *arg)
 {
@@ -1431,6 +1479,7 @@ static int mp_property_volume(void *ctx, struct m_property *prop,
                               int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    lock_audio_chain(mpctx);
     if (!mixer_audio_initialized(mpctx->mixer))
         return M_PROPERTY_UNAVAILABLE;
     switch (action) {
@@ -1471,6 +1520,7 @@ static int mp_property_mute(void *ctx, struct m_property *prop,
                             int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    lock_audio_chain(mpctx);
     if (!mixer_audio_initialized(mpctx->mixer))
         return M_PROPERTY_ERROR;
     switch (action) {
@@ -1491,6 +1541,7 @@ static int mp_property_volrestore(void *ctx, struct m_property *prop,
                                   int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    lock_audio_chain(mpctx);
     switch (action) {
     case M_PROPERTY_GET: {
         char *s = mixer_get_volume_restore_data(mpctx->mixer);
@@ -1587,11 +1638,43 @@ static int mp_property_audio_codec(void *ctx, struct m_property *prop,
     return m_property_strdup_ro(action, arg, c);
 }
 
+/// Underruns of the audio decoder thread (RO)
+static int mp_property_ad_queue_underruns(void *ctx, struct m_property *prop,
+                                          int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->d_audio || !mpctx->d_audio->thread)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_int_ro(action, arg, mpctx->d_audio->underruns);
+}
+
+/// Audio output delay estimator (RO)
+static int mp_property_audio_timing(void *ctx, struct m_property *prop,
+                                    int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct ao_timing_stats st;
+    if (!mpctx->ao || !ao_get_timing_stats(mpctx->ao, &st))
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct m_sub_property props[] = {
+        {"latency",         SUB_PROP_DOUBLE(st.latency)},
+        {"drift",           SUB_PROP_DOUBLE(st.drift * 1e6)},
+        {"jitter",          SUB_PROP_DOUBLE(st.jitter)},
+        {"observations",    SUB_PROP_INT64(st.observations)},
+        {"resyncs",         SUB_PROP_INT64(st.resyncs)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
 /// Audio bitrate (RO)
 static int mp_property_audio_bitrate(void *ctx, struct m_property *prop,
                                      int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    lock_audio_chain(mpctx);
     if (!mpctx->d_audio)
         return M_PROPERTY_UNAVAILABLE;
     if (action == M_PROPERTY_PRINT) {
@@ -1606,6 +1689,7 @@ static int mp_property_samplerate(void *ctx, struct m_property *prop,
                                   int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    lock_audio_chain(mpctx);
     struct mp_audio fmt = {0};
     if (mpctx->d_audio)
         fmt = mpctx->d_audio->decode_format;
@@ -1623,6 +1707,7 @@ static int mp_property_channels(void *ctx, struct m_property *prop,
                                 int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    lock_audio_chain(mpctx);
     struct mp_audio fmt = {0};
     if (mpctx->d_audio)
         fmt = mpctx->d_audio->decode_format;
@@ -1647,6 +1732,7 @@ static int mp_property_balance(void *ctx, struct m_property *prop,
                                int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    lock_audio_chain(mpctx);
     float bal;
 
     switch (action) {
@@ -1986,6 +2072,27 @@ static int mp_property_hwdec(void *ctx, struct m_property *prop,
     return mp_property_generic_option(mpctx, prop, action, arg);
 }
 
+/// How the video decoder uses threads (RO)
+static int mp_property_decoder_threading(void *ctx, struct m_property *prop,
+                                         int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct dec_video *vd = mpctx->d_video;
+    struct vd_threading_info info = {0};
+    if (!vd || video_vd_control(vd, VDCTRL_GET_THREADING, &info) != CONTROL_TRUE)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct m_sub_property props[] = {
+        {"threads",         SUB_PROP_INT(info.threads)},
+        {"type",            SUB_PROP_STR(info.type)},
+        {"low-latency",     SUB_PROP_FLAG(info.low_latency)},
+        {"frame-time",      SUB_PROP_DOUBLE(info.frame_time)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
 #define VF_DEINTERLACE_LABEL "deinterlace"
 
 static bool probe_deint_filter(struct MPContext *mpctx, const char *filt)
@@ -2387,6 +2494,17 @@ static int mp_property_video_bitrate(void *ctx, struct m_property *prop,
     return m_property_int_ro(action, arg, mpctx->d_video->bitrate);
 }
 
+/// Decoded frames queued by the video decoder thread (RO)
+static int mp_property_vd_queue_frames(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    int frames = mpctx->d_video ? video_thread_queued_frames(mpctx->d_video) : -1;
+    if (frames < 0)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_int_ro(action, arg, frames);
+}
+
 static int property_imgparams(struct mp_image_params p, int action, void *arg)
 {
     if (!p.imgfmt)
@@ -3002,6 +3120,57 @@ static int mp_property_af(void *ctx, struct m_property *prop,
     return property_filter(prop, action, arg, ctx, STREAM_AUDIO);
 }
 
+// Filters the user can see, i.e. without the internal "in" and "out" nodes.
+static struct af_instance *af_stats_filter(struct af_stream *afs, int item)
+{
+    struct af_instance *af = afs->first->next;
+    for (int n = 0; n < item && af != afs->last; n++)
+        af = af->next;
+    return af == afs->last ? NULL : af;
+}
+
+static int get_af_stats_entry(int item, int action, void *arg, void *ctx)
+{
+    struct af_instance *af = af_stats_filter(ctx, item);
+    if (!af)
+        return M_PROPERTY_ERROR;
+
+    struct af_stats *st = &af->stats;
+    double time = st->time / 1e6;
+    double duration = af->fmt_in.rate > 0 ? st->samples_in /
+                                            (double)af->fmt_in.rate : 0;
+    struct m_sub_property props[] = {
+        {"name",            SUB_PROP_STR(af->info->name)},
+        {"label",           SUB_PROP_STR(af->label), .unavailable = !af->label},
+        {"auto-inserted",   SUB_PROP_FLAG(af->auto_inserted)},
+        {"frames-in",       SUB_PROP_INT64(st->frames_in)},
+        {"samples-in",      SUB_PROP_INT64(st->samples_in)},
+        {"samples-out",     SUB_PROP_INT64(st->samples_out)},
+        {"time",            SUB_PROP_DOUBLE(time)},
+        {"load",            SUB_PROP_DOUBLE(duration > 0 ? time / duration : 0),
+                            .unavailable = duration <= 0},
+        {"delay",           SUB_PROP_DOUBLE(af_buffered_delay(af))},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+/// Per-filter processing statistics of the audio filter chain (RO)
+static int mp_property_af_stats(void *ctx, struct m_property *prop,
+                                int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    lock_audio_chain(mpctx);
+    if (!mpctx->d_audio || !mpctx->d_audio->afilter)
+        return M_PROPERTY_UNAVAILABLE;
+    struct af_stream *afs = mpctx->d_audio->afilter;
+    int count = 0;
+    while (af_stats_filter(afs, count))
+        count++;
+    return m_property_read_list(action, arg, count, get_af_stats_entry, afs);
+}
+
 static int mp_property_ab_loop(void *ctx, struct m_property *prop,
                                int action, void *arg)
 {
@@ -3244,6 +3413,8 @@ static const struct m_property mp_properties[] = {
     {"avsync", mp_property_avsync},
     {"total-avsync-change", mp_property_total_avsync_change},
     {"drop-frame-count", mp_property_drop_frame_cnt},
+    {"wakeup-stats", mp_property_wakeup_stats},
+    {"image-pool-stats", mp_property_image_pool_stats},
     {"vo-drop-frame-count", mp_property_vo_drop_frame_count},
     {"percent-pos", mp_property_percent_pos},
     {"time-start", mp_property_time_start},
@@ -3298,6 +3469,8 @@ static const struct m_property mp_properties[] = {
     {"audio-delay", mp_property_audio_delay},
     {"audio-format", mp_property_audio_format},
     {"audio-codec", mp_property_audio_codec},
+    {"ad-queue-underruns", mp_property_ad_queue_underruns},
+    {"audio-timing", mp_property_audio_timing},
     {"audio-bitrate", mp_property_audio_bitrate},
     {"audio-samplerate", mp_property_samplerate},
     {"audio-channels", mp_property_channels},
@@ -3335,6 +3508,7 @@ static const struct m_property mp_properties[] = {
     {"video-params", mp_property_vd_imgparams},
     {"video-format", mp_property_video_format},
     {"video-codec", mp_property_video_codec},
+    {"vd-queue-frames", mp_property_vd_queue_frames},
     {"video-bitrate", mp_property_video_bitrate},
     M_PROPERTY_ALIAS("dwidth", "video-out-params/dw"),
     M_PROPERTY_ALIAS("dheight", "video-out-params/dh"),
@@ -3348,6 +3522,7 @@ static const struct m_property mp_properties[] = {
     {"vid", mp_property_video},
     {"program", mp_property_program},
     {"hwdec", mp_property_hwdec},
+    {"decoder-threading", mp_property_decoder_threading},
 
     {"estimated-frame-count", mp_property_frame_count},
     {"estimated-frame-number", mp_property_frame_number},
@@ -3373,6 +3548,7 @@ static const struct m_property mp_properties[] = {
 
     {"vf", mp_property_vf},
     {"af", mp_property_af},
+    {"af-stats", mp_property_af_stats},
 
     {"video-rotate", video_simple_refresh_property},
 
@@ -4059,6 +4235,8 @@ int run_command(MPContext *mpctx, mp_cmd_t *cmd)
     struct MPOpts *opts = mpctx->opts;
     int osd_duration = opts->osd_duration;
     int on_osd = cmd->flags & MP_ON_OSD_FLAGS;
+    // Commands are rare, and many of them can end up in the audio chain.
+    lock_audio_chain(mpctx);
     bool auto_osd = on_osd == MP_ON_OSD_AUTO;
     bool msg_osd = auto_osd || (on_osd & MP_ON_OSD_MSG);
     bool bar_osd = auto_osd || (on_osd & MP_ON_OSD_BAR);
@@ -142,6 +142,13 @@ typedef struct MPContext {
     struct mp_client_api *clients;
     struct mp_dispatch_queue *dispatch;
     struct mp_cancel *playback_abort;
+    // Keeps the shared slice threads alive for image copies (see
+    // mp_pic_threads_run()). They are stopped with the last player.
+    struct mp_slice_threads *slice_threads;
+    // This player's --image-pool-max for the process-wide image buffer cache.
+    struct mp_image_buffer_user *image_buffers;
+    // Cached --replaygain-db database (replaygain.c)
+    struct mp_replaygain_db *replaygain_db;
 
     struct mp_log *statusline;
     struct osd_state *osd;
@@ -340,6 +347,7 @@ typedef struct MPContext {
     struct mp_nav_state *nav_state;
 
     struct mp_ipc_ctx *ipc_ctx;
+    struct mp_status_page *status_page;
 
     struct mpv_opengl_cb_context *gl_cb_ctx;
 } MPContext;
@@ -350,6 +358,8 @@ void reinit_audio_chain(struct MPContext *mpctx);
 int reinit_audio_filters(struct MPContext *mpctx);
 double playing_audio_pts(struct MPContext *mpctx);
 void fill_audio_out_buffers(struct MPContext *mpctx, double endpts);
+void unlock_audio_chain(struct MPContext *mpctx);
+void lock_audio_chain(struct MPContext *mpctx);
 double written_audio_pts(struct MPContext *mpctx);
 void clear_audio_output_buffers(struct MPContext *mpctx);
 void set_playback_speed(struct MPContext *mpctx, double new_speed);
@@ -460,6 +470,12 @@ void handle_force_window(struct MPContext *mpctx, bool reconfig);
 void add_frame_pts(struct MPContext *mpctx, double pts);
 void seek_to_last_frame(struct MPContext *mpctx);
 
+// replaygain.c
+int mp_replaygain_scan(struct MPContext *mpctx);
+struct replaygain_data *mp_replaygain_lookup(struct MPContext *mpctx,
+                                             void *ta_parent,
+                                             const char *filename);
+
 // scripting.c
 struct mp_scripting {
     const char *file_ext;   // e.g. "lua"
@@ -467,6 +483,11 @@ struct mp_scripting {
 };
 void mp_load_scripts(struct MPContext *mpctx);
 
+// status_page.c
+void mp_status_page_init(struct MPContext *mpctx);
+void mp_status_page_uninit(struct MPContext *mpctx);
+void mp_status_page_update(struct MPContext *mpctx);
+
 // sub.c
 void reset_subtitle_state(struct MPContext *mpctx);
 void uninit_stream_sub_decoders(struct demuxer *demuxer);
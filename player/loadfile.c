@@ -250,7 +250,7 @@ static struct sh_stream *select_fallback_stream(struct demuxer *d,
 static void wakeup_demux(void *pctx)
 {
     struct MPContext *mpctx = pctx;
-    mp_input_wakeup(mpctx->input);
+    mp_input_wakeup_src(mpctx->input, MP_WAKEUP_DEMUX);
 }
 
 static void enable_demux_thread(struct MPContext *mpctx)
@@ -56,6 +56,8 @@
 #include "stream/stream.h"
 #include "sub/osd.h"
 #include "video/decode/dec_video.h"
+#include "video/filter/slice_threads.h"
+#include "video/mp_image_pool.h"
 #include "video/out/vo.h"
 
 #include "core.h"
@@ -148,6 +150,8 @@ void mp_destroy(struct MPContext *mpctx)
 
     shutdown_clients(mpctx);
 
+    mp_status_page_uninit(mpctx);
+
     uninit_audio_out(mpctx);
     uninit_video_out(mpctx);
 
@@ -167,6 +171,10 @@ void mp_destroy(struct MPContext *mpctx)
 
     osd_free(mpctx->osd);
 
+    // If this was the last player, this frees all cached image buffers.
+    talloc_free(mpctx->image_buffers);
+    mpctx->image_buffers = NULL;
+
     if (cas_terminal_owner(mpctx, mpctx)) {
         terminal_uninit();
         cas_terminal_owner(mpctx, NULL);
@@ -330,6 +338,7 @@ struct MPContext *mp_create(void)
         .playlist = talloc_struct(mpctx, struct playlist, {0}),
         .dispatch = mp_dispatch_create(mpctx),
         .playback_abort = mp_cancel_new(mpctx),
+        .slice_threads = mp_slice_threads_create(mpctx, 0),
     };
 
     mpctx->global = talloc_zero(mpctx, struct mpv_global);
@@ -354,6 +363,10 @@ struct MPContext *mp_create(void)
 
     mpctx->global->opts = mpctx->opts;
 
+    // Updated with the user's --image-pool-max when video is initialized.
+    mpctx->image_buffers =
+        mp_image_buffer_add_user(mpctx, mpctx->opts->image_pool_max * 1024LL);
+
     mpctx->input = mp_input_init(mpctx->global);
     screenshot_init(mpctx);
     mpctx->mixer = mixer_init(mpctx, mpctx->global);
@@ -370,6 +383,12 @@ void wakeup_playloop(void *ctx)
     mp_input_wakeup(mpctx->input);
 }
 
+static void wakeup_dispatch(void *ctx)
+{
+    struct MPContext *mpctx = ctx;
+    mp_input_wakeup_src(mpctx->input, MP_WAKEUP_DISPATCH);
+}
+
 // Finish mpctx initialization. This must be done after setting up all options.
 // Some of the initializations depend on the options, and can't be changed or
 // undone later.
@@ -401,7 +420,7 @@ int mp_initialize(struct MPContext *mpctx)
     mp_input_load(mpctx->input);
     mp_input_set_cancel(mpctx->input, mpctx->playback_abort);
 
-    mp_dispatch_set_wakeup_fn(mpctx->dispatch, wakeup_playloop, mpctx);
+    mp_dispatch_set_wakeup_fn(mpctx->dispatch, wakeup_dispatch, mpctx);
 
 #if HAVE_ENCODING
     if (opts->encode_opts->file && opts->encode_opts->file[0]) {
@@ -469,6 +488,8 @@ int mp_initialize(struct MPContext *mpctx)
     mpctx->ipc_ctx = mp_init_ipc(mpctx->clients, mpctx->global);
 #endif
 
+    mp_status_page_init(mpctx);
+
     prepare_playlist(mpctx, mpctx->playlist);
 
     MP_STATS(mpctx, "end init");
@@ -525,6 +546,9 @@ int mpv_main(int argc, char *argv[])
         exit_player(mpctx, EXIT_NONE);
     }
 
+    if (opts->replaygain_scan)
+        exit_player(mpctx, mp_replaygain_scan(mpctx) < 0 ? EXIT_ERROR : EXIT_NORMAL);
+
 #ifdef _WIN32
     if (opts->w32_priority > 0)
         SetPriorityClass(GetCurrentProcess(), opts->w32_priority);
@@ -54,9 +54,14 @@
 
 // Wait until mp_input_wakeup(mpctx->input) is called, since the last time
 // mp_wait_events() was called. (But see mp_process_input().)
+// While waiting, clients can read some properties without locking the core.
 void mp_wait_events(struct MPContext *mpctx, double sleeptime)
 {
+    mp_client_publish_snapshot(mpctx);
+    // The audio chain is locked again on demand (see lock_audio_chain()).
+    unlock_audio_chain(mpctx);
     mp_input_wait(mpctx->input, sleeptime);
+    mp_client_invalidate_snapshot(mpctx);
 }
 
 // Process any queued input, whether it's user input, or requests from client
@@ -1003,6 +1008,8 @@ void run_playloop(struct MPContext *mpctx)
 
     handle_osd_redraw(mpctx);
 
+    mp_status_page_update(mpctx);
+
     mp_wait_events(mpctx, mpctx->sleeptime);
     mpctx->sleeptime = 100.0; // infinite for all practical purposes
 
@@ -1022,6 +1029,7 @@ void run_playloop(struct MPContext *mpctx)
 void mp_idle(struct MPContext *mpctx)
 {
     handle_dummy_ticks(mpctx);
+    mp_status_page_update(mpctx);
     mp_wait_events(mpctx, mpctx->sleeptime);
     mpctx->sleeptime = 100.0;
     mp_process_input(mpctx);
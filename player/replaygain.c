@@ -0,0 +1,562 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <libavutil/cpu.h>
+
+#include "config.h"
+#include "talloc.h"
+
+#include "osdep/io.h"
+
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "common/playlist.h"
+#include "options/options.h"
+#include "options/path.h"
+#include "misc/bstr.h"
+#include "stream/stream.h"
+#include "demux/demux.h"
+#include "demux/stheader.h"
+#include "audio/audio.h"
+#include "audio/audio_buffer.h"
+#include "audio/loudness.h"
+#include "audio/decode/dec_audio.h"
+#include "audio/filter/af.h"
+
+#include "core.h"
+
+// The database is a text file with one line per file:
+//  <size> <mtime> <track gain> <track peak> <album gain> <album peak> <path>
+// Entries are only valid if size and mtime still match the file.
+#define MP_REPLAYGAIN_DIR "replaygain"
+#define MP_REPLAYGAIN_DB MP_REPLAYGAIN_DIR "/db"
+
+// ReplayGain 2.0 reference level.
+#define REFERENCE_LUFS -18.0
+
+// Give up on a file after this many decoding errors in a row.
+#define MAX_ERRORS 50
+
+// Samples decoded and measured at once.
+#define SCAN_SAMPLES 8192
+
+struct db_entry {
+    char *path;             // absolute
+    int64_t size, mtime;
+    struct replaygain_data rg;
+};
+
+// Entries are sorted by path (see db_sort()).
+struct db {
+    struct db_entry *entries;
+    int num_entries;
+};
+
+// The database as last read by mp_replaygain_lookup(), kept for the lifetime
+// of the player. It's read again only if the file changed.
+struct mp_replaygain_db {
+    struct db db;
+    int64_t size, mtime;    // of the database file (-1 if it didn't exist)
+};
+
+struct scan_file {
+    char *path;             // absolute
+    char *dir;
+    int64_t size, mtime;
+    int album;
+    struct mp_loudness *meter; // set by the worker; NULL on failure
+};
+
+struct album {
+    char *dir;
+    bool valid;             // all files have up-to-date database entries
+    int first, count;       // files of the album in scan_ctx.files
+};
+
+struct scan_ctx {
+    struct mp_log *log;
+    struct mpv_global *global;
+    struct MPOpts *opts;    // no user audio filters
+    pthread_mutex_t lock;
+    struct scan_file *files;
+    int num_files;
+    int next_file;          // protected by lock
+};
+
+// libavcodec's codec open/close is not thread-safe (we don't install a lock
+// manager), and the stream/demuxer layers were never meant to be opened
+// concurrently either. Decoding itself runs in parallel.
+static pthread_mutex_t open_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *get_abs_path(void *ta_parent, const char *filename)
+{
+    if (mp_is_url(bstr0(filename)))
+        return NULL;
+    char *cwd = mp_getcwd(NULL);
+    char *res = cwd ? mp_path_join(ta_parent, bstr0(cwd), bstr0(filename)) : NULL;
+    talloc_free(cwd);
+    // Newlines would break the database format.
+    if (res && strchr(res, '\n')) {
+        talloc_free(res);
+        res = NULL;
+    }
+    return res;
+}
+
+static bool get_identity(const char *path, int64_t *size, int64_t *mtime)
+{
+    struct stat st;
+    if (stat(path, &st) || !S_ISREG(st.st_mode))
+        return false;
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+    return true;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    const struct db_entry *e1 = a, *e2 = b;
+    return strcmp(e1->path, e2->path);
+}
+
+// Sort the entries, and remove duplicate paths.
+static void db_sort(struct db *db)
+{
+    qsort(db->entries, db->num_entries, sizeof(db->entries[0]),
+          compare_entries);
+    int out = 0;
+    for (int n = 0; n < db->num_entries; n++) {
+        if (out && compare_entries(&db->entries[out - 1], &db->entries[n]) == 0)
+            continue;
+        db->entries[out++] = db->entries[n];
+    }
+    db->num_entries = out;
+}
+
+static void db_read(struct db *db, void *ta_parent, struct mpv_global *global)
+{
+    char *filename = mp_find_config_file(NULL, global, MP_REPLAYGAIN_DB);
+    struct stream *s = filename ? stream_open(filename, global) : NULL;
+    talloc_free(filename);
+    if (!s)
+        return;
+    bstr data = stream_read_complete(s, NULL, 256 * 1024 * 1024);
+    free_stream(s);
+
+    bstr rest = data;
+    while (rest.len) {
+        bstr line = bstr_strip_linebreaks(bstr_getline(rest, &rest));
+        struct db_entry e = {0};
+        e.size = bstrtoll(line, &line, 10);
+        e.mtime = bstrtoll(line, &line, 10);
+        e.rg.track_gain = bstrtod(line, &line);
+        e.rg.track_peak = bstrtod(line, &line);
+        e.rg.album_gain = bstrtod(line, &line);
+        e.rg.album_peak = bstrtod(line, &line);
+        if (!bstr_eatstart0(&line, " ") || !line.len)
+            continue;
+        e.path = bstrto0(ta_parent, line);
+        MP_TARRAY_APPEND(ta_parent, db->entries, db->num_entries, e);
+    }
+    talloc_free(data.start);
+    db_sort(db);
+}
+
+static bool db_write(struct db *db, struct mpv_global *global)
+{
+    mp_mk_config_dir(global, MP_REPLAYGAIN_DIR);
+    char *dir = mp_find_config_file(NULL, global, MP_REPLAYGAIN_DIR);
+    if (!dir)
+        return false;
+    char *filename = mp_path_join(dir, bstr0(dir), bstr0("db"));
+    char *tmp = talloc_asprintf(dir, "%s.tmp", filename);
+    bool ok = false;
+    FILE *f = fopen(tmp, "wb");
+    if (f) {
+        ok = true;
+        for (int n = 0; n < db->num_entries; n++) {
+            struct db_entry *e = &db->entries[n];
+            if (fprintf(f, "%"PRId64" %"PRId64" %f %f %f %f %s\n",
+                        e->size, e->mtime, e->rg.track_gain, e->rg.track_peak,
+                        e->rg.album_gain, e->rg.album_peak, e->path) < 0)
+                ok = false;
+        }
+        if (fclose(f))
+            ok = false;
+        // Replace the old database atomically, so that an interrupted scan
+        // or a concurrent lookup never sees a partial file.
+        if (ok && rename(tmp, filename))
+            ok = false;
+        if (!ok)
+            unlink(tmp);
+    }
+    talloc_free(dir);
+    return ok;
+}
+
+static struct db_entry *db_find(struct db *db, const char *path)
+{
+    struct db_entry key = {.path = (char *)path};
+    return bsearch(&key, db->entries, db->num_entries, sizeof(db->entries[0]),
+                   compare_entries);
+}
+
+// Return the database, reading it only if it was changed since the last call
+// (e.g. by --replaygain-scan in another process).
+static struct db *get_db(struct MPContext *mpctx)
+{
+    char *filename = mp_find_config_file(NULL, mpctx->global, MP_REPLAYGAIN_DB);
+    int64_t size = -1, mtime = -1;
+    if (filename)
+        get_identity(filename, &size, &mtime);
+    talloc_free(filename);
+
+    struct mp_replaygain_db *c = mpctx->replaygain_db;
+    if (!c || c->size != size || c->mtime != mtime) {
+        talloc_free(c);
+        c = mpctx->replaygain_db = talloc_zero(mpctx, struct mp_replaygain_db);
+        c->size = size;
+        c->mtime = mtime;
+        if (size >= 0)
+            db_read(&c->db, c, mpctx->global);
+    }
+    return &c->db;
+}
+
+// Return the stored gain for the given file, if it was scanned and has not
+// been modified since.
+struct replaygain_data *mp_replaygain_lookup(struct MPContext *mpctx,
+                                             void *ta_parent,
+                                             const char *filename)
+{
+    struct replaygain_data *res = NULL;
+    char *path = get_abs_path(NULL, filename);
+    int64_t size, mtime;
+    if (path && get_identity(path, &size, &mtime)) {
+        struct db_entry *e = db_find(get_db(mpctx), path);
+        if (e && e->size == size && e->mtime == mtime) {
+            res = talloc_ptrtype(ta_parent, res);
+            *res = e->rg;
+        }
+    }
+    talloc_free(path);
+    return res;
+}
+
+static bool init_filters(struct dec_audio *d_audio, struct mp_audio *out,
+                         struct mp_audio_buffer *buf)
+{
+    struct af_stream *afs = d_audio->afilter;
+    if (AF_FORMAT_IS_SPECIAL(d_audio->decode_format.format))
+        return false;
+    // Keep the output format of the first segment, so that the meter sees a
+    // single rate and channel layout even if the file changes format.
+    if (!mp_audio_config_valid(out)) {
+        *out = d_audio->decode_format;
+        mp_audio_set_format(out, AF_FORMAT_FLOAT);
+    }
+    afs->input = d_audio->decode_format;
+    afs->output = *out;
+    if (af_init(afs) < 0 || !mp_audio_config_equals(&afs->output, out))
+        return false;
+    mp_audio_buffer_reinit(buf, out);
+    return true;
+}
+
+static void feed_meter(struct mp_loudness *meter, struct mp_audio_buffer *buf)
+{
+    while (mp_audio_buffer_samples(buf)) {
+        struct mp_audio mpa;
+        mp_audio_buffer_peek(buf, &mpa);
+        mp_loudness_add(meter, mpa.planes[0], mpa.samples);
+        mp_audio_buffer_skip(buf, mpa.samples);
+    }
+}
+
+// Decode the first audio track of the file. Returns NULL on failure.
+static struct mp_loudness *measure_file(struct scan_ctx *ctx, const char *path)
+{
+    struct mp_loudness *meter = NULL;
+    struct dec_audio *d_audio = NULL;
+    struct sh_stream *sh = NULL;
+    bool ok = false;
+
+    pthread_mutex_lock(&open_lock);
+    struct stream *stream = stream_open(path, ctx->global);
+    struct demuxer *demuxer =
+        stream ? demux_open(stream, NULL, NULL, ctx->global) : NULL;
+    for (int n = 0; demuxer && n < demuxer->num_streams; n++) {
+        if (demuxer->streams[n]->type == STREAM_AUDIO) {
+            sh = demuxer->streams[n];
+            break;
+        }
+    }
+    if (sh) {
+        demuxer_select_track(demuxer, sh, true);
+        d_audio = talloc_zero(NULL, struct dec_audio);
+        d_audio->log = mp_log_new(d_audio, ctx->log, "!ad");
+        d_audio->global = ctx->global;
+        d_audio->opts = ctx->opts;
+        d_audio->header = sh;
+        d_audio->pool = mp_audio_pool_create(d_audio);
+        d_audio->afilter = af_new(ctx->global);
+        d_audio->afilter->opts = ctx->opts;
+        ok = audio_init_best_codec(d_audio, ctx->opts->audio_decoders);
+    }
+    pthread_mutex_unlock(&open_lock);
+
+    struct mp_audio_buffer *buf = mp_audio_buffer_create(NULL);
+    struct mp_audio out = {0};
+    bool need_init = true;
+    int errors = 0;
+    while (ok && errors < MAX_ERRORS) {
+        if (need_init) {
+            int r = initial_audio_decode(d_audio);
+            if (r == AD_EOF)
+                break;
+            if (r < 0) {
+                errors++;
+                continue;
+            }
+            if (!init_filters(d_audio, &out, buf)) {
+                ok = false;
+                break;
+            }
+            if (!meter)
+                meter = mp_loudness_create(NULL, out.rate, &out.channels);
+            need_init = false;
+        }
+        int r = audio_decode(d_audio, buf, SCAN_SAMPLES);
+        feed_meter(meter, buf);
+        if (r == AD_EOF)
+            break;
+        need_init = r == AD_NEW_FMT;
+        errors = r == AD_ERR ? errors + 1 : 0;
+    }
+    if (errors >= MAX_ERRORS)
+        ok = false;
+    talloc_free(buf);
+
+    pthread_mutex_lock(&open_lock);
+    audio_uninit(d_audio);
+    free_demuxer(demuxer);
+    free_stream(stream);
+    pthread_mutex_unlock(&open_lock);
+
+    if (!ok || !meter) {
+        talloc_free(meter);
+        meter = NULL;
+    }
+    return meter;
+}
+
+static void *scan_thread(void *arg)
+{
+    struct scan_ctx *ctx = arg;
+    while (1) {
+        pthread_mutex_lock(&ctx->lock);
+        int n = ctx->next_file++;
+        pthread_mutex_unlock(&ctx->lock);
+        if (n >= ctx->num_files)
+            break;
+        struct scan_file *f = &ctx->files[n];
+        f->meter = measure_file(ctx, f->path);
+        if (!f->meter)
+            MP_ERR(ctx, "Could not measure %s\n", f->path);
+    }
+    return NULL;
+}
+
+// Sort by directory first, so that the files of an album are consecutive.
+static int compare_files(const void *a, const void *b)
+{
+    const struct scan_file *f1 = a, *f2 = b;
+    int r = strcmp(f1->dir, f2->dir);
+    return r ? r : strcmp(f1->path, f2->path);
+}
+
+static int compare_album_dir(const void *key, const void *a)
+{
+    const bstr *dir = key;
+    const struct album *album = a;
+    return bstrcmp0(*dir, album->dir);
+}
+
+static float gain_from_loudness(double lufs)
+{
+    // Digital silence has no loudness; leave it alone.
+    return isfinite(lufs) ? REFERENCE_LUFS - lufs : 0;
+}
+
+// Measure all local files on the playlist and store the results in the
+// database. Files in the same directory are treated as one album. Returns 0
+// on success, -1 if any file could not be measured or saved.
+int mp_replaygain_scan(struct MPContext *mpctx)
+{
+    struct scan_ctx *ctx = talloc_zero(NULL, struct scan_ctx);
+    ctx->log = mp_log_new(ctx, mpctx->log, "replaygain");
+    ctx->global = mpctx->global;
+    ctx->opts = talloc_memdup(ctx, mpctx->opts, sizeof(*mpctx->opts));
+    ctx->opts->af_settings = NULL;
+    pthread_mutex_init(&ctx->lock, NULL);
+    int res = 0;
+
+    struct db db = {0};
+    db_read(&db, ctx, ctx->global);
+
+    // Collect the files, grouped into albums by directory. An album is
+    // rescanned as a whole if any of its files changed, since the album gain
+    // depends on all of them.
+    struct scan_file *files = NULL;
+    int num_files = 0;
+    for (struct playlist_entry *e = mpctx->playlist->first; e; e = e->next) {
+        struct scan_file f = {0};
+        f.path = get_abs_path(ctx, e->filename);
+        if (!f.path || !get_identity(f.path, &f.size, &f.mtime)) {
+            MP_WARN(ctx, "Skipping %s (not a local file).\n", e->filename);
+            continue;
+        }
+        f.dir = bstrto0(ctx, mp_dirname(f.path));
+        MP_TARRAY_APPEND(ctx, files, num_files, f);
+    }
+    if (num_files)
+        qsort(files, num_files, sizeof(files[0]), compare_files);
+
+    struct album *albums = NULL;
+    int num_albums = 0;
+    for (int n = 0; n < num_files; n++) {
+        struct scan_file *f = &files[n];
+        // Each file is scanned once, even if it's on the playlist twice.
+        if (n && strcmp(f->path, files[n - 1].path) == 0)
+            continue;
+        if (!num_albums || strcmp(albums[num_albums - 1].dir, f->dir) != 0) {
+            MP_TARRAY_APPEND(ctx, albums, num_albums,
+                             (struct album){.dir = f->dir, .valid = true});
+        }
+        struct album *album = &albums[num_albums - 1];
+        f->album = num_albums - 1;
+        album->count++;
+        struct db_entry *old = db_find(&db, f->path);
+        if (!old || old->size != f->size || old->mtime != f->mtime)
+            album->valid = false;
+    }
+    for (int n = 0; n < num_files; n++) {
+        struct scan_file *f = &files[n];
+        if (n && strcmp(f->path, files[n - 1].path) == 0)
+            continue;
+        struct album *album = &albums[f->album];
+        if (album->valid)
+            continue;
+        if (!ctx->num_files || ctx->files[ctx->num_files - 1].album != f->album)
+            album->first = ctx->num_files;
+        MP_TARRAY_APPEND(ctx, ctx->files, ctx->num_files, *f);
+    }
+    MP_INFO(ctx, "Scanning %d of %d files.\n", ctx->num_files, num_files);
+
+    int num_threads = MPMAX(MPMIN(av_cpu_count(), ctx->num_files), 1);
+    pthread_t *threads = talloc_array(ctx, pthread_t, num_threads);
+    int started = 0;
+    for (int n = 0; n < num_threads; n++) {
+        if (pthread_create(&threads[n], NULL, scan_thread, ctx))
+            break;
+        started++;
+    }
+    if (!started)
+        scan_thread(ctx);
+    for (int n = 0; n < started; n++)
+        pthread_join(threads[n], NULL);
+
+    // Entries of other files in the directories of rescanned albums are
+    // dropped: their album gain was computed over a different set of files.
+    // (This also drops the old entries of the rescanned files.)
+    struct db new_db = {0};
+    for (int n = 0; n < db.num_entries; n++) {
+        bstr dir = mp_dirname(db.entries[n].path);
+        struct album *album = bsearch(&dir, albums, num_albums,
+                                      sizeof(albums[0]), compare_album_dir);
+        if (!album || album->valid)
+            MP_TARRAY_APPEND(ctx, new_db.entries, new_db.num_entries,
+                             db.entries[n]);
+    }
+
+    for (int a = 0; a < num_albums; a++) {
+        struct album *album = &albums[a];
+        if (album->valid)
+            continue;
+        struct scan_file *album_files = &ctx->files[album->first];
+        struct mp_loudness **meters = NULL;
+        int num_meters = 0;
+        float album_peak = 0;
+        for (int n = 0; n < album->count; n++) {
+            struct scan_file *f = &album_files[n];
+            if (!f->meter)
+                continue;
+            MP_TARRAY_APPEND(ctx, meters, num_meters, f->meter);
+            album_peak = MPMAX(album_peak, mp_loudness_peak(f->meter));
+        }
+        if (num_meters < album->count)
+            res = -1;
+        if (!num_meters)
+            continue;
+        double album_lufs = mp_loudness_integrated_multi(meters, num_meters);
+        MP_INFO(ctx, "Album %s: %.2f LUFS, peak %f\n", album->dir, album_lufs,
+                album_peak);
+
+        for (int n = 0; n < album->count; n++) {
+            struct scan_file *f = &album_files[n];
+            if (!f->meter)
+                continue;
+            double track = mp_loudness_integrated(f->meter);
+            MP_INFO(ctx, "%s: %.2f LUFS, peak %f\n", f->path, track,
+                    mp_loudness_peak(f->meter));
+            struct db_entry e = {
+                .path = f->path,
+                .size = f->size,
+                .mtime = f->mtime,
+                .rg = {
+                    .track_gain = gain_from_loudness(track),
+                    .track_peak = mp_loudness_peak(f->meter),
+                    .album_gain = gain_from_loudness(album_lufs),
+                    .album_peak = album_peak,
+                },
+            };
+            MP_TARRAY_APPEND(ctx, new_db.entries, new_db.num_entries, e);
+        }
+    }
+    db_sort(&new_db);
+
+    if (ctx->num_files && !db_write(&new_db, ctx->global)) {
+        MP_ERR(ctx, "Could not write the replaygain database.\n");
+        res = -1;
+    }
+
+    for (int n = 0; n < ctx->num_files; n++)
+        talloc_free(ctx->files[n].meter);
+    pthread_mutex_destroy(&ctx->lock);
+    talloc_free(ctx);
+    return res;
+}
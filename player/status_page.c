@@ -0,0 +1,199 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "talloc.h"
+
+#include "osdep/atomics.h"
+#include "osdep/io.h"
+#include "osdep/timer.h"
+#include "common/msg.h"
+#include "common/playlist.h"
+#include "options/options.h"
+#include "options/path.h"
+#include "libmpv/status_page.h"
+
+#include "core.h"
+
+// Querying the cache goes through the stream cache lock, and finding the
+// playlist position walks the playlist; don't do these on every iteration.
+#define SLOW_UPDATE_INTERVAL 0.25
+
+struct mp_status_page {
+    int fd;
+    struct mpv_status_page *page;
+    double next_slow_update;
+};
+
+// The page layout is fixed, so seq is a plain integer there. We're the only
+// writer; readers access it with atomic loads.
+static atomic_uint_least32_t *page_seq(struct mpv_status_page *p)
+{
+    return (atomic_uint_least32_t *)&p->seq;
+}
+
+static void seq_begin(struct mpv_status_page *p)
+{
+    atomic_uint_least32_t *seq = page_seq(p);
+    // A reused page may have been left with an odd seq by a crashed player.
+    uint32_t v = atomic_load_explicit(seq, memory_order_relaxed);
+    atomic_store_explicit(seq, v | 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void seq_end(struct mpv_status_page *p)
+{
+    atomic_uint_least32_t *seq = page_seq(p);
+    uint32_t v = atomic_load_explicit(seq, memory_order_relaxed);
+    atomic_store_explicit(seq, v + 1, memory_order_release);
+}
+
+void mp_status_page_uninit(struct MPContext *mpctx)
+{
+    struct mp_status_page *st = mpctx->status_page;
+    if (!st)
+        return;
+    if (st->page) {
+        // Let readers know nothing is being updated anymore.
+        seq_begin(st->page);
+        st->page->idle = 1;
+        st->page->path[0] = '\0';
+        seq_end(st->page);
+        munmap(st->page, sizeof(*st->page));
+    }
+    if (st->fd >= 0)
+        close(st->fd);
+    talloc_free(st);
+    mpctx->status_page = NULL;
+}
+
+void mp_status_page_init(struct MPContext *mpctx)
+{
+    char *opt = mpctx->opts->status_page_path;
+    if (!opt || !opt[0])
+        return;
+
+    struct mp_status_page *st = talloc_zero(NULL, struct mp_status_page);
+    st->fd = -1;
+    mpctx->status_page = st;
+
+    char *path = mp_get_user_path(st, mpctx->global, opt);
+    // Reuse an existing file in place. Truncating it would make readers which
+    // still have it mapped crash with SIGBUS.
+    st->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (st->fd < 0) {
+        MP_ERR(mpctx, "Could not create status page '%s'.\n", path);
+        goto error;
+    }
+    struct stat fst;
+    if (fstat(st->fd, &fst) < 0 ||
+        (fst.st_size < (off_t)sizeof(*st->page) &&
+         ftruncate(st->fd, sizeof(*st->page)) < 0))
+    {
+        MP_ERR(mpctx, "Could not resize status page '%s'.\n", path);
+        goto error;
+    }
+    void *map = mmap(NULL, sizeof(*st->page), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, st->fd, 0);
+    if (map == MAP_FAILED) {
+        MP_ERR(mpctx, "Could not map status page '%s'.\n", path);
+        goto error;
+    }
+    st->page = map;
+    // The file may be in use by readers, so write the header like any other
+    // update. Keep seq itself, so that it doesn't go back to a value readers
+    // may have seen before.
+    seq_begin(st->page);
+    struct mpv_status_page init = {
+        .magic = MPV_STATUS_PAGE_MAGIC,
+        .version = MPV_STATUS_PAGE_VERSION,
+        .size = sizeof(*st->page),
+        .idle = 1,
+        .time_pos = NAN,
+        .duration = NAN,
+        .avsync = NAN,
+        .total_avsync_change = NAN,
+        .speed = NAN,
+        .cache_percent = NAN,
+        .playlist_pos = -1,
+    };
+    init.seq = st->page->seq;
+    *st->page = init;
+    seq_end(st->page);
+    MP_VERBOSE(mpctx, "Publishing status page to '%s'.\n", path);
+    return;
+
+error:
+    mp_status_page_uninit(mpctx);
+}
+
+// Called once per playloop iteration. This should stay cheap: only read
+// fields the playloop maintains anyway.
+void mp_status_page_update(struct MPContext *mpctx)
+{
+    struct mp_status_page *st = mpctx->status_page;
+    if (!st || !st->page)
+        return;
+    struct mpv_status_page *p = st->page;
+
+    bool loaded = mpctx->demuxer && mpctx->filename;
+    double len = loaded ? get_time_length(mpctx) : -1;
+
+    const char *filename = mpctx->filename ? mpctx->filename : "";
+    bool new_file = strncmp(p->path, filename, sizeof(p->path) - 1) != 0;
+
+    double now = mp_time_sec();
+    bool update_slow = new_file || now >= st->next_slow_update;
+    float cache = -1;
+    int pos = -1;
+    if (update_slow) {
+        cache = mp_get_cache_percent(mpctx);
+        pos = playlist_entry_to_index(mpctx->playlist, mpctx->playlist->current);
+        st->next_slow_update = now + SLOW_UPDATE_INTERVAL;
+    }
+
+    seq_begin(p);
+
+    p->update_count++;
+    p->time_pos = loaded ? get_playback_time(mpctx) : NAN;
+    p->duration = len >= 0 ? len : NAN;
+    p->avsync = mpctx->last_av_difference == MP_NOPTS_VALUE
+                ? NAN : mpctx->last_av_difference;
+    p->total_avsync_change = mpctx->total_avsync_change == MP_NOPTS_VALUE
+                ? NAN : mpctx->total_avsync_change;
+    p->speed = mpctx->opts->playback_speed;
+    if (update_slow) {
+        p->cache_percent = cache >= 0 ? cache : NAN;
+        p->playlist_pos = pos;
+    }
+    p->pause = mpctx->paused;
+    p->paused_for_cache = mpctx->paused_for_cache;
+    p->idle = !loaded;
+    p->drop_frame_count = mpctx->dropped_frames_total;
+    if (new_file)
+        snprintf(p->path, sizeof(p->path), "%s", filename);
+
+    seq_end(p);
+}
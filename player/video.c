@@ -39,6 +39,7 @@
 #include "stream/stream.h"
 #include "sub/osd.h"
 #include "video/hwdec.h"
+#include "video/mp_image_pool.h"
 #include "video/filter/vf.h"
 #include "video/decode/dec_video.h"
 #include "video/decode/vd.h"
@@ -285,6 +286,9 @@ int reinit_video_chain(struct MPContext *mpctx)
 
     update_window_title(mpctx, true);
 
+    mp_image_buffer_set_limit(mpctx->image_buffers,
+                              opts->image_pool_max * 1024LL);
+
     struct dec_video *d_video = talloc_zero(NULL, struct dec_video);
     mpctx->d_video = d_video;
     d_video->global = mpctx->global;
@@ -294,6 +298,13 @@ int reinit_video_chain(struct MPContext *mpctx)
     d_video->fps = sh->video->fps;
     d_video->vo = mpctx->video_out;
 
+    // Live network streams: keep decoder delay low, so that playback doesn't
+    // fall behind the source.
+    struct demuxer *demuxer = track->demuxer;
+    d_video->low_latency = opts->untimed ||
+        (demuxer && demuxer->stream && demuxer->stream->is_network &&
+         !demuxer->seekable);
+
     if (opts->force_fps) {
         d_video->fps = opts->force_fps;
         MP_INFO(mpctx, "FPS forced to %5.3f.\n", d_video->fps);
@@ -308,6 +319,15 @@ int reinit_video_chain(struct MPContext *mpctx)
     if (!video_init_best_codec(d_video, opts->video_decoders))
         goto err_out;
 
+    // Hardware decoding APIs are not necessarily safe to use from another
+    // thread than the one the VO interop expects.
+    if (opts->vd_queue > 0 && !sh->attached_picture && !opts->hwdec_api) {
+        d_video->wakeup_cb = wakeup_playloop;
+        d_video->wakeup_cb_ctx = mpctx;
+        if (!video_start_thread(d_video, opts->vd_queue))
+            MP_WARN(mpctx, "Could not start video decoder thread.\n");
+    }
+
     bool saver_state = opts->pause || !opts->stop_screensaver;
     vo_control(mpctx->video_out, saver_state ? VOCTRL_RESTORE_SCREENSAVER
                                              : VOCTRL_KILL_SCREENSAVER, NULL);
@@ -367,6 +387,57 @@ static int check_framedrop(struct MPContext *mpctx)
     return 0;
 }
 
+// Adjust a newly read packet, and return the framedrop mode to decode it with.
+static int prepare_packet(struct MPContext *mpctx, struct demux_packet *pkt)
+{
+    struct dec_video *d_video = mpctx->d_video;
+
+    if (pkt && pkt->pts != MP_NOPTS_VALUE)
+        pkt->pts += mpctx->video_offset;
+    if (pkt && pkt->dts != MP_NOPTS_VALUE)
+        pkt->dts += mpctx->video_offset;
+    if ((pkt && pkt->pts >= mpctx->hrseek_pts - .005) ||
+        video_has_broken_packet_pts(d_video) ||
+        !mpctx->opts->hr_seek_framedrop)
+    {
+        mpctx->hrseek_framedrop = false;
+    }
+    bool hrseek = mpctx->hrseek_active && mpctx->video_status == STATUS_SYNCING;
+    return hrseek && mpctx->hrseek_framedrop ? 2 : check_framedrop(mpctx);
+}
+
+static void add_dropped_frames(struct MPContext *mpctx, int dropped)
+{
+    if (mpctx->video_status == STATUS_PLAYING) {
+        mpctx->dropped_frames_total += dropped;
+        mpctx->dropped_frames += dropped;
+    }
+}
+
+// Same as decode_image(), but with the decoder running on its own thread.
+// Keep the decoder's packet queue filled, and pick up decoded frames.
+static int decode_image_async(struct MPContext *mpctx)
+{
+    struct dec_video *d_video = mpctx->d_video;
+
+    while (video_thread_needs_packet(d_video)) {
+        struct demux_packet *pkt;
+        if (demux_read_packet_async(d_video->header, &pkt) == 0)
+            break; // demuxer will wake us up
+        int framedrop_type = prepare_packet(mpctx, pkt);
+        video_thread_send_packet(d_video, pkt, framedrop_type);
+    }
+
+    int dropped;
+    int r = video_thread_read_frame(d_video, &d_video->waiting_decoded_mpi,
+                                    &dropped);
+    add_dropped_frames(mpctx, dropped);
+    if (r < 0)
+        return VD_EOF;
+    // If nothing was decoded yet, the decoder thread will wake us up.
+    return r > 0 ? VD_PROGRESS : VD_WAIT;
+}
+
 // Read a packet, store decoded image into d_video->waiting_decoded_mpi
 // returns VD_* code
 static int decode_image(struct MPContext *mpctx)
@@ -379,33 +450,20 @@ static int decode_image(struct MPContext *mpctx)
         return VD_EOF;
     }
 
+    if (d_video->thread)
+        return decode_image_async(mpctx);
+
     struct demux_packet *pkt;
     if (demux_read_packet_async(d_video->header, &pkt) == 0)
         return VD_WAIT;
-    if (pkt && pkt->pts != MP_NOPTS_VALUE)
-        pkt->pts += mpctx->video_offset;
-    if (pkt && pkt->dts != MP_NOPTS_VALUE)
-        pkt->dts += mpctx->video_offset;
-    if ((pkt && pkt->pts >= mpctx->hrseek_pts - .005) ||
-        d_video->has_broken_packet_pts ||
-        !mpctx->opts->hr_seek_framedrop)
-    {
-        mpctx->hrseek_framedrop = false;
-    }
-    bool hrseek = mpctx->hrseek_active && mpctx->video_status == STATUS_SYNCING;
-    int framedrop_type = hrseek && mpctx->hrseek_framedrop ?
-                         2 : check_framedrop(mpctx);
+    int framedrop_type = prepare_packet(mpctx, pkt);
     d_video->waiting_decoded_mpi =
         video_decode(d_video, pkt, framedrop_type);
     bool had_packet = !!pkt;
     talloc_free(pkt);
 
-    if (had_packet && !d_video->waiting_decoded_mpi &&
-        mpctx->video_status == STATUS_PLAYING)
-    {
-        mpctx->dropped_frames_total++;
-        mpctx->dropped_frames++;
-    }
+    if (had_packet && !d_video->waiting_decoded_mpi)
+        add_dropped_frames(mpctx, 1);
 
     return had_packet ? VD_PROGRESS : VD_EOF;
 }
@@ -462,6 +520,10 @@ static int video_filter(struct MPContext *mpctx, bool eof)
 
     // If something was decoded, and the filter chain is ready, filter it.
     if (!need_vf_reconfig && d_video->waiting_decoded_mpi) {
+        // With --vf-pipeline, the filters may still be busy with the previous
+        // frames. Keep the frame; the filter will wake us up.
+        if (!vf_can_filter_frame(vf))
+            return VD_WAIT;
         vf_filter_frame(vf, d_video->waiting_decoded_mpi);
         d_video->waiting_decoded_mpi = NULL;
         return VD_PROGRESS;
@@ -753,6 +815,8 @@ void write_video(struct MPContext *mpctx, double endpts)
 
     update_fps(mpctx);
 
+    // Let the audio decoder thread run while decoding video.
+    unlock_audio_chain(mpctx);
     int r = video_output_image(mpctx, endpts);
     MP_TRACE(mpctx, "video_output_image: %d\n", r);
 
@@ -63,6 +63,15 @@
 #include "common/common.h"
 
 
+// Memory used by the ringbuffers of all caches in the process, which possibly
+// belong to different player instances. See --cache-process-max.
+static pthread_mutex_t process_lock = PTHREAD_MUTEX_INITIALIZER;
+static int64_t process_used;
+// All live caches. The limit is a single process-wide value: the largest
+// --cache-process-max any of them was opened with.
+static struct priv **process_caches;
+static int num_process_caches;
+
 // Note: (struct priv*)(cache->priv)->cache == cache
 struct priv {
     pthread_t cache_thread;
@@ -77,6 +86,7 @@ struct priv {
     int64_t back_size;      // keep back_size amount of old bytes for backward seek
     int64_t seek_limit;     // keep filling cache if distance is less that seek limit
     bool seekable;          // underlying stream is seekable
+    int64_t process_max;    // --cache-process-max of the opening player
 
     struct mp_log *log;
 
@@ -292,6 +302,39 @@ done:
     return true;
 }
 
+static void process_add_cache(struct priv *s)
+{
+    pthread_mutex_lock(&process_lock);
+    MP_TARRAY_APPEND(NULL, process_caches, num_process_caches, s);
+    pthread_mutex_unlock(&process_lock);
+}
+
+static void process_remove_cache(struct priv *s)
+{
+    pthread_mutex_lock(&process_lock);
+    process_used -= s->buffer_size;
+    for (int n = 0; n < num_process_caches; n++) {
+        if (process_caches[n] == s) {
+            MP_TARRAY_REMOVE_AT(process_caches, num_process_caches, n);
+            break;
+        }
+    }
+    if (!num_process_caches) {
+        talloc_free(process_caches);
+        process_caches = NULL;
+    }
+    pthread_mutex_unlock(&process_lock);
+}
+
+// Must be called with process_lock held. Returns 0 if unlimited.
+static int64_t process_limit(void)
+{
+    int64_t limit = 0;
+    for (int n = 0; n < num_process_caches; n++)
+        limit = MPMAX(limit, process_caches[n]->process_max);
+    return limit;
+}
+
 // This is called both during init and at runtime.
 static int resize_cache(struct priv *s, int64_t size)
 {
@@ -299,9 +342,25 @@ static int resize_cache(struct priv *s, int64_t size)
     int64_t max_size = ((size_t)-1) / 4;
     int64_t buffer_size = MPMIN(MPMAX(size, min_size), max_size);
 
+    // Reserve the memory; the old buffer is released below.
+    pthread_mutex_lock(&process_lock);
+    int64_t process_max = process_limit();
+    if (process_max > 0) {
+        int64_t avail = process_max - (process_used - s->buffer_size);
+        if (buffer_size > avail) {
+            buffer_size = MPMAX(avail, min_size);
+            MP_WARN(s, "Cache size reduced to %" PRId64 " KiB due to "
+                    "--cache-process-max.\n", buffer_size / 1024);
+        }
+    }
+    process_used += buffer_size;
+    pthread_mutex_unlock(&process_lock);
+
     unsigned char *buffer = malloc(buffer_size);
     if (!buffer) {
-        free(buffer);
+        pthread_mutex_lock(&process_lock);
+        process_used -= buffer_size;
+        pthread_mutex_unlock(&process_lock);
         return STREAM_ERROR;
     }
 
@@ -332,6 +391,9 @@ static int resize_cache(struct priv *s, int64_t size)
     }
 
     free(s->buffer);
+    pthread_mutex_lock(&process_lock);
+    process_used -= s->buffer_size;
+    pthread_mutex_unlock(&process_lock);
 
     s->buffer_size = buffer_size;
     s->back_size = buffer_size / 2;
@@ -605,6 +667,7 @@ static void cache_uninit(stream_t *cache)
     pthread_mutex_destroy(&s->mutex);
     pthread_cond_destroy(&s->wakeup);
     free(s->buffer);
+    process_remove_cache(s);
     talloc_free(s);
 }
 
@@ -622,9 +685,12 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
     cache_drop_contents(s);
 
     s->seek_limit = opts->seek_min * 1024ULL;
+    s->process_max = opts->process_max * 1024ULL;
+    process_add_cache(s);
 
     if (resize_cache(s, opts->size * 1024ULL) != STREAM_OK) {
         MP_ERR(s, "Failed to allocate cache buffer.\n");
+        process_remove_cache(s);
         talloc_free(s);
         return -1;
     }
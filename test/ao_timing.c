@@ -0,0 +1,121 @@
+#include <math.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "audio/out/ao_timing.h"
+
+#define RATE 48000
+
+// Simulated device: plays at RATE * (1 + drift) per second of system time,
+// and reports the delay rounded up to whole periods, plus some noise.
+struct sim {
+    double drift;
+    double period;          // seconds
+    double noise;           // seconds
+    int64_t now;            // us
+    int64_t written;
+    double pos;             // true played position (samples)
+    uint32_t state;
+};
+
+static double sim_true_delay(struct sim *s)
+{
+    return (s->written - s->pos) / RATE;
+}
+
+static double sim_reported_delay(struct sim *s)
+{
+    double d = ceil(sim_true_delay(s) / s->period) * s->period;
+    return d + (mp_test_rand_r(&s->state) / 32768.0 - 0.5) * 2 * s->noise;
+}
+
+// Advance by 20 ms, keeping about 200 ms buffered.
+static void sim_step(struct sim *s)
+{
+    s->now += 20000;
+    s->pos += 0.02 * RATE * (1 + s->drift);
+    while (s->written - s->pos < 0.2 * RATE)
+        s->written += 1024;
+}
+
+static void test_drift_and_smoothing(void **state)
+{
+    struct ao_timing *t = ao_timing_create(NULL, RATE);
+    assert_true(ao_timing_get_delay(t, 0, 0) < 0);
+
+    struct sim s = {.drift = 300e-6, .period = 0.01, .noise = 0.002,
+                    .now = 1000000, .state = 1};
+    // Sum and sum of squares of the errors of the raw reports and estimates.
+    double raw[2] = {0}, est[2] = {0};
+    int count = 0;
+    for (int n = 0; n < 60 * 50; n++) {
+        sim_step(&s);
+        double report = sim_reported_delay(&s);
+        ao_timing_update(t, s.now, s.written, report);
+        // Compare after the fit settled.
+        if (n >= 10 * 50) {
+            double err = report - sim_true_delay(&s);
+            raw[0] += err;
+            raw[1] += err * err;
+            err = ao_timing_get_delay(t, s.now, s.written) - sim_true_delay(&s);
+            est[0] += err;
+            est[1] += err * err;
+            count++;
+        }
+    }
+    // The reports are biased by half a period on average, and so is the fit.
+    // Only the spread around that is noise.
+    double raw_bias = raw[0] / count, est_bias = est[0] / count;
+    double raw_err = sqrt(raw[1] / count - raw_bias * raw_bias);
+    double est_err = sqrt(est[1] / count - est_bias * est_bias);
+
+    struct ao_timing_stats st;
+    ao_timing_get_stats(t, &st);
+    assert_true(fabs(st.drift - s.drift) < 50e-6);
+    assert_int_equal(st.resyncs, 0);
+    assert_int_equal(st.observations, 60 * 50);
+    assert_true(st.jitter > 0.001 && st.jitter < 0.01);
+    assert_true(fabs(raw_bias - s.period / 2) < 0.001);
+    assert_true(fabs(est_bias - raw_bias) < 0.001);
+    assert_true(fabs(st.latency - sim_true_delay(&s) - est_bias) < 0.001);
+    assert_true(est_err < raw_err / 4);
+
+    // Between observations, the estimate follows the device clock.
+    double before = ao_timing_get_delay(t, s.now, s.written);
+    double after = ao_timing_get_delay(t, s.now + 100000, s.written);
+    assert_true(fabs(before - after - 0.1 * (1 + s.drift)) < 0.001);
+
+    ao_timing_reset(t);
+    assert_true(ao_timing_get_delay(t, s.now, s.written) < 0);
+    talloc_free(t);
+}
+
+static void test_resync(void **state)
+{
+    struct ao_timing *t = ao_timing_create(NULL, RATE);
+    struct sim s = {.period = 0.001, .now = 0, .state = 2};
+    for (int n = 0; n < 5 * 50; n++) {
+        sim_step(&s);
+        ao_timing_update(t, s.now, s.written, sim_reported_delay(&s));
+    }
+    // Underrun: the device stalls for 300 ms.
+    s.now += 300000;
+    for (int n = 0; n < 50; n++) {
+        sim_step(&s);
+        ao_timing_update(t, s.now, s.written, sim_reported_delay(&s));
+    }
+    struct ao_timing_stats st;
+    ao_timing_get_stats(t, &st);
+    assert_int_equal(st.resyncs, 1);
+    double est = ao_timing_get_delay(t, s.now, s.written);
+    assert_true(fabs(est - sim_true_delay(&s)) < 0.002);
+    talloc_free(t);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_drift_and_smoothing),
+        unit_test(test_resync),
+    };
+    return run_tests(tests);
+}
@@ -0,0 +1,155 @@
+#include <limits.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "audio/audio.h"
+#include "audio/audio_buffer.h"
+
+static struct mp_audio_pool *pool;
+static struct mp_audio fmt;
+static int next_sample;
+
+// Return a frame with consecutive sample values, like a decoder would.
+static struct mp_audio *new_frame(int samples)
+{
+    struct mp_audio *f = mp_audio_pool_get(pool, &fmt, samples);
+    assert_true(f != NULL);
+    for (int c = 0; c < f->num_planes; c++) {
+        for (int i = 0; i < samples; i++)
+            ((float *)f->planes[c])[i] = next_sample + i + c * 1e6;
+    }
+    next_sample += samples;
+    return f;
+}
+
+// Read everything from the buffer, and check that the samples are consecutive.
+static void check_read(struct mp_audio_buffer *ab, int *expected)
+{
+    while (mp_audio_buffer_samples(ab)) {
+        struct mp_audio data;
+        mp_audio_buffer_peek(ab, &data);
+        assert_true(data.samples > 0);
+        for (int c = 0; c < data.num_planes; c++) {
+            for (int i = 0; i < data.samples; i++) {
+                float v = ((float *)data.planes[c])[i];
+                assert_true(v == *expected + i + c * 1e6);
+            }
+        }
+        *expected += data.samples;
+        mp_audio_buffer_skip(ab, data.samples);
+    }
+}
+
+static void copies_since(struct mp_audio_stats *start, int64_t *copies,
+                         int64_t *allocs)
+{
+    struct mp_audio_stats now;
+    mp_audio_get_stats(&now);
+    *copies = now.copies - start->copies;
+    *allocs = now.allocs - start->allocs;
+}
+
+static void setup(void)
+{
+    pool = mp_audio_pool_create(NULL);
+    fmt = (struct mp_audio){0};
+    mp_audio_set_format(&fmt, AF_FORMAT_FLOATP);
+    mp_audio_set_num_channels(&fmt, 2);
+    fmt.rate = 48000;
+    next_sample = 0;
+}
+
+// The path from the filter chain to the AO: decoder thread buffer, player
+// buffer, AO buffer. Moving frames through it must not copy any audio.
+static void test_no_copies(void **state)
+{
+    setup();
+    struct mp_audio_buffer *thread_buf = mp_audio_buffer_create(pool);
+    struct mp_audio_buffer *player_buf = mp_audio_buffer_create(pool);
+    struct mp_audio_buffer *ao_buf = mp_audio_buffer_create(pool);
+    mp_audio_buffer_reinit(thread_buf, &fmt);
+    mp_audio_buffer_reinit(player_buf, &fmt);
+    mp_audio_buffer_reinit(ao_buf, &fmt);
+
+    struct mp_audio_stats start;
+    mp_audio_get_stats(&start);
+    int expected = 0, frames = 100;
+    for (int n = 0; n < frames; n++) {
+        mp_audio_buffer_append_frame(thread_buf, new_frame(1024));
+        // Odd sizes, so that frames are split.
+        mp_audio_buffer_move(player_buf, thread_buf, 777);
+        // Like player/audio.c and push.c: pass (parts of) frames by reference.
+        while (mp_audio_buffer_samples(player_buf) > 300) {
+            struct mp_audio data;
+            mp_audio_buffer_peek(player_buf, &data);
+            data.samples = MPMIN(data.samples, 300);
+            mp_audio_buffer_append(ao_buf, &data);
+            mp_audio_buffer_skip(player_buf, data.samples);
+        }
+        check_read(ao_buf, &expected);
+    }
+    mp_audio_buffer_move(player_buf, thread_buf, INT_MAX);
+    check_read(player_buf, &expected);
+    assert_int_equal(expected, frames * 1024);
+
+    int64_t copies, allocs;
+    copies_since(&start, &copies, &allocs);
+    assert_int_equal(copies, 0);
+    // One buffer per plane and frame, from the decoder.
+    assert_int_equal(allocs, frames * 2);
+    talloc_free(pool);
+}
+
+static void test_contiguous(void **state)
+{
+    setup();
+    struct mp_audio_buffer *ab = mp_audio_buffer_create(pool);
+    mp_audio_buffer_reinit(ab, &fmt);
+    for (int n = 0; n < 4; n++)
+        mp_audio_buffer_append_frame(ab, new_frame(100));
+    mp_audio_buffer_skip(ab, 50);
+
+    struct mp_audio_stats start;
+    mp_audio_get_stats(&start);
+    struct mp_audio data;
+    mp_audio_buffer_peek_contiguous(ab, 40, &data);
+    assert_int_equal(data.samples, 50); // fits into the first frame
+    mp_audio_buffer_peek_contiguous(ab, 220, &data);
+    assert_true(data.samples >= 220);
+    int64_t copies, allocs;
+    copies_since(&start, &copies, &allocs);
+    assert_int_equal(copies, 3); // 50 + 100 + 100 samples merged
+    mp_audio_buffer_prepend_silence(ab, 10);
+    mp_audio_buffer_peek(ab, &data);
+    assert_int_equal(data.samples, 10);
+    assert_true(((float *)data.planes[1])[9] == 0);
+    mp_audio_buffer_skip(ab, 10);
+    int expected = 50;
+    check_read(ab, &expected);
+    assert_int_equal(expected, 400);
+    talloc_free(pool);
+}
+
+// Filters can process in place if they own the only reference.
+static void test_writeable(void **state)
+{
+    setup();
+    struct mp_audio *f = new_frame(10);
+    assert_true(mp_audio_is_writeable(f));
+    struct mp_audio *ref = mp_audio_new_ref(f);
+    assert_true(!mp_audio_is_writeable(f));
+    assert_true(ref->planes[0] == f->planes[0]);
+    talloc_free(ref);
+    assert_true(mp_audio_is_writeable(f));
+    talloc_free(f);
+    talloc_free(pool);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_no_copies),
+        unit_test(test_contiguous),
+        unit_test(test_writeable),
+    };
+    return run_tests(tests);
+}
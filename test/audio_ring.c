@@ -0,0 +1,118 @@
+#include <pthread.h>
+#include <sched.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "osdep/atomics.h"
+#include "audio/audio_ring.h"
+
+#define PLANES 3
+
+struct stress {
+    struct mp_audio_ring *ring;
+    uint32_t total;
+    atomic_int errors;
+};
+
+// Plane n of sample i contains i * PLANES + n.
+static void *writer(void *arg)
+{
+    struct stress *s = arg;
+    uint32_t state = 1;
+    uint32_t buf[PLANES][700];
+    uint32_t pos = 0;
+    while (pos < s->total) {
+        int n = mp_test_rand_r(&state) % 700 + 1;
+        n = MPMIN(n, s->total - pos);
+        for (int p = 0; p < PLANES; p++) {
+            for (int i = 0; i < n; i++)
+                buf[p][i] = (pos + i) * PLANES + p;
+        }
+        for (int done = 0; done < n;) {
+            void *planes[PLANES] = {buf[0] + done, buf[1] + done, buf[2] + done};
+            int r = mp_audio_ring_write(s->ring, planes, n - done);
+            if (r < 0 || r > n - done)
+                atomic_fetch_add(&s->errors, 1);
+            if (r == 0)
+                sched_yield();
+            done += r;
+        }
+        pos += n;
+    }
+    return NULL;
+}
+
+static void *reader(void *arg)
+{
+    struct stress *s = arg;
+    uint32_t state = 2;
+    uint32_t buf[PLANES][500];
+    uint32_t pos = 0;
+    while (pos < s->total) {
+        int n = mp_test_rand_r(&state) % 500 + 1;
+        int buffered = mp_audio_ring_buffered(s->ring);
+        void *planes[PLANES] = {buf[0], buf[1], buf[2]};
+        int r = mp_audio_ring_read(s->ring, planes, n);
+        // The reader must see at least what was reported buffered before.
+        if (r < 0 || r > n || r < MPMIN(buffered, n))
+            atomic_fetch_add(&s->errors, 1);
+        for (int p = 0; p < PLANES; p++) {
+            for (int i = 0; i < r; i++) {
+                if (buf[p][i] != (pos + i) * PLANES + p)
+                    atomic_fetch_add(&s->errors, 1);
+            }
+        }
+        if (r == 0)
+            sched_yield();
+        pos += r;
+    }
+    return NULL;
+}
+
+static void test_stress(void **state)
+{
+    int sizes[] = {1, 7, 1024, 4800};
+    for (int n = 0; n < MP_ARRAY_SIZE(sizes); n++) {
+        struct stress s = {
+            .ring = mp_audio_ring_create(NULL, PLANES, 4, sizes[n]),
+            // Tiny rings need a context switch per sample.
+            .total = MPMIN(sizes[n] * 100000, 10 * 1000 * 1000),
+            .errors = ATOMIC_VAR_INIT(0),
+        };
+        pthread_t w, r;
+        assert_true(pthread_create(&w, NULL, writer, &s) == 0);
+        assert_true(pthread_create(&r, NULL, reader, &s) == 0);
+        pthread_join(w, NULL);
+        pthread_join(r, NULL);
+        assert_int_equal(atomic_load(&s.errors), 0);
+        assert_int_equal(mp_audio_ring_buffered(s.ring), 0);
+        talloc_free(s.ring);
+    }
+}
+
+static void test_basic(void **state)
+{
+    struct mp_audio_ring *r = mp_audio_ring_create(NULL, 1, 2, 5);
+    int16_t in[8] = {1, 2, 3, 4, 5, 6, 7, 8}, out[8] = {0};
+    assert_int_equal(mp_audio_ring_size(r), 5);
+    assert_int_equal(mp_audio_ring_write(r, (void *[]){in}, 8), 5);
+    assert_int_equal(mp_audio_ring_available(r), 0);
+    assert_int_equal(mp_audio_ring_read(r, NULL, 2), 2);
+    assert_int_equal(mp_audio_ring_write(r, (void *[]){in + 5}, 3), 2);
+    assert_int_equal(mp_audio_ring_read(r, (void *[]){out}, 8), 5);
+    for (int n = 0; n < 5; n++)
+        assert_int_equal(out[n], n + 3);
+    assert_int_equal(mp_audio_ring_write(r, (void *[]){in}, 3), 3);
+    mp_audio_ring_reset(r);
+    assert_int_equal(mp_audio_ring_buffered(r), 0);
+    assert_int_equal(mp_audio_ring_read(r, (void *[]){out}, 8), 0);
+    talloc_free(r);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_basic),
+        unit_test(test_stress),
+    };
+    return run_tests(tests);
+}
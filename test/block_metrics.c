@@ -0,0 +1,64 @@
+#include "test_helpers.h"
+#include "common/common.h"
+#include "video/filter/block_metrics.h"
+
+#define MAX_BLOCKS 40
+#define ROWS 24
+
+static unsigned char *random_plane(void *ta_parent, int stride, bool extreme)
+{
+    unsigned char *p = talloc_size(ta_parent, stride * ROWS);
+    for (int n = 0; n < stride * ROWS; n++)
+        p[n] = extreme ? (mp_test_rand() & 1) * 255 : mp_test_rand() & 0xFF;
+    return p;
+}
+
+// Compare all implementations the CPU supports against the C version.
+static void test_block_metrics_exact(void **state)
+{
+    void *tmp = talloc_new(NULL);
+    const struct mp_block_metrics *ref =
+        mp_block_metrics_get(MP_BLOCK_METRICS_C);
+    assert_string_equal(ref->name, "C");
+    for (int level = 1; level < MP_BLOCK_METRICS_COUNT; level++) {
+        const struct mp_block_metrics *m = mp_block_metrics_get(level);
+        if (m == mp_block_metrics_get(level - 1))
+            continue; // not supported
+        for (int iter = 0; iter < 2000; iter++) {
+            int n = mp_test_rand() % (MAX_BLOCKS + 1);
+            // Odd offsets and strides to exercise unaligned loads.
+            int s = n * 8 + 1 + mp_test_rand() % 32;
+            int off = mp_test_rand() % 16;
+            bool extreme = iter % 4 == 0;
+            unsigned char *pa = random_plane(tmp, s + 16, extreme);
+            unsigned char *pb = random_plane(tmp, s + 16, extreme);
+            // Leave room for the row above b in the comb metric.
+            unsigned char *a = pa + s + off, *b = pb + s + off;
+            int r1[MAX_BLOCKS], r2[MAX_BLOCKS];
+
+            ref->diff(a, b, s, n, r1);
+            m->diff(a, b, s, n, r2);
+            assert_memory_equal(r1, r2, n * sizeof(int));
+            ref->comb(a, b, s, n, r1);
+            m->comb(a, b, s, n, r2);
+            assert_memory_equal(r1, r2, n * sizeof(int));
+            ref->var(a, b, s, n, r1);
+            m->var(a, b, s, n, r2);
+            assert_memory_equal(r1, r2, n * sizeof(int));
+            ref->sad8x8(pa + off, pb, s, s + 16, n, r1);
+            m->sad8x8(pa + off, pb, s, s + 16, n, r2);
+            assert_memory_equal(r1, r2, n * sizeof(int));
+            assert_true(ref->xor64(pa + off, n) == m->xor64(pa + off, n));
+            if (iter % 100 == 0)
+                talloc_free_children(tmp);
+        }
+    }
+    talloc_free(tmp);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_block_metrics_exact),
+    };
+    return run_tests(tests);
+}
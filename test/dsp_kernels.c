@@ -0,0 +1,301 @@
+#include <math.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "audio/filter/af.h"
+#include "audio/filter/dsp_kernels.h"
+
+// In [-1, 1).
+static float rnd(void)
+{
+    return mp_test_rand() / 16384.0f - 1.0f;
+}
+
+static void fill(float *p, int n)
+{
+    for (int i = 0; i < n; i++)
+        p[i] = rnd();
+}
+
+// Compare all implementations the CPU supports against the C version.
+static void test_dsp_funcs(void **state)
+{
+    const struct mp_dsp_funcs *ref = mp_dsp_get(MP_DSP_C);
+    float a[300], b[300], t[300], r1[300], r2[300];
+    for (int level = 1; level < MP_DSP_COUNT; level++) {
+        const struct mp_dsp_funcs *f = mp_dsp_get(level);
+        if (f == mp_dsp_get(level - 1))
+            continue; // not supported
+        for (int iter = 0; iter < 1000; iter++) {
+            int n = iter % 280, off = iter % 7;
+            fill(a, 300);
+            fill(b, 300);
+            fill(t, 300);
+            float d1 = ref->dot(a + off, b, n), d2 = f->dot(a + off, b, n);
+            assert_true(fabsf(d1 - d2) <= 1e-4 * (n + 1));
+            ref->blend(r1, a + off, b, t, n);
+            f->blend(r2, a + off, b, t, n);
+            for (int i = 0; i < n; i++)
+                assert_true(fabsf(r1[i] - r2[i]) <= 1e-6);
+        }
+    }
+}
+
+// The previous chain for the output stage: conversion to float, af_volume,
+// and conversion to the output format with libswresample.
+static float ref_load(const void *p, int type, int i)
+{
+    switch (type) {
+    case MP_DSP_S16: return ((int16_t *)p)[i] * (1.0f / (1 << 15));
+    case MP_DSP_S32: return ((int32_t *)p)[i] * (1.0f / (1U << 31));
+    }
+    return ((float *)p)[i];
+}
+
+static int64_t ref_store(float v, int type)
+{
+    switch (type) {
+    case MP_DSP_S16: return MPCLAMP(lrintf(v * (1 << 15)), INT16_MIN, INT16_MAX);
+    case MP_DSP_S32: return MPCLAMP(llrintf(v * (1U << 31)), INT32_MIN, INT32_MAX);
+    }
+    return 0;
+}
+
+static void test_convert(void **state)
+{
+    enum { SAMPLES = 1000, NCH = 3 };
+    int sizes[] = {2, 4, 4};
+    float gains[] = {1.0, 0.5, 2.5};
+    static float in_f[SAMPLES * NCH], out_f[SAMPLES * NCH];
+    for (int level = 0; level < MP_DSP_COUNT; level++) {
+        const struct mp_dsp_funcs *f = mp_dsp_get(level);
+        if (level && f == mp_dsp_get(level - 1))
+            continue;
+        for (int n = 0; n < 3 * 3 * 4 * 3 * 2; n++) {
+            struct mp_dsp_convert_params p = {
+                .in_type = n % 3,
+                .out_type = n / 3 % 3,
+                .in_planar = n / 9 % 2,
+                .out_planar = n / 18 % 2,
+                .gain = gains[n / 36 % 3],
+                .softclip = n / 108 % 2,
+                .channels = NCH,
+            };
+            // Includes values out of range for the float cases.
+            for (int i = 0; i < SAMPLES * NCH; i++)
+                in_f[i] = rnd() * 1.2;
+            void *src[NCH], *dst[NCH];
+            int is = sizes[p.in_type], os = sizes[p.out_type];
+            for (int c = 0; c < NCH; c++) {
+                src[c] = (char *)in_f + (p.in_planar ? c * SAMPLES * is : 0);
+                dst[c] = (char *)out_f + (p.out_planar ? c * SAMPLES * os : 0);
+            }
+            if (p.in_type != MP_DSP_FLOAT) {
+                // Make integer input in place.
+                float tmp[SAMPLES * NCH];
+                memcpy(tmp, in_f, sizeof(tmp));
+                for (int i = 0; i < SAMPLES * NCH; i++) {
+                    int64_t v = ref_store(tmp[i], p.in_type);
+                    if (p.in_type == MP_DSP_S16) {
+                        ((int16_t *)in_f)[i] = v;
+                    } else {
+                        ((int32_t *)in_f)[i] = v;
+                    }
+                }
+            }
+            mp_dsp_convert(f, &p, dst, src, SAMPLES);
+            for (int c = 0; c < NCH; c++) {
+                for (int i = 0; i < SAMPLES; i++) {
+                    int ii = p.in_planar ? c * SAMPLES + i : i * NCH + c;
+                    int oi = p.out_planar ? c * SAMPLES + i : i * NCH + c;
+                    float v = ref_load(in_f, p.in_type, ii);
+                    if (p.gain != 1.0f) {
+                        v *= p.gain;
+                        v = p.softclip ? af_softclip(v) : MPCLAMP(v, -1.0, 1.0);
+                    }
+                    if (p.out_type == MP_DSP_FLOAT) {
+                        assert_true(fabsf(out_f[oi] - v) <= 1e-6);
+                    } else {
+                        // 1 LSB of rounding error (the order of the
+                        // multiplications differs), except for s32, where
+                        // a float has only 24 bits of precision.
+                        int64_t r = ref_store(v, p.out_type);
+                        int64_t o = p.out_type == MP_DSP_S16
+                                  ? ((int16_t *)out_f)[oi]
+                                  : ((int32_t *)out_f)[oi];
+                        int64_t tol = p.out_type == MP_DSP_S16 ? 1 : 256;
+                        assert_true(llabs(r - o) <= tol);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void test_xcorr(void **state)
+{
+    void *tmp = talloc_new(NULL);
+    const struct mp_dsp_funcs *ref = mp_dsp_get(MP_DSP_C);
+    int sizes[][2] = {{1, 1}, {1, 7}, {16, 16}, {100, 257}, {1150, 2492}};
+    for (int n = 0; n < MP_ARRAY_SIZE(sizes); n++) {
+        int a_len = sizes[n][0], b_len = sizes[n][1], lags = b_len - a_len + 1;
+        struct mp_dsp_xcorr *c = mp_dsp_xcorr_create(tmp, a_len, b_len);
+        assert_true(c != NULL);
+        float *a = talloc_array(tmp, float, a_len);
+        float *b = talloc_array(tmp, float, b_len);
+        fill(a, a_len);
+        fill(b, b_len);
+        // Plant a copy of a, so that there's a clear maximum.
+        int peak = lags / 3;
+        for (int i = 0; i < a_len; i++)
+            b[peak + i] = a[i] * 2;
+        memcpy(c->a, a, a_len * sizeof(float));
+        memcpy(c->b, b, b_len * sizeof(float));
+        float *r = mp_dsp_xcorr_run(c);
+
+        double *direct = talloc_array(tmp, double, lags);
+        double dot = 0, norm = 0, max = 0;
+        for (int d = 0; d < lags; d++) {
+            direct[d] = ref->dot(a, b + d, a_len);
+            dot += direct[d] * r[d];
+            norm += direct[d] * direct[d];
+            max = MPMAX(max, fabs(direct[d]));
+        }
+        double scale = dot / norm;
+        assert_true(scale > 0);
+        int best = 0;
+        for (int d = 0; d < lags; d++) {
+            assert_true(fabs(r[d] / scale - direct[d]) <= 1e-3 * max);
+            if (r[d] > r[best])
+                best = d;
+        }
+        assert_int_equal(best, peak);
+    }
+    assert_true(mp_dsp_xcorr_create(tmp, 10, 9) == NULL);
+    assert_true(mp_dsp_xcorr_create(tmp, 10, 65537) == NULL);
+    talloc_free(tmp);
+}
+
+static void test_fir(void **state)
+{
+    void *tmp = talloc_new(NULL);
+    // taps, delay, partition
+    int cases[][3] = {{1, 0, 0}, {32, 1, 0}, {64, 50, -1}, {193, 0, 0},
+                      {193, 0, 16}, {100, 37, 8}, {1000, 3, 0}, {3000, 0, 256}};
+    int len = 5000;
+    float *in = talloc_array(tmp, float, len);
+    float *out = talloc_array(tmp, float, len);
+    fill(in, len);
+    for (int level = 0; level < MP_DSP_COUNT; level++) {
+        const struct mp_dsp_funcs *f = mp_dsp_get(level);
+        if (level && f == mp_dsp_get(level - 1))
+            continue;
+        for (int n = 0; n < MP_ARRAY_SIZE(cases); n++) {
+            int num_taps = cases[n][0], delay = cases[n][1];
+            float *taps = talloc_array(tmp, float, num_taps);
+            fill(taps, num_taps);
+            struct mp_dsp_fir *fir =
+                mp_dsp_fir_create(tmp, f, taps, num_taps, delay, cases[n][2]);
+            assert_true(fir != NULL);
+            int part = mp_dsp_fir_partition(fir);
+            if (cases[n][2])
+                assert_int_equal(part, MPMAX(cases[n][2], 0));
+            for (int iter = 0; iter < 2; iter++) {
+                // Random block sizes, partially in place.
+                for (int pos = 0; pos < len;) {
+                    int size = (rnd() + 1) * 300 + 1;
+                    size = MPMIN(size, len - pos);
+                    float *src = in + pos;
+                    if (size & 1) {
+                        memcpy(out + pos, src, size * sizeof(float));
+                        src = out + pos;
+                    }
+                    mp_dsp_fir_process(fir, out + pos, src, size);
+                    pos += size;
+                }
+                // FFT rounding errors depend on the whole partition, so
+                // compare against the overall signal level.
+                double max_err = 0, max_sum = 0;
+                for (int t = 0; t < len; t++) {
+                    double sum = 0, abs_sum = 0;
+                    for (int j = 0; j < num_taps && t - delay - j >= 0; j++) {
+                        sum += taps[j] * in[t - delay - j];
+                        abs_sum += fabs(taps[j] * in[t - delay - j]);
+                    }
+                    max_err = MPMAX(max_err, fabs(out[t] - sum));
+                    max_sum = MPMAX(max_sum, abs_sum);
+                }
+                assert_true(max_err <= 1e-6 * max_sum);
+                mp_dsp_fir_reset(fir);
+            }
+        }
+    }
+    assert_true(mp_dsp_fir_create(tmp, mp_dsp_get(-1), in, 10, 0, 12) == NULL);
+    talloc_free(tmp);
+}
+
+static void test_iir(void **state)
+{
+    int channels[] = {1, 2, 4, 6, 7};
+    enum { SAMPLES = 2000, STAGES = 3 };
+    static float data[SAMPLES * 8];
+    static double ref[SAMPLES * 8];
+    for (int level = 0; level < MP_DSP_COUNT; level++) {
+        const struct mp_dsp_funcs *f = mp_dsp_get(level);
+        if (level && f == mp_dsp_get(level - 1))
+            continue;
+        for (int n = 0; n < MP_ARRAY_SIZE(channels); n++) {
+            int nch = channels[n];
+            struct mp_dsp_iir *iir = mp_dsp_iir_create(NULL, f, nch, STAGES);
+            struct mp_dsp_biquad bq[8][STAGES];
+            for (int c = 0; c < nch; c++) {
+                for (int s = 0; s < STAGES; s++) {
+                    // Stable poles at radius r, angle w.
+                    double r = 0.5 + 0.45 * (rnd() + 1) / 2, w = rnd() * M_PI;
+                    bq[c][s] = (struct mp_dsp_biquad){
+                        .b0 = rnd(), .b1 = rnd(), .b2 = rnd(),
+                        .a1 = -2 * r * cos(w), .a2 = r * r,
+                        .d = s % 2 ? rnd() : 0,
+                    };
+                    mp_dsp_iir_set(iir, c, s, &bq[c][s]);
+                }
+            }
+            fill(data, SAMPLES * nch);
+            for (int i = 0; i < SAMPLES * nch; i++)
+                ref[i] = data[i];
+            mp_dsp_iir_process(iir, data, 700);
+            mp_dsp_iir_process(iir, data + 700 * nch, SAMPLES - 700);
+            for (int c = 0; c < nch; c++) {
+                for (int s = 0; s < STAGES; s++) {
+                    struct mp_dsp_biquad *b = &bq[c][s];
+                    double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+                    for (int i = 0; i < SAMPLES; i++) {
+                        double x = ref[i * nch + c];
+                        double y = b->b0 * x + b->b1 * x1 + b->b2 * x2 -
+                                   b->a1 * y1 - b->a2 * y2;
+                        x2 = x1; x1 = x; y2 = y1; y1 = y;
+                        ref[i * nch + c] = y + b->d * x;
+                    }
+                }
+            }
+            double max = 0, err = 0;
+            for (int i = 0; i < SAMPLES * nch; i++) {
+                max = MPMAX(max, fabs(ref[i]));
+                err = MPMAX(err, fabs(data[i] - ref[i]));
+            }
+            assert_true(err < 1e-4 * max);
+            talloc_free(iir);
+        }
+    }
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_dsp_funcs),
+        unit_test(test_convert),
+        unit_test(test_xcorr),
+        unit_test(test_fir),
+        unit_test(test_iir),
+    };
+    return run_tests(tests);
+}
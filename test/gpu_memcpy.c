@@ -0,0 +1,73 @@
+#include "test_helpers.h"
+#include "common/common.h"
+#include "video/gpu_memcpy.h"
+#include "video/img_format.h"
+#include "video/memcpy_pic.h"
+#include "video/mp_image.h"
+
+// Odd sizes and offsets, to exercise the unaligned head and tail handling.
+static void test_gpu_memcpy_pic(void **state)
+{
+    void *tmp = talloc_new(NULL);
+    for (int iter = 0; iter < 500; iter++) {
+        int w = 1 + mp_test_rand() % 300, h = 1 + mp_test_rand() % 8;
+        int src_stride = w + mp_test_rand() % 64;
+        int dst_stride = w + mp_test_rand() % 64;
+        if (iter % 4 == 0)
+            src_stride = dst_stride = w; // packed fast path
+        int src_off = mp_test_rand() % 32, dst_off = mp_test_rand() % 32;
+        uint8_t *src = talloc_size(tmp, src_stride * h + src_off);
+        uint8_t *ref = talloc_zero_size(tmp, dst_stride * h + dst_off);
+        uint8_t *res = talloc_zero_size(tmp, dst_stride * h + dst_off);
+        for (int n = 0; n < src_stride * h + src_off; n++)
+            src[n] = mp_test_rand();
+        memcpy_pic(ref + dst_off, src + src_off, w, h, dst_stride, src_stride);
+        gpu_memcpy_pic(res + dst_off, src + src_off, w, h, dst_stride, src_stride);
+        assert_memory_equal(ref, res, dst_stride * h + dst_off);
+        memset(res, 0, dst_stride * h + dst_off);
+        gpu_memcpy(res + dst_off, src + src_off, w);
+        assert_memory_equal(src + src_off, res + dst_off, w);
+        if (iter % 100 == 0)
+            talloc_free_children(tmp);
+    }
+    talloc_free(tmp);
+}
+
+// Also compares the threaded copy of a large image against memcpy_pic.
+static void test_gpu_memcpy_image(void **state)
+{
+    int w = 1920, h = 1080;
+    struct mp_slice_threads *threads = mp_slice_threads_create(NULL, 0);
+    struct mp_image *src = mp_image_alloc(IMGFMT_NV12, w, h);
+    struct mp_image *ref = mp_image_alloc(IMGFMT_NV12, w, h);
+    struct mp_image *res = mp_image_alloc(IMGFMT_NV12, w, h);
+    assert_true(src && ref && res);
+    for (int p = 0; p < src->num_planes; p++) {
+        for (int y = 0; y < src->plane_h[p]; y++) {
+            for (int x = 0; x < src->stride[p]; x++)
+                src->planes[p][y * src->stride[p] + x] = mp_test_rand();
+        }
+    }
+
+    mp_image_copy(ref, src);
+    mp_image_copy_gpu(res, src);
+
+    for (int p = 0; p < src->num_planes; p++) {
+        for (int y = 0; y < src->plane_h[p]; y++) {
+            assert_memory_equal(ref->planes[p] + y * ref->stride[p],
+                                res->planes[p] + y * res->stride[p], w);
+        }
+    }
+    talloc_free(src);
+    talloc_free(ref);
+    talloc_free(res);
+    talloc_free(threads);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_gpu_memcpy_pic),
+        unit_test(test_gpu_memcpy_image),
+    };
+    return run_tests(tests);
+}
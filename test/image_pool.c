@@ -0,0 +1,116 @@
+#include "test_helpers.h"
+#include "common/common.h"
+#include "video/mp_image_pool.h"
+
+#define MB (1024 * 1024)
+
+static struct mp_image_buffer_stats get_stats(void)
+{
+    struct mp_image_buffer_stats st;
+    mp_image_buffer_get_stats(&st);
+    return st;
+}
+
+static void test_buffer_reuse(void **state)
+{
+    struct mp_image_buffer_user *user = mp_image_buffer_add_user(NULL, 64 * MB);
+    mp_image_buffer_trim();
+    struct mp_image_buffer_stats st0 = get_stats();
+
+    // 1080p 4:2:0
+    void *a = mp_image_buffer_alloc(1920 * 1088 * 3 / 2);
+    assert_true(((uintptr_t)a & 15) == 0);
+    memset(a, 1, 1920 * 1088 * 3 / 2);
+    mp_image_buffer_free(a);
+    assert_int_equal(get_stats().cached_count, 1);
+
+    // A slightly different size falls into the same size class.
+    void *b = mp_image_buffer_alloc(1920 * 1080 * 3 / 2);
+    assert_true(a == b);
+    // But a much smaller one doesn't.
+    void *c = mp_image_buffer_alloc(720 * 480 * 3 / 2);
+    assert_true(c != a);
+    mp_image_buffer_free(b);
+    mp_image_buffer_free(c);
+
+    // Small allocations bypass the cache.
+    void *d = mp_image_buffer_alloc(100);
+    mp_image_buffer_free(d);
+
+    struct mp_image_buffer_stats st = get_stats();
+    assert_int_equal(st.hits - st0.hits, 1);
+    assert_int_equal(st.misses - st0.misses, 2);
+    assert_int_equal(st.cached_count, 2);
+
+    mp_image_buffer_trim();
+    st = get_stats();
+    assert_int_equal(st.cached_count, 0);
+    assert_int_equal(st.cached_bytes, 0);
+    talloc_free(user);
+}
+
+static void test_buffer_lru(void **state)
+{
+    mp_image_buffer_trim();
+    struct mp_image_buffer_user *user = mp_image_buffer_add_user(NULL, 10 * MB);
+
+    // 4 buffers of 4 MB each don't fit; the oldest ones are dropped first.
+    void *bufs[4];
+    for (int n = 0; n < 4; n++)
+        bufs[n] = mp_image_buffer_alloc(4 * MB - n * 256 * 1024);
+    struct mp_image_buffer_stats st0 = get_stats();
+    for (int n = 0; n < 4; n++)
+        mp_image_buffer_free(bufs[n]);
+    struct mp_image_buffer_stats st = get_stats();
+    assert_int_equal(st.evictions - st0.evictions, 2);
+    assert_true(st.cached_bytes <= 10 * MB);
+
+    // The 2 most recently freed ones are still there.
+    for (int n = 3; n >= 2; n--) {
+        void *p = mp_image_buffer_alloc(4 * MB - n * 256 * 1024);
+        assert_true(p == bufs[n]);
+        mp_image_buffer_free(p);
+    }
+
+    // Lowering the limit trims immediately; 0 disables caching.
+    mp_image_buffer_set_limit(user, 0);
+    assert_int_equal(get_stats().cached_count, 0);
+    void *p = mp_image_buffer_alloc(MB);
+    mp_image_buffer_free(p);
+    assert_int_equal(get_stats().cached_count, 0);
+    talloc_free(user);
+}
+
+static void test_buffer_users(void **state)
+{
+    // Players with different limits: the largest one applies, no matter in
+    // which order they were set.
+    struct mp_image_buffer_user *a = mp_image_buffer_add_user(NULL, 32 * MB);
+    struct mp_image_buffer_user *b = mp_image_buffer_add_user(NULL, 8 * MB);
+    assert_int_equal(get_stats().limit, 32 * MB);
+    mp_image_buffer_set_limit(b, 16 * MB);
+    assert_int_equal(get_stats().limit, 32 * MB);
+
+    void *p = mp_image_buffer_alloc(4 * MB);
+    mp_image_buffer_free(p);
+    assert_int_equal(get_stats().cached_count, 1);
+
+    // Removing a player lowers the limit, but keeps what still fits.
+    talloc_free(a);
+    assert_int_equal(get_stats().limit, 16 * MB);
+    assert_int_equal(get_stats().cached_count, 1);
+
+    // The last player frees everything.
+    talloc_free(b);
+    assert_int_equal(get_stats().cached_count, 0);
+    assert_int_equal(get_stats().cached_bytes, 0);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_buffer_reuse),
+        unit_test(test_buffer_lru),
+        unit_test(test_buffer_users),
+    };
+    return run_tests(tests);
+}
@@ -0,0 +1,197 @@
+#include "test_helpers.h"
+#include "common/common.h"
+#include "misc/json.h"
+
+static const char *const test_docs[] = {
+    "null",
+    "true",
+    "false",
+    "123",
+    "-1.5",
+    "\"\"",
+    "\"a\\\"b\\\\c\\n\\u0001\"",
+    "[]",
+    "{}",
+    "[1,2.5,\"x\",[true,false,null],{}]",
+    "{\"command\":[\"get_property\",\"time-pos\"],\"request_id\":12}",
+    "{\"a\":{\"b\":{\"c\":[[[\"deep\"]]]}},\"d\":\"\\t\\u001f\"}",
+};
+
+static char *write_node(void *ta_parent, struct mpv_node *node)
+{
+    char *res = talloc_strdup(ta_parent, "");
+    assert_int_equal(json_write(&res, node), 0);
+    return res;
+}
+
+// Parse src in one go with json_parse(). Returns NULL on failure.
+static char *parse_oneshot(void *ta_parent, const char *src, int depth)
+{
+    struct mpv_node node;
+    char *text = (char *)src;
+    if (json_parse(ta_parent, &node, &text, depth) < 0)
+        return NULL;
+    json_skip_whitespace(&text);
+    if (text[0])
+        return NULL;
+    return write_node(ta_parent, &node);
+}
+
+// Parse src with the incremental parser, feeding random sized chunks.
+static char *parse_chunked(void *ta_parent, const char *src, size_t len,
+                           int depth, int max_chunk)
+{
+    struct json_parser *p = json_parser_create(ta_parent, depth);
+    bstr data = {(unsigned char *)src, len};
+    int r = 0;
+    while (data.len && r == 0) {
+        bstr chunk = bstr_splice(data, 0, 1 + mp_test_rand() % max_chunk);
+        size_t chunk_len = chunk.len;
+        r = json_parser_feed(p, &chunk);
+        data = bstr_cut(data, chunk_len - chunk.len);
+    }
+    if (r == 0)
+        r = json_parser_finish(p);
+    if (r < 0)
+        return NULL;
+    while (data.len && strchr(" \t\r\n", data.start[0]))
+        data = bstr_cut(data, 1);
+    if (data.len)
+        return NULL;
+    struct mpv_node node;
+    void *doc = json_parser_get(p, &node);
+    char *res = write_node(ta_parent, &node);
+    talloc_free(doc);
+    return res;
+}
+
+static void test_json_roundtrip(void **state)
+{
+    void *tmp = talloc_new(NULL);
+    for (int n = 0; n < MP_ARRAY_SIZE(test_docs); n++) {
+        char *res = parse_oneshot(tmp, test_docs[n], 10);
+        assert_true(res != NULL);
+        // Writing the parsed document must reproduce the input exactly
+        // (except for floats, which are written with a fixed precision).
+        if (strcmp(test_docs[n], "-1.5") == 0) {
+            assert_string_equal(res, "-1.500000");
+        } else if (!strchr(test_docs[n], '.')) {
+            assert_string_equal(res, test_docs[n]);
+        }
+        assert_string_equal(parse_oneshot(tmp, res, 10), res);
+    }
+    assert_string_equal(parse_oneshot(tmp, " [ 1 , { \"a\" : 2 } ]\n", 10),
+                        "[1,{\"a\":2}]");
+    talloc_free(tmp);
+}
+
+static void test_json_errors(void **state)
+{
+    static const char *const bad[] = {
+        "", "[", "[1,]", "{\"a\"}", "{\"a\":}", "{1:2}", "[1 2]", "tru",
+        "nul", "\"abc", "]", "{\"a\":1,}", "--1", "[1]]", "\"\\q\"",
+    };
+    void *tmp = talloc_new(NULL);
+    for (int n = 0; n < MP_ARRAY_SIZE(bad); n++) {
+        assert_true(parse_oneshot(tmp, bad[n], 10) == NULL);
+        assert_true(parse_chunked(tmp, bad[n], strlen(bad[n]), 10, 3) == NULL);
+    }
+    // Depth limit: a scalar at top-level has depth 1.
+    assert_true(parse_oneshot(tmp, "[[1]]", 3) != NULL);
+    assert_true(parse_oneshot(tmp, "[[1]]", 2) == NULL);
+    assert_true(parse_oneshot(tmp, "[[]]", 2) != NULL);
+    talloc_free(tmp);
+}
+
+static void test_json_stream(void **state)
+{
+    void *tmp = talloc_new(NULL);
+    struct json_parser *p = json_parser_create(tmp, 10);
+    // Several documents in one stream, split at every possible position.
+    const char *stream = "{\"a\":1}\n[\"b\"] 42\n";
+    const char *expect[] = {"{\"a\":1}", "[\"b\"]", "42"};
+    size_t len = strlen(stream);
+    for (size_t split = 0; split <= len; split++) {
+        bstr parts[2] = {{(unsigned char *)stream, split},
+                         {(unsigned char *)stream + split, len - split}};
+        int got = 0;
+        for (int i = 0; i < 2; i++) {
+            while (parts[i].len) {
+                int r = json_parser_feed(p, &parts[i]);
+                assert_true(r >= 0);
+                if (r == 0)
+                    break;
+                struct mpv_node node;
+                void *doc = json_parser_get(p, &node);
+                assert_true(got < MP_ARRAY_SIZE(expect));
+                assert_string_equal(write_node(tmp, &node), expect[got++]);
+                talloc_free(doc);
+            }
+        }
+        assert_int_equal(got, MP_ARRAY_SIZE(expect));
+    }
+    talloc_free(tmp);
+}
+
+static void test_json_fuzz(void **state)
+{
+    void *tmp = talloc_new(NULL);
+    for (int iter = 0; iter < 20000; iter++) {
+        const char *doc = test_docs[mp_test_rand() % MP_ARRAY_SIZE(test_docs)];
+        char *src = talloc_strdup(tmp, doc);
+        size_t len = strlen(src);
+        // Randomly corrupt, truncate, or leave the document alone.
+        int mutations = mp_test_rand() % 4;
+        for (int n = 0; n < mutations && len; n++) {
+            int pos = mp_test_rand() % len;
+            switch (mp_test_rand() % 3) {
+            case 0: src[pos] = "[]{}\",:\\ x1-"[mp_test_rand() % 12]; break;
+            case 1: src[pos] = 1 + mp_test_rand() % 255; break;
+            case 2: len = pos; src[len] = '\0'; break;
+            }
+        }
+        int depth = 1 + mp_test_rand() % 6;
+        // Incremental parsing must agree with parsing the whole string.
+        char *a = parse_oneshot(tmp, src, depth);
+        char *b = parse_chunked(tmp, src, len, depth, 1 + mp_test_rand() % 8);
+        assert_true(!a == !b);
+        if (a)
+            assert_string_equal(a, b);
+        if (iter % 1000 == 0)
+            talloc_free_children(tmp);
+    }
+    talloc_free(tmp);
+}
+
+// A large document, written back exactly as it was.
+static void test_json_large(void **state)
+{
+    void *tmp = talloc_new(NULL);
+    bstr src = {0};
+    bstr_xappend_asprintf(tmp, &src, "[");
+    for (int n = 0; n < 20000; n++) {
+        bstr_xappend_asprintf(tmp, &src, "%s{\"id\":%d,\"name\":\"item \\\"%d\\\"\","
+                              "\"values\":[1.500000,true,null,\"x\\ty\"]}",
+                              n ? "," : "", n, n);
+    }
+    bstr_xappend_asprintf(tmp, &src, "]");
+
+    struct mpv_node node;
+    char *text = talloc_strdup(tmp, src.start);
+    assert_int_equal(json_parse(tmp, &node, &text, 10), 0);
+    char *out = talloc_strdup(tmp, "");
+    assert_int_equal(json_write(&out, &node), 0);
+    assert_string_equal(out, src.start);
+    talloc_free(tmp);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_json_roundtrip),
+        unit_test(test_json_errors),
+        unit_test(test_json_stream),
+        unit_test(test_json_fuzz),
+        unit_test(test_json_large),
+    };
+    return run_tests(tests);
+}
@@ -0,0 +1,145 @@
+#include <math.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "audio/chmap.h"
+#include "audio/loudness.h"
+
+// Add seconds of a sine wave with the given peak level (dBFS) to all
+// channels.
+static void add_sine(struct mp_loudness *m, int rate, int nch, double freq,
+                     double dbfs, double seconds)
+{
+    int samples = lrint(seconds * rate);
+    double amp = pow(10, dbfs / 20);
+    float buf[1000 * 8];
+    for (int pos = 0; pos < samples; pos += 1000) {
+        int n = MPMIN(1000, samples - pos);
+        for (int i = 0; i < n; i++) {
+            float v = amp * sin(2 * M_PI * freq * (pos + i) / rate);
+            for (int c = 0; c < nch; c++)
+                buf[i * nch + c] = v;
+        }
+        mp_loudness_add(m, buf, n);
+    }
+}
+
+// EBU Tech 3341 test cases 1 to 5 (integrated loudness), at 48 and 44.1 kHz.
+static void test_r128(void **state)
+{
+    struct mp_chmap stereo;
+    mp_chmap_from_channels(&stereo, 2);
+    int rates[] = {48000, 44100};
+    for (int n = 0; n < MP_ARRAY_SIZE(rates); n++) {
+        int rate = rates[n];
+        struct mp_loudness *m = mp_loudness_create(NULL, rate, &stereo);
+        add_sine(m, rate, 2, 1000, -23, 20);
+        double l1 = mp_loudness_integrated(m);
+        talloc_free(m);
+
+        m = mp_loudness_create(NULL, rate, &stereo);
+        add_sine(m, rate, 2, 1000, -33, 20);
+        double l2 = mp_loudness_integrated(m);
+        talloc_free(m);
+
+        // The quiet parts are below the relative gate.
+        m = mp_loudness_create(NULL, rate, &stereo);
+        add_sine(m, rate, 2, 1000, -36, 10);
+        add_sine(m, rate, 2, 1000, -23, 60);
+        add_sine(m, rate, 2, 1000, -36, 10);
+        double l3 = mp_loudness_integrated(m);
+        talloc_free(m);
+
+        // Only the -72 dBFS parts are below the absolute gate.
+        m = mp_loudness_create(NULL, rate, &stereo);
+        add_sine(m, rate, 2, 1000, -72, 10);
+        add_sine(m, rate, 2, 1000, -36, 10);
+        add_sine(m, rate, 2, 1000, -23, 60);
+        add_sine(m, rate, 2, 1000, -36, 10);
+        add_sine(m, rate, 2, 1000, -72, 10);
+        double l4 = mp_loudness_integrated(m);
+        float peak = mp_loudness_peak(m);
+        talloc_free(m);
+
+        m = mp_loudness_create(NULL, rate, &stereo);
+        add_sine(m, rate, 2, 1000, -26, 20);
+        add_sine(m, rate, 2, 1000, -20, 20.1);
+        add_sine(m, rate, 2, 1000, -26, 20);
+        double l5 = mp_loudness_integrated(m);
+        talloc_free(m);
+
+        assert_true(fabs(l1 + 23) <= 0.1);
+        assert_true(fabs(l2 + 33) <= 0.1);
+        assert_true(fabs(l3 + 23) <= 0.1);
+        assert_true(fabs(l4 + 23) <= 0.1);
+        assert_true(fabs(l5 + 23) <= 0.1);
+        assert_true(fabs(peak - pow(10, -23 / 20.0)) < 1e-3);
+    }
+}
+
+// LFE is ignored, surround channels count more; silence has no loudness;
+// the album loudness is computed from the blocks of all tracks.
+static void test_channels_album(void **state)
+{
+    struct mp_chmap ch51;
+    assert_true(mp_chmap_from_str(&ch51, bstr0("5.1")));
+    struct mp_loudness *m = mp_loudness_create(NULL, 48000, &ch51);
+    float buf[6 * 480] = {0};
+    for (int pos = 0; pos < 48000 * 5; pos += 480) {
+        for (int i = 0; i < 480; i++) {
+            float v = 0.1 * sin(2 * M_PI * 1000 * (pos + i) / 48000);
+            for (int c = 0; c < 6; c++)
+                buf[i * 6 + c] = ch51.speaker[c] == MP_SPEAKER_ID_FL ||
+                                 ch51.speaker[c] == MP_SPEAKER_ID_LFE ? v : 0;
+        }
+        mp_loudness_add(m, buf, 480);
+    }
+    double front = mp_loudness_integrated(m);
+    talloc_free(m);
+
+    m = mp_loudness_create(NULL, 48000, &ch51);
+    for (int pos = 0; pos < 48000 * 5; pos += 480) {
+        for (int i = 0; i < 480; i++) {
+            float v = 0.1 * sin(2 * M_PI * 1000 * (pos + i) / 48000);
+            for (int c = 0; c < 6; c++) {
+                int sp = ch51.speaker[c];
+                buf[i * 6 + c] = sp == MP_SPEAKER_ID_BL || sp == MP_SPEAKER_ID_SL
+                                 ? v : 0;
+            }
+        }
+        mp_loudness_add(m, buf, 480);
+    }
+    double surround = mp_loudness_integrated(m);
+    talloc_free(m);
+    // -20 dBFS sine on one channel: -20 - 3 (rms) + 0.69 (K-weighting at
+    // 1 kHz) - 0.691.
+    assert_true(fabs(front + 23.0) <= 0.1);
+    assert_true(fabs(surround - front - 10 * log10(1.41)) <= 0.05);
+
+    struct mp_chmap mono;
+    mp_chmap_from_channels(&mono, 1);
+    struct mp_loudness *album[2];
+    album[0] = mp_loudness_create(NULL, 48000, &mono);
+    album[1] = mp_loudness_create(NULL, 48000, &mono);
+    float silence[1000] = {0};
+    mp_loudness_add(album[0], silence, 1000);
+    assert_true(isinf(mp_loudness_integrated(album[0])));
+    add_sine(album[0], 48000, 1, 1000, -20, 10);
+    add_sine(album[1], 48000, 1, 1000, -26, 30);
+    double a = mp_loudness_integrated_multi(album, 2);
+    // Mean energy of 10 s at -20 and 30 s at -26 (the relative gate is
+    // at about -31.4).
+    double expected = mp_loudness_integrated(album[0]) +
+                      10 * log10((1 + 3 * pow(10, -0.6)) / 4);
+    assert_true(fabs(a - expected) <= 0.05);
+    talloc_free(album[0]);
+    talloc_free(album[1]);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_r128),
+        unit_test(test_channels_album),
+    };
+    return run_tests(tests);
+}
@@ -0,0 +1,85 @@
+#include "test_helpers.h"
+#include "common/common.h"
+#include "video/memcpy_pic.h"
+
+// What memcpy_pic() does for small images.
+static void ref_memcpy_pic(uint8_t *dst, const uint8_t *src, int bytes, int h,
+                           int dst_stride, int src_stride)
+{
+    for (int y = 0; y < h; y++)
+        memcpy(dst + (ptrdiff_t)y * dst_stride, src + (ptrdiff_t)y * src_stride,
+               bytes);
+}
+
+static void ref_memset_pic(uint8_t *dst, uint32_t fill, int size, int bytes,
+                           int h, int stride)
+{
+    uint8_t value[4];
+    if (size == 2) {
+        uint16_t v = fill;
+        memcpy(value, &v, 2);
+    } else {
+        memcpy(value, &fill, 4);
+    }
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < bytes; x++)
+            dst[(ptrdiff_t)y * stride + x] = size == 1 ? fill : value[x % size];
+    }
+}
+
+// Run the large code paths with odd sizes, offsets, and negative strides.
+static void test_memcpy_pic_large(void **state)
+{
+    // Like a player, keep the shared threads alive.
+    struct mp_slice_threads *threads = mp_slice_threads_create(NULL, 0);
+    void *tmp = talloc_new(NULL);
+    for (int iter = 0; iter < 60; iter++) {
+        int bytes = 1024 + mp_test_rand() % 4000;
+        int h = 1 + MP_PIC_LARGE / bytes;
+        if (iter % 3 == 0)
+            h *= 2; // threaded
+        int pad = iter % 4 == 0 ? 0 : mp_test_rand() % 100;
+        int stride = bytes + pad, off = mp_test_rand() % 32;
+        int src_stride = iter % 5 == 0 ? stride : bytes + mp_test_rand() % 100;
+        size_t size = (size_t)stride * h + 32, src_size = (size_t)src_stride * h + 32;
+        uint8_t *src = talloc_size(tmp, src_size);
+        uint8_t *ref = talloc_zero_size(tmp, size);
+        uint8_t *res = talloc_zero_size(tmp, size);
+        for (size_t n = 0; n < src_size; n++)
+            src[n] = mp_test_rand();
+
+        uint8_t *s = src + off, *d_ref = ref + off, *d_res = res + off;
+        int ds = stride, ss = src_stride;
+        if (iter % 7 == 0) {
+            // vertically flipped
+            s += (ptrdiff_t)(h - 1) * ss;
+            d_ref += (ptrdiff_t)(h - 1) * ds;
+            d_res += (ptrdiff_t)(h - 1) * ds;
+            ds = -ds;
+            ss = -ss;
+        }
+        ref_memcpy_pic(d_ref, s, bytes, h, ds, ss);
+        memcpy_pic(d_res, s, bytes, h, ds, ss);
+        assert_memory_equal(ref, res, size);
+
+        int fill_size = 1 << (iter % 3);
+        uint32_t fill = mp_test_rand();
+        fill |= (uint32_t)mp_test_rand() << 16;
+        if (fill_size == 1)
+            fill &= 0xFF;
+        ref_memset_pic(ref + off, fill, fill_size, bytes & ~3, h, stride);
+        memset_pic_large(res + off, fill, fill_size, bytes & ~3, h, stride);
+        assert_memory_equal(ref, res, size);
+
+        talloc_free_children(tmp);
+    }
+    talloc_free(tmp);
+    talloc_free(threads);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_memcpy_pic_large),
+    };
+    return run_tests(tests);
+}
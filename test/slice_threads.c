@@ -0,0 +1,281 @@
+#include "test_helpers.h"
+#include "common/common.h"
+#include "video/filter/block_metrics.h"
+#include "video/filter/pullup.h"
+#include "video/filter/slice_threads.h"
+#include "video/filter/vf_divtc.h"
+#include "video/filter/vf_eq.h"
+#include "video/filter/vf_noise.h"
+
+struct cover_job {
+    int align;
+    int rows[256];
+    int calls[MP_MAX_SLICES];
+};
+
+static void cover_rows(void *ctx, int slice, int y0, int y1)
+{
+    struct cover_job *job = ctx;
+    assert_true(y0 < y1);
+    assert_true(y0 % job->align == 0);
+    job->calls[slice]++;
+    // Every slice index is used by one thread only, but the rows of
+    // different slices are disjoint, so this doesn't need atomics.
+    for (int y = y0; y < y1; y++)
+        job->rows[y]++;
+}
+
+static void test_slice_cover(void **state)
+{
+    void *tmp = talloc_new(NULL);
+    struct mp_slice_threads *pools[] = {
+        NULL,
+        mp_slice_threads_create(tmp, 1),
+        mp_slice_threads_create(tmp, 3),
+        mp_slice_threads_create(tmp, MP_MAX_SLICES),
+    };
+    assert_int_equal(mp_slice_threads_count(NULL), 1);
+    for (int p = 0; p < MP_ARRAY_SIZE(pools); p++) {
+        int count = mp_slice_threads_count(pools[p]);
+        assert_true(count >= 1 && count <= MP_MAX_SLICES);
+        for (int h = 0; h <= 256; h += 1 + h / 8) {
+            for (int align = 1; align <= 16; align *= 2) {
+                struct cover_job job = {.align = align};
+                mp_slice_threads_run(pools[p], h, align, cover_rows, &job);
+                for (int y = 0; y < h; y++)
+                    assert_int_equal(job.rows[y], 1);
+                for (int n = 0; n < MP_MAX_SLICES; n++)
+                    assert_true(job.calls[n] <= 1);
+            }
+        }
+    }
+    talloc_free(tmp);
+}
+
+struct nested_job {
+    struct mp_slice_threads *threads;
+    int rows[64][64];
+};
+
+static void nested_cols(void *ctx, int slice, int x0, int x1)
+{
+    int *row = ctx;
+    for (int x = x0; x < x1; x++)
+        row[x]++;
+}
+
+static void nested_rows(void *ctx, int slice, int y0, int y1)
+{
+    struct nested_job *job = ctx;
+    // The threads are busy with the outer job, so this runs inline instead
+    // of deadlocking.
+    for (int y = y0; y < y1; y++)
+        mp_slice_threads_run(job->threads, 64, 1, nested_cols, job->rows[y]);
+}
+
+static void test_slice_shared(void **state)
+{
+    for (int round = 0; round < 2; round++) {
+        // The threads are started by the first job, and stopped with the
+        // last handle, so the second round starts them again.
+        struct mp_slice_threads *a = mp_slice_threads_create(NULL, 4);
+        struct mp_slice_threads *b = mp_slice_threads_create(NULL, 4);
+        struct nested_job job = {.threads = b};
+        mp_slice_threads_run(a, 64, 1, nested_rows, &job);
+        for (int y = 0; y < 64; y++) {
+            for (int x = 0; x < 64; x++)
+                assert_int_equal(job.rows[y][x], 1);
+        }
+        struct cover_job cover = {.align = 1};
+        mp_slice_threads_run_shared(4, 256, 1, cover_rows, &cover);
+        for (int y = 0; y < 256; y++)
+            assert_int_equal(cover.rows[y], 1);
+        talloc_free(a);
+        talloc_free(b);
+    }
+    // Without handles, this runs inline.
+    struct cover_job cover = {.align = 1};
+    mp_slice_threads_run_shared(4, 256, 1, cover_rows, &cover);
+    assert_int_equal(cover.calls[0], 1);
+    for (int y = 0; y < 256; y++)
+        assert_int_equal(cover.rows[y], 1);
+}
+
+#define W 96
+#define H 64
+#define FRAMES 12
+
+// Feed the same random frames to pullup, and record the metrics of every
+// submitted field.
+static void run_pullup(struct mp_slice_threads *threads, int *out, int out_len)
+{
+    struct pullup_context *c = pullup_alloc_context();
+    c->junk_left = c->junk_right = 1;
+    c->junk_top = c->junk_bottom = 4;
+    c->metric_plane = 0;
+    c->threads = threads;
+    c->format = PULLUP_FMT_Y;
+    c->nplanes = 4;
+    pullup_preinit_context(c);
+    c->bpp[0] = c->bpp[1] = c->bpp[2] = 8;
+    c->w[0] = W;
+    c->h[0] = H;
+    c->w[1] = c->w[2] = W / 2;
+    c->h[1] = c->h[2] = H / 2;
+    c->w[3] = ((W + 15) / 16) * ((H + 15) / 16);
+    c->h[3] = 2;
+    c->stride[0] = W;
+    c->stride[1] = c->stride[2] = W / 2;
+    c->stride[3] = c->w[3];
+    c->background[1] = c->background[2] = 128;
+    pullup_init_context(c);
+
+    mp_test_srand(1);
+    int pos = 0;
+    for (int frame = 0; frame < FRAMES; frame++) {
+        struct pullup_buffer *b = pullup_get_buffer(c, 2);
+        assert_true(b != NULL);
+        for (int n = 0; n < W * H; n++)
+            b->planes[0][n] = mp_test_rand() & 0xFF;
+        for (int parity = 0; parity < 2; parity++) {
+            pullup_submit_field(c, b, parity, frame);
+            int len = c->metric_len;
+            assert_true(pos + 3 * len <= out_len);
+            memcpy(out + pos, c->last->diffs, len * sizeof(int));
+            memcpy(out + pos + len, c->last->comb, len * sizeof(int));
+            memcpy(out + pos + len * 2, c->last->var, len * sizeof(int));
+            pos += 3 * len;
+        }
+        pullup_release_buffer(b, 2);
+        struct pullup_frame *f;
+        while ((f = pullup_get_frame(c)))
+            pullup_release_frame(f);
+    }
+    pullup_free_context(c);
+}
+
+static void test_pullup_metrics(void **state)
+{
+    void *tmp = talloc_new(NULL);
+    int len = FRAMES * 2 * 3 * (W / 8) * (H / 8);
+    int *ref = talloc_zero_array(tmp, int, len);
+    int *res = talloc_zero_array(tmp, int, len);
+    run_pullup(NULL, ref, len);
+    for (int threads = 1; threads <= 5; threads += 2) {
+        memset(res, 0, len * sizeof(int));
+        run_pullup(mp_slice_threads_create(tmp, threads), res, len);
+        assert_memory_equal(ref, res, len * sizeof(int));
+    }
+    talloc_free(tmp);
+}
+
+// Odd sizes, so that the slices aren't all the same.
+#define PW 173
+#define PH 91
+#define PS 192
+
+static void random_plane(unsigned char *p, int size)
+{
+    for (int n = 0; n < size; n++)
+        p[n] = mp_test_rand() & 0xFF;
+}
+
+static void test_eq_plane(void **state)
+{
+    void *tmp = talloc_new(NULL);
+    // contrast, brightness, gamma, gamma weight
+    double params[][4] = {
+        {1.2, 0, 1, 1}, {0.8, 0.1, 1.5, 0.5}, {2, -0.3, 0.5, 1},
+    };
+    unsigned char *src = talloc_size(tmp, PS * PH);
+    unsigned char *ref = talloc_size(tmp, PS * PH);
+    unsigned char *res = talloc_size(tmp, PS * PH);
+    mp_test_srand(1);
+    random_plane(src, PS * PH);
+    for (int n = 0; n < MP_ARRAY_SIZE(params); n++) {
+        double *p = params[n];
+        memset(ref, 0, PS * PH);
+        vf_eq_adjust_plane(NULL, p[0], p[1], p[2], p[3], ref, src, PW, PH,
+                           PS, PS);
+        for (int threads = 1; threads <= 5; threads += 2) {
+            memset(res, 0, PS * PH);
+            vf_eq_adjust_plane(mp_slice_threads_create(tmp, threads),
+                               p[0], p[1], p[2], p[3], res, src, PW, PH,
+                               PS, PS);
+            assert_memory_equal(ref, res, PS * PH);
+        }
+    }
+    talloc_free(tmp);
+}
+
+// With the same options and seed, the generators must stay in sync over
+// several frames (the averaged mode keeps state per row).
+static void test_noise_plane(void **state)
+{
+    void *tmp = talloc_new(NULL);
+    unsigned char *src = talloc_size(tmp, PS * PH);
+    unsigned char *ref = talloc_size(tmp, PS * PH);
+    unsigned char *res = talloc_size(tmp, PS * PH);
+    mp_test_srand(2);
+    random_plane(src, PS * PH);
+    // The padding after each row is never written.
+    memset(ref, 0, PS * PH);
+    memset(res, 0, PS * PH);
+    for (int flags = 0; flags < 32; flags++) {
+        int averaged = flags & 1, pattern = (flags >> 1) & 1,
+            temporal = (flags >> 2) & 1, uniform = (flags >> 3) & 1,
+            hq = (flags >> 4) & 1;
+        for (int threads = 1; threads <= 5; threads += 2) {
+            struct mp_slice_threads *st = mp_slice_threads_create(tmp, threads);
+            struct vf_noise_param *a = vf_noise_param_create(tmp, 30, averaged,
+                                        pattern, temporal, uniform, hq);
+            struct vf_noise_param *b = vf_noise_param_create(tmp, 30, averaged,
+                                        pattern, temporal, uniform, hq);
+            for (int frame = 0; frame < 4; frame++) {
+                srand(frame);
+                vf_noise_plane(NULL, a, ref, src, PS, PS, PW, PH);
+                srand(frame);
+                vf_noise_plane(st, b, res, src, PS, PS, PW, PH);
+                assert_memory_equal(ref, res, PS * PH);
+            }
+            talloc_free(a);
+            talloc_free(b);
+            talloc_free(st);
+        }
+    }
+    talloc_free(tmp);
+}
+
+static void test_divtc_diff(void **state)
+{
+    void *tmp = talloc_new(NULL);
+    int os = PS, ns = PS + 16;
+    unsigned char *old = talloc_size(tmp, os * PH);
+    unsigned char *new = talloc_size(tmp, ns * PH);
+    mp_test_srand(3);
+    random_plane(old, os * PH);
+    random_plane(new, ns * PH);
+    const struct mp_block_metrics *m = mp_block_metrics_get(-1);
+    for (int h = 8; h <= PH; h += 9) {
+        int ref = vf_divtc_diff_plane(NULL, m, old, new, PW, h, os, ns);
+        assert_true(ref > 0);
+        for (int threads = 1; threads <= 5; threads += 2) {
+            int res = vf_divtc_diff_plane(mp_slice_threads_create(tmp, threads),
+                                          m, old, new, PW, h, os, ns);
+            assert_int_equal(ref, res);
+        }
+    }
+    talloc_free(tmp);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_slice_cover),
+        unit_test(test_slice_shared),
+        unit_test(test_pullup_metrics),
+        unit_test(test_eq_plane),
+        unit_test(test_noise_plane),
+        unit_test(test_divtc_diff),
+    };
+    return run_tests(tests);
+}
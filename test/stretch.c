@@ -0,0 +1,137 @@
+#include <math.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "audio/chmap.h"
+#include "audio/filter/stretch.h"
+
+#define RATE 48000
+
+static const struct mp_stretch_opts def_opts = {
+    .window_ms = 46,
+    .phase_lock = 1,
+    .transients = 1,
+};
+
+// Feed samples of a sine wave in blocks, drain, and return all output (which
+// is a talloc child of ta_parent) in *out_len.
+static float *run(void *ta_parent, const struct mp_stretch_opts *opts,
+                  int nch, double speed, double freq, int samples, int *out_len)
+{
+    struct mp_stretch *s = mp_stretch_create(ta_parent, nch, RATE, opts);
+    assert_true(s != NULL);
+    mp_stretch_set_speed(s, speed);
+
+    int block = 1024;
+    float *in[MP_NUM_CHANNELS], *out[MP_NUM_CHANNELS];
+    float *res = NULL;
+    int len = 0;
+    for (int c = 0; c < nch; c++)
+        in[c] = talloc_array(ta_parent, float, block);
+    for (int pos = 0; ; pos += block) {
+        int n = MPMIN(block, samples - pos);
+        if (n > 0) {
+            for (int c = 0; c < nch; c++) {
+                for (int i = 0; i < n; i++)
+                    in[c][i] = 0.5 * sin(2 * M_PI * freq * (pos + i) / RATE);
+            }
+            mp_stretch_push(s, in, n);
+        } else {
+            mp_stretch_drain(s);
+        }
+        int max = mp_stretch_max_output(s);
+        res = talloc_realloc(ta_parent, res, float, len + max);
+        out[0] = res + len;
+        for (int c = 1; c < nch; c++)
+            out[c] = talloc_array(ta_parent, float, max); // only check ch. 0
+        int got = mp_stretch_pull(s, out, max);
+        assert_true(got <= max);
+        len += got;
+        if (n <= 0)
+            break;
+    }
+    *out_len = len;
+    return res;
+}
+
+static void test_length(void **state)
+{
+    void *tmp = talloc_new(NULL);
+    double speeds[] = {1.0, 1.25, 1.5, 2.0, 3.0, 0.5};
+    int samples = RATE * 3;
+    for (int n = 0; n < MP_ARRAY_SIZE(speeds); n++) {
+        int len;
+        run(tmp, &def_opts, 2, speeds[n], 440, samples, &len);
+        int expected = lrint(samples / speeds[n]);
+        assert_true(abs(len - expected) <= 1);
+    }
+    talloc_free(tmp);
+}
+
+// The pitch must not change: count zero crossings in the steady part.
+static void test_pitch(void **state)
+{
+    void *tmp = talloc_new(NULL);
+    double speeds[] = {1.5, 2.0, 0.75};
+    for (int n = 0; n < MP_ARRAY_SIZE(speeds); n++) {
+        for (int lock = 0; lock < 2; lock++) {
+            struct mp_stretch_opts opts = def_opts;
+            opts.phase_lock = lock;
+            int len;
+            float *out = run(tmp, &opts, 1, speeds[n], 440, RATE * 4, &len);
+            int start = len / 4, end = len * 3 / 4, crossings = 0;
+            double energy = 0;
+            for (int i = start; i < end; i++) {
+                crossings += (out[i] < 0) != (out[i + 1] < 0);
+                energy += out[i] * out[i];
+            }
+            double freq = crossings / 2.0 / ((end - start) / (double)RATE);
+            double rms = sqrt(energy / (end - start));
+            assert_true(fabs(freq - 440) < 5);
+            // The input has rms 0.354; no large dropouts or gain errors.
+            assert_true(fabs(rms - 0.354) < 0.05);
+        }
+    }
+    talloc_free(tmp);
+}
+
+// Input pushed after a drain must not be dropped, and must not be preceded
+// by the silence the drain appended.
+static void test_push_after_drain(void **state)
+{
+    void *tmp = talloc_new(NULL);
+    struct mp_stretch *s = mp_stretch_create(tmp, 1, RATE, &def_opts);
+    assert_true(s != NULL);
+    mp_stretch_set_speed(s, 1.5);
+
+    int samples = RATE;
+    float *in = talloc_array(tmp, float, samples);
+    for (int i = 0; i < samples; i++)
+        in[i] = 0.5 * sin(2 * M_PI * 440 * i / RATE);
+
+    for (int round = 0; round < 2; round++) {
+        mp_stretch_push(s, &in, samples);
+        mp_stretch_drain(s);
+        int max = mp_stretch_max_output(s);
+        float *out = talloc_array(tmp, float, max);
+        int len = mp_stretch_pull(s, &out, max);
+        assert_true(abs(len - lrint(samples / 1.5)) <= 1);
+        // Apart from the fade-in/out at the ends, there are no gaps.
+        for (int i = len / 8; i < len - len / 8; i += 64) {
+            float peak = 0;
+            for (int j = i; j < MPMIN(i + RATE / 440 + 1, len); j++)
+                peak = MPMAX(peak, fabsf(out[j]));
+            assert_true(peak > 0.25);
+        }
+    }
+    talloc_free(tmp);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_length),
+        unit_test(test_pitch),
+        unit_test(test_push_after_drain),
+    };
+    return run_tests(tests);
+}
@@ -6,6 +6,30 @@
 #include <setjmp.h>
 #include <cmocka.h>
 
+#include <stdint.h>
 #include <stdio.h>
 
+// Pseudo-random numbers in [0, MP_TEST_RAND_MAX]. They are the same on every
+// run, so that failures are reproducible. mp_test_rand_r() uses the given
+// state (any initial value), e.g. for each thread or simulated object.
+#define MP_TEST_RAND_MAX 0x7fff
+
+static inline int mp_test_rand_r(uint32_t *state)
+{
+    *state = *state * 1103515245 + 12345;
+    return (*state >> 16) & MP_TEST_RAND_MAX;
+}
+
+static uint32_t mp_test_rand_state = 1;
+
+static inline void mp_test_srand(uint32_t seed)
+{
+    mp_test_rand_state = seed;
+}
+
+static inline int mp_test_rand(void)
+{
+    return mp_test_rand_r(&mp_test_rand_state);
+}
+
 #endif
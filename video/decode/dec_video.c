@@ -23,9 +23,11 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "common/msg.h"
 
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 
 #include "stream/stream.h"
@@ -56,12 +58,73 @@ const vd_functions_t * const mpcodecs_vd_drivers[] = {
     NULL
 };
 
-void video_reset_decoding(struct dec_video *d_video)
+// Number of packets queued for the decoder thread. Packets are small, and
+// the demuxer queues them anyway, so this only avoids starving the decoder.
+#define MAX_QUEUED_PACKETS 2
+
+struct vd_packet {
+    struct demux_packet *packet;    // NULL on EOF
+    int drop_frame;
+};
+
+struct vd_thread {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+
+    // -- protected by lock
+    bool terminate;
+    bool decoding;          // decoder is in use outside of the lock
+    struct vd_packet packets[MAX_QUEUED_PACKETS];
+    int num_packets;
+    bool eof_queued;        // EOF packet was queued (no more input)
+    bool eof;               // decoder was fully drained after EOF
+    struct mp_image **frames;
+    int num_frames;
+    int max_frames;
+    int dropped;            // packets which didn't output a frame
+    int broken_pts;         // copy of d_video->has_broken_packet_pts
+};
+
+// Wait until the decoder thread is not touching the decoder. While the lock
+// is held, the decoder and d_video can be accessed safely.
+static void lock_decoder(struct dec_video *d_video)
 {
-    video_vd_control(d_video, VDCTRL_RESET, NULL);
-    if (d_video->vfilter && d_video->vfilter->initialized == 1)
-        vf_seek_reset(d_video->vfilter);
-    mp_image_unrefp(&d_video->waiting_decoded_mpi);
+    struct vd_thread *t = d_video->thread;
+    if (!t)
+        return;
+    pthread_mutex_lock(&t->lock);
+    while (t->decoding)
+        pthread_cond_wait(&t->wakeup, &t->lock);
+}
+
+static void unlock_decoder(struct dec_video *d_video)
+{
+    struct vd_thread *t = d_video->thread;
+    if (!t)
+        return;
+    pthread_cond_broadcast(&t->wakeup);
+    pthread_mutex_unlock(&t->lock);
+}
+
+// Drop all queued packets and frames. Called with the lock held.
+static void flush_thread_queues(struct vd_thread *t)
+{
+    for (int n = 0; n < t->num_packets; n++)
+        talloc_free(t->packets[n].packet);
+    t->num_packets = 0;
+    for (int n = 0; n < t->num_frames; n++)
+        talloc_free(t->frames[n]);
+    t->num_frames = 0;
+    t->eof_queued = t->eof = false;
+    t->dropped = 0;
+}
+
+static void reset_decoder_state(struct dec_video *d_video)
+{
+    const struct vd_functions *vd = d_video->vd_driver;
+    if (vd)
+        vd->control(d_video, VDCTRL_RESET, NULL);
     d_video->num_buffered_pts = 0;
     d_video->last_pts = MP_NOPTS_VALUE;
     d_video->last_packet_pdts = MP_NOPTS_VALUE;
@@ -72,12 +135,27 @@ void video_reset_decoding(struct dec_video *d_video)
     d_video->unsorted_pts = MP_NOPTS_VALUE;
 }
 
+void video_reset_decoding(struct dec_video *d_video)
+{
+    lock_decoder(d_video);
+    if (d_video->thread)
+        flush_thread_queues(d_video->thread);
+    reset_decoder_state(d_video);
+    unlock_decoder(d_video);
+    if (d_video->vfilter && d_video->vfilter->initialized == 1)
+        vf_seek_reset(d_video->vfilter);
+    mp_image_unrefp(&d_video->waiting_decoded_mpi);
+}
+
 int video_vd_control(struct dec_video *d_video, int cmd, void *arg)
 {
     const struct vd_functions *vd = d_video->vd_driver;
+    int r = CONTROL_UNKNOWN;
+    lock_decoder(d_video);
     if (vd)
-        return vd->control(d_video, cmd, arg);
-    return CONTROL_UNKNOWN;
+        r = vd->control(d_video, cmd, arg);
+    unlock_decoder(d_video);
+    return r;
 }
 
 int video_set_colors(struct dec_video *d_video, const char *item, int value)
@@ -115,8 +193,26 @@ int video_get_colors(struct dec_video *d_video, const char *item, int *value)
     return 0;
 }
 
+static void stop_thread(struct dec_video *d_video)
+{
+    struct vd_thread *t = d_video->thread;
+    if (!t)
+        return;
+    pthread_mutex_lock(&t->lock);
+    t->terminate = true;
+    pthread_cond_broadcast(&t->wakeup);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->thread, NULL);
+    flush_thread_queues(t);
+    pthread_cond_destroy(&t->wakeup);
+    pthread_mutex_destroy(&t->lock);
+    talloc_free(t);
+    d_video->thread = NULL;
+}
+
 void video_uninit(struct dec_video *d_video)
 {
+    stop_thread(d_video);
     mp_image_unrefp(&d_video->waiting_decoded_mpi);
     if (d_video->vd_driver) {
         MP_VERBOSE(d_video, "Uninit video.\n");
@@ -378,6 +474,149 @@ struct mp_image *video_decode(struct dec_video *d_video,
     return mpi;
 }
 
+static void *decode_thread(void *p)
+{
+    struct dec_video *d_video = p;
+    struct vd_thread *t = d_video->thread;
+
+    mpthread_set_name("video decoder");
+
+    pthread_mutex_lock(&t->lock);
+    while (!t->terminate) {
+        if (!t->num_packets || t->num_frames >= t->max_frames) {
+            pthread_cond_wait(&t->wakeup, &t->lock);
+            continue;
+        }
+
+        // The EOF entry stays queued until the decoder is fully drained.
+        struct vd_packet pkt = t->packets[0];
+        if (pkt.packet) {
+            t->num_packets--;
+            memmove(&t->packets[0], &t->packets[1],
+                    t->num_packets * sizeof(t->packets[0]));
+        }
+        t->decoding = true;
+        pthread_mutex_unlock(&t->lock);
+
+        struct mp_image *mpi = video_decode(d_video, pkt.packet, pkt.drop_frame);
+        talloc_free(pkt.packet);
+
+        pthread_mutex_lock(&t->lock);
+        t->decoding = false;
+        t->broken_pts = d_video->has_broken_packet_pts;
+        if (mpi) {
+            MP_TARRAY_APPEND(t, t->frames, t->num_frames, mpi);
+        } else if (pkt.packet) {
+            t->dropped++;
+        } else {
+            t->num_packets = 0;
+            t->eof = true;
+        }
+        pthread_cond_broadcast(&t->wakeup);
+        if (d_video->wakeup_cb)
+            d_video->wakeup_cb(d_video->wakeup_cb_ctx);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+// Run the decoder on a separate thread, which keeps up to max_frames decoded
+// frames ready. Packets have to be passed with video_thread_send_packet(), and
+// frames read with video_thread_read_frame(), instead of video_decode().
+bool video_start_thread(struct dec_video *d_video, int max_frames)
+{
+    assert(!d_video->thread);
+    struct vd_thread *t = talloc_zero(NULL, struct vd_thread);
+    t->max_frames = MPMAX(max_frames, 1);
+    t->broken_pts = d_video->has_broken_packet_pts;
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->wakeup, NULL);
+    d_video->thread = t;
+    if (pthread_create(&t->thread, NULL, decode_thread, d_video)) {
+        pthread_cond_destroy(&t->wakeup);
+        pthread_mutex_destroy(&t->lock);
+        talloc_free(t);
+        d_video->thread = NULL;
+        return false;
+    }
+    MP_VERBOSE(d_video, "Decoding on a separate thread (%d frames).\n",
+               t->max_frames);
+    return true;
+}
+
+// Whether the decoder thread can accept another packet.
+bool video_thread_needs_packet(struct dec_video *d_video)
+{
+    struct vd_thread *t = d_video->thread;
+    pthread_mutex_lock(&t->lock);
+    bool r = !t->eof_queued && t->num_packets < MAX_QUEUED_PACKETS;
+    pthread_mutex_unlock(&t->lock);
+    return r;
+}
+
+// Queue a packet for decoding; takes ownership of the packet. packet==NULL
+// signals EOF, after which the decoder is drained.
+void video_thread_send_packet(struct dec_video *d_video,
+                              struct demux_packet *packet, int drop_frame)
+{
+    struct vd_thread *t = d_video->thread;
+    pthread_mutex_lock(&t->lock);
+    assert(!t->eof_queued && t->num_packets < MAX_QUEUED_PACKETS);
+    t->packets[t->num_packets++] = (struct vd_packet){packet, drop_frame};
+    t->eof_queued = !packet;
+    pthread_cond_broadcast(&t->wakeup);
+    pthread_mutex_unlock(&t->lock);
+}
+
+// Return the next decoded frame. *dropped is set to the number of packets
+// that didn't produce a frame since the last call.
+//  > 0: *out_mpi is set to a new frame
+//  == 0: no frame yet, d_video->wakeup_cb will be called when there is
+//  < 0: EOF was sent, and the decoder is drained
+int video_thread_read_frame(struct dec_video *d_video, struct mp_image **out_mpi,
+                            int *dropped)
+{
+    struct vd_thread *t = d_video->thread;
+    int r = 0;
+    *out_mpi = NULL;
+    pthread_mutex_lock(&t->lock);
+    *dropped = t->dropped;
+    t->dropped = 0;
+    if (t->num_frames) {
+        *out_mpi = t->frames[0];
+        MP_TARRAY_REMOVE_AT(t->frames, t->num_frames, 0);
+        pthread_cond_broadcast(&t->wakeup);
+        r = 1;
+    } else if (t->eof) {
+        r = -1;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return r;
+}
+
+// Number of decoded frames ready to be read, or -1 if there is no thread.
+int video_thread_queued_frames(struct dec_video *d_video)
+{
+    struct vd_thread *t = d_video->thread;
+    if (!t)
+        return -1;
+    pthread_mutex_lock(&t->lock);
+    int r = t->num_frames;
+    pthread_mutex_unlock(&t->lock);
+    return r;
+}
+
+bool video_has_broken_packet_pts(struct dec_video *d_video)
+{
+    struct vd_thread *t = d_video->thread;
+    if (!t)
+        return d_video->has_broken_packet_pts;
+    pthread_mutex_lock(&t->lock);
+    int r = t->broken_pts;
+    pthread_mutex_unlock(&t->lock);
+    return r;
+}
+
 int video_reconfig_filters(struct dec_video *d_video,
                            const struct mp_image_params *params)
 {
@@ -76,8 +76,18 @@ struct dec_video {
     float fps;            // FPS from demuxer or from user override
     float initial_decoder_aspect;
 
+    // Prefer low decoding delay over throughput (set before init)
+    bool low_latency;
+
     // State used only by player/video.c
     double last_pts;
+
+    // Called by the decoder thread if new frames can be read, or if more
+    // packets can be sent (see video_start_thread()).
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_cb_ctx;
+
+    struct vd_thread *thread; // if non-NULL, decoding runs on a separate thread
 };
 
 struct mp_decoder_list *video_decoder_list(void);
@@ -100,4 +110,13 @@ int video_reconfig_filters(struct dec_video *d_video,
 
 int video_vf_vo_control(struct dec_video *d_video, int vf_cmd, void *data);
 
+bool video_start_thread(struct dec_video *d_video, int max_frames);
+bool video_thread_needs_packet(struct dec_video *d_video);
+void video_thread_send_packet(struct dec_video *d_video,
+                              struct demux_packet *packet, int drop_frame);
+int video_thread_read_frame(struct dec_video *d_video, struct mp_image **out_mpi,
+                            int *dropped);
+int video_thread_queued_frames(struct dec_video *d_video);
+bool video_has_broken_packet_pts(struct dec_video *d_video);
+
 #endif /* MPLAYER_DEC_VIDEO_H */
@@ -2,6 +2,7 @@
 #define MPV_LAVC_H
 
 #include <stdbool.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
 
@@ -33,6 +34,14 @@ typedef struct lavc_ctx {
     enum AVDiscard skip_frame;
     const char *software_fallback_decoder;
 
+    // Decoding time statistics (in seconds)
+    int64_t decode_time;        // since the last output frame (microseconds)
+    double frame_time;          // moving average per output frame
+
+    // For --vd-lavc-dr (software decoding only)
+    struct mp_image_pool *dr_pool;
+    pthread_mutex_t dr_lock;
+
     // From VO
     struct mp_hwdec_info *hwdec_info;
 
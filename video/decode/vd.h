@@ -46,6 +46,14 @@ enum vd_ctrl {
     VDCTRL_QUERY_UNSEEN_FRAMES, // current decoder lag
     VDCTRL_FORCE_HWDEC_FALLBACK, // force software decoding fallback
     VDCTRL_GET_HWDEC,
+    VDCTRL_GET_THREADING, // struct vd_threading_info*
+};
+
+struct vd_threading_info {
+    int threads;            // number of decoding threads (1 if none)
+    const char *type;       // "frame", "slice", or "none"
+    bool low_latency;       // same as dec_video.low_latency
+    double frame_time;      // average decoding time per frame (seconds)
 };
 
 #endif /* MPLAYER_VD_H */
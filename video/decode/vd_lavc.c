@@ -21,12 +21,14 @@
 #include <assert.h>
 #include <time.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include <sys/types.h>
 
 #include <libavutil/common.h>
 #include <libavutil/opt.h>
 #include <libavutil/intreadwrite.h>
 #include <libavutil/pixdesc.h>
+#include <libavutil/cpu.h>
 
 #include "talloc.h"
 #include "config.h"
@@ -35,8 +37,10 @@
 #include "misc/bstr.h"
 #include "common/av_common.h"
 #include "common/codecs.h"
+#include "osdep/timer.h"
 
 #include "video/fmt-conversion.h"
+#include "video/mp_image_pool.h"
 
 #include "vd.h"
 #include "video/img_format.h"
@@ -59,6 +63,7 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
 static void uninit_avctx(struct dec_video *vd);
 
 static int get_buffer2_hwdec(AVCodecContext *avctx, AVFrame *pic, int flags);
+static int get_buffer2_direct(AVCodecContext *avctx, AVFrame *pic, int flags);
 static enum AVPixelFormat get_format_hwdec(struct AVCodecContext *avctx,
                                            const enum AVPixelFormat *pix_fmt);
 
@@ -72,8 +77,10 @@ struct vd_lavc_params {
     int skip_frame;
     int framedrop;
     int threads;
+    int thread_type;
     int bitexact;
     int check_hw_profile;
+    int dr;
     char **avopts;
 };
 
@@ -99,8 +106,13 @@ const struct m_sub_options vd_lavc_conf = {
         OPT_DISCARD("skipframe", skip_frame, 0),
         OPT_DISCARD("framedrop", framedrop, 0),
         OPT_INTRANGE("threads", threads, 0, 0, 16),
+        OPT_CHOICE("thread-type", thread_type, 0,
+                   ({"auto", 0},
+                    {"frame", FF_THREAD_FRAME},
+                    {"slice", FF_THREAD_SLICE})),
         OPT_FLAG("bitexact", bitexact, 0),
         OPT_FLAG("check-hw-profile", check_hw_profile, 0),
+        OPT_FLAG("dr", dr, 0),
         OPT_KEYVALUELIST("o", avopts, 0),
         {0}
     },
@@ -108,6 +120,7 @@ const struct m_sub_options vd_lavc_conf = {
     .defaults = &(const struct vd_lavc_params){
         .show_all = 0,
         .check_hw_profile = 1,
+        .dr = 1,
         .skip_loop_filter = AVDISCARD_DEFAULT,
         .skip_idct = AVDISCARD_DEFAULT,
         .skip_frame = AVDISCARD_DEFAULT,
@@ -258,7 +271,9 @@ static struct vd_lavc_hwdec *probe_hwdec(struct dec_video *vd, bool autoprobe,
 
 static void uninit(struct dec_video *vd)
 {
+    vd_ffmpeg_ctx *ctx = vd->priv;
     uninit_avctx(vd);
+    pthread_mutex_destroy(&ctx->dr_lock);
     talloc_free(vd->priv);
 }
 
@@ -268,6 +283,7 @@ static int init(struct dec_video *vd, const char *decoder)
     ctx = vd->priv = talloc_zero(NULL, vd_ffmpeg_ctx);
     ctx->log = vd->log;
     ctx->opts = vd->opts;
+    pthread_mutex_init(&ctx->dr_lock, NULL);
 
     ctx->selected_hwdec = vd->opts->hwdec_api;
 
@@ -327,6 +343,49 @@ static int init(struct dec_video *vd, const char *decoder)
     return 1;
 }
 
+// Pixels per frame for which another decoding thread is worth it. More threads
+// than that don't make decoding faster, but cost memory, and with frame
+// threading each thread adds a frame of delay.
+#define PIXELS_PER_THREAD (128 * 1024)
+
+// Pick the threading type and thread count for software decoding.
+static void setup_threads(struct dec_video *vd, AVCodec *codec)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    AVCodecContext *avctx = ctx->avctx;
+    struct vd_lavc_params *lavc_param = vd->opts->vd_lavc_params;
+    struct sh_video *c = vd->header->video;
+    bool can_frame = codec->capabilities & CODEC_CAP_FRAME_THREADS;
+    bool can_slice = codec->capabilities & CODEC_CAP_SLICE_THREADS;
+
+    int type = lavc_param->thread_type;
+    if (!type) {
+        type = FF_THREAD_FRAME;
+        // Slice threading adds no delay, but whether it helps depends on how
+        // the stream was encoded (e.g. h264 needs multiple slices per frame).
+        if (!can_frame || (vd->low_latency && can_slice))
+            type = FF_THREAD_SLICE;
+    }
+    avctx->thread_type = type;
+
+    int threads = lavc_param->threads;
+    if (!threads) {
+        int cores = av_cpu_count();
+        int w = c->coded_width ? c->coded_width : c->disp_w;
+        int h = c->coded_height ? c->coded_height : c->disp_h;
+        threads = w * h > 0 ? MPMAX(w * h / PIXELS_PER_THREAD, 2) : 16;
+        // Frame threading is the only option, but delay should be low.
+        if (vd->low_latency && type == FF_THREAD_FRAME)
+            threads = 2;
+        threads = MPCLAMP(threads, 1, MPCLAMP(cores, 1, 16));
+    }
+    avctx->thread_count = threads;
+
+    MP_VERBOSE(vd, "Requesting %d threads (%s threading%s).\n", threads,
+               type == FF_THREAD_FRAME ? "frame" : "slice",
+               vd->low_latency ? ", low latency" : "");
+}
+
 static void init_avctx(struct dec_video *vd, const char *decoder,
                        struct vd_lavc_hwdec *hwdec)
 {
@@ -372,7 +431,14 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
         if (ctx->hwdec->init(ctx) < 0)
             goto error;
     } else {
-        mp_set_avcodec_threads(vd->log, avctx, lavc_param->threads);
+        setup_threads(vd, lavc_codec);
+        if (lavc_param->dr && (lavc_codec->capabilities & CODEC_CAP_DR1)) {
+            ctx->dr_pool = mp_image_pool_new(DR_POOL_SIZE);
+            avctx->get_buffer2 = get_buffer2_direct;
+            // The callback locks dr_lock, so frame threads can call it
+            // directly instead of syncing with the main thread.
+            avctx->thread_safe_callbacks = 1;
+        }
     }
 
     avctx->flags |= lavc_param->bitexact ? CODEC_FLAG_BITEXACT : 0;
@@ -452,6 +518,10 @@ static void uninit_avctx(struct dec_video *vd)
     av_freep(&ctx->avctx);
 
     av_frame_free(&ctx->pic);
+
+    // Frames still referenced elsewhere are freed when they're unreferenced.
+    talloc_free(ctx->dr_pool);
+    ctx->dr_pool = NULL;
 }
 
 static void update_image_params(struct dec_video *vd, AVFrame *frame,
@@ -601,6 +671,73 @@ static int get_buffer2_hwdec(AVCodecContext *avctx, AVFrame *pic, int flags)
     return 0;
 }
 
+// Stride alignment for frames allocated by get_buffer2_direct(). This is more
+// than libavcodec requires, and makes rows start at cache line boundaries,
+// which helps SIMD code in filters and texture uploads in VOs.
+#define DR_ALIGN 64
+
+// Enough for the reference frames of any codec, plus frames queued in the
+// filter chain and the VO. If it's exceeded, the pool just forgets about the
+// frames in use (see mp_image_pool_get()).
+#define DR_POOL_SIZE 32
+
+// Software decoding: allocate frames from our own pool instead of the
+// libavcodec internal one. The memory then comes from the same process-wide
+// buffer cache as the rest of the player's images (see mp_image_alloc()), and
+// can be recycled by filters and other decoders. The VO still gets a copy (or
+// an upload) of each frame; decoding into VO memory is not supported.
+static int get_buffer2_direct(AVCodecContext *avctx, AVFrame *pic, int flags)
+{
+    struct dec_video *vd = avctx->opaque;
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
+    int imgfmt = pixfmt2imgfmt(pic->format);
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(imgfmt);
+    if (!imgfmt || !(desc.flags & MP_IMGFLAG_BYTE_ALIGNED) ||
+        (desc.flags & (MP_IMGFLAG_HWACCEL | MP_IMGFLAG_PAL)))
+        goto fallback;
+
+    int w = pic->width;
+    int h = pic->height;
+    int stride_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(avctx, &w, &h, stride_align);
+    // The allocated size is only used for the strides and plane sizes; the
+    // frame returned by the decoder still has the real size. The additional
+    // rows provide the padding libavcodec's SIMD code may read past the end.
+    w = FFALIGN(w, DR_ALIGN << desc.chroma_xs);
+    h += 4 << desc.chroma_ys;
+
+    pthread_mutex_lock(&ctx->dr_lock);
+    struct mp_image *img = mp_image_pool_get(ctx->dr_pool, imgfmt, w, h);
+    pthread_mutex_unlock(&ctx->dr_lock);
+    if (!img)
+        goto fallback;
+
+    for (int n = 0; n < AV_NUM_DATA_POINTERS; n++) {
+        if (n < MP_MAX_PLANES && img->planes[n]) {
+            if (stride_align[n] && img->stride[n] % stride_align[n]) {
+                talloc_free(img);
+                goto fallback;
+            }
+            pic->data[n] = img->planes[n];
+            pic->linesize[n] = img->stride[n];
+        } else {
+            pic->data[n] = NULL;
+            pic->linesize[n] = 0;
+        }
+    }
+
+    pic->buf[0] = av_buffer_create(NULL, 0, free_mpi, img, 0);
+    if (!pic->buf[0]) {
+        talloc_free(img);
+        goto fallback;
+    }
+    return 0;
+
+fallback:
+    return avcodec_default_get_buffer2(avctx, pic, flags);
+}
+
 static int decode(struct dec_video *vd, struct demux_packet *packet,
                   int flags, struct mp_image **out_image)
 {
@@ -621,9 +758,11 @@ static int decode(struct dec_video *vd, struct demux_packet *packet,
 
     mp_set_av_packet(&pkt, packet, NULL);
 
+    int64_t t0 = mp_time_us();
     hwdec_lock(ctx);
     ret = avcodec_decode_video2(avctx, ctx->pic, &got_picture, &pkt);
     hwdec_unlock(ctx);
+    ctx->decode_time += mp_time_us() - t0;
     if (ret < 0) {
         MP_WARN(vd, "Error while decoding frame!\n");
         return -1;
@@ -633,6 +772,12 @@ static int decode(struct dec_video *vd, struct demux_packet *packet,
     if (!got_picture)
         return 0;
 
+    // Time spent in the decoder since the previous output frame. With frame
+    // threading, this is the wall-clock cost per frame, not the CPU time.
+    double t = ctx->decode_time / 1e6;
+    ctx->frame_time = ctx->frame_time ? ctx->frame_time * 0.9 + t * 0.1 : t;
+    ctx->decode_time = 0;
+
     struct mp_image_params params;
     update_image_params(vd, ctx->pic, &params);
     vd->codec_pts = mp_pts_from_av(ctx->pic->pkt_pts, NULL);
@@ -709,6 +854,18 @@ static int control(struct dec_video *vd, int cmd, void *arg)
     }
     case VDCTRL_FORCE_HWDEC_FALLBACK:
         return force_fallback(vd);
+    case VDCTRL_GET_THREADING: {
+        struct vd_threading_info *info = arg;
+        int type = avctx->thread_count > 1 ? avctx->active_thread_type : 0;
+        *info = (struct vd_threading_info){
+            .threads = type ? avctx->thread_count : 1,
+            .type = type & FF_THREAD_FRAME ? "frame" :
+                    type & FF_THREAD_SLICE ? "slice" : "none",
+            .low_latency = vd->low_latency,
+            .frame_time = ctx->frame_time,
+        };
+        return CONTROL_TRUE;
+    }
     }
     return CONTROL_UNKNOWN;
 }
@@ -0,0 +1,334 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include <libavutil/cpu.h>
+
+#include "common/common.h"
+#include "block_metrics.h"
+
+// The SIMD code is compiled with per-function target attributes, so the rest
+// of the binary still runs on CPUs without these instruction sets.
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define HAVE_X86_INTRINSICS 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_INTRINSICS 0
+#endif
+
+#define ABS(a) (((a)^((a)>>31))-((a)>>31))
+
+// Sum of absolute differences over rows x 8 blocks, multiplied by scale.
+static void sad_rows_c(unsigned char *a, unsigned char *b, int as, int bs,
+                       int rows, int scale, int n, int *dest)
+{
+    for (int k = 0; k < n; k++) {
+        unsigned char *pa = a + k * 8, *pb = b + k * 8;
+        int sum = 0;
+        for (int i = 0; i < rows; i++) {
+            for (int j = 0; j < 8; j++)
+                sum += ABS(pa[j] - pb[j]);
+            pa += as;
+            pb += bs;
+        }
+        dest[k] = sum * scale;
+    }
+}
+
+static void diff_c(unsigned char *a, unsigned char *b, int s, int n, int *dest)
+{
+    sad_rows_c(a, b, s, s, 4, 1, n, dest);
+}
+
+static void comb_c(unsigned char *a, unsigned char *b, int s, int n, int *dest)
+{
+    for (int k = 0; k < n; k++) {
+        unsigned char *pa = a + k * 8, *pb = b + k * 8;
+        int sum = 0;
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 8; j++) {
+                sum += ABS((pa[j] << 1) - pb[j - s] - pb[j])
+                     + ABS((pb[j] << 1) - pa[j] - pa[j + s]);
+            }
+            pa += s;
+            pb += s;
+        }
+        dest[k] = sum;
+    }
+}
+
+static void var_c(unsigned char *a, unsigned char *b, int s, int n, int *dest)
+{
+    // 4*: match comb scaling
+    sad_rows_c(a, a + s, s, s, 3, 4, n, dest);
+}
+
+static void sad8x8_c(unsigned char *a, unsigned char *b, int as, int bs,
+                     int n, int *dest)
+{
+    sad_rows_c(a, b, as, bs, 8, 1, n, dest);
+}
+
+static uint64_t xor64_c(unsigned char *p, int n)
+{
+    uint64_t sum = 0;
+    for (int i = 0; i < n; i++) {
+        uint64_t w;
+        memcpy(&w, p + i * 8, 8);
+        sum ^= w;
+    }
+    return sum;
+}
+
+static const struct mp_block_metrics metrics_c = {
+    .name = "C",
+    .diff = diff_c,
+    .comb = comb_c,
+    .var = var_c,
+    .sad8x8 = sad8x8_c,
+    .xor64 = xor64_c,
+};
+
+#if HAVE_X86_INTRINSICS
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+
+// SSE2: 2 blocks per iteration. psadbw sums each 8 byte half separately,
+// which is exactly one block each.
+static SSE2 void sad_rows_sse2(unsigned char *a, unsigned char *b,
+                               int as, int bs, int rows, int scale,
+                               int n, int *dest)
+{
+    int k = 0;
+    for (; k + 2 <= n; k += 2) {
+        __m128i sum = _mm_setzero_si128();
+        for (int i = 0; i < rows; i++) {
+            __m128i va = _mm_loadu_si128((__m128i *)(a + i * as + k * 8));
+            __m128i vb = _mm_loadu_si128((__m128i *)(b + i * bs + k * 8));
+            sum = _mm_add_epi64(sum, _mm_sad_epu8(va, vb));
+        }
+        dest[k + 0] = _mm_cvtsi128_si32(sum) * scale;
+        dest[k + 1] = _mm_cvtsi128_si32(_mm_unpackhi_epi64(sum, sum)) * scale;
+    }
+    sad_rows_c(a + k * 8, b + k * 8, as, bs, rows, scale, n - k, dest + k);
+}
+
+static SSE2 void diff_sse2(unsigned char *a, unsigned char *b, int s, int n,
+                           int *dest)
+{
+    sad_rows_sse2(a, b, s, s, 4, 1, n, dest);
+}
+
+static SSE2 void var_sse2(unsigned char *a, unsigned char *b, int s, int n,
+                          int *dest)
+{
+    sad_rows_sse2(a, a + s, s, s, 3, 4, n, dest);
+}
+
+static SSE2 void sad8x8_sse2(unsigned char *a, unsigned char *b, int as,
+                             int bs, int n, int *dest)
+{
+    sad_rows_sse2(a, b, as, bs, 8, 1, n, dest);
+}
+
+static SSE2 __m128i abs_epi16_sse2(__m128i v)
+{
+    return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+
+// Comb metric of one row of one block, all arguments as 16 bit words. The
+// per-pixel maximum is 1020, so 4 rows can be accumulated in 16 bits.
+static SSE2 __m128i comb_row_sse2(__m128i a, __m128i an, __m128i b, __m128i bp)
+{
+    __m128i t1 = _mm_sub_epi16(_mm_sub_epi16(_mm_add_epi16(a, a), bp), b);
+    __m128i t2 = _mm_sub_epi16(_mm_sub_epi16(_mm_add_epi16(b, b), a), an);
+    return _mm_add_epi16(abs_epi16_sse2(t1), abs_epi16_sse2(t2));
+}
+
+static SSE2 int hsum_epi16_sse2(__m128i v)
+{
+    v = _mm_madd_epi16(v, _mm_set1_epi16(1));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+static SSE2 void comb_sse2(unsigned char *a, unsigned char *b, int s, int n,
+                           int *dest)
+{
+    __m128i zero = _mm_setzero_si128();
+    int k = 0;
+    for (; k + 2 <= n; k += 2) {
+        __m128i lo = zero, hi = zero;
+        for (int i = 0; i < 4; i++) {
+            unsigned char *pa = a + i * s + k * 8, *pb = b + i * s + k * 8;
+            __m128i va = _mm_loadu_si128((__m128i *)pa);
+            __m128i van = _mm_loadu_si128((__m128i *)(pa + s));
+            __m128i vb = _mm_loadu_si128((__m128i *)pb);
+            __m128i vbp = _mm_loadu_si128((__m128i *)(pb - s));
+            lo = _mm_add_epi16(lo, comb_row_sse2(_mm_unpacklo_epi8(va, zero),
+                                                 _mm_unpacklo_epi8(van, zero),
+                                                 _mm_unpacklo_epi8(vb, zero),
+                                                 _mm_unpacklo_epi8(vbp, zero)));
+            hi = _mm_add_epi16(hi, comb_row_sse2(_mm_unpackhi_epi8(va, zero),
+                                                 _mm_unpackhi_epi8(van, zero),
+                                                 _mm_unpackhi_epi8(vb, zero),
+                                                 _mm_unpackhi_epi8(vbp, zero)));
+        }
+        dest[k + 0] = hsum_epi16_sse2(lo);
+        dest[k + 1] = hsum_epi16_sse2(hi);
+    }
+    comb_c(a + k * 8, b + k * 8, s, n - k, dest + k);
+}
+
+static SSE2 uint64_t xor64_sse2(unsigned char *p, int n)
+{
+    __m128i sum = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 2 <= n; i += 2)
+        sum = _mm_xor_si128(sum, _mm_loadu_si128((__m128i *)(p + i * 8)));
+    uint64_t r[2];
+    _mm_storeu_si128((__m128i *)r, sum);
+    return r[0] ^ r[1] ^ xor64_c(p + i * 8, n - i);
+}
+
+static const struct mp_block_metrics metrics_sse2 = {
+    .name = "SSE2",
+    .diff = diff_sse2,
+    .comb = comb_sse2,
+    .var = var_sse2,
+    .sad8x8 = sad8x8_sse2,
+    .xor64 = xor64_sse2,
+};
+
+// AVX2: 4 blocks per iteration for the SAD based metrics. The comb metric
+// needs 16 bit intermediates, so each 256 bit register holds 2 blocks.
+static AVX2 void sad_rows_avx2(unsigned char *a, unsigned char *b,
+                               int as, int bs, int rows, int scale,
+                               int n, int *dest)
+{
+    int k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m256i sum = _mm256_setzero_si256();
+        for (int i = 0; i < rows; i++) {
+            __m256i va = _mm256_loadu_si256((__m256i *)(a + i * as + k * 8));
+            __m256i vb = _mm256_loadu_si256((__m256i *)(b + i * bs + k * 8));
+            sum = _mm256_add_epi64(sum, _mm256_sad_epu8(va, vb));
+        }
+        int64_t r[4];
+        _mm256_storeu_si256((__m256i *)r, sum);
+        for (int j = 0; j < 4; j++)
+            dest[k + j] = r[j] * scale;
+    }
+    sad_rows_sse2(a + k * 8, b + k * 8, as, bs, rows, scale, n - k, dest + k);
+}
+
+static AVX2 void diff_avx2(unsigned char *a, unsigned char *b, int s, int n,
+                           int *dest)
+{
+    sad_rows_avx2(a, b, s, s, 4, 1, n, dest);
+}
+
+static AVX2 void var_avx2(unsigned char *a, unsigned char *b, int s, int n,
+                          int *dest)
+{
+    sad_rows_avx2(a, a + s, s, s, 3, 4, n, dest);
+}
+
+static AVX2 void sad8x8_avx2(unsigned char *a, unsigned char *b, int as,
+                             int bs, int n, int *dest)
+{
+    sad_rows_avx2(a, b, as, bs, 8, 1, n, dest);
+}
+
+static AVX2 __m256i load_epu8_epi16_avx2(unsigned char *p)
+{
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *)p));
+}
+
+static AVX2 void comb_avx2(unsigned char *a, unsigned char *b, int s, int n,
+                           int *dest)
+{
+    int k = 0;
+    for (; k + 2 <= n; k += 2) {
+        __m256i sum = _mm256_setzero_si256();
+        for (int i = 0; i < 4; i++) {
+            unsigned char *pa = a + i * s + k * 8, *pb = b + i * s + k * 8;
+            __m256i va = load_epu8_epi16_avx2(pa);
+            __m256i van = load_epu8_epi16_avx2(pa + s);
+            __m256i vb = load_epu8_epi16_avx2(pb);
+            __m256i vbp = load_epu8_epi16_avx2(pb - s);
+            __m256i t1 = _mm256_sub_epi16(
+                _mm256_sub_epi16(_mm256_add_epi16(va, va), vbp), vb);
+            __m256i t2 = _mm256_sub_epi16(
+                _mm256_sub_epi16(_mm256_add_epi16(vb, vb), va), van);
+            sum = _mm256_add_epi16(sum, _mm256_add_epi16(_mm256_abs_epi16(t1),
+                                                         _mm256_abs_epi16(t2)));
+        }
+        // Each 128 bit lane holds one block.
+        sum = _mm256_madd_epi16(sum, _mm256_set1_epi16(1));
+        sum = _mm256_add_epi32(sum, _mm256_shuffle_epi32(sum,
+                                                 _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm256_add_epi32(sum, _mm256_shuffle_epi32(sum,
+                                                 _MM_SHUFFLE(2, 3, 0, 1)));
+        dest[k + 0] = _mm_cvtsi128_si32(_mm256_castsi256_si128(sum));
+        dest[k + 1] = _mm_cvtsi128_si32(_mm256_extracti128_si256(sum, 1));
+    }
+    comb_c(a + k * 8, b + k * 8, s, n - k, dest + k);
+}
+
+static AVX2 uint64_t xor64_avx2(unsigned char *p, int n)
+{
+    __m256i sum = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+        sum = _mm256_xor_si256(sum, _mm256_loadu_si256((__m256i *)(p + i * 8)));
+    uint64_t r[4];
+    _mm256_storeu_si256((__m256i *)r, sum);
+    return r[0] ^ r[1] ^ r[2] ^ r[3] ^ xor64_sse2(p + i * 8, n - i);
+}
+
+static const struct mp_block_metrics metrics_avx2 = {
+    .name = "AVX2",
+    .diff = diff_avx2,
+    .comb = comb_avx2,
+    .var = var_avx2,
+    .sad8x8 = sad8x8_avx2,
+    .xor64 = xor64_avx2,
+};
+
+#endif
+
+const struct mp_block_metrics *mp_block_metrics_get(int max_level)
+{
+    if (max_level < 0 || max_level >= MP_BLOCK_METRICS_COUNT)
+        max_level = MP_BLOCK_METRICS_COUNT - 1;
+#if HAVE_X86_INTRINSICS
+    int flags = av_get_cpu_flags();
+#ifdef AV_CPU_FLAG_AVX2
+    if (max_level >= MP_BLOCK_METRICS_AVX2 && (flags & AV_CPU_FLAG_AVX2))
+        return &metrics_avx2;
+#endif
+    if (max_level >= MP_BLOCK_METRICS_SSE2 && (flags & AV_CPU_FLAG_SSE2))
+        return &metrics_sse2;
+#endif
+    return &metrics_c;
+}
@@ -0,0 +1,56 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_BLOCK_METRICS_H
+#define MP_BLOCK_METRICS_H
+
+#include <stdint.h>
+
+// Block metrics used by the telecine filters (vf_pullup, vf_divtc). All
+// functions process a row of n horizontally adjacent blocks, each 8 bytes
+// wide, and write one result per block to dest[0..n-1]. All implementations
+// return exactly the same results.
+
+enum {
+    MP_BLOCK_METRICS_C,
+    MP_BLOCK_METRICS_SSE2,
+    MP_BLOCK_METRICS_AVX2,
+    MP_BLOCK_METRICS_COUNT
+};
+
+typedef void (*mp_block_metric_fn)(unsigned char *a, unsigned char *b,
+                                   int s, int n, int *dest);
+
+struct mp_block_metrics {
+    const char *name;
+    // pullup metrics on 8x4 blocks of a field; s is the field stride.
+    // diff: sum of absolute differences between a and b
+    // comb: line interpolation comb metric (reads the line above b)
+    // var: 4 * vertical differences of a (3 rows, b is unused)
+    mp_block_metric_fn diff, comb, var;
+    // Sum of absolute differences on 8x8 blocks, with separate strides.
+    void (*sad8x8)(unsigned char *a, unsigned char *b, int as, int bs,
+                   int n, int *dest);
+    // XOR of the n 64 bit words starting at p (no alignment required).
+    uint64_t (*xor64)(unsigned char *p, int n);
+};
+
+// Return the fastest implementation supported by the CPU, but not above
+// max_level (one of MP_BLOCK_METRICS_*; -1 for no limit). Never NULL.
+const struct mp_block_metrics *mp_block_metrics_get(int max_level);
+
+#endif
@@ -21,74 +21,13 @@
 #include <string.h>
 #include "config.h"
 #include "pullup.h"
+#include "block_metrics.h"
+#include "slice_threads.h"
 #include "common/common.h"
 
 
 #define ABS(a) (((a)^((a)>>31))-((a)>>31))
 
-static int diff_y(unsigned char *a, unsigned char *b, int s)
-{
-        int i, j, diff=0;
-        for (i=4; i; i--) {
-                for (j=0; j<8; j++) diff += ABS(a[j]-b[j]);
-                a+=s; b+=s;
-        }
-        return diff;
-}
-
-static int licomb_y(unsigned char *a, unsigned char *b, int s)
-{
-        int i, j, diff=0;
-        for (i=4; i; i--) {
-                for (j=0; j<8; j++)
-                        diff += ABS((a[j]<<1) - b[j-s] - b[j])
-                                + ABS((b[j]<<1) - a[j] - a[j+s]);
-                a+=s; b+=s;
-        }
-        return diff;
-}
-
-#if 0
-static int qpcomb_y(unsigned char *a, unsigned char *b, int s)
-{
-        int i, j, diff=0;
-        for (i=4; i; i--) {
-                for (j=0; j<8; j++)
-                        diff += ABS(a[j] - 3*b[j-s] + 3*a[j+s] - b[j]);
-                a+=s; b+=s;
-        }
-        return diff;
-}
-
-static int licomb_y_test(unsigned char *a, unsigned char *b, int s)
-{
-        int c = licomb_y(a,b,s);
-        int m = licomb_y_mmx(a,b,s);
-        if (c != m) printf("%d != %d\n", c, m);
-        return m;
-}
-#endif
-
-static int var_y(unsigned char *a, unsigned char *b, int s)
-{
-        int i, j, var=0;
-        for (i=3; i; i--) {
-                for (j=0; j<8; j++) {
-                        var += ABS(a[j]-a[j+s]);
-                }
-                a+=s; b+=s;
-        }
-        return 4*var; /* match comb scaling */
-}
-
-
-
-
-
-
-
-
-
 static void alloc_buffer(struct pullup_context *c, struct pullup_buffer *b)
 {
         int i;
@@ -153,18 +92,41 @@ struct pullup_buffer *pullup_get_buffer(struct pullup_context *c, int parity)
 
 
 
+struct metric_job {
+        struct pullup_context *c;
+        unsigned char *a, *b;
+        void (*func)(unsigned char *, unsigned char *, int, int, int *);
+        int *dest;
+};
+
+/* Compute the metric for the block rows y0 to y1 */
+static void compute_metric_rows(void *ctx, int slice, int y0, int y1)
+{
+        struct metric_job *job = ctx;
+        struct pullup_context *c = job->c;
+        int mp = c->metric_plane;
+        int ystep = c->stride[mp]<<3;
+        int s = c->stride[mp]<<1; /* field stride */
+        unsigned char *a = job->a + y0 * ystep;
+        unsigned char *b = job->b + y0 * ystep;
+        int *dest = job->dest + y0 * c->metric_w;
+        int y;
+
+        /* A whole row of 8 byte wide blocks at once */
+        for (y = y0; y < y1; y++) {
+                job->func(a, b, s, c->metric_w, dest);
+                dest += c->metric_w;
+                a += ystep; b += ystep;
+        }
+}
+
 static void compute_metric(struct pullup_context *c,
         struct pullup_field *fa, int pa,
         struct pullup_field *fb, int pb,
-        int (*func)(unsigned char *, unsigned char *, int), int *dest)
+        void (*func)(unsigned char *, unsigned char *, int, int, int *),
+        int *dest)
 {
-        unsigned char *a, *b;
-        int x, y;
         int mp = c->metric_plane;
-        int xstep = c->bpp[mp];
-        int ystep = c->stride[mp]<<3;
-        int s = c->stride[mp]<<1; /* field stride */
-        int w = c->metric_w*xstep;
 
         if (!fa->buffer || !fb->buffer) return;
 
@@ -174,21 +136,17 @@ static void compute_metric(struct pullup_context *c,
                 return;
         }
 
-        a = fa->buffer->planes[mp] + pa * c->stride[mp] + c->metric_offset;
-        b = fb->buffer->planes[mp] + pb * c->stride[mp] + c->metric_offset;
-
-        for (y = c->metric_h; y; y--) {
-                for (x = 0; x < w; x += xstep) {
-                        *dest++ = func(a + x, b + x, s);
-                }
-                a += ystep; b += ystep;
-        }
+        struct metric_job job = {
+                .c = c,
+                .a = fa->buffer->planes[mp] + pa * c->stride[mp] + c->metric_offset,
+                .b = fb->buffer->planes[mp] + pb * c->stride[mp] + c->metric_offset,
+                .func = func,
+                .dest = dest,
+        };
+        /* Every block row writes its own part of dest */
+        mp_slice_threads_run(c->threads, c->metric_h, 1, compute_metric_rows, &job);
 }
 
-
-
-
-
 static void alloc_metrics(struct pullup_context *c, struct pullup_field *f)
 {
         f->diffs = calloc(c->metric_len, sizeof(int));
@@ -556,6 +514,7 @@ struct pullup_context *pullup_alloc_context(void)
         struct pullup_context *c;
 
         c = calloc(1, sizeof(struct pullup_context));
+        c->cpu_level = -1;
 
         return c;
 }
@@ -586,25 +545,30 @@ void pullup_init_context(struct pullup_context *c)
         c->frame->ifields = calloc(3, sizeof (struct pullup_buffer *));
 
         switch(c->format) {
-        case PULLUP_FMT_Y:
-                c->diff = diff_y;
-                c->comb = licomb_y;
-                c->var = var_y;
+        case PULLUP_FMT_Y: {
+                const struct mp_block_metrics *m =
+                        mp_block_metrics_get(c->cpu_level);
+                c->diff = m->diff;
+                c->comb = m->comb;
+                c->var = m->var;
                 break;
         }
+        }
 }
 
 void pullup_free_context(struct pullup_context *c)
 {
-        struct pullup_field *f;
+        struct pullup_field *f, *next;
         free(c->buffers);
         f = c->head;
         do {
                 if (!f) break;
+                next = f->next;
                 free(f->diffs);
                 free(f->comb);
-                f = f->next;
-                free(f->prev);
+                free(f->var);
+                free(f);
+                f = next;
         } while (f != c->head);
         free(c->frame);
         free(c);
@@ -65,13 +65,15 @@ struct pullup_context
         int metric_plane;
         int strict_breaks;
         int strict_pairs;
+        struct mp_slice_threads *threads; /* optional, for computing metrics */
+        int cpu_level; /* max. MP_BLOCK_METRICS_* to use, -1 for best */
         /* Internal data */
         struct pullup_field *first, *last, *head;
         struct pullup_buffer *buffers;
         int nbuffers;
-        int (*diff)(unsigned char *, unsigned char *, int);
-        int (*comb)(unsigned char *, unsigned char *, int);
-        int (*var)(unsigned char *, unsigned char *, int);
+        void (*diff)(unsigned char *, unsigned char *, int, int, int *);
+        void (*comb)(unsigned char *, unsigned char *, int, int, int *);
+        void (*var)(unsigned char *, unsigned char *, int, int, int *);
         int metric_w, metric_h, metric_len, metric_offset;
         struct pullup_frame *frame;
 };
@@ -0,0 +1,238 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <pthread.h>
+
+#include <libavutil/cpu.h>
+
+#include "talloc.h"
+#include "common/common.h"
+#include "osdep/threads.h"
+
+#include "slice_threads.h"
+
+// The worker threads are shared by all mp_slice_threads handles in the
+// process. They are started on the first mp_slice_threads_run() call, and
+// stopped when the last handle is freed. Only one job runs on them at a time;
+// a caller that finds them busy does its job alone.
+struct pool {
+    pthread_t threads[MP_MAX_SLICES - 1];
+    int num_threads;        // worker threads (excludes the caller)
+    bool terminate;
+    // Current job
+    uint64_t job_id;        // incremented for each job
+    mp_slice_fn fn;
+    void *ctx;
+    int h, align, num_slices;
+    int pending;            // slices not finished yet
+};
+
+struct mp_slice_threads {
+    int max_slices;
+};
+
+struct worker {
+    struct pool *pool;
+    int index;
+};
+
+// Protects all fields of the pool and the variables below.
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wakeup = PTHREAD_COND_INITIALIZER;
+static struct pool *pool;
+static int pool_refs;       // number of mp_slice_threads handles
+static bool pool_busy;      // a job is running
+
+// Rows of the given slice (slices cover [0, h), and start at multiples of
+// align).
+static void slice_range(struct pool *p, int slice, int *y0, int *y1)
+{
+    int units = (p->h + p->align - 1) / p->align;
+    *y0 = MPMIN((int64_t)units * slice / p->num_slices * p->align, p->h);
+    *y1 = MPMIN((int64_t)units * (slice + 1) / p->num_slices * p->align, p->h);
+}
+
+static void run_slice(struct pool *p, int slice)
+{
+    int y0, y1;
+    slice_range(p, slice, &y0, &y1);
+    if (y1 > y0)
+        p->fn(p->ctx, slice, y0, y1);
+}
+
+static void *worker_thread(void *arg)
+{
+    struct worker w = *(struct worker *)arg;
+    struct pool *p = w.pool;
+    talloc_free(arg);
+
+    mpthread_set_name("slices");
+
+    uint64_t done_id = 0;
+    pthread_mutex_lock(&pool_lock);
+    while (!p->terminate) {
+        // Worker n handles slice n + 1; the caller does slice 0.
+        int slice = w.index + 1;
+        if (p->job_id == done_id || slice >= p->num_slices) {
+            done_id = p->job_id;
+            pthread_cond_wait(&pool_wakeup, &pool_lock);
+            continue;
+        }
+        done_id = p->job_id;
+        pthread_mutex_unlock(&pool_lock);
+
+        run_slice(p, slice);
+
+        pthread_mutex_lock(&pool_lock);
+        p->pending -= 1;
+        if (!p->pending)
+            pthread_cond_broadcast(&pool_wakeup);
+    }
+    pthread_mutex_unlock(&pool_lock);
+    return NULL;
+}
+
+// Called with pool_lock held.
+static struct pool *pool_create(void)
+{
+    struct pool *p = talloc_zero(NULL, struct pool);
+    int threads = MPCLAMP(av_cpu_count(), 1, MP_MAX_SLICES);
+    for (int n = 0; n < threads - 1; n++) {
+        struct worker *w = talloc_ptrtype(NULL, w);
+        *w = (struct worker){p, n};
+        if (pthread_create(&p->threads[n], NULL, worker_thread, w)) {
+            talloc_free(w);
+            break;
+        }
+        p->num_threads++;
+    }
+    return p;
+}
+
+static void destroy(void *ptr)
+{
+    pthread_mutex_lock(&pool_lock);
+    struct pool *p = NULL;
+    pool_refs -= 1;
+    if (!pool_refs) {
+        // Wait for mp_slice_threads_run_shared() callers.
+        while (pool_busy)
+            pthread_cond_wait(&pool_wakeup, &pool_lock);
+        p = pool;
+        pool = NULL;
+        if (p) {
+            p->terminate = true;
+            pthread_cond_broadcast(&pool_wakeup);
+        }
+    }
+    pthread_mutex_unlock(&pool_lock);
+    if (p) {
+        for (int n = 0; n < p->num_threads; n++)
+            pthread_join(p->threads[n], NULL);
+        talloc_free(p);
+    }
+}
+
+// Return a handle for mp_slice_threads_run(). threads is the maximum number of
+// slices an image is split into; 0 uses the number of CPUs. No threads are
+// created until the handle is used, and they are shared with all other
+// handles.
+// Never returns NULL; if no threads can be created, the caller's thread does
+// all the work.
+struct mp_slice_threads *mp_slice_threads_create(void *ta_parent, int threads)
+{
+    if (threads <= 0)
+        threads = av_cpu_count();
+
+    struct mp_slice_threads *st = talloc_zero(ta_parent, struct mp_slice_threads);
+    st->max_slices = MPCLAMP(threads, 1, MP_MAX_SLICES);
+    talloc_set_destructor(st, destroy);
+
+    pthread_mutex_lock(&pool_lock);
+    pool_refs += 1;
+    pthread_mutex_unlock(&pool_lock);
+    return st;
+}
+
+// Number of slices mp_slice_threads_run() uses at most.
+int mp_slice_threads_count(struct mp_slice_threads *st)
+{
+    return st ? st->max_slices : 1;
+}
+
+static void run(int max_slices, int h, int align, mp_slice_fn fn, void *ctx)
+{
+    assert(align > 0);
+    if (h <= 0)
+        return;
+    int units = (h + align - 1) / align;
+    max_slices = MPMIN(max_slices, units);
+
+    struct pool *p = NULL;
+    if (max_slices > 1) {
+        pthread_mutex_lock(&pool_lock);
+        if (!pool && pool_refs)
+            pool = pool_create();
+        if (pool && pool->num_threads && !pool_busy) {
+            p = pool;
+            pool_busy = true;
+            p->fn = fn;
+            p->ctx = ctx;
+            p->h = h;
+            p->align = align;
+            p->num_slices = MPMIN(p->num_threads + 1, max_slices);
+            p->pending = p->num_slices - 1;
+            p->job_id++;
+            pthread_cond_broadcast(&pool_wakeup);
+        }
+        pthread_mutex_unlock(&pool_lock);
+    }
+
+    if (!p) {
+        fn(ctx, 0, 0, h);
+        return;
+    }
+
+    run_slice(p, 0);
+
+    pthread_mutex_lock(&pool_lock);
+    while (p->pending)
+        pthread_cond_wait(&pool_wakeup, &pool_lock);
+    pool_busy = false;
+    pthread_cond_broadcast(&pool_wakeup);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// Call fn on slices of the rows [0, h), and wait until all calls are done.
+// Each slice except the last starts and ends at a multiple of align rows (so
+// align=2 keeps chroma rows of 4:2:0 images intact). Slices with no rows are
+// skipped. st can be NULL, which calls fn(ctx, 0, 0, h) directly. This also
+// happens if the threads are busy with another job (e.g. if fn itself calls
+// this function).
+void mp_slice_threads_run(struct mp_slice_threads *st, int h, int align,
+                          mp_slice_fn fn, void *ctx)
+{
+    run(mp_slice_threads_count(st), h, align, fn, ctx);
+}
+
+// Like mp_slice_threads_run(), for callers which don't own a handle. The
+// threads are only used if some handle exists, and at most max_slices slices.
+void mp_slice_threads_run_shared(int max_slices, int h, int align,
+                                 mp_slice_fn fn, void *ctx)
+{
+    run(MPCLAMP(max_slices, 1, MP_MAX_SLICES), h, align, fn, ctx);
+}
@@ -0,0 +1,39 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_SLICE_THREADS_H
+#define MP_SLICE_THREADS_H
+
+// Runs a function on horizontal bands ("slices") of an image in parallel.
+struct mp_slice_threads;
+
+// Upper bound for mp_slice_threads_count().
+#define MP_MAX_SLICES 16
+
+// Process a band of rows y0 <= y < y1. slice is the index of the band
+// (0 <= slice < mp_slice_threads_count()); calls with different indexes run
+// concurrently, and can e.g. write partial results to an array.
+typedef void (*mp_slice_fn)(void *ctx, int slice, int y0, int y1);
+
+struct mp_slice_threads *mp_slice_threads_create(void *ta_parent, int threads);
+int mp_slice_threads_count(struct mp_slice_threads *st);
+void mp_slice_threads_run(struct mp_slice_threads *st, int h, int align,
+                          mp_slice_fn fn, void *ctx);
+void mp_slice_threads_run_shared(int max_slices, int h, int align,
+                                 mp_slice_fn fn, void *ctx);
+
+#endif
@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <libavutil/common.h>
 #include <libavutil/mem.h>
@@ -33,10 +34,10 @@
 #include "options/m_config.h"
 
 #include "options/options.h"
+#include "osdep/threads.h"
 
 #include "video/img_format.h"
 #include "video/mp_image.h"
-#include "video/mp_image_pool.h"
 #include "vf.h"
 
 #include "video/memcpy_pic.h"
@@ -127,6 +128,9 @@ static const vf_info_t *const filter_list[] = {
 };
 
 static void vf_uninit_filter(vf_instance_t *vf);
+static void pipeline_destroy(struct vf_chain *c);
+static void pipeline_pause(struct vf_chain *c);
+static void pipeline_resume(struct vf_chain *c);
 
 static bool get_desc(struct m_obj_desc *dst, int index)
 {
@@ -155,14 +159,17 @@ const struct m_obj_list vf_obj_list = {
 // filter which does not return CONTROL_UNKNOWN for it.
 int vf_control_any(struct vf_chain *c, int cmd, void *arg)
 {
+    int r = CONTROL_UNKNOWN;
+    pipeline_pause(c);
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
         if (cur->control) {
-            int r = cur->control(cur, cmd, arg);
+            r = cur->control(cur, cmd, arg);
             if (r != CONTROL_UNKNOWN)
-                return r;
+                break;
         }
     }
-    return CONTROL_UNKNOWN;
+    pipeline_resume(c);
+    return r;
 }
 
 int vf_control_by_label(struct vf_chain *c,int cmd, void *arg, bstr label)
@@ -171,7 +178,10 @@ int vf_control_by_label(struct vf_chain *c,int cmd, void *arg, bstr label)
     struct vf_instance *cur = vf_find_by_label(c, label_str);
     talloc_free(label_str);
     if (cur) {
-        return cur->control ? cur->control(cur, cmd, arg) : CONTROL_NA;
+        pipeline_pause(c);
+        int r = cur->control ? cur->control(cur, cmd, arg) : CONTROL_NA;
+        pipeline_resume(c);
+        return r;
     } else {
         return CONTROL_UNKNOWN;
     }
@@ -198,12 +208,13 @@ static void vf_fix_img_params(struct mp_image *img, struct mp_image_params *p)
 }
 
 // Get a new image for filter output, with size and pixel format according to
-// the last vf_config call.
+// the last vf_config call. Image memory is recycled by the process-wide buffer
+// cache in mp_image_pool.c, so filters don't need to keep their own pools.
 struct mp_image *vf_alloc_out_image(struct vf_instance *vf)
 {
     struct mp_image_params *p = &vf->fmt_out;
     assert(p->imgfmt);
-    struct mp_image *img = mp_image_pool_get(vf->out_pool, p->imgfmt, p->w, p->h);
+    struct mp_image *img = mp_image_alloc(p->imgfmt, p->w, p->h);
     if (img)
         vf_fix_img_params(img, p);
     return img;
@@ -216,7 +227,7 @@ bool vf_make_out_image_writeable(struct vf_instance *vf, struct mp_image *img)
     assert(p->imgfmt);
     assert(p->imgfmt == img->imgfmt);
     assert(p->w == img->w && p->h == img->h);
-    return mp_image_pool_make_writeable(vf->out_pool, img);
+    return mp_image_make_writeable(img);
 }
 
 //============================================================================
@@ -264,7 +275,6 @@ static struct vf_instance *vf_open(struct vf_chain *c, const char *name,
         .log = mp_log_new(vf, c->log, name),
         .hwdec = c->hwdec,
         .query_format = vf_default_query_format,
-        .out_pool = talloc_steal(vf, mp_image_pool_new(16)),
         .chain = c,
     };
     struct m_config *config = m_config_from_obj_desc(vf, vf->log, &desc);
@@ -307,6 +317,7 @@ void vf_remove_filter(struct vf_chain *c, struct vf_instance *vf)
     while (prev && prev->next != vf)
         prev = prev->next;
     assert(prev); // not inserted
+    pipeline_destroy(c);
     prev->next = vf->next;
     vf_uninit_filter(vf);
 }
@@ -316,6 +327,7 @@ struct vf_instance *vf_append_filter(struct vf_chain *c, const char *name,
 {
     struct vf_instance *vf = vf_open_filter(c, name, args);
     if (vf) {
+        pipeline_destroy(c);
         // Insert it before the last filter, which is the "out" pseudo-filter
         // (But after the "in" pseudo-filter)
         struct vf_instance **pprev = &c->first->next;
@@ -401,6 +413,349 @@ static int vf_do_filter(struct vf_instance *vf, struct mp_image *img)
     }
 }
 
+// --vf-pipeline: each filter runs on its own thread. Frames are passed from
+// one filter to the next through short queues, so consecutive frames can be
+// in different filters at the same time. The filter's own out_queued array is
+// accessed by its thread only. All other state (the queues, and the filters
+// while the pipeline is paused) is protected by the pipeline lock.
+
+// Max. number of frames queued for each filter (and the output).
+#define PIPELINE_QUEUE 2
+
+struct vf_stage {
+    struct vf_pipeline *p;
+    struct vf_instance *vf;
+    pthread_t thread;
+    struct mp_image **in;   // frames waiting to be filtered
+    int num_in;
+    bool eof_in;            // no more frames after in[]
+    bool busy;              // filter is being run without the lock held
+    struct mp_image **tmp;  // filter output that didn't fit into the next queue
+    int num_tmp;
+};
+
+struct vf_pipeline {
+    struct vf_chain *chain;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool terminate;
+    int paused;
+    bool error;
+    bool eof_sent;          // vf_output_frame() was called with eof=true
+    struct vf_stage **stages;
+    int num_stages;
+    struct mp_image **out;  // output of the last filter
+    int num_out;
+    bool eof_out;           // the last filter was fully flushed
+};
+
+// Filters which are bound to a thread, or which use threads themselves.
+static bool pipeline_compatible(struct vf_instance *vf)
+{
+    const char *name = vf->info->name;
+    return !vf->needs_input && strcmp(name, "vavpp") != 0 &&
+           strcmp(name, "vdpaupp") != 0;
+}
+
+static void stage_next_queue(struct vf_stage *st, struct mp_image ****queue,
+                             int **num, bool **eof)
+{
+    struct vf_pipeline *p = st->p;
+    for (int n = 0; n < p->num_stages - 1; n++) {
+        if (p->stages[n] == st) {
+            struct vf_stage *next = p->stages[n + 1];
+            *queue = &next->in;
+            *num = &next->num_in;
+            *eof = &next->eof_in;
+            return;
+        }
+    }
+    *queue = &p->out;
+    *num = &p->num_out;
+    *eof = &p->eof_out;
+}
+
+// Call the player's wakeup callback. Called with the lock held.
+static void pipeline_wakeup_player(struct vf_pipeline *p)
+{
+    if (p->chain->wakeup_callback) {
+        pthread_mutex_unlock(&p->lock);
+        p->chain->wakeup_callback(p->chain->wakeup_callback_ctx);
+        pthread_mutex_lock(&p->lock);
+    }
+}
+
+static void *stage_thread(void *ptr)
+{
+    struct vf_stage *st = ptr;
+    struct vf_pipeline *p = st->p;
+    struct vf_instance *vf = st->vf;
+
+    mpthread_set_name("vf pipeline");
+
+    pthread_mutex_lock(&p->lock);
+    struct mp_image ***next;
+    int *num_next;
+    bool *next_eof;
+    stage_next_queue(st, &next, &num_next, &next_eof);
+    bool is_first = st == p->stages[0];
+    bool is_last = next == &p->out;
+
+    while (!p->terminate) {
+        bool can_run = !p->paused && !p->error && *num_next < PIPELINE_QUEUE;
+        if (can_run && st->num_tmp) {
+            // A filter can output several frames per input frame. Pass them
+            // on only as far as the next queue has room.
+            while (st->num_tmp && *num_next < PIPELINE_QUEUE) {
+                MP_TARRAY_APPEND(NULL, *next, *num_next, st->tmp[0]);
+                MP_TARRAY_REMOVE_AT(st->tmp, st->num_tmp, 0);
+            }
+            pthread_cond_broadcast(&p->wakeup);
+            if (is_last)
+                pipeline_wakeup_player(p);
+            continue;
+        }
+        if (!can_run || !(st->num_in || (st->eof_in && !*next_eof))) {
+            pthread_cond_wait(&p->wakeup, &p->lock);
+            continue;
+        }
+        struct mp_image *img = NULL;
+        if (st->num_in) {
+            img = st->in[0];
+            MP_TARRAY_REMOVE_AT(st->in, st->num_in, 0);
+            // The previous filter can queue the next frame while this one is
+            // filtered.
+            pthread_cond_broadcast(&p->wakeup);
+        }
+        st->busy = true;
+        pthread_mutex_unlock(&p->lock);
+
+        // Same for the player, which waits for vf_can_filter_frame().
+        if (img && is_first && p->chain->wakeup_callback)
+            p->chain->wakeup_callback(p->chain->wakeup_callback_ctx);
+
+        // img==NULL flushes the filter on EOF. Like vf_output_frame_until(),
+        // keep doing that until it stops returning frames.
+        int r = vf_do_filter(vf, img);
+        while (r >= 0 && vf_has_output_frame(vf))
+            MP_TARRAY_APPEND(st, st->tmp, st->num_tmp, vf_dequeue_output_frame(vf));
+        bool flushed = !img && (r < 0 || !st->num_tmp);
+
+        pthread_mutex_lock(&p->lock);
+        st->busy = false;
+        if (r < 0)
+            p->error = true;
+        if (flushed)
+            *next_eof = true;
+        // (The output in st->tmp is passed on by the next iteration.)
+        pthread_cond_broadcast(&p->wakeup);
+        if (is_last && (flushed || r < 0))
+            pipeline_wakeup_player(p);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+// Drop all frames queued between the filters. Called with the pipeline paused
+// (or with no threads running).
+static void pipeline_flush(struct vf_chain *c)
+{
+    struct vf_pipeline *p = c->pipeline;
+    if (!p)
+        return;
+    pthread_mutex_lock(&p->lock);
+    for (int n = 0; n < p->num_stages; n++) {
+        struct vf_stage *st = p->stages[n];
+        for (int i = 0; i < st->num_in; i++)
+            talloc_free(st->in[i]);
+        st->num_in = 0;
+        st->eof_in = false;
+        for (int i = 0; i < st->num_tmp; i++)
+            talloc_free(st->tmp[i]);
+        st->num_tmp = 0;
+    }
+    for (int n = 0; n < p->num_out; n++)
+        talloc_free(p->out[n]);
+    p->num_out = 0;
+    p->eof_out = p->eof_sent = p->error = false;
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Wait until no filter runs, and keep it that way until pipeline_resume().
+// While paused, the filters can be accessed from the calling thread.
+static void pipeline_pause(struct vf_chain *c)
+{
+    struct vf_pipeline *p = c->pipeline;
+    if (!p)
+        return;
+    pthread_mutex_lock(&p->lock);
+    p->paused++;
+    for (int n = 0; n < p->num_stages; n++) {
+        while (p->stages[n]->busy)
+            pthread_cond_wait(&p->wakeup, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void pipeline_resume(struct vf_chain *c)
+{
+    struct vf_pipeline *p = c->pipeline;
+    if (!p)
+        return;
+    pthread_mutex_lock(&p->lock);
+    assert(p->paused > 0);
+    p->paused--;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void pipeline_destroy(struct vf_chain *c)
+{
+    struct vf_pipeline *p = c->pipeline;
+    if (!p)
+        return;
+    pthread_mutex_lock(&p->lock);
+    p->terminate = true;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+    for (int n = 0; n < p->num_stages; n++)
+        pthread_join(p->stages[n]->thread, NULL);
+    pipeline_flush(c);
+    // (The queues are not allocated as children of p, because the threads
+    // resize them concurrently.)
+    for (int n = 0; n < p->num_stages; n++)
+        talloc_free(p->stages[n]->in);
+    talloc_free(p->out);
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
+    talloc_free(p);
+    c->pipeline = NULL;
+}
+
+static void pipeline_create(struct vf_chain *c)
+{
+    assert(!c->pipeline);
+    int num_filters = 0;
+    for (struct vf_instance *vf = c->first->next; vf != c->last; vf = vf->next) {
+        if (!pipeline_compatible(vf)) {
+            MP_VERBOSE(c, "Filter '%s' can't be used with --vf-pipeline.\n",
+                       vf->info->name);
+            return;
+        }
+        num_filters++;
+    }
+    if (num_filters < 2)
+        return; // nothing to pipeline
+
+    struct vf_pipeline *p = talloc_zero(NULL, struct vf_pipeline);
+    p->chain = c;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+    c->pipeline = p;
+    for (struct vf_instance *vf = c->first->next; vf != c->last; vf = vf->next) {
+        struct vf_stage *st = talloc_zero(p, struct vf_stage);
+        *st = (struct vf_stage){ .p = p, .vf = vf };
+        MP_TARRAY_APPEND(p, p->stages, p->num_stages, st);
+    }
+    // Don't let threads look at the stage list while it's being created.
+    pthread_mutex_lock(&p->lock);
+    for (int n = 0; n < p->num_stages; n++) {
+        if (pthread_create(&p->stages[n]->thread, NULL, stage_thread,
+                           p->stages[n]))
+        {
+            p->num_stages = n;
+            pthread_mutex_unlock(&p->lock);
+            MP_ERR(c, "Could not start filter threads.\n");
+            pipeline_destroy(c);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+    MP_VERBOSE(c, "Running %d filters in parallel.\n", p->num_stages);
+}
+
+static int pipeline_filter_frame(struct vf_chain *c, struct mp_image *img)
+{
+    struct vf_pipeline *p = c->pipeline;
+    int r = vf_do_filter(c->first, img); // only the "in" pseudo-filter
+    struct vf_stage *first = p->stages[0];
+    pthread_mutex_lock(&p->lock);
+    if (p->eof_sent) {
+        // New input after EOF: wait until the old data was flushed. (The
+        // caller checked vf_can_filter_frame(), so this normally won't wait.)
+        while (!p->eof_out && !p->error)
+            pthread_cond_wait(&p->wakeup, &p->lock);
+        for (int n = 0; n < p->num_stages; n++)
+            p->stages[n]->eof_in = false;
+        p->eof_out = p->eof_sent = false;
+    }
+    // The caller checked vf_can_filter_frame(), so there's room in the queue.
+    while (vf_has_output_frame(c->first)) {
+        MP_TARRAY_APPEND(NULL, first->in, first->num_in,
+                         vf_dequeue_output_frame(c->first));
+    }
+    if (p->error)
+        r = -1;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+    return r;
+}
+
+static int pipeline_output_frame(struct vf_chain *c, bool eof)
+{
+    struct vf_pipeline *p = c->pipeline;
+    if (c->last->num_out_queued)
+        return 1;
+    if (c->initialized < 1)
+        return -1;
+    int r;
+    pthread_mutex_lock(&p->lock);
+    if (eof && !p->eof_sent) {
+        p->eof_sent = true;
+        p->stages[0]->eof_in = true;
+        pthread_cond_broadcast(&p->wakeup);
+    }
+    while (1) {
+        if (p->num_out) {
+            struct mp_image *img = p->out[0];
+            MP_TARRAY_REMOVE_AT(p->out, p->num_out, 0);
+            pthread_cond_broadcast(&p->wakeup);
+            vf_do_filter(c->last, img); // only the "out" pseudo-filter
+            r = 1;
+            break;
+        }
+        if (p->error) {
+            r = -1;
+            break;
+        }
+        // On EOF, the caller wants to know whether the chain is drained, so
+        // wait until all frames went through.
+        if (!eof || p->eof_out) {
+            r = 0;
+            break;
+        }
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return r;
+}
+
+// Whether vf_filter_frame() can take a new frame now. With --vf-pipeline, this
+// is false while the first filter still has enough frames queued (or the
+// chain is being drained after EOF). The caller should keep the frame, and try
+// again after c->wakeup_callback was called.
+bool vf_can_filter_frame(struct vf_chain *c)
+{
+    struct vf_pipeline *p = c->pipeline;
+    if (!p)
+        return true;
+    pthread_mutex_lock(&p->lock);
+    bool r = p->error || ((!p->eof_sent || p->eof_out) &&
+                          p->stages[0]->num_in < PIPELINE_QUEUE);
+    pthread_mutex_unlock(&p->lock);
+    return r;
+}
+
 // Input a frame into the filter chain. Ownership of img is transferred.
 // Return >= 0 on success, < 0 on failure (even if output frames were produced)
 int vf_filter_frame(struct vf_chain *c, struct mp_image *img)
@@ -412,6 +767,8 @@ int vf_filter_frame(struct vf_chain *c, struct mp_image *img)
     }
     assert(mp_image_params_equal(&img->params, &c->input_params));
     vf_fix_img_params(img, &c->override_params);
+    if (c->pipeline)
+        return pipeline_filter_frame(c, img);
     return vf_do_filter(c->first, img);
 }
 
@@ -456,6 +813,8 @@ static int vf_output_frame_until(struct vf_chain *c, struct vf_instance *until,
 //  returns: -1: error, 0: no output, 1: output available
 int vf_output_frame(struct vf_chain *c, bool eof)
 {
+    if (c->pipeline)
+        return pipeline_output_frame(c, eof);
     return vf_output_frame_until(c, c->last, eof);
 }
 
@@ -477,6 +836,8 @@ struct mp_image *vf_read_output_frame(struct vf_chain *c)
 // returns -1: error, 0: nothing needed, 1: add new frame with vf_filter_frame()
 int vf_needs_input(struct vf_chain *c)
 {
+    if (c->pipeline)
+        return 0; // not used with filters that implement needs_input
     struct vf_instance *prev = c->first;
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
         while (cur->needs_input && cur->needs_input(cur)) {
@@ -509,8 +870,11 @@ static void vf_chain_forget_frames(struct vf_chain *c)
 
 void vf_seek_reset(struct vf_chain *c)
 {
+    pipeline_pause(c);
+    pipeline_flush(c);
     vf_control_all(c, VFCTRL_SEEK_RESET, NULL);
     vf_chain_forget_frames(c);
+    pipeline_resume(c);
 }
 
 int vf_next_config(struct vf_instance *vf,
@@ -589,8 +953,6 @@ static int vf_reconfig_wrapper(struct vf_instance *vf,
                                const struct mp_image_params *p)
 {
     vf_forget_frames(vf);
-    if (vf->out_pool)
-        mp_image_pool_clear(vf->out_pool);
 
     if (!vf->query_format(vf, p->imgfmt))
         return -2;
@@ -628,6 +990,7 @@ int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params,
                 const struct mp_image_params *override_params)
 {
     int r = 0;
+    pipeline_destroy(c);
     vf_chain_forget_frames(c);
     for (struct vf_instance *vf = c->first; vf; ) {
         struct vf_instance *next = vf->next;
@@ -662,6 +1025,8 @@ int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params,
         c->input_params = c->override_params = c->output_params =
             (struct mp_image_params){0};
     }
+    if (r >= 0 && c->opts->vf_pipeline)
+        pipeline_create(c);
     return r;
 }
 
@@ -729,6 +1094,7 @@ void vf_destroy(struct vf_chain *c)
 {
     if (!c)
         return;
+    pipeline_destroy(c);
     while (c->first) {
         vf_instance_t *vf = c->first;
         c->first = vf->next;
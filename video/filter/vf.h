@@ -95,7 +95,6 @@ typedef struct vf_instance {
 
     struct mp_image_params fmt_in, fmt_out;
 
-    struct mp_image_pool *out_pool;
     struct vf_priv_s *priv;
     struct mp_log *log;
     struct mp_hwdec_info *hwdec;
@@ -133,6 +132,9 @@ struct vf_chain {
     // since they are supposed to call it from foreign threads.
     void (*wakeup_callback)(void *ctx);
     void *wakeup_callback_ctx;
+
+    // If non-NULL, each filter runs on its own thread (--vf-pipeline).
+    struct vf_pipeline *pipeline;
 };
 
 typedef struct vf_seteq {
@@ -160,6 +162,7 @@ int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params,
                 const struct mp_image_params *override_params);
 int vf_control_any(struct vf_chain *c, int cmd, void *arg);
 int vf_control_by_label(struct vf_chain *c, int cmd, void *arg, bstr label);
+bool vf_can_filter_frame(struct vf_chain *c);
 int vf_filter_frame(struct vf_chain *c, struct mp_image *img);
 int vf_output_frame(struct vf_chain *c, bool eof);
 int vf_needs_input(struct vf_chain *c);
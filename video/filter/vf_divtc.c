@@ -32,6 +32,9 @@
 #include "video/img_format.h"
 #include "video/mp_image.h"
 #include "vf.h"
+#include "block_metrics.h"
+#include "slice_threads.h"
+#include "vf_divtc.h"
 
 #include "video/memcpy_pic.h"
 
@@ -49,38 +52,82 @@ struct vf_priv_s
    int *history;
    struct vf_detc_pts_buf ptsbuf;
    struct mp_image *buffer;
+   struct mp_slice_threads *threads;
+   const struct mp_block_metrics *metrics;
    };
 
-static int diff(unsigned char *old, unsigned char *new, int os, int ns)
+struct diff_job
    {
-   int x, y, d=0;
+   const struct mp_block_metrics *metrics;
+   unsigned char *old, *new;
+   int w, h, os, ns;
+   int max[MP_MAX_SLICES], sum[MP_MAX_SLICES], n[MP_MAX_SLICES];
+   };
+
+static void diff_rows(void *ctx, int slice, int y0, int y1)
+   {
+   struct diff_job *job=ctx;
+   int x, y, i, nb, d[64], max=0, sum=0, n=0;
 
-   for(y=8; y; y--, new+=ns, old+=os)
-      for(x=8; x; x--)
-         d+=abs(new[x]-old[x]);
+   for(y=y0; y<y1 && y<job->h-7; y+=8)
+      {
+      /* Note that the blocks start at x+1. */
+      for(x=0; x<job->w-7; x+=nb*8)
+         {
+         nb=MPMIN((job->w-x)/8, MP_ARRAY_SIZE(d));
+         job->metrics->sad8x8(job->old+x+1+y*job->os, job->new+x+1+y*job->ns,
+                              job->os, job->ns, nb, d);
+         for(i=0; i<nb; i++)
+            {
+            if(d[i]>max) max=d[i];
+            sum+=d[i];
+            }
+         n+=nb;
+         }
+      }
 
-   return d;
+   job->max[slice]=max;
+   job->sum[slice]=sum;
+   job->n[slice]=n;
    }
 
-static int diff_plane(unsigned char *old, unsigned char *new,
-                      int w, int h, int os, int ns, int arg)
+// The 8x8 blocks are split across threads in bands of whole block rows. The
+// partial results are combined afterwards, so this is exactly the same as
+// doing it on a single thread.
+int vf_divtc_diff_plane(struct mp_slice_threads *threads,
+                        const struct mp_block_metrics *metrics,
+                        unsigned char *old, unsigned char *new,
+                        int w, int h, int os, int ns)
    {
-   int x, y, d, max=0, sum=0, n=0;
+   struct diff_job job={.metrics=metrics, .old=old, .new=new,
+                        .w=w, .h=h, .os=os, .ns=ns};
+   int max=0, sum=0, n=0;
 
-   for(y=0; y<h-7; y+=8)
+   mp_slice_threads_run(threads, h, 8, diff_rows, &job);
+
+   for(int i=0; i<mp_slice_threads_count(threads); i++)
       {
-      for(x=0; x<w-7; x+=8)
-         {
-         d=diff(old+x+y*os, new+x+y*ns, os, ns);
-         if(d>max) max=d;
-         sum+=d;
-         n++;
-         }
+      if(job.max[i]>max) max=job.max[i];
+      sum+=job.sum[i];
+      n+=job.n[i];
       }
 
    return (sum+n*max)/2;
    }
 
+static int diff_image(struct vf_priv_s *p, mp_image_t *old, mp_image_t *new)
+   {
+   int sum=0;
+   for(int i=0; i<old->num_planes; i++)
+      {
+      sum+=vf_divtc_diff_plane(p->threads, p->metrics,
+                               old->planes[i], new->planes[i],
+                               (old->w * old->fmt.bytes[i]) >> old->fmt.xs[i],
+                               old->plane_h[i], old->stride[i], new->stride[i]);
+      }
+   return sum;
+   }
+
 /*
 static unsigned int checksum_plane(unsigned char *p, unsigned char *z,
                                    int w, int h, int s, int zs, int arg)
@@ -98,26 +145,36 @@ static unsigned int checksum_plane(unsigned char *p, unsigned char *z,
 
 #define FAST_64BIT (UINTPTR_MAX >= UINT64_MAX)
 
-static unsigned int checksum_plane(unsigned char *p, unsigned char *z,
-                                   int w, int h, int s, int zs, int arg)
+static unsigned int checksum_plane(const struct mp_block_metrics *m,
+                                   unsigned char *p, int w, int h, int s)
    {
    unsigned int shift;
    uint32_t sum, t;
-   unsigned char *e, *e2;
+   unsigned char *e;
 #if FAST_64BIT
    typedef uint64_t wsum_t;
 #else
    typedef uint32_t wsum_t;
+   unsigned char *e2;
 #endif
    wsum_t wsum;
+#if FAST_64BIT
+   int nw;
+#endif
 
    for(sum=0; h; h--, p+=s-w)
       {
       for(shift=0, e=p+w; (size_t)p&(sizeof(wsum_t)-1) && p<e;)
          sum^=*p++<<(shift=(shift-8)&31);
 
+#if FAST_64BIT
+      nw=(e-p)/sizeof(wsum_t);
+      wsum=m->xor64(p, nw);
+      p+=nw*sizeof(wsum_t);
+#else
       for(wsum=0, e2=e-sizeof(wsum_t)+1; p<e2; p+=sizeof(wsum_t))
          wsum^=*(wsum_t *)p;
+#endif
 
 #if FAST_64BIT
       t=av_be2ne32((uint32_t)(wsum>>32^wsum));
@@ -132,6 +189,18 @@ static unsigned int checksum_plane(unsigned char *p, unsigned char *z,
    return sum;
    }
 
+static unsigned int checksum_image(struct vf_priv_s *p, mp_image_t *mpi)
+   {
+   unsigned int sum=0;
+   for(int i=0; i<mpi->num_planes; i++)
+      {
+      sum+=checksum_plane(p->metrics, mpi->planes[i],
+                          (mpi->w * mpi->fmt.bytes[i]) >> mpi->fmt.xs[i],
+                          mpi->plane_h[i], mpi->stride[i]);
+      }
+   return sum;
+   }
+
 static int deghost_plane(unsigned char *d, unsigned char *s,
                          int w, int h, int ds, int ss, int threshold)
    {
@@ -235,8 +304,8 @@ static struct mp_image *filter(struct vf_instance *vf, struct mp_image *mpi)
       {
       case 1:
          fprintf(p->file, "%08x %d\n",
-                 (unsigned int)imgop((void *)checksum_plane, mpi, 0, 0),
-                 p->frameno?imgop(diff_plane, dmpi, mpi, 0):0);
+                 checksum_image(p, mpi),
+                 p->frameno?diff_image(p, dmpi, mpi):0);
          break;
 
       case 2:
@@ -248,7 +317,7 @@ static struct mp_image *filter(struct vf_instance *vf, struct mp_image *mpi)
             break;
             }
 
-         checksum=(unsigned int)imgop((void *)checksum_plane, mpi, 0, 0);
+         checksum=checksum_image(p, mpi);
 
          if(checksum!=p->csdata[p->frameno])
             {
@@ -291,7 +360,7 @@ static struct mp_image *filter(struct vf_instance *vf, struct mp_image *mpi)
                *histp=p->history+p->frameno%p->window;
 
             *sump-=*histp;
-            *sump+=(*histp=imgop(diff_plane, dmpi, mpi, 0));
+            *sump+=(*histp=diff_image(p, dmpi, mpi));
             }
 
          m=match(p, p->sum, -1, -1, &d);
@@ -600,6 +669,9 @@ static int vf_open(vf_instance_t *vf)
    if(!(p->history=calloc(sizeof *p->history, p->window)))
       abort();
 
+   p->threads=mp_slice_threads_create(vf, 0);
+   p->metrics=mp_block_metrics_get(-1);
+
    vf_detc_init_pts_buf(&p->ptsbuf);
    return 1;
    fail:
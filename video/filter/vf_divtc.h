@@ -0,0 +1,15 @@
+#ifndef MP_VF_DIVTC_H_
+#define MP_VF_DIVTC_H_
+
+struct mp_block_metrics;
+struct mp_slice_threads;
+
+// The difference measure vf_divtc uses between two frames, for one plane of
+// w x h bytes, split into slices on threads (NULL for the caller's thread).
+// os and ns are the strides of old and new.
+int vf_divtc_diff_plane(struct mp_slice_threads *threads,
+                        const struct mp_block_metrics *metrics,
+                        unsigned char *old, unsigned char *new,
+                        int w, int h, int os, int ns);
+
+#endif
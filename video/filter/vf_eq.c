@@ -36,6 +36,8 @@
 #include "video/img_format.h"
 #include "video/mp_image.h"
 #include "vf.h"
+#include "slice_threads.h"
+#include "vf_eq.h"
 
 #define LUT16
 
@@ -77,8 +79,16 @@ typedef struct vf_priv_s {
   int gamma_i, contrast_i, brightness_i, saturation_i;
 
   double   par[8];
+
+  struct mp_slice_threads *threads;
 } vf_eq2_t;
 
+struct adjust_job {
+  eq2_param_t   *par;
+  unsigned char *dst, *src;
+  unsigned      w, dstride, sstride;
+};
+
 
 static
 void create_lut (eq2_param_t *par)
@@ -174,6 +184,49 @@ void apply_lut (eq2_param_t *par, unsigned char *dst, unsigned char *src,
   }
 }
 
+static
+void adjust_rows (void *ctx, int slice, int y0, int y1)
+{
+  struct adjust_job *job = ctx;
+
+  job->par->adjust (job->par, job->dst + y0 * job->dstride,
+    job->src + y0 * job->sstride, job->w, y1 - y0, job->dstride, job->sstride);
+}
+
+static
+void adjust_plane (struct mp_slice_threads *threads, eq2_param_t *par,
+  unsigned char *dst, unsigned char *src, unsigned w, unsigned h,
+  unsigned dstride, unsigned sstride)
+{
+  /* The LUT is shared by all slices, so create it here */
+  if (!par->lut_clean)
+    create_lut (par);
+
+  struct adjust_job job = {
+    .par = par,
+    .dst = dst,
+    .src = src,
+    .w = w,
+    .dstride = dstride,
+    .sstride = sstride,
+  };
+  mp_slice_threads_run (threads, h, 1, adjust_rows, &job);
+}
+
+void vf_eq_adjust_plane (struct mp_slice_threads *threads, double c, double b,
+  double g, double w, unsigned char *dst, unsigned char *src, int width,
+  int height, int dstride, int sstride)
+{
+  eq2_param_t *par = talloc_zero (NULL, eq2_param_t);
+  par->c = c;
+  par->b = b;
+  par->g = g;
+  par->w = w;
+  par->adjust = &apply_lut;
+  adjust_plane (threads, par, dst, src, width, height, dstride, sstride);
+  talloc_free (par);
+}
+
 static struct mp_image *filter(struct vf_instance *vf, struct mp_image *src)
 {
   vf_eq2_t      *eq2;
@@ -210,8 +263,9 @@ static struct mp_image *filter(struct vf_instance *vf, struct mp_image *src)
       dst.planes[i] = eq2->buf[i];
       dst.stride[i] = eq2->buf_w[i];
 
-      eq2->param[i].adjust (&eq2->param[i], dst.planes[i], src->planes[i],
-        eq2->buf_w[i], eq2->buf_h[i], dst.stride[i], src->stride[i]);
+      adjust_plane (eq2->threads, &eq2->param[i], dst.planes[i],
+        src->planes[i], eq2->buf_w[i], eq2->buf_h[i], dst.stride[i],
+        src->stride[i]);
     }
   }
 
@@ -425,6 +479,8 @@ int vf_open(vf_instance_t *vf)
     set_saturation (eq2, par[3]);
     eq2->saturation_i = (int) (100.0 * vf->priv->saturation) - 100;
 
+  eq2->threads = mp_slice_threads_create (vf, 0);
+
   return 1;
 }
 
@@ -0,0 +1,13 @@
+#ifndef MP_VF_EQ_H_
+#define MP_VF_EQ_H_
+
+struct mp_slice_threads;
+
+// Apply contrast c, brightness b and gamma g (with weight w) to a plane, as
+// vf_eq does, split into slices on threads (NULL for the caller's thread).
+void vf_eq_adjust_plane(struct mp_slice_threads *threads, double c, double b,
+                        double g, double w, unsigned char *dst,
+                        unsigned char *src, int width, int height,
+                        int dstride, int sstride);
+
+#endif
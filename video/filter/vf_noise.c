@@ -33,9 +33,11 @@
 #include "video/img_format.h"
 #include "video/mp_image.h"
 #include "vf.h"
+#include "slice_threads.h"
 #include "video/memcpy_pic.h"
 
 #include "vf_lavfi.h"
+#include "vf_noise.h"
 
 #define MAX_NOISE 4096
 #define MAX_SHIFT 1024
@@ -46,7 +48,7 @@
 static inline void lineNoise(uint8_t *dst, uint8_t *src, int8_t *noise, int len, int shift);
 static inline void lineNoiseAvg(uint8_t *dst, uint8_t *src, int len, int8_t **shift);
 
-typedef struct FilterParam{
+typedef struct vf_noise_param{
         int strength;
         int uniform;
         int temporal;
@@ -69,6 +71,7 @@ struct vf_priv_s {
         int uniform;
         int hq;
         struct vf_lw_opts *lw_opts;
+        struct mp_slice_threads *threads;
 };
 
 static const int patt[4] = {
@@ -170,10 +173,37 @@ static inline void lineNoiseAvg(uint8_t *dst, uint8_t *src, int len, int8_t **sh
 
 /***************************************************************************/
 
-static void donoise(uint8_t *dst, uint8_t *src, int dstStride, int srcStride, int width, int height, FilterParam *fp){
+struct noise_job {
+        uint8_t *dst, *src;
+        int dstStride, srcStride, width;
+        FilterParam *fp;
+        int *shifts;
+};
+
+static void noise_rows(void *ctx, int slice, int y0, int y1){
+        struct noise_job *job= ctx;
+        FilterParam *fp= job->fp;
+        uint8_t *dst= job->dst + y0*job->dstStride;
+        uint8_t *src= job->src + y0*job->srcStride;
+        int y;
+
+        for(y=y0; y<y1; y++)
+        {
+                int shift= job->shifts[y];
+                if (fp->averaged) {
+                    lineNoiseAvg(dst, src, job->width, fp->prev_shift[y]);
+                    fp->prev_shift[y][fp->shiftptr] = fp->noise + shift;
+                } else {
+                    lineNoise(dst, src, fp->noise, job->width, shift);
+                }
+                dst+= job->dstStride;
+                src+= job->srcStride;
+        }
+}
+
+static void donoise(struct mp_slice_threads *threads, uint8_t *dst, uint8_t *src, int dstStride, int srcStride, int width, int height, FilterParam *fp){
         int8_t *noise= fp->noise;
         int y;
-        int shift=0;
 
         if(!noise)
         {
@@ -192,25 +222,37 @@ static void donoise(uint8_t *dst, uint8_t *src, int dstStride, int srcStride, in
                 return;
         }
 
+        // The random shifts are picked in order, so that the result doesn't
+        // depend on how the rows are distributed across threads.
+        int *shifts= talloc_array(NULL, int, height);
         for(y=0; y<height; y++)
         {
+                int shift;
                 if(fp->temporal)        shift=  rand()&(MAX_SHIFT  -1);
                 else                    shift= fp->nonTempRandShift[y];
 
                 if(fp->quality==0) shift&= ~7;
-                if (fp->averaged) {
-                    lineNoiseAvg(dst, src, width, fp->prev_shift[y]);
-                    fp->prev_shift[y][fp->shiftptr] = noise + shift;
-                } else {
-                    lineNoise(dst, src, noise, width, shift);
-                }
-                dst+= dstStride;
-                src+= srcStride;
+                shifts[y]= shift;
         }
+
+        struct noise_job job = {
+                .dst = dst, .src = src,
+                .dstStride = dstStride, .srcStride = srcStride,
+                .width = width, .fp = fp, .shifts = shifts,
+        };
+        mp_slice_threads_run(threads, height, 1, noise_rows, &job);
+        talloc_free(shifts);
+
         fp->shiftptr++;
         if (fp->shiftptr == 3) fp->shiftptr = 0;
 }
 
+void vf_noise_plane(struct mp_slice_threads *threads, struct vf_noise_param *fp,
+                    uint8_t *dst, uint8_t *src, int dstStride, int srcStride,
+                    int width, int height){
+        donoise(threads, dst, src, dstStride, srcStride, width, height, fp);
+}
+
 static struct mp_image *filter(struct vf_instance *vf, struct mp_image *mpi)
 {
         struct mp_image *dmpi = mpi;
@@ -221,9 +263,10 @@ static struct mp_image *filter(struct vf_instance *vf, struct mp_image *mpi)
             mp_image_copy_attributes(dmpi, mpi);
         }
 
-        donoise(dmpi->planes[0], mpi->planes[0], dmpi->stride[0], mpi->stride[0], mpi->w, mpi->h, &vf->priv->lumaParam);
-        donoise(dmpi->planes[1], mpi->planes[1], dmpi->stride[1], mpi->stride[1], mpi->w/2, mpi->h/2, &vf->priv->chromaParam);
-        donoise(dmpi->planes[2], mpi->planes[2], dmpi->stride[2], mpi->stride[2], mpi->w/2, mpi->h/2, &vf->priv->chromaParam);
+        struct mp_slice_threads *threads = vf->priv->threads;
+        donoise(threads, dmpi->planes[0], mpi->planes[0], dmpi->stride[0], mpi->stride[0], mpi->w, mpi->h, &vf->priv->lumaParam);
+        donoise(threads, dmpi->planes[1], mpi->planes[1], dmpi->stride[1], mpi->stride[1], mpi->w/2, mpi->h/2, &vf->priv->chromaParam);
+        donoise(threads, dmpi->planes[2], mpi->planes[2], dmpi->stride[2], mpi->stride[2], mpi->w/2, mpi->h/2, &vf->priv->chromaParam);
 
         if (dmpi != mpi)
             talloc_free(mpi);
@@ -262,6 +305,24 @@ static void parse(FilterParam *fp, struct vf_priv_s *p){
         if(fp->strength) initNoise(fp);
 }
 
+static void free_param(void *ptr){
+        FilterParam *fp= ptr;
+        av_free(fp->noise);
+}
+
+struct vf_noise_param *vf_noise_param_create(void *ta_parent, int strength,
+                                             int averaged, int pattern,
+                                             int temporal, int uniform, int hq){
+        struct vf_priv_s p = {
+                .strength = strength, .averaged = averaged, .pattern = pattern,
+                .temporal = temporal, .uniform = uniform, .hq = hq,
+        };
+        FilterParam *fp= talloc_zero(ta_parent, FilterParam);
+        talloc_set_destructor(fp, free_param);
+        parse(fp, &p);
+        return fp;
+}
+
 static int vf_open(vf_instance_t *vf){
     vf->filter=filter;
     vf->query_format=query_format;
@@ -278,6 +339,7 @@ static int vf_open(vf_instance_t *vf){
 
     parse(&vf->priv->lumaParam, vf->priv);
     parse(&vf->priv->chromaParam, vf->priv);
+    vf->priv->threads = mp_slice_threads_create(vf, 0);
 
     return 1;
 }
@@ -0,0 +1,23 @@
+#ifndef MP_VF_NOISE_H_
+#define MP_VF_NOISE_H_
+
+#include <stdint.h>
+
+struct mp_slice_threads;
+struct vf_noise_param;
+
+// Noise generator for one plane, with the vf_noise options of the same names.
+// It is seeded with a fixed value, so generators with the same options give
+// the same noise.
+struct vf_noise_param *vf_noise_param_create(void *ta_parent, int strength,
+                                             int averaged, int pattern,
+                                             int temporal, int uniform, int hq);
+
+// Add noise to the next frame's plane, as vf_noise does, split into slices on
+// threads (NULL for the caller's thread). The random shifts of the temporal
+// mode are drawn with rand().
+void vf_noise_plane(struct mp_slice_threads *threads, struct vf_noise_param *fp,
+                    uint8_t *dst, uint8_t *src, int dst_stride, int src_stride,
+                    int width, int height);
+
+#endif
@@ -31,6 +31,7 @@
 #include "video/memcpy_pic.h"
 
 #include "pullup.h"
+#include "slice_threads.h"
 #include "vf_lavfi.h"
 
 #undef MAX
@@ -44,6 +45,7 @@ struct vf_priv_s {
         int junk_left, junk_right, junk_top, junk_bottom;
         int strict_breaks, metric_plane;
         struct vf_lw_opts *lw_opts;
+        struct mp_slice_threads *threads;
 };
 
 static void reset(struct vf_instance *vf)
@@ -251,6 +253,7 @@ static int vf_open(vf_instance_t *vf)
         {
             return 1;
         }
+        p->threads = mp_slice_threads_create(vf, 0);
         reset(vf);
         return 1;
 }
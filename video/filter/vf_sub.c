@@ -108,7 +108,7 @@ static struct mp_image *filter(struct vf_instance *vf, struct mp_image *mpi)
         return mpi;
 
     osd_draw_on_image_p(osd, priv->dim, mpi->pts, OSD_DRAW_SUB_FILTER,
-                        vf->out_pool, mpi);
+                        NULL, mpi);
 
     return mpi;
 }
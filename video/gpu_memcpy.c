@@ -0,0 +1,181 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libavutil/cpu.h>
+
+#include "common/common.h"
+#include "video/filter/slice_threads.h"
+#include "memcpy_pic.h"
+#include "mp_image.h"
+#include "gpu_memcpy.h"
+
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define HAVE_X86_INTRINSICS 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_INTRINSICS 0
+#endif
+
+// Images smaller than this are copied by the calling thread only.
+#define MIN_THREADED_BYTES (512 * 1024)
+
+#if HAVE_X86_INTRINSICS
+
+#define SSE4 __attribute__((target("sse4.1")))
+
+SSE4 static void copy_sse4(uint8_t *dst, const uint8_t *src, size_t size)
+{
+    // Streaming loads require 16 byte aligned source addresses.
+    size_t head = MPMIN((16 - ((uintptr_t)src & 15)) & 15, size);
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    size -= head;
+
+    // Load a whole cache line before storing anything; this is what makes
+    // the CPU's streaming load buffer effective.
+    while (size >= 64) {
+        __m128i *s = (__m128i *)src;
+        __m128i x0 = _mm_stream_load_si128(s + 0);
+        __m128i x1 = _mm_stream_load_si128(s + 1);
+        __m128i x2 = _mm_stream_load_si128(s + 2);
+        __m128i x3 = _mm_stream_load_si128(s + 3);
+        _mm_storeu_si128((__m128i *)dst + 0, x0);
+        _mm_storeu_si128((__m128i *)dst + 1, x1);
+        _mm_storeu_si128((__m128i *)dst + 2, x2);
+        _mm_storeu_si128((__m128i *)dst + 3, x3);
+        src += 64;
+        dst += 64;
+        size -= 64;
+    }
+    while (size >= 16) {
+        _mm_storeu_si128((__m128i *)dst,
+                         _mm_stream_load_si128((__m128i *)src));
+        src += 16;
+        dst += 16;
+        size -= 16;
+    }
+    memcpy(dst, src, size);
+}
+
+SSE4 static void copy_pic_sse4(uint8_t *dst, const uint8_t *src,
+                               int bytes_per_line, int height,
+                               int dst_stride, int src_stride)
+{
+    // Make sure the source is synced - doesn't hurt if not needed.
+    _mm_sfence();
+    if (bytes_per_line == dst_stride && dst_stride == src_stride &&
+        src_stride > 0)
+    {
+        copy_sse4(dst, src, (size_t)src_stride * height);
+        return;
+    }
+    for (int y = 0; y < height; y++) {
+        copy_sse4(dst, src, bytes_per_line);
+        dst += dst_stride;
+        src += src_stride;
+    }
+}
+
+#endif
+
+bool gpu_memcpy_is_fast(void)
+{
+#if HAVE_X86_INTRINSICS
+    return av_get_cpu_flags() & AV_CPU_FLAG_SSE4;
+#else
+    return false;
+#endif
+}
+
+void gpu_memcpy_pic(void *dst, const void *src, int bytes_per_line, int height,
+                    int dst_stride, int src_stride)
+{
+#if HAVE_X86_INTRINSICS
+    if (gpu_memcpy_is_fast()) {
+        copy_pic_sse4(dst, src, bytes_per_line, height, dst_stride, src_stride);
+        return;
+    }
+#endif
+    memcpy_pic(dst, src, bytes_per_line, height, dst_stride, src_stride);
+}
+
+void gpu_memcpy(void *dst, const void *src, size_t size)
+{
+#if HAVE_X86_INTRINSICS
+    if (gpu_memcpy_is_fast()) {
+        _mm_sfence();
+        copy_sse4(dst, src, size);
+        return;
+    }
+#endif
+    memcpy(dst, src, size);
+}
+
+struct copy_job {
+    struct mp_image *dst, *src;
+    int plane;
+    int line_bytes;
+};
+
+static void copy_rows(void *ctx, int slice, int y0, int y1)
+{
+    struct copy_job *job = ctx;
+    int p = job->plane;
+    gpu_memcpy_pic(job->dst->planes[p] + y0 * job->dst->stride[p],
+                   job->src->planes[p] + y0 * job->src->stride[p],
+                   job->line_bytes, y1 - y0,
+                   job->dst->stride[p], job->src->stride[p]);
+}
+
+void mp_image_copy_gpu(struct mp_image *dst, struct mp_image *src)
+{
+    assert(dst->imgfmt == src->imgfmt);
+    assert(dst->w == src->w && dst->h == src->h);
+    assert(mp_image_is_writeable(dst));
+    if (!gpu_memcpy_is_fast()) {
+        mp_image_copy(dst, src);
+        return;
+    }
+
+    size_t size = 0;
+    for (int n = 0; n < dst->num_planes; n++)
+        size += (dst->plane_w[n] * dst->fmt.bpp[n] + 7) / 8 * dst->plane_h[n];
+
+    for (int n = 0; n < dst->num_planes; n++) {
+        struct copy_job job = {
+            .dst = dst,
+            .src = src,
+            .plane = n,
+            .line_bytes = (dst->plane_w[n] * dst->fmt.bpp[n] + 7) / 8,
+        };
+        if (size >= MIN_THREADED_BYTES) {
+            mp_pic_threads_run(dst->plane_h[n], copy_rows, &job);
+        } else {
+            copy_rows(&job, 0, 0, dst->plane_h[n]);
+        }
+    }
+
+    // Watch out for AV_PIX_FMT_FLAG_PSEUDOPAL retardation
+    if ((dst->fmt.flags & MP_IMGFLAG_PAL) && dst->planes[1] && src->planes[1])
+        memcpy(dst->planes[1], src->planes[1], MP_PALETTE_SIZE);
+}
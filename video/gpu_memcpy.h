@@ -0,0 +1,44 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_GPU_MEMCPY_H
+#define MP_GPU_MEMCPY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct mp_image;
+
+// Copy functions for reading from uncached, write-combined (USWC) memory, such
+// as mapped hardware decoder surfaces. Normal loads from such memory are
+// extremely slow; on x86 CPUs with SSE4.1, these use streaming loads
+// (MOVNTDQA), which fetch a full cache line at once. Otherwise, or if the CPU
+// lacks SSE4.1, they behave like memcpy()/memcpy_pic()/mp_image_copy().
+
+// Whether the optimized code path is available.
+bool gpu_memcpy_is_fast(void);
+
+void gpu_memcpy(void *dst, const void *src, size_t size);
+void gpu_memcpy_pic(void *dst, const void *src, int bytes_per_line, int height,
+                    int dst_stride, int src_stride);
+
+// Like mp_image_copy(), but with gpu_memcpy(). Large images are split into
+// bands copied by several threads in parallel (see mp_pic_threads_run()),
+// because a single core can't saturate the bus with streaming loads.
+void mp_image_copy_gpu(struct mp_image *dst, struct mp_image *src);
+
+#endif
@@ -0,0 +1,267 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <libavutil/cpu.h>
+
+#include "common/common.h"
+#include "video/filter/slice_threads.h"
+#include "memcpy_pic.h"
+
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define HAVE_X86_INTRINSICS 1
+#include <immintrin.h>
+#else
+#define HAVE_X86_INTRINSICS 0
+#endif
+
+// Copying is limited by memory bandwidth; a few threads are enough to
+// saturate it.
+#define MAX_THREADS 4
+
+void mp_pic_threads_run(int h, mp_slice_fn fn, void *ctx)
+{
+    mp_slice_threads_run_shared(MAX_THREADS, h, 1, fn, ctx);
+}
+
+struct pic_job {
+    uint8_t *dst;
+    const uint8_t *src;     // NULL for fills
+    int bytes, dst_stride, src_stride;
+    uint8_t pattern[16];    // fill value, repeated
+    int fill_size;
+    bool nt;                // use non-temporal stores
+};
+
+static void fill_c(uint8_t *dst, size_t n, const uint8_t *pattern, int size)
+{
+    if (size == 1) {
+        memset(dst, pattern[0], n);
+        return;
+    }
+    size_t done = MPMIN(n, 16);
+    memcpy(dst, pattern, done);
+    // done is always a multiple of the pattern size here.
+    while (done < n) {
+        size_t c = MPMIN(done, n - done);
+        memcpy(dst + done, dst, c);
+        done += c;
+    }
+}
+
+#if HAVE_X86_INTRINSICS
+
+#define SSE2 __attribute__((target("sse2")))
+
+SSE2 static void copy_nt(uint8_t *dst, const uint8_t *src, size_t n)
+{
+    // Non-temporal stores require 16 byte aligned destination addresses.
+    size_t head = MPMIN((16 - ((uintptr_t)dst & 15)) & 15, n);
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    n -= head;
+
+    while (n >= 64) {
+        __m128i x0 = _mm_loadu_si128((const __m128i *)src + 0);
+        __m128i x1 = _mm_loadu_si128((const __m128i *)src + 1);
+        __m128i x2 = _mm_loadu_si128((const __m128i *)src + 2);
+        __m128i x3 = _mm_loadu_si128((const __m128i *)src + 3);
+        _mm_stream_si128((__m128i *)dst + 0, x0);
+        _mm_stream_si128((__m128i *)dst + 1, x1);
+        _mm_stream_si128((__m128i *)dst + 2, x2);
+        _mm_stream_si128((__m128i *)dst + 3, x3);
+        src += 64;
+        dst += 64;
+        n -= 64;
+    }
+    while (n >= 16) {
+        _mm_stream_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+        src += 16;
+        dst += 16;
+        n -= 16;
+    }
+    memcpy(dst, src, n);
+}
+
+SSE2 static void fill_nt(uint8_t *dst, size_t n, const uint8_t *pattern)
+{
+    size_t head = MPMIN((16 - ((uintptr_t)dst & 15)) & 15, n);
+    memcpy(dst, pattern, head);
+    dst += head;
+    n -= head;
+
+    // Continue the pattern where the head left off.
+    uint8_t rot[16];
+    for (int i = 0; i < 16; i++)
+        rot[i] = pattern[(i + head) & 15];
+    __m128i v = _mm_loadu_si128((const __m128i *)rot);
+
+    while (n >= 64) {
+        _mm_stream_si128((__m128i *)dst + 0, v);
+        _mm_stream_si128((__m128i *)dst + 1, v);
+        _mm_stream_si128((__m128i *)dst + 2, v);
+        _mm_stream_si128((__m128i *)dst + 3, v);
+        dst += 64;
+        n -= 64;
+    }
+    while (n >= 16) {
+        _mm_stream_si128((__m128i *)dst, v);
+        dst += 16;
+        n -= 16;
+    }
+    memcpy(dst, rot, n);
+}
+
+// Non-temporal stores are weakly ordered; they must be fenced before another
+// thread can rely on seeing the data.
+SSE2 static void fence_nt(void)
+{
+    _mm_sfence();
+}
+
+static bool have_nt(void)
+{
+    return av_get_cpu_flags() & AV_CPU_FLAG_SSE2;
+}
+
+#else
+
+static void copy_nt(uint8_t *dst, const uint8_t *src, size_t n)
+{
+    memcpy(dst, src, n);
+}
+
+static void fill_nt(uint8_t *dst, size_t n, const uint8_t *pattern)
+{
+    fill_c(dst, n, pattern, 16);
+}
+
+static void fence_nt(void)
+{
+}
+
+static bool have_nt(void)
+{
+    return false;
+}
+
+#endif
+
+static void do_line(struct pic_job *job, uint8_t *dst, const uint8_t *src,
+                    size_t n)
+{
+    if (src) {
+        if (job->nt) {
+            copy_nt(dst, src, n);
+        } else {
+            memcpy(dst, src, n);
+        }
+    } else {
+        if (job->nt) {
+            fill_nt(dst, n, job->pattern);
+        } else {
+            fill_c(dst, n, job->pattern, job->fill_size);
+        }
+    }
+}
+
+static void do_rows(void *ctx, int slice, int y0, int y1)
+{
+    struct pic_job *job = ctx;
+    uint8_t *dst = job->dst + (ptrdiff_t)y0 * job->dst_stride;
+    const uint8_t *src =
+        job->src ? job->src + (ptrdiff_t)y0 * job->src_stride : NULL;
+    bool packed = job->bytes == job->dst_stride &&
+                  (!src || job->dst_stride == job->src_stride);
+    if (packed) {
+        do_line(job, dst, src, (size_t)job->bytes * (y1 - y0));
+    } else {
+        for (int y = y0; y < y1; y++) {
+            do_line(job, dst, src, job->bytes);
+            dst += job->dst_stride;
+            if (src)
+                src += job->src_stride;
+        }
+    }
+    if (job->nt)
+        fence_nt();
+}
+
+static void run_job(struct pic_job *job, int height)
+{
+    // Flip vertically flipped images, so that packed planes can be copied in
+    // one go (like memcpy_pic() does).
+    if (job->dst_stride < 0 && (!job->src || job->src_stride < 0)) {
+        job->dst += (ptrdiff_t)(height - 1) * job->dst_stride;
+        job->dst_stride = -job->dst_stride;
+        if (job->src) {
+            job->src += (ptrdiff_t)(height - 1) * job->src_stride;
+            job->src_stride = -job->src_stride;
+        }
+    }
+
+    int64_t size = (int64_t)job->bytes * height;
+    job->nt = size >= MP_PIC_LARGE && have_nt();
+    if (size >= MP_PIC_LARGE * 2) {
+        mp_pic_threads_run(height, do_rows, job);
+    } else {
+        do_rows(job, 0, 0, height);
+    }
+}
+
+void memcpy_pic_large(void *dst, const void *src, int bytesPerLine, int height,
+                      int dstStride, int srcStride)
+{
+    struct pic_job job = {
+        .dst = dst,
+        .src = src,
+        .bytes = bytesPerLine,
+        .dst_stride = dstStride,
+        .src_stride = srcStride,
+    };
+    run_job(&job, height);
+}
+
+// fill_size is the size of the fill value in bytes (1, 2 or 4). Its lowest
+// fill_size bytes are written in native byte order.
+void memset_pic_large(void *dst, uint32_t fill, int fill_size,
+                      int bytesPerLine, int height, int stride)
+{
+    struct pic_job job = {
+        .dst = dst,
+        .bytes = bytesPerLine,
+        .dst_stride = stride,
+        .fill_size = fill_size,
+    };
+    uint8_t value[4];
+    if (fill_size == 1) {
+        value[0] = fill;
+    } else if (fill_size == 2) {
+        uint16_t v = fill;
+        memcpy(value, &v, 2);
+    } else {
+        memcpy(value, &fill, 4);
+    }
+    for (int i = 0; i < 16; i++)
+        job.pattern[i] = value[i % fill_size];
+    run_job(&job, height);
+}
@@ -23,13 +23,37 @@
 #include <string.h>
 #include <stddef.h>
 
+#include "video/filter/slice_threads.h"
+
 #define my_memcpy_pic memcpy_pic
 #define memcpy_pic2(d, s, b, h, ds, ss, unused) memcpy_pic(d, s, b, h, ds, ss)
 
+// Planes of at least this many bytes are handled by the *_large() functions
+// in memcpy_pic.c. These write with non-temporal stores, so that copying a
+// frame doesn't evict everything else from the CPU cache, and split planes
+// twice this size across threads. TOOLS/bench/memcpy_pic measures where
+// this pays off.
+#define MP_PIC_LARGE (4 * 1024 * 1024)
+
+void memcpy_pic_large(void *dst, const void *src, int bytesPerLine, int height,
+                      int dstStride, int srcStride);
+void memset_pic_large(void *dst, uint32_t fill, int fill_size,
+                      int bytesPerLine, int height, int stride);
+
+// Copy the rows [0, h) of a large image in slices, with fn as in
+// mp_slice_threads_run(). This uses the shared slice threads, which a player
+// keeps alive while it exists. Without a player, or if the threads are busy
+// with another job, the caller's thread does all the work.
+void mp_pic_threads_run(int h, mp_slice_fn fn, void *ctx);
+
 static inline void memcpy_pic(void *dst, const void *src,
                               int bytesPerLine, int height,
                               int dstStride, int srcStride)
 {
+    if ((int64_t)bytesPerLine * height >= MP_PIC_LARGE) {
+        memcpy_pic_large(dst, src, bytesPerLine, height, dstStride, srcStride);
+        return;
+    }
     if (bytesPerLine == dstStride && dstStride == srcStride) {
         if (srcStride < 0) {
             src = (uint8_t*)src + (height - 1) * srcStride;
@@ -50,6 +74,10 @@ static inline void memcpy_pic(void *dst, const void *src,
 static inline void memset_pic(void *dst, int fill, int bytesPerLine, int height,
                               int stride)
 {
+    if ((int64_t)bytesPerLine * height >= MP_PIC_LARGE) {
+        memset_pic_large(dst, fill, 1, bytesPerLine, height, stride);
+        return;
+    }
     if (bytesPerLine == stride) {
         memset(dst, fill, stride * height);
     } else {
@@ -65,6 +93,8 @@ static inline void memset16_pic(void *dst, int fill, int unitsPerLine,
 {
     if (fill == 0) {
         memset_pic(dst, 0, unitsPerLine * 2, height, stride);
+    } else if ((int64_t)unitsPerLine * 2 * height >= MP_PIC_LARGE) {
+        memset_pic_large(dst, (uint16_t)fill, 2, unitsPerLine * 2, height, stride);
     } else {
         for (int i = 0; i < height; i++) {
             uint16_t *line = dst;
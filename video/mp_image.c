@@ -34,6 +34,7 @@
 
 #include "img_format.h"
 #include "mp_image.h"
+#include "mp_image_pool.h"
 #include "sws_utils.h"
 #include "memcpy_pic.h"
 #include "fmt-conversion.h"
@@ -143,7 +144,7 @@ static bool mp_image_alloc_planes(struct mp_image *mpi)
     for (int n = 0; n < MP_MAX_PLANES; n++)
         sum += plane_size[n];
 
-    uint8_t *data = av_malloc(FFMAX(sum, 1));
+    uint8_t *data = mp_image_buffer_alloc(FFMAX(sum, 1));
     if (!data)
         return false;
 
@@ -213,7 +214,7 @@ struct mp_image *mp_image_alloc(int imgfmt, int w, int h)
         talloc_free(mpi);
         return NULL;
     }
-    mpi->refcount->free = av_free;
+    mpi->refcount->free = mp_image_buffer_free;
     mpi->refcount->arg = mpi->planes[0];
     return mpi;
 }
@@ -20,9 +20,12 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <string.h>
 #include <pthread.h>
 #include <assert.h>
 
+#include <libavutil/mem.h>
+
 #include "talloc.h"
 
 #include "common/common.h"
@@ -217,3 +220,182 @@ void mp_image_pool_set_lru(struct mp_image_pool *pool)
 {
     pool->use_lru = true;
 }
+
+// The buffer cache keeps the plane data of freed images, and hands it out
+// again to any later allocation of the same size class, no matter which
+// filter, decoder, or player instance it comes from. This is below the
+// mp_image_pool level: pools recycle whole images of exactly the same format
+// and size, while the buffer cache also helps with resolution changes, and
+// with frames that are passed between different filters.
+
+#define BUFFER_HEADER 64                    // keeps the av_malloc() alignment
+#define MIN_CACHED_SIZE (64 * 1024)         // don't bother with small images
+#define DEFAULT_LIMIT (64 * 1024 * 1024)
+
+struct buffer_header {
+    size_t size;                // size class of the data (0 if not cached)
+};
+
+struct mp_image_buffer_user {
+    int64_t limit;
+};
+
+static pthread_mutex_t buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct buffer_header **cached_buffers;   // least recently freed first
+static struct mp_image_buffer_stats buffer_stats = { .limit = DEFAULT_LIMIT };
+// The limit is the largest one of all users, or DEFAULT_LIMIT if there are
+// none.
+static struct mp_image_buffer_user **buffer_users;
+static int num_buffer_users;
+
+// Round up so that there are 8 size classes per power of 2. This wastes at
+// most 1/8 of the buffer.
+static size_t size_class(size_t size)
+{
+    size_t step = 1;
+    while (size > step * 16)
+        step <<= 1;
+    return MP_ALIGN_UP(size, step);
+}
+
+// Free the least recently used buffers until the cache is within limit.
+static void trim_locked(int64_t limit)
+{
+    int drop = 0;
+    while (drop < buffer_stats.cached_count && buffer_stats.cached_bytes > limit) {
+        struct buffer_header *h = cached_buffers[drop++];
+        buffer_stats.cached_bytes -= h->size;
+        buffer_stats.evictions++;
+        av_free(h);
+    }
+    buffer_stats.cached_count -= drop;
+    memmove(cached_buffers, cached_buffers + drop,
+            buffer_stats.cached_count * sizeof(cached_buffers[0]));
+}
+
+// Allocate image data. The returned pointer has the same alignment as with
+// av_malloc(), and must be freed with mp_image_buffer_free().
+void *mp_image_buffer_alloc(size_t size)
+{
+    size_t csize = size >= MIN_CACHED_SIZE ? size_class(size) : 0;
+    struct buffer_header *h = NULL;
+    if (csize) {
+        pthread_mutex_lock(&buffer_mutex);
+        // Prefer the most recently freed buffer; it's more likely to be in
+        // the CPU caches.
+        for (int n = buffer_stats.cached_count - 1; n >= 0; n--) {
+            if (cached_buffers[n]->size == csize) {
+                h = cached_buffers[n];
+                MP_TARRAY_REMOVE_AT(cached_buffers, buffer_stats.cached_count, n);
+                buffer_stats.cached_bytes -= csize;
+                break;
+            }
+        }
+        if (h) {
+            buffer_stats.hits++;
+        } else {
+            buffer_stats.misses++;
+        }
+        pthread_mutex_unlock(&buffer_mutex);
+    }
+    if (!h) {
+        h = av_malloc(BUFFER_HEADER + MPMAX(csize, size));
+        if (!h)
+            return NULL;
+        h->size = csize;
+    }
+    return (char *)h + BUFFER_HEADER;
+}
+
+// Can be called from any thread.
+void mp_image_buffer_free(void *ptr)
+{
+    if (!ptr)
+        return;
+    struct buffer_header *h = (void *)((char *)ptr - BUFFER_HEADER);
+    if (h->size) {
+        pthread_mutex_lock(&buffer_mutex);
+        if (h->size <= buffer_stats.limit) {
+            MP_TARRAY_APPEND(NULL, cached_buffers, buffer_stats.cached_count, h);
+            buffer_stats.cached_bytes += h->size;
+            trim_locked(buffer_stats.limit);
+            h = NULL;
+        }
+        pthread_mutex_unlock(&buffer_mutex);
+    }
+    av_free(h);
+}
+
+// Recompute the limit after a user was added, removed, or changed.
+static void update_limit_locked(void)
+{
+    int64_t limit = num_buffer_users ? 0 : DEFAULT_LIMIT;
+    for (int n = 0; n < num_buffer_users; n++)
+        limit = MPMAX(limit, buffer_users[n]->limit);
+    buffer_stats.limit = limit;
+    trim_locked(limit);
+}
+
+static void destroy_user(void *p)
+{
+    struct mp_image_buffer_user *user = p;
+    pthread_mutex_lock(&buffer_mutex);
+    for (int n = 0; n < num_buffer_users; n++) {
+        if (buffer_users[n] == user) {
+            MP_TARRAY_REMOVE_AT(buffer_users, num_buffer_users, n);
+            break;
+        }
+    }
+    update_limit_locked();
+    if (!num_buffer_users) {
+        // The last user (usually a player) is gone; a host destroying it
+        // usually wants the memory back.
+        trim_locked(0);
+        talloc_free(buffer_users);
+        buffer_users = NULL;
+    }
+    pthread_mutex_unlock(&buffer_mutex);
+}
+
+// Register a user of the buffer cache (e.g. a player), which wants unused
+// buffers of up to limit bytes to be kept. The cache is shared by the whole
+// process, so the largest limit of all users applies. Freeing the returned
+// object removes the user; with the last one, all unused buffers are freed.
+struct mp_image_buffer_user *mp_image_buffer_add_user(void *ta_parent,
+                                                      int64_t limit)
+{
+    struct mp_image_buffer_user *user =
+        talloc_zero(ta_parent, struct mp_image_buffer_user);
+    user->limit = limit;
+    talloc_set_destructor(user, destroy_user);
+    pthread_mutex_lock(&buffer_mutex);
+    MP_TARRAY_APPEND(NULL, buffer_users, num_buffer_users, user);
+    update_limit_locked();
+    pthread_mutex_unlock(&buffer_mutex);
+    return user;
+}
+
+// Change the limit of a user. If the process-wide limit drops, unused buffers
+// are freed immediately.
+void mp_image_buffer_set_limit(struct mp_image_buffer_user *user, int64_t bytes)
+{
+    pthread_mutex_lock(&buffer_mutex);
+    user->limit = bytes;
+    update_limit_locked();
+    pthread_mutex_unlock(&buffer_mutex);
+}
+
+// Free all unused buffers.
+void mp_image_buffer_trim(void)
+{
+    pthread_mutex_lock(&buffer_mutex);
+    trim_locked(0);
+    pthread_mutex_unlock(&buffer_mutex);
+}
+
+void mp_image_buffer_get_stats(struct mp_image_buffer_stats *st)
+{
+    pthread_mutex_lock(&buffer_mutex);
+    *st = buffer_stats;
+    pthread_mutex_unlock(&buffer_mutex);
+}
@@ -2,6 +2,8 @@
 #define MPV_MP_IMAGE_POOL_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 struct mp_image_pool;
 
@@ -24,4 +26,24 @@ struct mp_image *mp_image_pool_new_copy(struct mp_image_pool *pool,
 bool mp_image_pool_make_writeable(struct mp_image_pool *pool,
                                   struct mp_image *img);
 
+// Process-wide cache of image data buffers, used by mp_image_alloc().
+struct mp_image_buffer_stats {
+    int64_t hits;               // allocations served from the cache
+    int64_t misses;             // allocations that needed new memory
+    int64_t evictions;          // cached buffers freed due to the limit
+    int64_t cached_bytes;       // memory held by unused buffers
+    int cached_count;           // number of unused buffers
+    int64_t limit;              // maximum for cached_bytes
+};
+
+struct mp_image_buffer_user;
+
+void *mp_image_buffer_alloc(size_t size);
+void mp_image_buffer_free(void *ptr);
+struct mp_image_buffer_user *mp_image_buffer_add_user(void *ta_parent,
+                                                      int64_t limit);
+void mp_image_buffer_set_limit(struct mp_image_buffer_user *user, int64_t bytes);
+void mp_image_buffer_trim(void);
+void mp_image_buffer_get_stats(struct mp_image_buffer_stats *st);
+
 #endif
@@ -574,7 +574,8 @@ static bool render_frame(struct vo *vo)
     } else {
         in->hasframe_rendered = true;
         pthread_mutex_unlock(&in->lock);
-        mp_input_wakeup(vo->input_ctx); // core can queue new video now
+        // core can queue new video now
+        mp_input_wakeup_src(vo->input_ctx, MP_WAKEUP_VO);
 
         MP_STATS(vo, "start video");
 
@@ -621,7 +622,7 @@ static bool render_frame(struct vo *vo)
     in->rendering = false;
 
     pthread_cond_signal(&in->wakeup); // for vo_wait_frame()
-    mp_input_wakeup(vo->input_ctx);
+    mp_input_wakeup_src(vo->input_ctx, MP_WAKEUP_VO);
 
     pthread_mutex_unlock(&in->lock);
 
@@ -687,12 +688,12 @@ static void *vo_thread(void *ptr)
                 wait_until = MPMIN(wait_until, in->wakeup_pts);
             } else {
                 in->wakeup_pts = 0;
-                mp_input_wakeup(vo->input_ctx);
+                mp_input_wakeup_src(vo->input_ctx, MP_WAKEUP_VO);
             }
         }
         if (vo->want_redraw && !in->want_redraw) {
             in->want_redraw = true;
-            mp_input_wakeup(vo->input_ctx);
+            mp_input_wakeup_src(vo->input_ctx, MP_WAKEUP_VO);
         }
         bool redraw = in->request_redraw;
         bool send_reset = in->send_reset;
@@ -858,7 +859,7 @@ void vo_event(struct vo *vo, int event)
     struct vo_internal *in = vo->in;
     pthread_mutex_lock(&in->lock);
     if ((in->queued_events & event & VO_EVENTS_USER) != (event & VO_EVENTS_USER))
-        mp_input_wakeup(vo->input_ctx);
+        mp_input_wakeup_src(vo->input_ctx, MP_WAKEUP_VO);
     in->queued_events |= event;
     pthread_mutex_unlock(&in->lock);
 }
@@ -24,6 +24,7 @@
 #include "mp_image.h"
 #include "img_format.h"
 #include "mp_image_pool.h"
+#include "gpu_memcpy.h"
 
 bool check_va_status(struct mp_log *log, VAStatus status, const char *msg)
 {
@@ -415,7 +416,7 @@ static struct mp_image *try_download(struct mp_image *src,
     if (va_image_map(p->ctx, image, &tmp)) {
         dst = mp_image_pool_get(pool, tmp.imgfmt, tmp.w, tmp.h);
         if (dst)
-            mp_image_copy(dst, &tmp);
+            mp_image_copy_gpu(dst, &tmp);
         va_image_unmap(p->ctx, image);
     }
     mp_image_copy_attributes(dst, src);
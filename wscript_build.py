@@ -88,10 +88,12 @@ def build(ctx):
         ## Audio
         ( "audio/audio.c" ),
         ( "audio/audio_buffer.c" ),
+        ( "audio/audio_ring.c" ),
         ( "audio/chmap.c" ),
         ( "audio/chmap_sel.c" ),
         ( "audio/fmt-conversion.c" ),
         ( "audio/format.c" ),
+        ( "audio/loudness.c" ),
         ( "audio/mixer.c" ),
         ( "audio/decode/ad_lavc.c" ),
         ( "audio/decode/ad_mpg123.c",            "mpg123" ),
@@ -120,14 +122,18 @@ def build(ctx):
         ( "audio/filter/af_pan.c" ),
         ( "audio/filter/af_scaletempo.c" ),
         ( "audio/filter/af_sinesuppress.c" ),
+        ( "audio/filter/af_stretch.c" ),
         ( "audio/filter/af_sub.c" ),
         ( "audio/filter/af_surround.c" ),
         ( "audio/filter/af_sweep.c" ),
         ( "audio/filter/af_volume.c" ),
+        ( "audio/filter/dsp_kernels.c" ),
         ( "audio/filter/filter.c" ),
+        ( "audio/filter/stretch.c" ),
         ( "audio/filter/tools.c" ),
         ( "audio/filter/window.c" ),
         ( "audio/out/ao.c" ),
+        ( "audio/out/ao_timing.c" ),
         ( "audio/out/ao_alsa.c",                 "alsa" ),
         ( "audio/out/ao_coreaudio.c",            "coreaudio" ),
         ( "audio/out/ao_coreaudio_exclusive.c",  "coreaudio" ),
@@ -219,8 +225,10 @@ def build(ctx):
         ( "player/lua.c",                        "lua" ),
         ( "player/osd.c" ),
         ( "player/playloop.c" ),
+        ( "player/replaygain.c" ),
         ( "player/screenshot.c" ),
         ( "player/scripting.c" ),
+        ( "player/status_page.c" ),
         ( "player/sub.c" ),
         ( "player/timeline/tl_cue.c" ),
         ( "player/timeline/tl_mpv_edl.c" ),
@@ -280,8 +288,10 @@ def build(ctx):
         ## Video
         ( "video/csputils.c" ),
         ( "video/fmt-conversion.c" ),
+        ( "video/gpu_memcpy.c" ),
         ( "video/image_writer.c" ),
         ( "video/img_format.c" ),
+        ( "video/memcpy_pic.c" ),
         ( "video/mp_image.c" ),
         ( "video/mp_image_pool.c" ),
         ( "video/sws_utils.c" ),
@@ -294,7 +304,9 @@ def build(ctx):
         ( "video/decode/vd_lavc.c" ),
         ( "video/decode/vda.c",                  "vda-hwaccel" ),
         ( "video/decode/vdpau.c",                "vdpau-hwaccel" ),
+        ( "video/filter/block_metrics.c" ),
         ( "video/filter/pullup.c" ),
+        ( "video/filter/slice_threads.c" ),
         ( "video/filter/vf.c" ),
         ( "video/filter/vf_buffer.c" ),
         ( "video/filter/vf_crop.c" ),
@@ -460,6 +472,15 @@ def build(ctx):
                 includes = _all_includes(ctx),
                 features = "c cprogram",
             )
+        # Standalone benchmarks; they print timings and aren't run by tests.
+        for bench in ctx.path.ant_glob("TOOLS/bench/*.c"):
+            ctx(
+                target   = os.path.splitext(bench.srcpath())[0],
+                source   = bench.srcpath(),
+                use      = ctx.dependencies_use() + ['objects'],
+                includes = _all_includes(ctx),
+                features = "c cprogram",
+            )
 
     build_shared = ctx.dependency_satisfied('libmpv-shared')
     build_static = ctx.dependency_satisfied('libmpv-static')
@@ -512,7 +533,7 @@ def build(ctx):
             PRIV_LIBS    = get_deps(),
         )
 
-        headers = ["client.h", "qthelper.hpp", "opengl_cb.h"]
+        headers = ["client.h", "qthelper.hpp", "opengl_cb.h", "status_page.h"]
         for f in headers:
             ctx.install_as(ctx.env.INCDIR + '/mpv/' + f, 'libmpv/' + f)
 